@@ -24,7 +24,7 @@ LOCAL_SRC_FILES := \
 ifeq ($(TW_EXCLUDE_ENCRYPTED_BACKUPS), true)
     LOCAL_SRC_FILES += twrpTarold.cpp
 else
-    LOCAL_SRC_FILES += twrpTar.cpp
+    LOCAL_SRC_FILES += twrpTar.cpp tarEncrypt.c
 endif
 
 LOCAL_SRC_FILES += \
@@ -33,8 +33,12 @@ LOCAL_SRC_FILES += \
     partitionmanager.cpp \
     twinstall.cpp \
     twrp-functions.cpp \
+    twrpDirIndex.cpp \
+    twrpImage.cpp \
+    twrpBlockMap.cpp \
     openrecoveryscript.cpp \
-    tarWrite.c
+    tarWrite.c \
+    tarCompress.c
 
 ifeq ($(TARGET_DEVICE),leo)
     LOCAL_CFLAGS += -DTW_DEVICE_IS_HTC_LEO
@@ -74,7 +78,7 @@ LOCAL_CFLAGS += -DRECOVERY_API_VERSION=$(RECOVERY_API_VERSION)
 #    libm \
 #    libc
 
-LOCAL_C_INCLUDES += bionic external/stlport/stlport
+LOCAL_C_INCLUDES += bionic external/stlport/stlport external/zlib
 
 LOCAL_STATIC_LIBRARIES :=
 LOCAL_SHARED_LIBRARIES :=
@@ -281,6 +285,18 @@ ifneq ($(TW_EXCLUDE_ENCRYPTED_BACKUPS), true)
 else
     LOCAL_CFLAGS += -DTW_EXCLUDE_ENCRYPTED_BACKUPS
 endif
+ifneq ($(TW_TAR_BUFFER_SIZE),)
+    LOCAL_CFLAGS += -DTW_TAR_BUFFER_SIZE=$(TW_TAR_BUFFER_SIZE)
+endif
+ifneq ($(TW_IMAGE_BUFFER_SIZE),)
+    LOCAL_CFLAGS += -DTW_IMAGE_BUFFER_SIZE=$(TW_IMAGE_BUFFER_SIZE)
+endif
+ifeq ($(TW_NO_WIPE_DISCARD), true)
+    LOCAL_CFLAGS += -DTW_NO_WIPE_DISCARD
+endif
+ifeq ($(TW_WIPE_SECURE_DISCARD), true)
+    LOCAL_CFLAGS += -DTW_WIPE_SECURE_DISCARD
+endif
 ifneq ($(LANDSCAPE_RESOLUTION),)
     LOCAL_CFLAGS += -DTW_HAS_LANDSCAPE
 endif
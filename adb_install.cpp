@@ -29,6 +29,7 @@
 #include "ui.h"
 #include "cutils/properties.h"
 #include "adb_install.h"
+#include "sideload_digests.h"
 extern "C" {
 #include "minadbd/adb.h"
 }
@@ -87,6 +88,9 @@ apply_from_adb(const char* install_file) {
     ui->Print("\n\nNow send the package you want to apply\n"
               "to the device with \"adb sideload <filename>\"...\n");
 */
+    // Left over from a sideload that was never installed
+    unlink(SIDELOAD_DIGESTS_FILE);
+
     pid_t child;
     if ((child = fork()) == 0) {
         execl("/sbin/recovery", "recovery", "--adbd", install_file, NULL);
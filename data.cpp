@@ -35,6 +35,7 @@
 #include <string>
 #include <utility>
 #include <map>
+#include <deque>
 #include <fstream>
 #include <sstream>
 
@@ -62,8 +63,8 @@ extern "C"
 
 using namespace std;
 
-map<string, DataManager::TStrIntPair>   DataManager::mValues;
-map<string, string>			DataManager::mConstValues;
+deque<DataManager::Variable>		DataManager::mSlots;
+map<string, int>			DataManager::mSlotIndex;
 string					DataManager::mBackingFile;
 int					DataManager::mInitialized = 0;
 int                                     DataManager::SettingsFileRead = 0;
@@ -73,6 +74,15 @@ int                                     DataManager::pause = -1;
 #ifndef TW_NO_SCREEN_TIMEOUT
 extern blanktimer blankTimer;
 #endif
+
+// Variables that do more than notify the GUI when they are set
+enum {
+	SPECIAL_NONE = 0,
+	SPECIAL_TIME_ZONE_DST,
+	SPECIAL_SCREEN_TIMEOUT,
+	SPECIAL_USE_EXTERNAL_STORAGE,
+};
+
 // Device ID functions
 void DataManager::sanitize_device_id(char* device_id) {
 	const char* whitelist ="abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ1234567890-._";
@@ -123,7 +133,7 @@ void DataManager::get_device_id(void) {
 			strcat(device_id, hardware_id);
 		}
 		sanitize_device_id((char *)device_id);
-		mConstValues.insert(make_pair("tw_device_id", device_id));
+		InsertConst("tw_device_id", device_id);
 		LOGINFO("=> using device id: '%s'\n", device_id);
 		return;
 	}
@@ -147,7 +157,7 @@ void DataManager::get_device_id(void) {
 				// We found the serial number!
 				strcpy(device_id, token + CMDLINE_SERIALNO_LEN);
 				sanitize_device_id((char *)device_id);
-				mConstValues.insert(make_pair("tw_device_id", device_id));
+				InsertConst("tw_device_id", device_id);
 				return;
 			}
 			token = strtok(NULL, " ");
@@ -198,18 +208,18 @@ void DataManager::get_device_id(void) {
 		LOGINFO("=> Using Hardware ID for Device ID: '%s'\n", hardware_id);
 		strcpy(device_id, hardware_id);
 		sanitize_device_id((char *)device_id);
-		mConstValues.insert(make_pair("tw_device_id", device_id));
+		InsertConst("tw_device_id", device_id);
 		return;
 	}
 	if (strcmp(device_id, "0000000000000000") == 0) {
 		strcpy(device_id, "UDev");
 		LOGERR("=> Device ID is all zeros, using '%s'.", device_id);
-		mConstValues.insert(make_pair("tw_device_id", device_id));
+		InsertConst("tw_device_id", device_id);
 		return;
 	}
 	LOGINFO("=> Using Serial for Device ID: '%s'\n", device_id);
 	sanitize_device_id((char *)device_id);
-	mConstValues.insert(make_pair("tw_device_id", device_id));
+	InsertConst("tw_device_id", device_id);
 	return;
 }
 
@@ -300,8 +310,17 @@ int DataManager::ResetDefaults() {
 	rm = "rm -f /cache/recovery/.version &> /dev/null";
 	system(rm.c_str());
 
-	mValues.clear();
-	mConstValues.clear();
+	// Slots stay allocated so handles remain valid
+	deque<Variable>::iterator iter;
+	for (iter = mSlots.begin(); iter != mSlots.end(); ++iter) {
+		iter->str.clear();
+		iter->intValue = 0;
+		iter->ullValue = 0;
+		iter->floatValue = 0;
+		iter->persist = 0;
+		iter->isSet = false;
+		iter->isConst = false;
+	}
 	SetDefaultValues();
 	return 0;
 }
@@ -349,13 +368,13 @@ int DataManager::LoadValues(const string filename) {
 		d = fread(array, 1, length, in);
 		if (d != length)			goto error;
 		Value = array;
-		map<string, TStrIntPair>::iterator pos;
-		pos = mValues.find(Name);
-		if (pos != mValues.end()) {
-			pos->second.first = Value;
-			pos->second.second = 1;
-		} else
-			mValues.insert(TNameValuePair(Name, TStrIntPair(Value, 1)));
+		Variable& var = mSlots[InternSlot(Name)];
+		if (!var.isConst) {
+			var.str = Value;
+			ParseNumbers(var);
+			var.persist = 1;
+			var.isSet = true;
+		}
 		position += (a + b + c + d);
 	}
 	ret = 0;
@@ -388,28 +407,98 @@ int DataManager::SaveValues()
 	int file_version = FILE_VERSION;
 	fwrite(&file_version, 1, sizeof(int), out);
 
-	map<string, TStrIntPair>::iterator iter;
-	for (iter = mValues.begin(); iter != mValues.end(); ++iter) {
+	deque<Variable>::iterator iter;
+	for (iter = mSlots.begin(); iter != mSlots.end(); ++iter) {
 		// Save only the persisted data
-		if (iter->second.second != 0) {
-			unsigned short length = (unsigned short) iter->first.length() + 1;
+		if (iter->isSet && !iter->isConst && iter->persist != 0) {
+			unsigned short length = (unsigned short) iter->name.length() + 1;
 			fwrite(&length, 1, sizeof(unsigned short), out);
-			fwrite(iter->first.c_str(), 1, length, out);
-			length = (unsigned short) iter->second.first.length() + 1;
+			fwrite(iter->name.c_str(), 1, length, out);
+			length = (unsigned short) iter->str.length() + 1;
 			fwrite(&length, 1, sizeof(unsigned short), out);
-			fwrite(iter->second.first.c_str(), 1, length, out);
+			fwrite(iter->str.c_str(), 1, length, out);
 		}
 	}
 	fclose(out);
 	return 0;
 }
 
-int DataManager::GetValue(const string varName, string& value)
+// Returns the slot for varName, or -1 if the name has never been used
+int DataManager::FindSlot(const string& varName)
 {
-	string localStr = varName;
+	map<string, int>::iterator pos = mSlotIndex.find(varName);
+	return (pos == mSlotIndex.end() ? -1 : pos->second);
+}
 
-	if (!mInitialized)
-		SetDefaultValues();
+int DataManager::InternSlot(const string& varName)
+{
+	int slot = FindSlot(varName);
+	if (slot >= 0)
+		return slot;
+
+	Variable var;
+	var.name = varName;
+	var.intValue = 0;
+	var.ullValue = 0;
+	var.floatValue = 0;
+	var.persist = 0;
+	var.isSet = false;
+	var.isConst = false;
+	if (varName == "tw_time_zone_guidst")
+		var.special = SPECIAL_TIME_ZONE_DST;
+	else if (varName == "tw_screen_timeout_secs")
+		var.special = SPECIAL_SCREEN_TIMEOUT;
+	else if (varName == "tw_use_external_storage")
+		var.special = SPECIAL_USE_EXTERNAL_STORAGE;
+	else
+		var.special = SPECIAL_NONE;
+
+	slot = mSlots.size();
+	mSlots.push_back(var);
+	mSlotIndex.insert(make_pair(varName, slot));
+	return slot;
+}
+
+// Works out the numeric forms of a value that was set as a string
+void DataManager::ParseNumbers(Variable& var)
+{
+	const char* str = var.str.c_str();
+
+	var.intValue = atoi(str);
+	var.ullValue = strtoull(str, NULL, 10);
+	var.floatValue = atof(str);
+}
+
+// Default values never replace one that is already set
+void DataManager::InsertValue(const string varName, const string value, int persist)
+{
+	Variable& var = mSlots[InternSlot(varName)];
+	if (var.isSet)
+		return;
+
+	var.str = value;
+	ParseNumbers(var);
+	var.persist = persist;
+	var.isSet = true;
+}
+
+// Constants hide any value of the same name
+void DataManager::InsertConst(const string varName, const string value)
+{
+	Variable& var = mSlots[InternSlot(varName)];
+	if (var.isConst)
+		return;
+
+	var.str = value;
+	ParseNumbers(var);
+	var.persist = 0;
+	var.isSet = true;
+	var.isConst = true;
+}
+
+int DataManager::GetHandle(const string varName)
+{
+	string localStr = varName;
 
 	// Strip off leading and trailing '%' if provided
 	if (localStr.length() > 2 && localStr[0] == '%' && localStr[localStr.length()-1] == '%')
@@ -418,53 +507,68 @@ int DataManager::GetValue(const string varName, string& value)
 		localStr.erase(localStr.length() - 1, 1);
 	}
 
-	map<string, string>::iterator constPos;
-	constPos = mConstValues.find(localStr);
-	if (constPos != mConstValues.end())
-	{
-		value = constPos->second;
-		return 0;
-	}
+	return InternSlot(localStr);
+}
 
-	map<string, TStrIntPair>::iterator pos;
-	pos = mValues.find(localStr);
-	if (pos == mValues.end())
+int DataManager::GetValue(int handle, string& value)
+{
+	if (!mInitialized)
+		SetDefaultValues();
+
+	if (handle < 0 || handle >= (int) mSlots.size() || !mSlots[handle].isSet)
 		return -1;
 
-	value = pos->second.first;
+	value = mSlots[handle].str;
 	return 0;
 }
 
+// Finds the slot of an existing variable without interning the name
+int DataManager::LookupSlot(const string& varName)
+{
+	if (!mInitialized)
+		SetDefaultValues();
+
+	// Strip off leading and trailing '%' if provided
+	if (varName.length() > 2 && varName[0] == '%' && varName[varName.length()-1] == '%')
+		return FindSlot(varName.substr(1, varName.length() - 2));
+	return FindSlot(varName);
+}
+
+int DataManager::GetValue(const string varName, string& value)
+{
+	return GetValue(LookupSlot(varName), value);
+}
+
 int DataManager::GetValue(const string varName, int& value)
 {
-	string data;
+	int slot = LookupSlot(varName);
 
-	if (GetValue(varName,data) != 0)
+	if (slot < 0 || !mSlots[slot].isSet)
 		return -1;
 
-	value = atoi(data.c_str());
+	value = mSlots[slot].intValue;
 	return 0;
 }
 
 int DataManager::GetValue(const string varName, float& value)
 {
-	string data;
+	int slot = LookupSlot(varName);
 
-	if (GetValue(varName,data) != 0)
-        	return -1;
+	if (slot < 0 || !mSlots[slot].isSet)
+		return -1;
 
-	value = atof(data.c_str());
+	value = mSlots[slot].floatValue;
 	return 0;
 }
 
 unsigned long long DataManager::GetValue(const string varName, unsigned long long& value)
 {
-	string data;
+	int slot = LookupSlot(varName);
 
-	if (GetValue(varName,data) != 0)
-        	return -1;
+	if (slot < 0 || !mSlots[slot].isSet)
+		return -1;
 
-	value = strtoull(data.c_str(), NULL, 10);
+	value = mSlots[slot].ullValue;
 	return 0;
 }
 
@@ -474,17 +578,13 @@ string& DataManager::GetValueRef(const string varName)
 	if (!mInitialized)
 		SetDefaultValues();
 
-	map<string, string>::iterator constPos;
-	constPos = mConstValues.find(varName);
-	if (constPos != mConstValues.end())
-		return constPos->second;
-
-	map<string, TStrIntPair>::iterator pos;
-	pos = mValues.find(varName);
-	if (pos == mValues.end())
-		pos = (mValues.insert(TNameValuePair(varName, TStrIntPair("", 0)))).first;
-
-	return pos->second.first;
+	Variable& var = mSlots[InternSlot(varName)];
+	if (!var.isSet) {
+		var.str.clear();
+		var.persist = 0;
+		var.isSet = true;
+	}
+	return var.str;
 }
 
 // This function will return an empty string if the value doesn't exist
@@ -496,55 +596,109 @@ string DataManager::GetStrValue(const string varName)
 	return retVal;
 }
 
+string DataManager::GetStrValue(int handle)
+{
+	string retVal;
+
+	GetValue(handle, retVal);
+	return retVal;
+}
+
 // This function will return 0 if the value doesn't exist
 int DataManager::GetIntValue(const string varName)
 {
-	string retVal;
+	int retVal = 0;
 
 	GetValue(varName, retVal);
-	return atoi(retVal.c_str());
+	return retVal;
 }
 
-int DataManager::SetValue(const string varName, string value, int persist /* = 0 */)
+int DataManager::GetIntValue(int handle)
 {
 	if (!mInitialized)
 		SetDefaultValues();
 
-	// Don't allow empty values or numerical starting values
-	if (varName.empty() || (varName[0] >= '0' && varName[0] <= '9'))
+	if (handle < 0 || handle >= (int) mSlots.size())
+		return 0;
+	return mSlots[handle].intValue;
+}
+
+unsigned long long DataManager::GetULLValue(int handle)
+{
+	if (!mInitialized)
+		SetDefaultValues();
+
+	if (handle < 0 || handle >= (int) mSlots.size())
+		return 0;
+	return mSlots[handle].ullValue;
+}
+
+float DataManager::GetFloatValue(int handle)
+{
+	if (!mInitialized)
+		SetDefaultValues();
+
+	if (handle < 0 || handle >= (int) mSlots.size())
+		return 0;
+	return mSlots[handle].floatValue;
+}
+
+int DataManager::StoreValue(int handle, const string& value, int intValue, unsigned long long ullValue, float floatValue, int persist)
+{
+	if (!mInitialized)
+		SetDefaultValues();
+
+	if (handle < 0 || handle >= (int) mSlots.size())
 		return -1;
 
-	map<string, string>::iterator constChk;
-	constChk = mConstValues.find(varName);
-	if (constChk != mConstValues.end())
+	Variable& var = mSlots[handle];
+
+	// Don't allow empty values or numerical starting values
+	if (var.name.empty() || (var.name[0] >= '0' && var.name[0] <= '9'))
+		return -1;
+	if (var.isConst)
 		return -1;
 
-	map<string, TStrIntPair>::iterator pos;
-	pos = mValues.find(varName);
-	if (pos == mValues.end())
-		pos = (mValues.insert(TNameValuePair(varName, TStrIntPair(value, persist)))).first;
-	else
-		pos->second.first = value;
+	bool changed = !var.isSet || var.str != value;
 
-	if (pos->second.second != 0)
+	if (!var.isSet) {
+		var.persist = persist;
+		var.isSet = true;
+	}
+	var.str = value;
+	var.intValue = intValue;
+	var.ullValue = ullValue;
+	var.floatValue = floatValue;
+	// Setting the same value again has nothing to save or tell the GUI about
+	if (!changed)
+		return 0;
+
+	if (var.persist != 0)
 		SaveValues();
-	if (varName == "tw_time_zone_guidst")
+	if (var.special == SPECIAL_TIME_ZONE_DST)
 		SetGUI_TimeZone();
-	if (varName == "tw_screen_timeout_secs") {
+	if (var.special == SPECIAL_SCREEN_TIMEOUT) {
 		if (pause == 0)
 #ifndef TW_NO_SCREEN_TIMEOUT
-			blankTimer.setTime(atoi(value.c_str()));
+			blankTimer.setTime(intValue);
 #endif
 	} else
-		gui_notifyVarChange(varName.c_str(), value.c_str());
+		gui_notifyVarChange(var.name.c_str(), value.c_str());
 	return 0;
 }
 
-int DataManager::SetValue(const string varName, int value, int persist /* = 0 */)
+int DataManager::SetValue(int handle, string value, int persist /* = 0 */)
+{
+	const char* str = value.c_str();
+
+	return StoreValue(handle, value, atoi(str), strtoull(str, NULL, 10), atof(str), persist);
+}
+
+int DataManager::SetValue(int handle, int value, int persist /* = 0 */)
 {
-	ostringstream valStr;
-	valStr << value;
-	if (varName == "tw_use_external_storage") {
+	char valStr[16];
+
+	if (handle >= 0 && handle < (int) mSlots.size() && mSlots[handle].special == SPECIAL_USE_EXTERNAL_STORAGE) {
 		string str;
 
 		if (GetIntValue(TW_HAS_DUAL_STORAGE) == 1) {
@@ -560,47 +714,95 @@ int DataManager::SetValue(const string varName, int value, int persist /* = 0 */
 
 		SetBackupFolder(str);
 	}
-	return SetValue(varName, valStr.str(), persist);;
+	snprintf(valStr, sizeof(valStr), "%d", value);
+	return StoreValue(handle, valStr, value, (unsigned long long) (long long) value, (float) value, persist);
+}
+
+int DataManager::SetValue(int handle, float value, int persist /* = 0 */)
+{
+	char valStr[32];
+
+	// Same format as the ostream the values used to be written with
+	snprintf(valStr, sizeof(valStr), "%g", value);
+	return StoreValue(handle, valStr, atoi(valStr), strtoull(valStr, NULL, 10), value, persist);
+}
+
+int DataManager::SetValue(int handle, unsigned long long value, int persist /* = 0 */)
+{
+	char valStr[24];
+
+	snprintf(valStr, sizeof(valStr), "%llu", value);
+	return StoreValue(handle, valStr, atoi(valStr), value, (float) value, persist);
+}
+
+int DataManager::SetValue(const string varName, string value, int persist /* = 0 */)
+{
+	if (!mInitialized)
+		SetDefaultValues();
+
+	// Don't allow empty values or numerical starting values
+	if (varName.empty() || (varName[0] >= '0' && varName[0] <= '9'))
+		return -1;
+
+	return SetValue(InternSlot(varName), value, persist);
+}
+
+int DataManager::SetValue(const string varName, int value, int persist /* = 0 */)
+{
+	if (varName.empty() || (varName[0] >= '0' && varName[0] <= '9'))
+		return -1;
+
+	return SetValue(InternSlot(varName), value, persist);
 }
 
 int DataManager::SetValue(const string varName, float value, int persist /* = 0 */)
 {
-	ostringstream valStr;
-	valStr << value;
-	return SetValue(varName, valStr.str(), persist);;
+	if (varName.empty() || (varName[0] >= '0' && varName[0] <= '9'))
+		return -1;
+
+	return SetValue(InternSlot(varName), value, persist);
 }
 
 int DataManager::SetValue(const string varName, unsigned long long value, int persist /* = 0 */)
 {
-	ostringstream valStr;
-	valStr << value;
-	return SetValue(varName, valStr.str(), persist);;
+	if (varName.empty() || (varName[0] >= '0' && varName[0] <= '9'))
+		return -1;
+
+	return SetValue(InternSlot(varName), value, persist);
 }
 
 int DataManager::SetProgress(float Fraction) {
-	return SetValue("ui_progress", (float) (Fraction * 100.0));
+	static int progress = GetHandle("ui_progress");
+
+	return SetValue(progress, (float) (Fraction * 100.0));
 }
 
 int DataManager::ShowProgress(float Portion, float Seconds) {
+	static int progress_portion = GetHandle("ui_progress_portion");
+	static int progress_frames = GetHandle("ui_progress_frames");
+
 	//float Starting_Portion;
 	//GetValue("ui_progress_portion", Starting_Portion);
-	if (SetValue("ui_progress_portion", (float)(Portion * 100.0)/* + Starting_Portion*/) != 0)
+	if (SetValue(progress_portion, (float)(Portion * 100.0)/* + Starting_Portion*/) != 0)
 		return -1;
-	if (SetValue("ui_progress_frames", Seconds * 30) != 0)
+	if (SetValue(progress_frames, Seconds * 30) != 0)
 		return -1;
 	return 0;
 }
 
 void DataManager::DumpValues()
 {
-	map<string, TStrIntPair>::iterator iter;
+	map<string, int>::iterator iter;
 	printf("\nData Manager dump (values with leading X are persisted):\n");
-	for (iter = mValues.begin(); iter != mValues.end(); ++iter) {
-		printf("%c %s=%s\n", iter->second.second ? 'X' : ' ', iter->first.c_str(), iter->second.first.c_str());
+	for (iter = mSlotIndex.begin(); iter != mSlotIndex.end(); ++iter) {
+		Variable& var = mSlots[iter->second];
+		if (var.isSet && !var.isConst)
+			printf("%c %s=%s\n", var.persist ? 'X' : ' ', var.name.c_str(), var.str.c_str());
 	}
-	map<string, string>::iterator it;
-    	for (it = mConstValues.begin(); it != mConstValues.end(); ++it) {
-        	printf("X %s=%s\n", it->first.c_str(), it->second.c_str());
+    	for (iter = mSlotIndex.begin(); iter != mSlotIndex.end(); ++iter) {
+		Variable& var = mSlots[iter->second];
+		if (var.isConst)
+        		printf("X %s=%s\n", var.name.c_str(), var.str.c_str());
     	}
 	printf("\n");
 }
@@ -703,203 +905,203 @@ void DataManager::SetDefaultValues()
 	
 	mInitialized = 1;
 
-	mConstValues.insert(make_pair("true", "1"));
-	mConstValues.insert(make_pair("false", "0"));
+	InsertConst("true", "1");
+	InsertConst("false", "0");
 
-	mConstValues.insert(make_pair(TW_VERSION_VAR, TW_VERSION_STR));
+	InsertConst(TW_VERSION_VAR, TW_VERSION_STR);
 // Extended-start
 #ifdef TW_DEVICE_IS_HTC_LEO
-	mValues.insert(make_pair(TW_HTC_LEO, make_pair("1", 1)));
+	InsertValue(TW_HTC_LEO, "1", 1);
 	// Bootloader check
 	if (Detect_BLDR() == 1) // cLK detected
 		PartitionManager.Process_Extra_Boot_Partitions();
-	mValues.insert(make_pair(TW_BOOT_IS_MTD, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_SD_SKIP_DALVIK, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_SKIP_NATIVESD, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_SD_BACKUP_SYSTEM, make_pair("1", 1)));
-    	mValues.insert(make_pair(TW_SD_BACKUP_DATA, make_pair("1", 1)));
-    	mValues.insert(make_pair(TW_SD_BACKUP_BOOT, make_pair("1", 1)));
-	mValues.insert(make_pair(TW_SD_RESTORE_SYSTEM, make_pair("1", 1)));
-    	mValues.insert(make_pair(TW_SD_RESTORE_DATA, make_pair("1", 1)));
-    	mValues.insert(make_pair(TW_SD_RESTORE_BOOT, make_pair("1", 1)));
-	mValues.insert(make_pair(TW_SD_USE_COMPRESSION_VAR, make_pair("0", 1)));
-    	mValues.insert(make_pair(TW_SD_SKIP_MD5_CHECK_VAR, make_pair("0", 1)));
-    	mValues.insert(make_pair(TW_SD_SKIP_MD5_GENERATE_VAR, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_SDBOOT_PARTITION, make_pair("", 1)));
-    	mValues.insert(make_pair(TW_DATA_PATH, make_pair("/sd-ext", 1)));
-	mValues.insert(make_pair(TW_DATA_ON_EXT, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_DATA_ON_EXT_CHECK, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_RESTORE_IS_DATAONEXT, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_VIBRATE_AFTER_SDBACKUP, make_pair("1", 1)));
-	mValues.insert(make_pair(TW_SDBACKUP_FEEDBACK_DURATION_MS, make_pair("100", 1)));
-	mValues.insert(make_pair(TW_VIBRATE_AFTER_SDRESTORE, make_pair("1", 1)));
-	mValues.insert(make_pair(TW_SDRESTORE_FEEDBACK_DURATION_MS, make_pair("100", 1)));
-	mValues.insert(make_pair(TW_SET_DROP_CACHES_AT_BOOT, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_DROP_CACHES, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_SET_IO_SCHED_AT_BOOT, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_IO_SCHED, make_pair("deadline", 1)));
-	mValues.insert(make_pair(TW_SET_CPU_F_AT_BOOT, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_MAX_CPU_F, make_pair("998400", 1)));
-	mValues.insert(make_pair(TW_MIN_CPU_F, make_pair("245000", 1)));
-	mValues.insert(make_pair(TW_SET_CPU_GOV_AT_BOOT, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_CPU_GOV, make_pair("performance", 1)));
+	InsertValue(TW_BOOT_IS_MTD, "0", 1);
+	InsertValue(TW_SD_SKIP_DALVIK, "0", 1);
+	InsertValue(TW_SKIP_NATIVESD, "0", 1);
+	InsertValue(TW_SD_BACKUP_SYSTEM, "1", 1);
+    	InsertValue(TW_SD_BACKUP_DATA, "1", 1);
+    	InsertValue(TW_SD_BACKUP_BOOT, "1", 1);
+	InsertValue(TW_SD_RESTORE_SYSTEM, "1", 1);
+    	InsertValue(TW_SD_RESTORE_DATA, "1", 1);
+    	InsertValue(TW_SD_RESTORE_BOOT, "1", 1);
+	InsertValue(TW_SD_USE_COMPRESSION_VAR, "0", 1);
+    	InsertValue(TW_SD_SKIP_MD5_CHECK_VAR, "0", 1);
+    	InsertValue(TW_SD_SKIP_MD5_GENERATE_VAR, "0", 1);
+	InsertValue(TW_SDBOOT_PARTITION, "", 1);
+    	InsertValue(TW_DATA_PATH, "/sd-ext", 1);
+	InsertValue(TW_DATA_ON_EXT, "0", 1);
+	InsertValue(TW_DATA_ON_EXT_CHECK, "0", 1);
+	InsertValue(TW_RESTORE_IS_DATAONEXT, "0", 1);
+	InsertValue(TW_VIBRATE_AFTER_SDBACKUP, "1", 1);
+	InsertValue(TW_SDBACKUP_FEEDBACK_DURATION_MS, "100", 1);
+	InsertValue(TW_VIBRATE_AFTER_SDRESTORE, "1", 1);
+	InsertValue(TW_SDRESTORE_FEEDBACK_DURATION_MS, "100", 1);
+	InsertValue(TW_SET_DROP_CACHES_AT_BOOT, "0", 1);
+	InsertValue(TW_DROP_CACHES, "0", 1);
+	InsertValue(TW_SET_IO_SCHED_AT_BOOT, "0", 1);
+	InsertValue(TW_IO_SCHED, "deadline", 1);
+	InsertValue(TW_SET_CPU_F_AT_BOOT, "0", 1);
+	InsertValue(TW_MAX_CPU_F, "998400", 1);
+	InsertValue(TW_MIN_CPU_F, "245000", 1);
+	InsertValue(TW_SET_CPU_GOV_AT_BOOT, "0", 1);
+	InsertValue(TW_CPU_GOV, "performance", 1);
 #else
-	mValues.insert(make_pair(TW_HTC_LEO, make_pair("0", 1)));
+	InsertValue(TW_HTC_LEO, "0", 1);
 	LOGINFO("=> Extended build for different device.\n");
 #endif
-    	mValues.insert(make_pair(TW_RESTORE_BOOT_VAR, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_SKIP_DALVIK, make_pair("0", 1)));
-    	mValues.insert(make_pair(TW_SDEXT2_SIZE, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_HAS_SDEXT_PARTITION, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_HAS_SDEXT2_PARTITION, make_pair("0", 1)));
-    	mValues.insert(make_pair(TW_USE_SDEXT2_PARTITION, make_pair("0", 1)));
-	mValues.insert(make_pair("tw_sdcard_file_system", make_pair("vfat", 1)));
-    	mValues.insert(make_pair("tw_sdpart2_file_system", make_pair("ext4", 1)));
-    	mValues.insert(make_pair(TW_SCREENSHOT_VAR, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_SEL_THEME_PATH, make_pair("", 1)));
-	mValues.insert(make_pair(TW_NUM_OF_MOUNTS_FOR_FS_CHK, make_pair("16", 1)));
-	mValues.insert(make_pair(TW_INCR_SIZE, make_pair("40", 1)));
-	mValues.insert(make_pair(TW_SKIP_SD_FREE_SZ_CHECK, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_RESCUE_EXT_CONTENTS, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_HANDLE_RESTORE_SIZE, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_HANDLE_SU, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_VIBRATE_AFTER_BUTTON_PRESS, make_pair("1", 1)));
-	mValues.insert(make_pair(TW_BUTTON_FEEDBACK_DURATION_MS, make_pair("25", 1)));
-	mValues.insert(make_pair(TW_VIBRATE_AFTER_BACKUP, make_pair("1", 1)));
-	mValues.insert(make_pair(TW_BACKUP_FEEDBACK_DURATION_MS, make_pair("100", 1)));
-	mValues.insert(make_pair(TW_VIBRATE_AFTER_RESTORE, make_pair("1", 1)));
-	mValues.insert(make_pair(TW_RESTORE_FEEDBACK_DURATION_MS, make_pair("100", 1)));
-	mValues.insert(make_pair(TW_VIBRATE_AFTER_INSTALL, make_pair("1", 1)));
-	mValues.insert(make_pair(TW_INSTALL_FEEDBACK_DURATION_MS, make_pair("100", 1)));
-	mValues.insert(make_pair(TW_VIBRATE_AFTER_PARTED, make_pair("1", 1)));
-	mValues.insert(make_pair(TW_PARTED_FEEDBACK_DURATION_MS, make_pair("100", 1)));
-	mValues.insert(make_pair(TW_MKNTFS_QUICK_FORMAT, make_pair("0", 1)));
+    	InsertValue(TW_RESTORE_BOOT_VAR, "0", 1);
+	InsertValue(TW_SKIP_DALVIK, "0", 1);
+    	InsertValue(TW_SDEXT2_SIZE, "0", 1);
+	InsertValue(TW_HAS_SDEXT_PARTITION, "0", 1);
+	InsertValue(TW_HAS_SDEXT2_PARTITION, "0", 1);
+    	InsertValue(TW_USE_SDEXT2_PARTITION, "0", 1);
+	InsertValue("tw_sdcard_file_system", "vfat", 1);
+    	InsertValue("tw_sdpart2_file_system", "ext4", 1);
+    	InsertValue(TW_SCREENSHOT_VAR, "0", 1);
+	InsertValue(TW_SEL_THEME_PATH, "", 1);
+	InsertValue(TW_NUM_OF_MOUNTS_FOR_FS_CHK, "16", 1);
+	InsertValue(TW_INCR_SIZE, "40", 1);
+	InsertValue(TW_SKIP_SD_FREE_SZ_CHECK, "0", 1);
+	InsertValue(TW_RESCUE_EXT_CONTENTS, "0", 1);
+	InsertValue(TW_HANDLE_RESTORE_SIZE, "0", 1);
+	InsertValue(TW_HANDLE_SU, "0", 1);
+	InsertValue(TW_VIBRATE_AFTER_BUTTON_PRESS, "1", 1);
+	InsertValue(TW_BUTTON_FEEDBACK_DURATION_MS, "25", 1);
+	InsertValue(TW_VIBRATE_AFTER_BACKUP, "1", 1);
+	InsertValue(TW_BACKUP_FEEDBACK_DURATION_MS, "100", 1);
+	InsertValue(TW_VIBRATE_AFTER_RESTORE, "1", 1);
+	InsertValue(TW_RESTORE_FEEDBACK_DURATION_MS, "100", 1);
+	InsertValue(TW_VIBRATE_AFTER_INSTALL, "1", 1);
+	InsertValue(TW_INSTALL_FEEDBACK_DURATION_MS, "100", 1);
+	InsertValue(TW_VIBRATE_AFTER_PARTED, "1", 1);
+	InsertValue(TW_PARTED_FEEDBACK_DURATION_MS, "100", 1);
+	InsertValue(TW_MKNTFS_QUICK_FORMAT, "0", 1);
 // Extended-End
 
 #ifdef TW_INCLUDE_MKNTFS
-	mConstValues.insert(make_pair(TW_SHOW_NTFS, "1"));
+	InsertConst(TW_SHOW_NTFS, "1");
 #else
-	mConstValues.insert(make_pair(TW_SHOW_NTFS, "0"));
+	InsertConst(TW_SHOW_NTFS, "0");
 #endif
 
 #ifdef TW_INCLUDE_EXFAT
-	mConstValues.insert(make_pair(TW_SHOW_EXFAT, "1"));
+	InsertConst(TW_SHOW_EXFAT, "1");
 #else
-	mConstValues.insert(make_pair(TW_SHOW_EXFAT, "0"));
+	InsertConst(TW_SHOW_EXFAT, "0");
 #endif
 
 #ifdef BOARD_HAS_NO_REAL_SDCARD
-	mConstValues.insert(make_pair(TW_ALLOW_PARTITION_SDCARD, "0"));
+	InsertConst(TW_ALLOW_PARTITION_SDCARD, "0");
 #else
-	mConstValues.insert(make_pair(TW_ALLOW_PARTITION_SDCARD, "1"));
+	InsertConst(TW_ALLOW_PARTITION_SDCARD, "1");
 #endif
 
 #ifdef TW_INCLUDE_DUMLOCK
-	mConstValues.insert(make_pair(TW_SHOW_DUMLOCK, "1"));
+	InsertConst(TW_SHOW_DUMLOCK, "1");
 #else
-	mConstValues.insert(make_pair(TW_SHOW_DUMLOCK, "0"));
+	InsertConst(TW_SHOW_DUMLOCK, "0");
 #endif
 
 #ifdef TW_INTERNAL_STORAGE_PATH
 	LOGINFO("=> Internal path defined: '%s'\n", EXPAND(TW_INTERNAL_STORAGE_PATH));
-	mValues.insert(make_pair(TW_USE_EXTERNAL_STORAGE, make_pair("0", 1)));
-	mConstValues.insert(make_pair(TW_HAS_INTERNAL, "1"));
-	mValues.insert(make_pair(TW_INTERNAL_PATH, make_pair(EXPAND(TW_INTERNAL_STORAGE_PATH), 0)));
-	mConstValues.insert(make_pair(TW_INTERNAL_LABEL, EXPAND(TW_INTERNAL_STORAGE_MOUNT_POINT)));
+	InsertValue(TW_USE_EXTERNAL_STORAGE, "0", 1);
+	InsertConst(TW_HAS_INTERNAL, "1");
+	InsertValue(TW_INTERNAL_PATH, EXPAND(TW_INTERNAL_STORAGE_PATH), 0);
+	InsertConst(TW_INTERNAL_LABEL, EXPAND(TW_INTERNAL_STORAGE_MOUNT_POINT));
 	path.clear();
 	path = "/";
 	path += EXPAND(TW_INTERNAL_STORAGE_MOUNT_POINT);
-	mConstValues.insert(make_pair(TW_INTERNAL_MOUNT, path));
+	InsertConst(TW_INTERNAL_MOUNT, path);
 	#ifdef TW_EXTERNAL_STORAGE_PATH
 		LOGINFO("=> External path defined: '%s'\n", EXPAND(TW_EXTERNAL_STORAGE_PATH));
 		// Device has dual storage
-		mConstValues.insert(make_pair(TW_HAS_DUAL_STORAGE, "1"));
-		mConstValues.insert(make_pair(TW_HAS_EXTERNAL, "1"));
-		mConstValues.insert(make_pair(TW_EXTERNAL_PATH, EXPAND(TW_EXTERNAL_STORAGE_PATH)));
-		mConstValues.insert(make_pair(TW_EXTERNAL_LABEL, EXPAND(TW_EXTERNAL_STORAGE_MOUNT_POINT)));
-		mValues.insert(make_pair(TW_ZIP_EXTERNAL_VAR, make_pair(EXPAND(TW_EXTERNAL_STORAGE_PATH), 1)));
+		InsertConst(TW_HAS_DUAL_STORAGE, "1");
+		InsertConst(TW_HAS_EXTERNAL, "1");
+		InsertConst(TW_EXTERNAL_PATH, EXPAND(TW_EXTERNAL_STORAGE_PATH));
+		InsertConst(TW_EXTERNAL_LABEL, EXPAND(TW_EXTERNAL_STORAGE_MOUNT_POINT));
+		InsertValue(TW_ZIP_EXTERNAL_VAR, EXPAND(TW_EXTERNAL_STORAGE_PATH), 1);
 		path.clear();
 		path = "/";
 		path += EXPAND(TW_EXTERNAL_STORAGE_MOUNT_POINT);
-		mConstValues.insert(make_pair(TW_EXTERNAL_MOUNT, path));
+		InsertConst(TW_EXTERNAL_MOUNT, path);
 		if (strcmp(EXPAND(TW_EXTERNAL_STORAGE_PATH), "/sdcard") == 0) {
-			mValues.insert(make_pair(TW_ZIP_INTERNAL_VAR, make_pair("/emmc", 1)));
+			InsertValue(TW_ZIP_INTERNAL_VAR, "/emmc", 1);
 		} else {
-			mValues.insert(make_pair(TW_ZIP_INTERNAL_VAR, make_pair("/sdcard", 1)));
+			InsertValue(TW_ZIP_INTERNAL_VAR, "/sdcard", 1);
 		}
 	#else
 		LOGINFO("=> Just has internal storage.\n");
 		// Just has internal storage
-		mValues.insert(make_pair(TW_ZIP_INTERNAL_VAR, make_pair("/sdcard", 1)));
-		mConstValues.insert(make_pair(TW_HAS_DUAL_STORAGE, "0"));
-		mConstValues.insert(make_pair(TW_HAS_EXTERNAL, "0"));
-		mConstValues.insert(make_pair(TW_EXTERNAL_PATH, "0"));
-		mConstValues.insert(make_pair(TW_EXTERNAL_MOUNT, "0"));
-		mConstValues.insert(make_pair(TW_EXTERNAL_LABEL, "0"));
+		InsertValue(TW_ZIP_INTERNAL_VAR, "/sdcard", 1);
+		InsertConst(TW_HAS_DUAL_STORAGE, "0");
+		InsertConst(TW_HAS_EXTERNAL, "0");
+		InsertConst(TW_EXTERNAL_PATH, "0");
+		InsertConst(TW_EXTERNAL_MOUNT, "0");
+		InsertConst(TW_EXTERNAL_LABEL, "0");
 	#endif
 #else
 	#ifdef RECOVERY_SDCARD_ON_DATA
 		#ifdef TW_EXTERNAL_STORAGE_PATH
 			LOGINFO("=> Has /data/media + external storage in '%s'\n", EXPAND(TW_EXTERNAL_STORAGE_PATH));
 			// Device has /data/media + external storage
-			mConstValues.insert(make_pair(TW_HAS_DUAL_STORAGE, "1"));
+			InsertConst(TW_HAS_DUAL_STORAGE, "1");
 		#else
 			LOGINFO("=> Single storage only -- data/media.\n");
 			// Device just has external storage
-			mConstValues.insert(make_pair(TW_HAS_DUAL_STORAGE, "0"));
-			mConstValues.insert(make_pair(TW_HAS_EXTERNAL, "0"));
+			InsertConst(TW_HAS_DUAL_STORAGE, "0");
+			InsertConst(TW_HAS_EXTERNAL, "0");
 		#endif
 	#else
 		LOGINFO("=> Single storage only.\n");
 		// Device just has external storage
-		mConstValues.insert(make_pair(TW_HAS_DUAL_STORAGE, "0"));
+		InsertConst(TW_HAS_DUAL_STORAGE, "0");
 	#endif
 	#ifdef RECOVERY_SDCARD_ON_DATA
 		LOGINFO("=> Device has /data/media defined.\n");
 		// Device has /data/media
-		mConstValues.insert(make_pair(TW_USE_EXTERNAL_STORAGE, "0"));
-		mConstValues.insert(make_pair(TW_HAS_INTERNAL, "1"));
-		mValues.insert(make_pair(TW_INTERNAL_PATH, make_pair("/data/media", 0)));
-		mConstValues.insert(make_pair(TW_INTERNAL_MOUNT, "/data"));
-		mConstValues.insert(make_pair(TW_INTERNAL_LABEL, "data"));
+		InsertConst(TW_USE_EXTERNAL_STORAGE, "0");
+		InsertConst(TW_HAS_INTERNAL, "1");
+		InsertValue(TW_INTERNAL_PATH, "/data/media", 0);
+		InsertConst(TW_INTERNAL_MOUNT, "/data");
+		InsertConst(TW_INTERNAL_LABEL, "data");
 		#ifdef TW_EXTERNAL_STORAGE_PATH
 			if (strcmp(EXPAND(TW_EXTERNAL_STORAGE_PATH), "/sdcard") == 0) {
-				mValues.insert(make_pair(TW_ZIP_INTERNAL_VAR, make_pair("/emmc", 1)));
+				InsertValue(TW_ZIP_INTERNAL_VAR, "/emmc", 1);
 			} else {
-				mValues.insert(make_pair(TW_ZIP_INTERNAL_VAR, make_pair("/sdcard", 1)));
+				InsertValue(TW_ZIP_INTERNAL_VAR, "/sdcard", 1);
 			}
 		#else
-			mValues.insert(make_pair(TW_ZIP_INTERNAL_VAR, make_pair("/sdcard", 1)));
+			InsertValue(TW_ZIP_INTERNAL_VAR, "/sdcard", 1);
 		#endif
 	#else
 		LOGINFO("=> No internal storage defined.\n");
 		// Device has no internal storage
-		mConstValues.insert(make_pair(TW_USE_EXTERNAL_STORAGE, "1"));
-		mConstValues.insert(make_pair(TW_HAS_INTERNAL, "0"));
-		mValues.insert(make_pair(TW_INTERNAL_PATH, make_pair("0", 0)));
-		mConstValues.insert(make_pair(TW_INTERNAL_MOUNT, "0"));
-		mConstValues.insert(make_pair(TW_INTERNAL_LABEL, "0"));
+		InsertConst(TW_USE_EXTERNAL_STORAGE, "1");
+		InsertConst(TW_HAS_INTERNAL, "0");
+		InsertValue(TW_INTERNAL_PATH, "0", 0);
+		InsertConst(TW_INTERNAL_MOUNT, "0");
+		InsertConst(TW_INTERNAL_LABEL, "0");
 	#endif
 	#ifdef TW_EXTERNAL_STORAGE_PATH
 		LOGINFO("=> Only external path defined: '%s'\n", EXPAND(TW_EXTERNAL_STORAGE_PATH));
 		// External has custom definition
-		mConstValues.insert(make_pair(TW_HAS_EXTERNAL, "1"));
-		mConstValues.insert(make_pair(TW_EXTERNAL_PATH, EXPAND(TW_EXTERNAL_STORAGE_PATH)));
-		mConstValues.insert(make_pair(TW_EXTERNAL_LABEL, EXPAND(TW_EXTERNAL_STORAGE_MOUNT_POINT)));
-		mValues.insert(make_pair(TW_ZIP_EXTERNAL_VAR, make_pair(EXPAND(TW_EXTERNAL_STORAGE_PATH), 1)));
+		InsertConst(TW_HAS_EXTERNAL, "1");
+		InsertConst(TW_EXTERNAL_PATH, EXPAND(TW_EXTERNAL_STORAGE_PATH));
+		InsertConst(TW_EXTERNAL_LABEL, EXPAND(TW_EXTERNAL_STORAGE_MOUNT_POINT));
+		InsertValue(TW_ZIP_EXTERNAL_VAR, EXPAND(TW_EXTERNAL_STORAGE_PATH), 1);
 		path.clear();
 		path = "/";
 		path += EXPAND(TW_EXTERNAL_STORAGE_MOUNT_POINT);
-		mConstValues.insert(make_pair(TW_EXTERNAL_MOUNT, path));
+		InsertConst(TW_EXTERNAL_MOUNT, path);
 	#else
 		#ifndef RECOVERY_SDCARD_ON_DATA
 			LOGINFO("=> No storage defined, defaulting to /sdcard.\n");
 			// Standard external definition
-			mConstValues.insert(make_pair(TW_HAS_EXTERNAL, "1"));
-			mConstValues.insert(make_pair(TW_EXTERNAL_PATH, "/sdcard"));
-			mConstValues.insert(make_pair(TW_EXTERNAL_MOUNT, "/sdcard"));
-			mConstValues.insert(make_pair(TW_EXTERNAL_LABEL, "sdcard"));
-			mValues.insert(make_pair(TW_ZIP_EXTERNAL_VAR, make_pair("/sdcard", 1)));
+			InsertConst(TW_HAS_EXTERNAL, "1");
+			InsertConst(TW_EXTERNAL_PATH, "/sdcard");
+			InsertConst(TW_EXTERNAL_MOUNT, "/sdcard");
+			InsertConst(TW_EXTERNAL_LABEL, "sdcard");
+			InsertValue(TW_ZIP_EXTERNAL_VAR, "/sdcard", 1);
 		#endif
 	#endif
 #endif
@@ -929,51 +1131,51 @@ void DataManager::SetDefaultValues()
 	SetValue(TW_ZIP_LOCATION_VAR, str.c_str(), 1);
 #endif
 
-	mConstValues.insert(make_pair(TW_REBOOT_SYSTEM, "1"));
-	mConstValues.insert(make_pair(TW_REBOOT_POWEROFF, "1"));
+	InsertConst(TW_REBOOT_SYSTEM, "1");
+	InsertConst(TW_REBOOT_POWEROFF, "1");
 
 #ifdef TW_NO_REBOOT_RECOVERY
-	mConstValues.insert(make_pair(TW_REBOOT_RECOVERY, "0"));
+	InsertConst(TW_REBOOT_RECOVERY, "0");
 #else
-	mConstValues.insert(make_pair(TW_REBOOT_RECOVERY, "1"));
+	InsertConst(TW_REBOOT_RECOVERY, "1");
 #endif
 
 #ifdef TW_NO_REBOOT_BOOTLOADER
-	mConstValues.insert(make_pair(TW_REBOOT_BOOTLOADER, "0"));
+	InsertConst(TW_REBOOT_BOOTLOADER, "0");
 #else
-	mConstValues.insert(make_pair(TW_REBOOT_BOOTLOADER, "1"));
+	InsertConst(TW_REBOOT_BOOTLOADER, "1");
 #endif
 
 #ifdef RECOVERY_SDCARD_ON_DATA
-	mConstValues.insert(make_pair(TW_HAS_DATA_MEDIA, "1"));
+	InsertConst(TW_HAS_DATA_MEDIA, "1");
 #else
-	mConstValues.insert(make_pair(TW_HAS_DATA_MEDIA, "0"));
+	InsertConst(TW_HAS_DATA_MEDIA, "0");
 #endif
 
 #ifdef TW_NO_BATT_PERCENT
-	mConstValues.insert(make_pair(TW_NO_BATTERY_PERCENT, "1"));
+	InsertConst(TW_NO_BATTERY_PERCENT, "1");
 #else
-	mConstValues.insert(make_pair(TW_NO_BATTERY_PERCENT, "0"));
+	InsertConst(TW_NO_BATTERY_PERCENT, "0");
 #endif
 
 #ifdef TW_CUSTOM_POWER_BUTTON
-	mConstValues.insert(make_pair(TW_POWER_BUTTON, EXPAND(TW_CUSTOM_POWER_BUTTON)));
+	InsertConst(TW_POWER_BUTTON, EXPAND(TW_CUSTOM_POWER_BUTTON));
 #else
-	mConstValues.insert(make_pair(TW_POWER_BUTTON, "0"));
+	InsertConst(TW_POWER_BUTTON, "0");
 #endif
 
 #ifdef TW_ALWAYS_RMRF
-	mConstValues.insert(make_pair(TW_RM_RF_VAR, "1"));
+	InsertConst(TW_RM_RF_VAR, "1");
 #endif
 
 #ifdef TW_NEVER_UNMOUNT_SYSTEM
-	mConstValues.insert(make_pair(TW_DONT_UNMOUNT_SYSTEM, "1"));
+	InsertConst(TW_DONT_UNMOUNT_SYSTEM, "1");
 #else
-	mConstValues.insert(make_pair(TW_DONT_UNMOUNT_SYSTEM, "0"));
+	InsertConst(TW_DONT_UNMOUNT_SYSTEM, "0");
 #endif
 
 #ifdef TW_NO_USB_STORAGE
-	mConstValues.insert(make_pair(TW_HAS_USB_STORAGE, "0"));
+	InsertConst(TW_HAS_USB_STORAGE, "0");
 #else
 	char lun_file[255];
 	string Lun_File_str = CUSTOM_LUN_FILE;
@@ -984,131 +1186,133 @@ void DataManager::SetDefaultValues()
 	}
 	if (!TWFunc::Path_Exists(Lun_File_str)) {
 		LOGINFO("=> Lun file '%s' does not exist, USB storage mode disabled\n", Lun_File_str.c_str());
-		mConstValues.insert(make_pair(TW_HAS_USB_STORAGE, "0"));
+		InsertConst(TW_HAS_USB_STORAGE, "0");
 	} else {
 		LOGINFO("=> Lun file '%s'\n", Lun_File_str.c_str());
-		mConstValues.insert(make_pair(TW_HAS_USB_STORAGE, "1"));
+		InsertConst(TW_HAS_USB_STORAGE, "1");
 	}
 #endif
 
 #ifdef TW_INCLUDE_INJECTTWRP
-	mConstValues.insert(make_pair(TW_HAS_INJECTTWRP, "1"));
-	mValues.insert(make_pair(TW_INJECT_AFTER_ZIP, make_pair("1", 1)));
+	InsertConst(TW_HAS_INJECTTWRP, "1");
+	InsertValue(TW_INJECT_AFTER_ZIP, "1", 1);
 #else
-	mConstValues.insert(make_pair(TW_HAS_INJECTTWRP, "0"));
-	mValues.insert(make_pair(TW_INJECT_AFTER_ZIP, make_pair("0", 1)));
+	InsertConst(TW_HAS_INJECTTWRP, "0");
+	InsertValue(TW_INJECT_AFTER_ZIP, "0", 1);
 #endif
 
 #ifdef TW_FLASH_FROM_STORAGE
-	mConstValues.insert(make_pair(TW_FLASH_ZIP_IN_PLACE, "1"));
+	InsertConst(TW_FLASH_ZIP_IN_PLACE, "1");
 #endif
 
 #ifdef TW_HAS_DOWNLOAD_MODE
-	mConstValues.insert(make_pair(TW_DOWNLOAD_MODE, "1"));
+	InsertConst(TW_DOWNLOAD_MODE, "1");
 #endif
 
 #ifdef TW_INCLUDE_CRYPTO
-	mConstValues.insert(make_pair(TW_HAS_CRYPTO, "1"));
+	InsertConst(TW_HAS_CRYPTO, "1");
 	LOGINFO("=> Device has crypto support compiled into recovery.\n");
 #endif
 
-	mValues.insert(make_pair("tw_encrypt_backup", make_pair("0", 0)));
+	InsertValue("tw_encrypt_backup", "0", 0);
 #ifdef TW_EXCLUDE_ENCRYPTED_BACKUPS
-	mValues.insert(make_pair("tw_include_encrypted_backup", make_pair("0", 0)));
+	InsertValue("tw_include_encrypted_backup", "0", 0);
 #else
 	LOGINFO("=> Encrypted backups support compiled into recovery.\n");
-	mValues.insert(make_pair("tw_include_encrypted_backup", make_pair("1", 0)));
+	InsertValue("tw_include_encrypted_backup", "1", 0);
 #endif
 
 #ifdef TW_SDEXT_NO_EXT4
-	mConstValues.insert(make_pair(TW_SDEXT_DISABLE_EXT4, "1"));
+	InsertConst(TW_SDEXT_DISABLE_EXT4, "1");
 #else
-	mConstValues.insert(make_pair(TW_SDEXT_DISABLE_EXT4, "0"));
+	InsertConst(TW_SDEXT_DISABLE_EXT4, "0");
 #endif
 
 #ifdef TW_HAS_NO_BOOT_PARTITION
-	mValues.insert(make_pair("tw_backup_list", make_pair("/system;/data;", 1)));
+	InsertValue("tw_backup_list", "/system;/data;", 1);
 #else
-	mValues.insert(make_pair("tw_backup_list", make_pair("/boot;/system;/data;", 1)));
+	InsertValue("tw_backup_list", "/boot;/system;/data;", 1);
 #endif
-	mConstValues.insert(make_pair(TW_MIN_SYSTEM_VAR, TW_MIN_SYSTEM_SIZE));
-	mValues.insert(make_pair(TW_BACKUP_NAME, make_pair("(Current Date)", 0)));
-	mValues.insert(make_pair(TW_BACKUP_SYSTEM_SIZE, make_pair("0", 0)));
-	mValues.insert(make_pair(TW_STORAGE_FREE_SIZE, make_pair("0", 0)));
+	InsertConst(TW_MIN_SYSTEM_VAR, TW_MIN_SYSTEM_SIZE);
+	InsertValue(TW_BACKUP_NAME, "(Current Date)", 0);
+	InsertValue(TW_BACKUP_SYSTEM_SIZE, "0", 0);
+	InsertValue(TW_STORAGE_FREE_SIZE, "0", 0);
 	
-	mValues.insert(make_pair(TW_REBOOT_AFTER_FLASH_VAR, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_SIGNED_ZIP_VERIFY_VAR, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_COLOR_THEME_VAR, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_USE_COMPRESSION_VAR, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_SHOW_SPAM_VAR, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_TIME_ZONE_VAR, make_pair("CST6CDT", 1)));
-	mValues.insert(make_pair(TW_SORT_FILES_BY_DATE_VAR, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_GUI_SORT_ORDER, make_pair("1", 1)));
-	mValues.insert(make_pair(TW_RM_RF_VAR, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_SKIP_MD5_CHECK_VAR, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_SKIP_MD5_GENERATE_VAR, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_SDEXT_SIZE, make_pair("512", 1)));
-	mValues.insert(make_pair(TW_SWAP_SIZE, make_pair("0", 1)));
-	mValues.insert(make_pair("tw_sdpart_file_system", make_pair("ext4", 1)));
-	mValues.insert(make_pair(TW_TIME_ZONE_GUISEL, make_pair("CST6;CDT", 1)));
-	mValues.insert(make_pair(TW_TIME_ZONE_GUIOFFSET, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_TIME_ZONE_GUIDST, make_pair("1", 1)));
-	mValues.insert(make_pair(TW_ACTION_BUSY, make_pair("0", 0)));
-	mValues.insert(make_pair(TW_BACKUP_AVG_IMG_RATE, make_pair("15000000", 1)));
-	mValues.insert(make_pair(TW_BACKUP_AVG_FILE_RATE, make_pair("3000000", 1)));
-	mValues.insert(make_pair(TW_BACKUP_AVG_FILE_COMP_RATE, make_pair("2000000", 1)));
-	mValues.insert(make_pair(TW_RESTORE_AVG_IMG_RATE, make_pair("15000000", 1)));
-	mValues.insert(make_pair(TW_RESTORE_AVG_FILE_RATE, make_pair("3000000", 1)));
-	mValues.insert(make_pair(TW_RESTORE_AVG_FILE_COMP_RATE, make_pair("2000000", 1)));
-	mValues.insert(make_pair("tw_wipe_cache", make_pair("0", 0)));
-	mValues.insert(make_pair("tw_wipe_dalvik", make_pair("0", 0)));
+	InsertValue(TW_REBOOT_AFTER_FLASH_VAR, "0", 1);
+	InsertValue(TW_SIGNED_ZIP_VERIFY_VAR, "0", 1);
+	InsertValue(TW_COLOR_THEME_VAR, "0", 1);
+	InsertValue(TW_USE_COMPRESSION_VAR, "0", 1);
+	InsertValue(TW_SHOW_SPAM_VAR, "0", 1);
+	InsertValue(TW_TIME_ZONE_VAR, "CST6CDT", 1);
+	InsertValue(TW_SORT_FILES_BY_DATE_VAR, "0", 1);
+	InsertValue(TW_GUI_SORT_ORDER, "1", 1);
+	InsertValue(TW_RM_RF_VAR, "0", 1);
+	InsertValue(TW_SKIP_MD5_CHECK_VAR, "0", 1);
+	InsertValue(TW_SKIP_MD5_GENERATE_VAR, "0", 1);
+	InsertValue(TW_SPARSE_IMAGES_VAR, "0", 1);
+	InsertValue(TW_USED_BLOCKS_IMAGES_VAR, "0", 1);
+	InsertValue(TW_SDEXT_SIZE, "512", 1);
+	InsertValue(TW_SWAP_SIZE, "0", 1);
+	InsertValue("tw_sdpart_file_system", "ext4", 1);
+	InsertValue(TW_TIME_ZONE_GUISEL, "CST6;CDT", 1);
+	InsertValue(TW_TIME_ZONE_GUIOFFSET, "0", 1);
+	InsertValue(TW_TIME_ZONE_GUIDST, "1", 1);
+	InsertValue(TW_ACTION_BUSY, "0", 0);
+	InsertValue(TW_BACKUP_AVG_IMG_RATE, "15000000", 1);
+	InsertValue(TW_BACKUP_AVG_FILE_RATE, "3000000", 1);
+	InsertValue(TW_BACKUP_AVG_FILE_COMP_RATE, "2000000", 1);
+	InsertValue(TW_RESTORE_AVG_IMG_RATE, "15000000", 1);
+	InsertValue(TW_RESTORE_AVG_FILE_RATE, "3000000", 1);
+	InsertValue(TW_RESTORE_AVG_FILE_COMP_RATE, "2000000", 1);
+	InsertValue("tw_wipe_cache", "0", 0);
+	InsertValue("tw_wipe_dalvik", "0", 0);
 	if (GetIntValue(TW_HAS_INTERNAL) == 1 && GetIntValue(TW_HAS_DATA_MEDIA) == 1 && GetIntValue(TW_HAS_EXTERNAL) == 0)
 		SetValue(TW_HAS_USB_STORAGE, 0, 0);
 	else
 		SetValue(TW_HAS_USB_STORAGE, 1, 0);
-	mValues.insert(make_pair(TW_ZIP_INDEX, make_pair("0", 0)));
-	mValues.insert(make_pair(TW_ZIP_QUEUE_COUNT, make_pair("0", 0)));
-	mValues.insert(make_pair(TW_FILENAME, make_pair("/sdcard", 0)));
-	mValues.insert(make_pair(TW_SIMULATE_ACTIONS, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_SIMULATE_FAIL, make_pair("0", 1)));
-	mValues.insert(make_pair(TW_IS_ENCRYPTED, make_pair("0", 0)));
-	mValues.insert(make_pair(TW_IS_DECRYPTED, make_pair("0", 0)));
-	mValues.insert(make_pair(TW_CRYPTO_PASSWORD, make_pair("0", 0)));
-	mValues.insert(make_pair(TW_DATA_BLK_DEVICE, make_pair("0", 0)));
-	mValues.insert(make_pair("tw_terminal_state", make_pair("0", 0)));
-	mValues.insert(make_pair("tw_background_thread_running", make_pair("0", 0)));
-	mValues.insert(make_pair(TW_RESTORE_FILE_DATE, make_pair("0", 0)));
+	InsertValue(TW_ZIP_INDEX, "0", 0);
+	InsertValue(TW_ZIP_QUEUE_COUNT, "0", 0);
+	InsertValue(TW_FILENAME, "/sdcard", 0);
+	InsertValue(TW_SIMULATE_ACTIONS, "0", 1);
+	InsertValue(TW_SIMULATE_FAIL, "0", 1);
+	InsertValue(TW_IS_ENCRYPTED, "0", 0);
+	InsertValue(TW_IS_DECRYPTED, "0", 0);
+	InsertValue(TW_CRYPTO_PASSWORD, "0", 0);
+	InsertValue(TW_DATA_BLK_DEVICE, "0", 0);
+	InsertValue("tw_terminal_state", "0", 0);
+	InsertValue("tw_background_thread_running", "0", 0);
+	InsertValue(TW_RESTORE_FILE_DATE, "0", 0);
 #ifdef TW_NO_SCREEN_TIMEOUT
-	mValues.insert(make_pair("tw_screen_timeout_secs", make_pair("0", 1)));
-	mValues.insert(make_pair("tw_no_screen_timeout", make_pair("1", 1)));
+	InsertValue("tw_screen_timeout_secs", "0", 1);
+	InsertValue("tw_no_screen_timeout", "1", 1);
 #else
-	mValues.insert(make_pair("tw_screen_timeout_secs", make_pair("60", 1)));
-	mValues.insert(make_pair("tw_no_screen_timeout", make_pair("0", 1)));
+	InsertValue("tw_screen_timeout_secs", "60", 1);
+	InsertValue("tw_no_screen_timeout", "0", 1);
 #endif
-	mValues.insert(make_pair("tw_gui_done", make_pair("0", 0)));
+	InsertValue("tw_gui_done", "0", 0);
 #ifdef TW_BRIGHTNESS_PATH
 	#ifndef TW_MAX_BRIGHTNESS
 		#define TW_MAX_BRIGHTNESS 255
 	#endif
 	if (strcmp(EXPAND(TW_BRIGHTNESS_PATH), "/nobrightness") != 0) {
 		LOGINFO("=> Brightness file '%s'\n", EXPAND(TW_BRIGHTNESS_PATH));
-		mConstValues.insert(make_pair("tw_has_brightnesss_file", "1"));
-		mConstValues.insert(make_pair("tw_brightness_file", EXPAND(TW_BRIGHTNESS_PATH)));
+		InsertConst("tw_has_brightnesss_file", "1");
+		InsertConst("tw_brightness_file", EXPAND(TW_BRIGHTNESS_PATH));
 		ostringstream maxVal;
 		maxVal << TW_MAX_BRIGHTNESS;
-		mConstValues.insert(make_pair("tw_brightness_max", maxVal.str()));
-		mValues.insert(make_pair("tw_brightness", make_pair(maxVal.str(), 1)));
-		mValues.insert(make_pair("tw_brightness_pct", make_pair("100", 1)));
+		InsertConst("tw_brightness_max", maxVal.str());
+		InsertValue("tw_brightness", maxVal.str(), 1);
+		InsertValue("tw_brightness_pct", "100", 1);
 	} else {
-		mConstValues.insert(make_pair("tw_has_brightnesss_file", "0"));
+		InsertConst("tw_has_brightnesss_file", "0");
 	}
 #endif
-	mValues.insert(make_pair(TW_MILITARY_TIME, make_pair("1", 1)));
-	mValues.insert(make_pair(TW_ROTATION, make_pair(EXPAND(TW_DEFAULT_ROTATION), 1)));
+	InsertValue(TW_MILITARY_TIME, "1", 1);
+	InsertValue(TW_ROTATION, EXPAND(TW_DEFAULT_ROTATION), 1);
 #ifdef TW_HAS_LANDSCAPE
-	mValues.insert(make_pair(TW_ENABLE_ROTATION, make_pair("1", 1)));
+	InsertValue(TW_ENABLE_ROTATION, "1", 1);
 #else
-	mValues.insert(make_pair(TW_ENABLE_ROTATION, make_pair("0", 1)));
+	InsertValue(TW_ENABLE_ROTATION, "0", 1);
 #endif
 }
 
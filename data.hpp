@@ -22,6 +22,7 @@
 #include <string>
 #include <utility>
 #include <map>
+#include <deque>
 
 using namespace std;
 
@@ -41,6 +42,19 @@ class DataManager {
 		// Helper functions
 		static string GetStrValue(const string varName);
 		static int GetIntValue(const string varName);
+		// Handles to interned variables for callers that read or update a
+		// variable often. A handle stays valid for the life of the process,
+		// even if the variable does not exist yet or defaults are reset.
+		static int GetHandle(const string varName);
+		static int GetValue(int handle, string& value);
+		static string GetStrValue(int handle);
+		static int GetIntValue(int handle);
+		static unsigned long long GetULLValue(int handle);
+		static float GetFloatValue(int handle);
+		static int SetValue(int handle, string value, int persist = 0);
+		static int SetValue(int handle, int value, int persist = 0);
+		static int SetValue(int handle, float value, int persist = 0);
+		static int SetValue(int handle, unsigned long long value, int persist = 0);
 		// Core set routines
 		static int SetValue(const string varName, string value, int persist = 0);
 		static int SetValue(const string varName, int value, int persist = 0);
@@ -72,14 +86,24 @@ class DataManager {
 		static void SetupTwrpFolder();
 
 	protected:
-		typedef pair<string, int> TStrIntPair;
-		typedef pair<string, unsigned long long> TStrULLPair;
-		typedef pair<string, TStrIntPair> TNameValuePair;
-		static map<string, TStrIntPair> mValues;
-		static map<string, TStrULLPair> mULLValues;
+		// Variables are interned into slots that are never removed. Each slot
+		// keeps the value as a string for themes plus its numeric forms, which
+		// are worked out once when the value is set.
+		struct Variable {
+			string name;
+			string str;
+			int intValue;
+			unsigned long long ullValue;
+			float floatValue;
+			int persist;
+			int special;
+			bool isSet;
+			bool isConst;
+		};
+		static deque<Variable> mSlots;
+		static map<string, int> mSlotIndex;
 		static string mBackingFile;
 		static int mInitialized;
-		static map<string, string> mConstValues;
 
 	// Extended functions
 	   	static int SettingsFileRead;
@@ -88,6 +112,13 @@ class DataManager {
 
 	protected:
 		static int SaveValues();
+		static int FindSlot(const string& varName);
+		static int LookupSlot(const string& varName);
+		static int InternSlot(const string& varName);
+		static void ParseNumbers(Variable& var);
+		static void InsertValue(const string varName, const string value, int persist);
+		static void InsertConst(const string varName, const string value);
+		static int StoreValue(int handle, const string& value, int intValue, unsigned long long ullValue, float floatValue, int persist);
 
 	private:
 		static void sanitize_device_id(char* device_id);
@@ -36,6 +36,7 @@
 #include <sstream>
 #include "../partitions.hpp"
 #include "../twrp-functions.hpp"
+#include "../twrpDirIndex.hpp"
 #include "../openrecoveryscript.hpp"
 
 #include "../adb_install.h"
@@ -69,6 +70,11 @@ extern blanktimer blankTimer;
 #endif
 void curtainClose(void);
 
+// Shows the running total while getfoldersize works through a big folder
+static void folder_size_progress(unsigned long long bytes, unsigned long folders, void* cookie) {
+	DataManager::SetValue("tw_filename1_size", (float)bytes / (float)1048576LLU);
+}
+
 GUIAction::GUIAction(xml_node<>* node)
 	: Conditional(node)
 {
@@ -95,6 +101,8 @@ GUIAction::GUIAction(xml_node<>* node)
 		if (!attr) return;	
 		action.mFunction = attr->value();
 		action.mArg = child->value();
+		action.mFunctionTemplate.Compile(action.mFunction);
+		action.mArgTemplate.Compile(action.mArg);
 		mActions.push_back(action);
 		child = child->next_sibling("action");
 	}
@@ -152,6 +160,12 @@ int GUIAction::NotifyVarChange(std::string varName, std::string value) {
 	return 0;
 }
 
+bool GUIAction::GetWatchedVars(std::vector<std::string>& vars)
+{
+	GetConditionVars(vars);
+	return true;
+}
+
 void GUIAction::simulate_progress_bar(void) {
 	gui_print("Simulating actions...\n");
 	for (int i = 0; i < 5; i++) {
@@ -331,15 +345,15 @@ std::string GUIAction::Function_Name() {
 	return func;
 }
 
-int GUIAction::doAction(Action action, int isThreaded /* = 0 */) {
+int GUIAction::doAction(const Action& action, int isThreaded /* = 0 */) {
 	static string zip_queue[10];
 	static int zip_queue_index;
 	static pthread_t terminal_command;
 	int simulate;
 
-	std::string arg = gui_parse_text(action.mArg);
+	std::string arg = action.mArgTemplate.Evaluate();
 
-	std::string function = gui_parse_text(action.mFunction);
+	std::string function = action.mFunctionTemplate.Evaluate();
 
 	DataManager::GetValue(TW_SIMULATE_ACTIONS, simulate);
 
@@ -690,7 +704,7 @@ int GUIAction::doAction(Action action, int isThreaded /* = 0 */) {
 			float Size = 0;
 
 			operation_start("FolderSize");
-			Size = ((float)TWFunc::Get_Folder_Size(arg, false) / (float)1048576LLU);
+			Size = ((float)twrpDirIndex::Get_Size(arg, false, folder_size_progress, NULL) / (float)1048576LLU);
 			DataManager::SetValue("tw_filename1_size", Size);
 			operation_end(0, simulate);
 			return 0;
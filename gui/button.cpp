@@ -292,3 +292,17 @@ int GUIButton::NotifyTouch(TOUCH_STATE state, int x, int y)
 		return 0;
 	return (mAction ? mAction->NotifyTouch(state, x, y) : 1);
 }
+
+int GUIButton::NotifyVarChange(std::string varName, std::string value)
+{
+	if (mButtonLabel)
+		mButtonLabel->NotifyVarChange(varName, value);
+	return 0;
+}
+
+bool GUIButton::GetWatchedVars(std::vector<std::string>& vars)
+{
+	if (mButtonLabel)
+		mButtonLabel->GetWatchedVars(vars);
+	return true;
+}
@@ -176,3 +176,19 @@ int GUICheckbox::NotifyTouch(TOUCH_STATE state, int x, int y)
 	return 0;
 }
 
+
+int GUICheckbox::NotifyVarChange(std::string varName, std::string value)
+{
+	if (mLabel)
+		mLabel->NotifyVarChange(varName, value);
+	return 0;
+}
+
+bool GUICheckbox::GetWatchedVars(std::vector<std::string>& vars)
+{
+	if (mLabel)
+		mLabel->GetWatchedVars(vars);
+	// Update() picks up the new state, the change only has to wake it
+	vars.push_back(mVarName);
+	return true;
+}
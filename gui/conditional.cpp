@@ -72,6 +72,13 @@ bool Conditional::IsConditionVariable(std::string var)
 	return false;
 }
 
+void Conditional::GetConditionVars(std::vector<std::string>& vars)
+{
+	std::vector<Condition>::iterator iter;
+	for (iter = mConditions.begin(); iter != mConditions.end(); iter++)
+		vars.push_back(iter->mVar1);
+}
+
 bool Conditional::isConditionTrue()
 {
 	std::vector<Condition>::iterator iter;
@@ -59,17 +59,22 @@ extern "C" void gui_print(const char *fmt, ...)
 
 			// Handle the normal \n\0 case
 			if (*next == '\0')
+			{
+				gui_wakeRender();
 				return;
+			}
 		}
 	}
 	std::string line = start;
 	gConsole.push_back(line);
+	gui_wakeRender();
 	return;
 }
 
 extern "C" void gui_cls()
 {
 	gConsole.clear();
+	gui_wakeRender();
 	return;
 }
 
@@ -101,11 +106,15 @@ extern "C" void gui_print_overwrite(const char *fmt, ...)
 
 			// Handle the normal \n\0 case
 			if (*next == '\0')
+			{
+				gui_wakeRender();
 				return;
+			}
 		}
 	}
 	std::string line = start;
 	gConsole.push_back(line);
+	gui_wakeRender();
 	return;
 }
 
@@ -123,7 +123,7 @@ GUIFileSelector::GUIFileSelector(xml_node<>* node)
 		}
 	}
 	child = node->first_node("text");
-	if (child)  mHeaderText = child->value();
+	if (child)  mHeaderText.Compile(child->value());
 
 	memset(&mHighlightColor, 0, sizeof(COLOR));
 	child = node->first_node("highlight");
@@ -136,9 +136,8 @@ GUIFileSelector::GUIFileSelector(xml_node<>* node)
 		}
 	}
 
-	// Simple way to check for static state
-	mLastValue = gui_parse_text(mHeaderText);
-	if (mLastValue != mHeaderText)
+	mLastValue = mHeaderText.Evaluate();
+	if (!mHeaderText.IsStatic())
 		mHeaderIsStatic = 0;
 	else
 		mHeaderIsStatic = -1;
@@ -577,14 +576,6 @@ int GUIFileSelector::Render(void)
 
 int GUIFileSelector::Update(void)
 {
-	if (!mHeaderIsStatic) {
-		std::string newValue = gui_parse_text(mHeaderText);
-		if (mLastValue != newValue) {
-			mLastValue = newValue;
-			mUpdate = 1;
-		}
-	}
-
 	if (mUpdate)
 	{
 		mUpdate = 0;
@@ -850,14 +841,22 @@ int GUIFileSelector::NotifyTouch(TOUCH_STATE state, int x, int y)
 	return 0;
 }
 
+bool GUIFileSelector::GetWatchedVars(std::vector<std::string>& vars)
+{
+	mHeaderText.GetVars(vars);
+	vars.push_back(mPathVar);
+	vars.push_back(mSortVariable);
+	return true;
+}
+
 int GUIFileSelector::NotifyVarChange(std::string varName, std::string value)
 {
 	if (varName.empty()) {
 		// Always clear the data variable so we know to use it
 		DataManager::SetValue(mVariable, "");
 	}
-	if (!mHeaderIsStatic) {
-		std::string newValue = gui_parse_text(mHeaderText);
+	if (!mHeaderIsStatic && mHeaderText.DependsOn(varName)) {
+		std::string newValue = mHeaderText.Evaluate();
 		if (mLastValue != newValue) {
 			mLastValue = newValue;
 			mStart = 0;
@@ -94,6 +94,19 @@ static int gRenderState = RENDER_NORMAL;
 static pthread_mutex_t gRenderStateMutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutexattr_t gRenderStateAttr;
 
+// The render loop runs at up to 30 frames per second while something on the
+// screen is changing, and sleeps once nothing has updated for a while. Input,
+// changes to variables the current page uses, console output and forced
+// renders wake it up again.
+// Objects that only poll their state are still updated once a second.
+#define RENDER_IDLE_FRAMES    60
+#define RENDER_IDLE_TIMEOUT   1
+
+static pthread_mutex_t gRenderWakeMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gRenderWakeCond = PTHREAD_COND_INITIALIZER;
+static int gRenderWakePending = 0;
+static int gRenderIdleFrames = 0;
+
 extern "C" void gr_write_frame_to_file(int fd);
 
 void flip(void)
@@ -108,6 +121,15 @@ void flip(void)
 	gr_flip();
 }
 
+static void flipRegion(const DIRTY_RECT& dirty)
+{
+	// Recordings store whole frames
+	if (gRecorder != -1 || dirty.w == 0)
+		flip();
+	else
+		gr_flip_region(dirty.x, dirty.y, dirty.w, dirty.h);
+}
+
 void rapidxml::parse_error_handler(const char *what, void *where)
 {
 	fprintf(stderr, "Parser error: %s\n", what);
@@ -366,8 +388,37 @@ static void loopTimer(void)
 	} while (1);
 }
 
+// Blocks until something asks for a redraw once the screen has been idle for
+// RENDER_IDLE_FRAMES frames, otherwise returns right away
+static void waitForRenderEvent(void)
+{
+    pthread_mutex_lock(&gRenderWakeMutex);
+    if (!gRenderWakePending && gRenderIdleFrames >= RENDER_IDLE_FRAMES)
+    {
+        timespec timeout;
+        clock_gettime(CLOCK_REALTIME, &timeout);
+        timeout.tv_sec += RENDER_IDLE_TIMEOUT;
+        pthread_cond_timedwait(&gRenderWakeCond, &gRenderWakeMutex, &timeout);
+    }
+    if (gRenderWakePending)
+    {
+        gRenderWakePending = 0;
+        gRenderIdleFrames = 0;
+    }
+    pthread_mutex_unlock(&gRenderWakeMutex);
+}
+
+void gui_wakeRender(void)
+{
+    pthread_mutex_lock(&gRenderWakeMutex);
+    gRenderWakePending = 1;
+    pthread_cond_signal(&gRenderWakeCond);
+    pthread_mutex_unlock(&gRenderWakeMutex);
+}
+
 static inline void doRenderIteration(void)
 {
+    waitForRenderEvent();
     loopTimer ();
 
     pthread_mutex_lock(&gRenderStateMutex);
@@ -375,25 +426,38 @@ static inline void doRenderIteration(void)
     if(gRenderState & RENDER_DISABLE)
     {
         pthread_mutex_unlock(&gRenderStateMutex);
+        if (gRenderIdleFrames < RENDER_IDLE_FRAMES)
+            gRenderIdleFrames++;
         return;
     }
 
+    int ret = 0;
     if(gRenderState == RENDER_NORMAL)
     {
-        int ret = PageManager::Update();
+        DIRTY_RECT dirty = { 0, 0, 0, 0 };
+        ret = PageManager::Update(&dirty);
         if(ret > 1)
+        {
             PageManager::Render();
-        if(ret > 0)
             flip();
+        }
+        else if(ret > 0)
+            flipRegion(dirty);
     }
     else if(gRenderState & RENDER_FORCE)
     {
         gRenderState &= ~(RENDER_FORCE);
         PageManager::Render ();
         flip ();
+        ret = 1;
     }
 
     pthread_mutex_unlock(&gRenderStateMutex);
+
+    if (ret > 0)
+        gRenderIdleFrames = 0;
+    else if (gRenderIdleFrames < RENDER_IDLE_FRAMES)
+        gRenderIdleFrames++;
 }
 
 static void runPageLoop(const std::string& stopVar)
@@ -443,6 +507,7 @@ int gui_forceRender(void)
     pthread_mutex_lock(&gRenderStateMutex);
     gRenderState |= RENDER_FORCE;
     pthread_mutex_unlock(&gRenderStateMutex);
+    gui_wakeRender();
     return 0;
 }
 
@@ -454,6 +519,7 @@ int gui_setRenderEnabled(int enable)
     else
         gRenderState |= RENDER_DISABLE;
     pthread_mutex_unlock(&gRenderStateMutex);
+    gui_wakeRender();
     return 0;
 }
 
@@ -479,43 +545,102 @@ int gui_changePackage(std::string newPackage)
     return 0;
 }
 
-std::string gui_parse_text(string inText)
+void TextTemplate::Compile(const std::string& text)
 {
-    // Copied from std::string GUIText::parseText(void)
-    // This function parses text for DataManager values encompassed by %value% in the XML
-    static int counter = 0;
-    std::string str = inText;
-    size_t pos = 0;
-    size_t next = 0, end = 0;
+    size_t pos = 0, next, end = 0;
+
+    mText = text;
+    mTokens.clear();
+    mVarCount = 0;
 
-    while (1)
+    while (pos < text.size())
     {
-        next = str.find('%', pos);
-        if (next == std::string::npos)
-	    return str;
-        end = str.find('%', next + 1);
-        if (end == std::string::npos)
-	    return str;
+        Token token;
 
-        // We have a block of data
-        std::string var = str.substr(next + 1, (end - next) - 1);
-        str.erase(next, (end - next) + 1);
+        next = text.find('%', pos);
+        if (next != std::string::npos)
+            end = text.find('%', next + 1);
+        if (next == std::string::npos || end == std::string::npos)
+        {
+            // No more blocks, the rest of the text is literal
+            next = end = text.size();
+        }
 
+        token.isVar = false;
+        token.handle = -1;
+        token.text = text.substr(pos, next - pos);
+        // %% is an escaped percent sign
         if (next + 1 == end)
+            token.text += '%';
+        if (!token.text.empty())
         {
-            str.insert(next, 1, '%');
+            if (!mTokens.empty() && !mTokens.back().isVar)
+                mTokens.back().text += token.text;
+            else
+                mTokens.push_back(token);
         }
-        else
+
+        if (end > next + 1 && end < text.size())
         {
-            std::string value;
-            if (DataManager::GetValue(var, value) == 0)
-                str.insert(next, value);
+            token.isVar = true;
+            token.text = text.substr(next + 1, (end - next) - 1);
+            token.handle = DataManager::GetHandle(token.text);
+            mTokens.push_back(token);
+            mVarCount++;
         }
+        pos = end + 1;
+    }
+}
+
+std::string TextTemplate::Evaluate(void) const
+{
+    if (mVarCount == 0)
+        return (mTokens.empty() ? std::string() : mTokens[0].text);
+
+    std::string str, value;
+    std::vector<Token>::const_iterator iter;
+    for (iter = mTokens.begin(); iter != mTokens.end(); ++iter)
+    {
+        if (!iter->isVar)
+            str += iter->text;
+        else if (DataManager::GetValue(iter->handle, value) == 0)
+            str += value;
+    }
+    return str;
+}
+
+bool TextTemplate::DependsOn(const std::string& varName) const
+{
+    if (varName.empty())
+        return mVarCount > 0;
 
-        pos = next + 1;
+    std::vector<Token>::const_iterator iter;
+    for (iter = mTokens.begin(); iter != mTokens.end(); ++iter)
+    {
+        if (iter->isVar && iter->text == varName)
+            return true;
+    }
+    return false;
+}
+
+void TextTemplate::GetVars(std::vector<std::string>& vars) const
+{
+    std::vector<Token>::const_iterator iter;
+    for (iter = mTokens.begin(); iter != mTokens.end(); ++iter)
+    {
+        if (iter->isVar)
+            vars.push_back(iter->text);
     }
 }
 
+std::string gui_parse_text(string inText)
+{
+    // This function parses text for DataManager values encompassed by %value% in the XML
+    if (inText.find('%') == std::string::npos)
+        return inText;
+    return TextTemplate(inText).Evaluate();
+}
+
 extern "C" int gui_init()
 {
     int fd;
@@ -687,6 +812,7 @@ extern "C" int gui_start()
     offmode_charge = DataManager::Pause_For_Battery_Charge();
 
     gGuiConsoleTerminate = 1;
+    gui_wakeRender();
     while (gGuiConsoleRunning)
 	loopTimer();
 
@@ -736,6 +862,7 @@ extern "C" int gui_startPage(const char* page_name)
 	return -1;
 
     gGuiConsoleTerminate = 1;
+    gui_wakeRender();
     while (gGuiConsoleRunning)
 	loopTimer();
 
@@ -590,6 +590,12 @@ int GUIInput::NotifyTouch(TOUCH_STATE state, int x, int y)
 	return 0;
 }
 
+bool GUIInput::GetWatchedVars(std::vector<std::string>& vars)
+{
+	vars.push_back(mVariable);
+	return true;
+}
+
 int GUIInput::NotifyVarChange(std::string varName, std::string value)
 {
 	if (varName == mVariable && !isLocalChange) {
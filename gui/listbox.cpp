@@ -117,7 +117,7 @@ GUIListBox::GUIListBox(xml_node<>* node)
 		}
 	}
 	child = node->first_node("text");
-	if (child)  mHeaderText = child->value();
+	if (child)  mHeaderText.Compile(child->value());
 
 	memset(&mHighlightColor, 0, sizeof(COLOR));
 	child = node->first_node("highlight");
@@ -130,9 +130,8 @@ GUIListBox::GUIListBox(xml_node<>* node)
 		}
 	}
 
-	// Simple way to check for static state
-	mLastValue = gui_parse_text(mHeaderText);
-	if (mLastValue != mHeaderText)
+	mLastValue = mHeaderText.Evaluate();
+	if (!mHeaderText.IsStatic())
 		mHeaderIsStatic = 0;
 	else
 		mHeaderIsStatic = -1;
@@ -531,14 +530,6 @@ int GUIListBox::Render(void)
 int GUIListBox::Update(void)
 {
 	if (!isConditionTrue())     return (mRendered ? 2 : 0);
-	if (!mHeaderIsStatic) {
-		std::string newValue = gui_parse_text(mHeaderText);
-		if (mLastValue != newValue) {
-			mLastValue = newValue;
-			mUpdate = 1;
-		}
-	}
-
 	if (mUpdate)
 	{
 		mUpdate = 0;
@@ -758,10 +749,17 @@ int GUIListBox::NotifyTouch(TOUCH_STATE state, int x, int y)
 	return 0;
 }
 
+bool GUIListBox::GetWatchedVars(std::vector<std::string>& vars)
+{
+	mHeaderText.GetVars(vars);
+	vars.push_back(mVariable);
+	return true;
+}
+
 int GUIListBox::NotifyVarChange(std::string varName, std::string value)
 {
-	if (!mHeaderIsStatic) {
-		std::string newValue = gui_parse_text(mHeaderText);
+	if (!mHeaderIsStatic && mHeaderText.DependsOn(varName)) {
+		std::string newValue = mHeaderText.Evaluate();
 		if (mLastValue != newValue) {
 			mLastValue = newValue;
 			mStart = 0;
@@ -117,6 +117,11 @@ public:
 	//  Returns 0 on success, <0 on error
 	virtual int NotifyVarChange(std::string varName, std::string value) { return 0; }
 
+	// GetWatchedVars - Adds the variables NotifyVarChange reacts to
+	//  Returns false to be notified of every change instead, which is
+	//  what objects that don't override this get
+	virtual bool GetWatchedVars(std::vector<std::string>& vars) { return false; }
+
 protected:
 	int mActionX, mActionY, mActionW, mActionH;
 };
@@ -128,6 +133,7 @@ public:
 
 public:
 	bool IsConditionVariable(std::string var);
+	void GetConditionVars(std::vector<std::string>& vars);
 	bool isConditionTrue();
 	bool isConditionValid();
 	void NotifyPageSet();
@@ -188,6 +194,7 @@ public:
 
 	// Notify of a variable change
 	virtual int NotifyVarChange(std::string varName, std::string value);
+	virtual bool GetWatchedVars(std::vector<std::string>& vars);
 
 	// Set maximum width in pixels
 	virtual int SetMaxWidth(unsigned width);
@@ -199,20 +206,18 @@ public:
 	bool isHighlighted;
 
 protected:
-	std::string mText;
+	TextTemplate mText;
 	std::string mLastValue;
 	COLOR mColor;
 	COLOR mHighlightColor;
 	Resource* mFont;
 	int mIsStatic;
 	int mVarChanged;
+	bool mGetsVarChanges;
 	int mFontHeight;
 	unsigned maxWidth;
 	unsigned charSkip;
 	bool hasHighlightColor;
-
-protected:
-	std::string parseText(void);
 };
 
 // GUIImage - Used for static image
@@ -263,6 +268,7 @@ public:
 	virtual int NotifyTouch(TOUCH_STATE state, int x, int y);
 	virtual int NotifyKey(int key);
 	virtual int NotifyVarChange(std::string varName, std::string value);
+	virtual bool GetWatchedVars(std::vector<std::string>& vars);
 	virtual int doActions();
 	virtual std::string Function_Name();
 
@@ -272,6 +278,8 @@ protected:
 	public:
 		std::string mFunction;
 		std::string mArg;
+		TextTemplate mFunctionTemplate;
+		TextTemplate mArgTemplate;
 	};
 
 	std::vector<Action> mActions;
@@ -279,7 +287,7 @@ protected:
 
 protected:
 	int getKeyByName(std::string key);
-	virtual int doAction(Action action, int isThreaded = 0);
+	virtual int doAction(const Action& action, int isThreaded = 0);
 	static void* thread_start(void *cookie);
 	void simulate_progress_bar(void);
 	int flash_zip(std::string filename, std::string pageName, const int simulate, int* wipe_cache);
@@ -314,6 +322,9 @@ public:
 	//  Return 0 on success, >0 to ignore remainder of touch, and <0 on error (Return error to allow other handlers)
 	virtual int NotifyTouch(TOUCH_STATE state, int x, int y);
 
+	// GetWatchedVars - Nothing here reacts to variable changes
+	virtual bool GetWatchedVars(std::vector<std::string>& vars) { return true; }
+
 protected:
 	enum SlideoutState
 	{
@@ -369,6 +380,10 @@ public:
 	//  Return 0 on success, >0 to ignore remainder of touch, and <0 on error
 	virtual int NotifyTouch(TOUCH_STATE state, int x, int y);
 
+	// NotifyVarChange - Notify of a variable change
+	virtual int NotifyVarChange(std::string varName, std::string value);
+	virtual bool GetWatchedVars(std::vector<std::string>& vars);
+
 protected:
 	GUIImage* mButtonImg;
 	Resource* mButtonIcon;
@@ -408,6 +423,10 @@ public:
 	//  Return 0 on success, >0 to ignore remainder of touch, and <0 on error
 	virtual int NotifyTouch(TOUCH_STATE state, int x, int y);
 
+	// NotifyVarChange - Notify of a variable change
+	virtual int NotifyVarChange(std::string varName, std::string value);
+	virtual bool GetWatchedVars(std::vector<std::string>& vars);
+
 protected:
 	Resource* mChecked;
 	Resource* mUnchecked;
@@ -440,6 +459,7 @@ public:
 
 	// NotifyVarChange - Notify of a variable change
 	virtual int NotifyVarChange(std::string varName, std::string value);
+	virtual bool GetWatchedVars(std::vector<std::string>& vars);
 
 	// SetPos - Update the position of the render object
 	//  Return 0 on success, <0 on error
@@ -475,7 +495,7 @@ protected:
 	std::string mVariable;
 	std::string mSortVariable;
 	std::string mSelection;
-	std::string mHeaderText;
+	TextTemplate mHeaderText;
 	std::string mLastValue;
 	int actualLineHeight;
 	int mStart;
@@ -544,6 +564,7 @@ public:
 
 	// NotifyVarChange - Notify of a variable change
 	virtual int NotifyVarChange(std::string varName, std::string value);
+	virtual bool GetWatchedVars(std::vector<std::string>& vars);
 
 	// SetPos - Update the position of the render object
 	//  Return 0 on success, <0 on error
@@ -567,7 +588,7 @@ protected:
 	std::string mVariable;
 	std::string mSelection;
 	std::string currentValue;
-	std::string mHeaderText;
+	TextTemplate mHeaderText;
 	std::string mLastValue;
 	int actualLineHeight;
 	int mStart;
@@ -633,6 +654,7 @@ public:
 
 	// NotifyVarChange - Notify of a variable change
 	virtual int NotifyVarChange(std::string varName, std::string value);
+	virtual bool GetWatchedVars(std::vector<std::string>& vars);
 
 	// SetPos - Update the position of the render object
 	//  Return 0 on success, <0 on error
@@ -651,7 +673,7 @@ protected:
 	std::string mVariable;
 	std::string selectedList;
 	std::string currentValue;
-	std::string mHeaderText;
+	TextTemplate mHeaderText;
 	std::string mLastValue;
 	int actualLineHeight;
 	int mStart;
@@ -737,6 +759,7 @@ public:
 	// NotifyVarChange - Notify of a variable change
 	//  Returns 0 on success, <0 on error
 	virtual int NotifyVarChange(std::string varName, std::string value);
+	virtual bool GetWatchedVars(std::vector<std::string>& vars);
 
 protected:
 	Resource* mEmptyBar;
@@ -744,6 +767,9 @@ protected:
 	std::string mMinValVar;
 	std::string mMaxValVar;
 	std::string mCurValVar;
+	int mMinValHandle;
+	int mMaxValHandle;
+	int mCurValHandle;
 	float mSlide;
 	float mSlideInc;
 	int mSlideFrames;
@@ -772,6 +798,9 @@ public:
 	//  Return 0 on success, >0 to ignore remainder of touch, and <0 on error
 	virtual int NotifyTouch(TOUCH_STATE state, int x, int y);
 
+	// GetWatchedVars - Nothing here reacts to variable changes
+	virtual bool GetWatchedVars(std::vector<std::string>& vars) { return true; }
+
 protected:
 	GUIAction* sAction;
 	Resource* sSlider;
@@ -810,6 +839,7 @@ public:
 	virtual int Update(void);
 	virtual int NotifyTouch(TOUCH_STATE state, int x, int y);
 	virtual int SetRenderPos(int x, int y, int w = 0, int h = 0);
+	virtual bool GetWatchedVars(std::vector<std::string>& vars) { return true; }
 
 protected:
 	virtual int GetSelection(int x, int y);
@@ -855,6 +885,7 @@ public:
 
 	// Notify of a variable change
 	virtual int NotifyVarChange(std::string varName, std::string value);
+	virtual bool GetWatchedVars(std::vector<std::string>& vars);
 
 	// NotifyTouch - Notify of a touch event
 	//  Return 0 on success, >0 to ignore remainder of touch, and <0 on error
@@ -938,6 +969,7 @@ public:
 
 	// Notify of a variable change
 	virtual int NotifyVarChange(std::string varName, std::string value);
+	virtual bool GetWatchedVars(std::vector<std::string>& vars);
 
 	// SetPageFocus - Notify when a page gains or loses focus
 	virtual void SetPageFocus(int inFocus);
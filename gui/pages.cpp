@@ -34,6 +34,7 @@
 #include <stdlib.h>
 
 #include <string>
+#include <algorithm>
 
 extern "C" {
 #include "../twcommon.h"
@@ -189,9 +190,78 @@ Page::Page(xml_node<>* page, xml_node<>* templates /* = NULL */)
 	// This is a recursive routine for template handling
 	ProcessNode(page, templates);
 
+	BuildVarWatchers();
 	return;
 }
 
+void Page::BuildVarWatchers(void)
+{
+	std::vector<ActionObject*>::iterator iter;
+	std::map<int, std::vector<ActionObject*> >::iterator watchers;
+
+	mVarWatchers.clear();
+	mAllVarWatchers.clear();
+
+	// First pass finds every watched variable, so objects that want all
+	// changes can be slotted into each list in page order
+	for (iter = mActions.begin(); iter != mActions.end(); ++iter)
+	{
+		std::vector<std::string> vars;
+		std::vector<std::string>::iterator var;
+
+		if (!(*iter)->GetWatchedVars(vars))
+			continue;
+		for (var = vars.begin(); var != vars.end(); ++var)
+		{
+			if (!var->empty())
+				mVarWatchers[DataManager::GetHandle(*var)];
+		}
+	}
+
+	for (iter = mActions.begin(); iter != mActions.end(); ++iter)
+	{
+		std::vector<std::string> vars;
+		std::vector<std::string>::iterator var;
+
+		if (!(*iter)->GetWatchedVars(vars))
+		{
+			mAllVarWatchers.push_back(*iter);
+			for (watchers = mVarWatchers.begin(); watchers != mVarWatchers.end(); ++watchers)
+				watchers->second.push_back(*iter);
+			continue;
+		}
+		for (var = vars.begin(); var != vars.end(); ++var)
+		{
+			if (var->empty())
+				continue;
+			std::vector<ActionObject*>& list = mVarWatchers[DataManager::GetHandle(*var)];
+			// Objects may list a variable more than once
+			if (list.empty() || list.back() != *iter)
+				list.push_back(*iter);
+		}
+	}
+}
+
+void Page::AddConditionVars(Conditional* element)
+{
+	std::vector<std::string> vars;
+	std::vector<std::string>::iterator var;
+
+	element->GetConditionVars(vars);
+	for (var = vars.begin(); var != vars.end(); ++var)
+	{
+		if (!var->empty())
+			mConditionVars.insert(DataManager::GetHandle(*var));
+	}
+}
+
+bool Page::UsesVar(const std::string& varName)
+{
+	int handle = DataManager::GetHandle(varName);
+
+	return !mAllVarWatchers.empty() || mVarWatchers.find(handle) != mVarWatchers.end() || mConditionVars.count(handle) != 0;
+}
+
 bool Page::ProcessNode(xml_node<>* page, xml_node<>* templates /* = NULL */, int depth /* = 0 */)
 {
 	if (depth == 10)
@@ -226,11 +296,13 @@ bool Page::ProcessNode(xml_node<>* page, xml_node<>* templates /* = NULL */, int
 			GUIText* element = new GUIText(child);
 			mRenders.push_back(element);
 			mActions.push_back(element);
+			AddConditionVars(element);
 		}
 		else if (type == "image")
 		{
 			GUIImage* element = new GUIImage(child);
 			mRenders.push_back(element);
+			AddConditionVars(element);
 		}
 		else if (type == "fill")
 		{
@@ -253,12 +325,14 @@ bool Page::ProcessNode(xml_node<>* page, xml_node<>* templates /* = NULL */, int
 			GUIButton* element = new GUIButton(child);
 			mRenders.push_back(element);
 			mActions.push_back(element);
+			AddConditionVars(element);
 		}
 		else if (type == "checkbox")
 		{
 			GUICheckbox* element = new GUICheckbox(child);
 			mRenders.push_back(element);
 			mActions.push_back(element);
+			AddConditionVars(element);
 		}
 		else if (type == "fileselector")
 		{
@@ -282,24 +356,28 @@ bool Page::ProcessNode(xml_node<>* page, xml_node<>* templates /* = NULL */, int
 			GUISlider* element = new GUISlider(child);
 			mRenders.push_back(element);
 			mActions.push_back(element);
+			AddConditionVars(element);
 		}
 		else if (type == "slidervalue")
 		{
 			GUISliderValue *element = new GUISliderValue(child);
 			mRenders.push_back(element);
 			mActions.push_back(element);
+			AddConditionVars(element);
 		}
 		else if (type == "listbox")
 		{
 			GUIListBox* element = new GUIListBox(child);
 			mRenders.push_back(element);
 			mActions.push_back(element);
+			AddConditionVars(element);
 		}
 		else if (type == "keyboard")
 		{
 			GUIKeyboard* element = new GUIKeyboard(child);
 			mRenders.push_back(element);
 			mActions.push_back(element);
+			AddConditionVars(element);
 		}
 		else if (type == "input")
 		{
@@ -307,6 +385,7 @@ bool Page::ProcessNode(xml_node<>* page, xml_node<>* templates /* = NULL */, int
 			mRenders.push_back(element);
 			mActions.push_back(element);
 			mInputs.push_back(element);
+			AddConditionVars(element);
 		}
 		else if (type == "partitionlist")
 		{
@@ -369,7 +448,35 @@ int Page::Render(void)
 	return 0;
 }
 
-int Page::Update(void)
+static void AddDirtyRect(DIRTY_RECT* dirty, int x, int y, int w, int h)
+{
+	// Objects without a known size could have drawn anywhere
+	if (w <= 0 || h <= 0)
+	{
+		x = 0;
+		y = 0;
+		w = gr_fb_width();
+		h = gr_fb_height();
+	}
+
+	if (dirty->w == 0)
+	{
+		dirty->x = x;
+		dirty->y = y;
+		dirty->w = w;
+		dirty->h = h;
+		return;
+	}
+
+	int x2 = std::max(dirty->x + dirty->w, x + w);
+	int y2 = std::max(dirty->y + dirty->h, y + h);
+	dirty->x = std::min(dirty->x, x);
+	dirty->y = std::min(dirty->y, y);
+	dirty->w = x2 - dirty->x;
+	dirty->h = y2 - dirty->y;
+}
+
+int Page::Update(DIRTY_RECT* dirty)
 {
 	int retCode = 0;
 
@@ -381,6 +488,14 @@ int Page::Update(void)
 			LOGERR("An update request has failed.\n");
 		else if (ret > retCode)
 			retCode = ret;
+
+		// The object drew itself, remember where so only that area is flipped
+		if (ret == 1 && dirty)
+		{
+			int x, y, w, h;
+			(*iter)->GetRenderPos(x, y, w, h);
+			AddDirtyRect(dirty, x, y, w, h);
+		}
 	}
 
 	return retCode;
@@ -497,12 +612,22 @@ void Page::SetPageFocus(int inFocus)
 int Page::NotifyVarChange(std::string varName, std::string value)
 {
 	std::vector<ActionObject*>::iterator iter;
+	std::vector<ActionObject*>* list = &mActions;
 
 	// Don't try to handle a lack of handlers
 	if (mActions.size() == 0)
 		return 1;
 
-	for (iter = mActions.begin(); iter != mActions.end(); ++iter)
+	// A page change (empty name) goes to everyone, anything else only to
+	// the objects that watch the variable
+	if (!varName.empty())
+	{
+		std::map<int, std::vector<ActionObject*> >::iterator watchers;
+		watchers = mVarWatchers.find(DataManager::GetHandle(varName));
+		list = (watchers != mVarWatchers.end() ? &watchers->second : &mAllVarWatchers);
+	}
+
+	for (iter = list->begin(); iter != list->end(); ++iter)
 	{
 		if ((*iter)->NotifyVarChange(varName, value))
 			LOGERR("An action handler errored on NotifyVarChange.\n");
@@ -674,15 +799,15 @@ int PageSet::Render(void)
 	return ret;
 }
 
-int PageSet::Update(void)
+int PageSet::Update(DIRTY_RECT* dirty)
 {
-	int ret;
+	int ret, overlayRet;
 
-	ret = (mCurrentPage ? mCurrentPage->Update() : -1);
-	if (ret < 0 || ret > 1)
+	ret = (mCurrentPage ? mCurrentPage->Update(dirty) : -1);
+	if (ret < 0 || ret > 1 || !mOverlayPage)
 		return ret;
-	ret = (mOverlayPage ? mOverlayPage->Update() : -1);
-	return ret;
+	overlayRet = mOverlayPage->Update(dirty);
+	return (overlayRet < 0 || overlayRet > ret ? overlayRet : ret);
 }
 
 int PageSet::NotifyTouch(TOUCH_STATE state, int x, int y)
@@ -725,6 +850,14 @@ int PageSet::NotifyVarChange(std::string varName, std::string value)
 	return (mCurrentPage ? mCurrentPage->NotifyVarChange(varName, value) : -1);
 }
 
+bool PageSet::UsesVar(const std::string& varName)
+{
+	if (mOverlayPage && mOverlayPage->UsesVar(varName))
+		return true;
+
+	return (mCurrentPage ? mCurrentPage->UsesVar(varName) : false);
+}
+
 int PageManager::LoadPackage(std::string name, std::string package, std::string startpage)
 {
 	int fd;
@@ -944,27 +1077,30 @@ int PageManager::Render(void)
 	return (mCurrentSet ? mCurrentSet->Render() : -1);
 }
 
-int PageManager::Update(void)
+int PageManager::Update(DIRTY_RECT* dirty)
 {
 #ifndef TW_NO_SCREEN_TIMEOUT
 	if(blankTimer.IsScreenOff())
 		return 0;
 #endif
-	return (mCurrentSet ? mCurrentSet->Update() : -1);
+	return (mCurrentSet ? mCurrentSet->Update(dirty) : -1);
 }
 
 int PageManager::NotifyTouch(TOUCH_STATE state, int x, int y)
 {
+	gui_wakeRender();
 	return (mCurrentSet ? mCurrentSet->NotifyTouch(state, x, y) : -1);
 }
 
 int PageManager::NotifyKey(int key)
 {
+	gui_wakeRender();
 	return (mCurrentSet ? mCurrentSet->NotifyKey(key) : -1);
 }
 
 int PageManager::NotifyKeyboard(int key)
 {
+	gui_wakeRender();
 	return (mCurrentSet ? mCurrentSet->NotifyKeyboard(key) : -1);
 }
 
@@ -978,10 +1114,19 @@ int PageManager::NotifyVarChange(std::string varName, std::string value)
 	return (mCurrentSet ? mCurrentSet->NotifyVarChange(varName, value) : -1);
 }
 
+bool PageManager::UsesVar(const std::string& varName)
+{
+	return (mCurrentSet ? mCurrentSet->UsesVar(varName) : false);
+}
+
 extern "C" void gui_notifyVarChange(const char *name, const char* value)
 {
 	if (!gGuiRunning)
 		return;
 
 	PageManager::NotifyVarChange(name, value);
+	// Variables nothing on the screen uses, like the clock on most pages,
+	// must not keep the render loop from going idle
+	if (PageManager::UsesVar(name))
+		gui_wakeRender();
 }
@@ -3,6 +3,11 @@
 #ifndef _PAGES_HEADER_HPP
 #define _PAGES_HEADER_HPP
 
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
 #ifdef HAVE_SELINUX
 #include "../minzip/Zip.h"
 #else
@@ -16,19 +21,62 @@ typedef struct {
 	unsigned char alpha;
 } COLOR;
 
+// Area of the screen redrawn by objects during an update, empty when w is 0
+typedef struct {
+	int x;
+	int y;
+	int w;
+	int h;
+} DIRTY_RECT;
+
 // Utility Functions
 int ConvertStrToColor(std::string str, COLOR* color);
 int gui_forceRender(void);
+void gui_wakeRender(void);
 int gui_setRenderEnabled(int enable);
 int gui_changePage(std::string newPage);
 int gui_changeOverlay(std::string newPage);
 std::string gui_parse_text(string inText);
 
+// TextTemplate - Text with DataManager values encompassed by %value%, split
+// into literal and variable tokens once so it can be evaluated cheaply
+class TextTemplate
+{
+public:
+	TextTemplate() { mVarCount = 0; }
+	TextTemplate(const std::string& text) { Compile(text); }
+
+public:
+	void Compile(const std::string& text);
+	std::string Evaluate(void) const;
+
+	// True if the text has no variables, so Evaluate always returns the same value
+	bool IsStatic(void) const { return mVarCount == 0; }
+	// True if varName is used by the text; an empty name means any variable
+	bool DependsOn(const std::string& varName) const;
+	// Adds the names of the variables used by the text
+	void GetVars(std::vector<std::string>& vars) const;
+	const std::string& GetText(void) const { return mText; }
+
+protected:
+	struct Token
+	{
+		bool isVar;
+		std::string text;  // literal text or variable name
+		int handle;        // DataManager handle of the variable
+	};
+
+	std::string mText;
+	std::vector<Token> mTokens;
+	int mVarCount;
+};
+
 class Resource;
 class ResourceManager;
 class RenderObject;
 class ActionObject;
 class InputObject;
+class Conditional;
 
 class Page
 {
@@ -41,13 +89,15 @@ public:
 
 public:
 	virtual int Render(void);
-	virtual int Update(void);
+	virtual int Update(DIRTY_RECT* dirty = NULL);
 	virtual int NotifyTouch(TOUCH_STATE state, int x, int y);
 	virtual int NotifyKey(int key);
 	virtual int NotifyKeyboard(int key);
 	virtual int SetKeyBoardFocus(int inFocus);
 	virtual int NotifyVarChange(std::string varName, std::string value);
 	virtual void SetPageFocus(int inFocus);
+	// True if anything on the page reacts to or shows the variable
+	bool UsesVar(const std::string& varName);
 
 protected:
 	std::string mName;
@@ -55,11 +105,20 @@ protected:
 	std::vector<ActionObject*> mActions;
 	std::vector<InputObject*> mInputs;
 
+	// Action objects to notify for a variable, by DataManager handle
+	std::map<int, std::vector<ActionObject*> > mVarWatchers;
+	// Action objects that want every variable change
+	std::vector<ActionObject*> mAllVarWatchers;
+	// Variables in the conditions of the page's objects, which are checked when they update
+	std::set<int> mConditionVars;
+
 	ActionObject* mTouchStart;
 	COLOR mBackground;
 
 protected:
 	bool ProcessNode(xml_node<>* page, xml_node<>* templates = NULL, int depth = 0);
+	void BuildVarWatchers(void);
+	void AddConditionVars(Conditional* element);
 };
 
 class PageSet
@@ -82,12 +141,13 @@ public:
 
 	// These are routing routines
 	int Render(void);
-	int Update(void);
+	int Update(DIRTY_RECT* dirty = NULL);
 	int NotifyTouch(TOUCH_STATE state, int x, int y);
 	int NotifyKey(int key);
 	int NotifyKeyboard(int key);
 	int SetKeyBoardFocus(int inFocus);
 	int NotifyVarChange(std::string varName, std::string value);
+	bool UsesVar(const std::string& varName);
 
 protected:
 	int LoadPages(xml_node<>* pages, xml_node<>* templates = NULL);
@@ -126,12 +186,14 @@ public:
 
 	// These are routing routines
 	static int Render(void);
-	static int Update(void);
+	static int Update(DIRTY_RECT* dirty = NULL);
 	static int NotifyTouch(TOUCH_STATE state, int x, int y);
 	static int NotifyKey(int key);
 	static int NotifyKeyboard(int key);
 	static int SetKeyBoardFocus(int inFocus);
 	static int NotifyVarChange(std::string varName, std::string value);
+	// True if the current page or overlay reacts to or shows the variable
+	static bool UsesVar(const std::string& varName);
 
 protected:
 	static PageSet* FindPackage(std::string name);
@@ -118,7 +118,7 @@ GUIPartitionList::GUIPartitionList(xml_node<>* node)
 		}
 	}
 	child = node->first_node("text");
-	if (child)  mHeaderText = child->value();
+	if (child)  mHeaderText.Compile(child->value());
 
 	memset(&mHighlightColor, 0, sizeof(COLOR));
 	child = node->first_node("highlight");
@@ -131,9 +131,8 @@ GUIPartitionList::GUIPartitionList(xml_node<>* node)
 		}
 	}
 
-	// Simple way to check for static state
-	mLastValue = gui_parse_text(mHeaderText);
-	if (mLastValue != mHeaderText)
+	mLastValue = mHeaderText.Evaluate();
+	if (!mHeaderText.IsStatic())
 		mHeaderIsStatic = 0;
 	else
 		mHeaderIsStatic = -1;
@@ -525,14 +524,6 @@ int GUIPartitionList::Render(void)
 
 int GUIPartitionList::Update(void)
 {
-	if (!mHeaderIsStatic) {
-		std::string newValue = gui_parse_text(mHeaderText);
-		if (mLastValue != newValue) {
-			mLastValue = newValue;
-			mUpdate = 1;
-		}
-	}
-
 	// Check for changes in mount points if the list type is mount and update the list and render if needed
 	if (ListType == "mount") {
 		int listSize = mList.size();
@@ -814,10 +805,17 @@ int GUIPartitionList::NotifyTouch(TOUCH_STATE state, int x, int y)
 	return 0;
 }
 
+bool GUIPartitionList::GetWatchedVars(std::vector<std::string>& vars)
+{
+	mHeaderText.GetVars(vars);
+	vars.push_back(mVariable);
+	return true;
+}
+
 int GUIPartitionList::NotifyVarChange(std::string varName, std::string value)
 {
-	if (!mHeaderIsStatic) {
-		std::string newValue = gui_parse_text(mHeaderText);
+	if (!mHeaderIsStatic && mHeaderText.DependsOn(varName)) {
+		std::string newValue = mHeaderText.Evaluate();
 		if (mLastValue != newValue) {
 			mLastValue = newValue;
 			mStart = 0;
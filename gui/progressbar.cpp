@@ -35,6 +35,7 @@ GUIProgressBar::GUIProgressBar(xml_node<>* node)
 	mLastPos = 0;
 	mSlide = 0.0;
 	mSlideInc = 0.0;
+	mSlideFrames = 0;
 
 	if (!node)
 	{
@@ -71,6 +72,14 @@ GUIProgressBar::GUIProgressBar(xml_node<>* node)
 		if (attr)   mCurValVar = attr->value();
 	}
 
+	// min and max may be numbers instead of variable names
+	mMinValHandle = mMaxValHandle = -1;
+	if (!mMinValVar.empty() && atoi(mMinValVar.c_str()) == 0)
+		mMinValHandle = DataManager::GetHandle(mMinValVar);
+	if (!mMaxValVar.empty() && atoi(mMaxValVar.c_str()) == 0)
+		mMaxValHandle = DataManager::GetHandle(mMaxValVar);
+	mCurValHandle = DataManager::GetHandle(mCurValVar);
+
 	if (mEmptyBar && mEmptyBar->GetResource())
 	{
 		mRenderW = gr_get_width(mEmptyBar->GetResource());
@@ -102,36 +111,23 @@ int GUIProgressBar::RenderInternal(void)
 
 int GUIProgressBar::Update(void)
 {
-	std::string str;
 	int min, max, cur, pos;
 
 	if (mMinValVar.empty())
 		min = 0;
+	else if (mMinValHandle < 0)
+		min = atoi(mMinValVar.c_str());
 	else
-	{
-		str.clear();
-		if (atoi(mMinValVar.c_str()) != 0)
-			str = mMinValVar;
-		else
-			DataManager::GetValue(mMinValVar, str);
-		min = atoi(str.c_str());
-	}
+		min = DataManager::GetIntValue(mMinValHandle);
 
 	if (mMaxValVar.empty())
 		max = 100;
+	else if (mMaxValHandle < 0)
+		max = atoi(mMaxValVar.c_str());
 	else
-	{
-		str.clear();
-		if (atoi(mMaxValVar.c_str()) != 0)
-			str = mMaxValVar;
-		else
-			DataManager::GetValue(mMaxValVar, str);
-		max = atoi(str.c_str());
-	}
+		max = DataManager::GetIntValue(mMaxValHandle);
 
-	str.clear();
-	DataManager::GetValue(mCurValVar, str);
-	cur = atoi(str.c_str());
+	cur = DataManager::GetIntValue(mCurValHandle);
 
 	// Do slide, if needed
 	if (mSlideFrames)
@@ -141,7 +137,7 @@ int GUIProgressBar::Update(void)
 		if (cur != (int) mSlide)
 		{
 			cur = (int) mSlide;
-			DataManager::SetValue(mCurValVar, cur);
+			DataManager::SetValue(mCurValHandle, cur);
 		}
 	}
 
@@ -156,8 +152,10 @@ int GUIProgressBar::Update(void)
 	if (max == 0)   pos = 0;
 	else            pos = (cur * mRenderW) / max;
 
+	// The slide steps once per rendered frame, so keep the render loop
+	// awake until it is done or it would crawl at the idle rate
 	if (pos == mLastPos)
-		return 0;
+		return (mSlideFrames > 0 ? 1 : 0);
 
 	mLastPos = pos;
 
@@ -166,6 +164,13 @@ int GUIProgressBar::Update(void)
 	return 2;
 }
 
+bool GUIProgressBar::GetWatchedVars(std::vector<std::string>& vars)
+{
+	vars.push_back("ui_progress_portion");
+	vars.push_back("ui_progress_frames");
+	return true;
+}
+
 int GUIProgressBar::NotifyVarChange(std::string varName, std::string value)
 {
 	static int nextPush = 0;
@@ -176,6 +181,7 @@ int GUIProgressBar::NotifyVarChange(std::string varName, std::string value)
 		mLastPos = 0;
 		mSlide = 0.0;
 		mSlideInc = 0.0;
+		mSlideFrames = 0;
 		return 0;
 	}
 
@@ -188,7 +194,7 @@ int GUIProgressBar::NotifyVarChange(std::string varName, std::string value)
 		{
 			mSlide += (mSlideInc * mSlideFrames);
 			cur = (int) mSlide;
-			DataManager::SetValue(mCurValVar, cur);
+			DataManager::SetValue(mCurValHandle, cur);
 			mSlideFrames = 0;
 		}
 
@@ -196,7 +202,7 @@ int GUIProgressBar::NotifyVarChange(std::string varName, std::string value)
 		{
 			mSlide += nextPush;
 			cur = (int) mSlide;
-			DataManager::SetValue(mCurValVar, cur);
+			DataManager::SetValue(mCurValHandle, cur);
 			nextPush = 0;
 		}
 
@@ -396,6 +396,14 @@ int GUISliderValue::NotifyTouch(TOUCH_STATE state, int x, int y)
 	return 0;
 }
 
+bool GUISliderValue::GetWatchedVars(std::vector<std::string>& vars)
+{
+	if (mLabel)
+		mLabel->GetWatchedVars(vars);
+	vars.push_back(mVariable);
+	return true;
+}
+
 int GUISliderValue::NotifyVarChange(std::string varName, std::string value)
 {
 	if (mLabel)
@@ -34,6 +34,7 @@ GUIText::GUIText(xml_node<>* node)
 	mFont = NULL;
 	mIsStatic = 1;
 	mVarChanged = 0;
+	mGetsVarChanges = false;
 	mFontHeight = 0;
 	maxWidth = 0;
 	charSkip = 0;
@@ -91,11 +92,10 @@ GUIText::GUIText(xml_node<>* node)
 	LoadPlacement(node->first_node("placement"), &mRenderX, &mRenderY, &mRenderW, &mRenderH, &mPlacement);
 
 	child = node->first_node("text");
-	if (child)  mText = child->value();
+	if (child)  mText.Compile(child->value());
 
-	// Simple way to check for static state
-	mLastValue = parseText();
-	if (mLastValue != mText)   mIsStatic = 0;
+	mLastValue = mText.Evaluate();
+	if (!mText.IsStatic())   mIsStatic = 0;
 
 	gr_getFontDetails(mFont ? mFont->GetResource() : NULL, (unsigned*) &mFontHeight, NULL);
 	return;
@@ -112,7 +112,7 @@ int GUIText::Render(void)
 	if (mFont)
 		fontResource = mFont->GetResource();
 
-	mLastValue = parseText();
+	mLastValue = mText.Evaluate();
 	displayValue = mLastValue;
 
 	if (charSkip)
@@ -157,18 +157,23 @@ int GUIText::Update(void)
 
 	static int updateCounter = 3;
 
-	// This hack just makes sure we update at least once a minute for things like clock and battery
-	if (updateCounter)  updateCounter--;
-	else
+	// Labels inside other objects never see NotifyVarChange, so they still
+	// have to poll for things like clock and battery
+	if (!mGetsVarChanges)
 	{
-		mVarChanged = 1;
-		updateCounter = 3;
+		if (updateCounter)  updateCounter--;
+		else
+		{
+			mVarChanged = 1;
+			updateCounter = 3;
+		}
 	}
 
 	if (mIsStatic || !mVarChanged)
 		return 0;
 
-	std::string newValue = parseText();
+	mVarChanged = 0;
+	std::string newValue = mText.Evaluate();
 	if (mLastValue == newValue)
 		return 0;
 	else
@@ -184,48 +189,23 @@ int GUIText::GetCurrentBounds(int& w, int& h)
 		fontResource = mFont->GetResource();
 
 	h = mFontHeight;
-	mLastValue = parseText();
+	mLastValue = mText.Evaluate();
 	w = gr_measureEx(mLastValue.c_str(), fontResource);
 	return 0;
 }
 
-std::string GUIText::parseText(void)
+int GUIText::NotifyVarChange(std::string varName, std::string value)
 {
-	static int counter = 0;
-	std::string str = mText;
-	size_t pos = 0;
-	size_t next = 0, end = 0;
-
-	while (1)
-	{
-		next = str.find('%', pos);
-		if (next == std::string::npos) return str;
-		end = str.find('%', next + 1);
-		if (end == std::string::npos) return str;
-
-		// We have a block of data
-		std::string var = str.substr(next + 1, (end - next) - 1);
-		str.erase(next, (end - next) + 1);
-
-		if (next + 1 == end)
-		{
-			str.insert(next, 1, '%');
-		}
-		else
-		{
-			std::string value;
-			if (DataManager::GetValue(var, value) == 0)
-				str.insert(next, value);
-		}
-
-		pos = next + 1;
-	}
+	mGetsVarChanges = true;
+	if (mText.DependsOn(varName))
+		mVarChanged = 1;
+	return 0;
 }
 
-int GUIText::NotifyVarChange(std::string varName, std::string value)
+bool GUIText::GetWatchedVars(std::vector<std::string>& vars)
 {
-	mVarChanged = 1;
-	return 0;
+	mText.GetVars(vars);
+	return true;
 }
 
 int GUIText::SetMaxWidth(unsigned width)
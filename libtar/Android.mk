@@ -21,6 +21,10 @@ else
 	LOCAL_CFLAGS += -DTAR_DEBUG_SUPPRESS
 endif
 
+ifeq ($(TW_TAR_FALLOCATE), true)
+	LOCAL_CFLAGS += -DHAVE_FALLOCATE
+endif
+
 ifeq ($(TWHAVE_SELINUX), true)
 	LOCAL_C_INCLUDES += external/libselinux/include
 	LOCAL_SHARED_LIBRARIES += libselinux
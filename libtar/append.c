@@ -50,6 +50,18 @@ void tar_dev_free(tar_dev_t *tdp) {
 /* appends a file to the tar archive */
 int tar_append_file(TAR *t, char *realname, char *savename) {
 	struct stat s;
+
+	if (lstat(realname, &s) != 0) {
+#ifdef DEBUG_APPEND
+		perror("lstat()");
+#endif
+		return -1;
+	}
+	return tar_append_file_stat(t, realname, savename, &s);
+}
+
+/* appends a file to the tar archive using the caller's lstat() result */
+int tar_append_file_stat(TAR *t, char *realname, char *savename, struct stat *s) {
 	int i;
 	libtar_hashptr_t hp;
 	tar_dev_t *td = NULL;
@@ -62,19 +74,12 @@ int tar_append_file(TAR *t, char *realname, char *savename) {
 	       (savename ? savename : "[NULL]"));
 #endif
 
-	if (lstat(realname, &s) != 0) {
-#ifdef DEBUG_APPEND
-		perror("lstat()");
-#endif
-		return -1;
-	}
-
 	/* set header block */
 #ifdef DEBUG_APPEND
 	puts("    tar_append_file(): setting header block...");
 #endif
 	memset(&(t->th_buf), 0, sizeof(struct tar_header));
-	th_set_from_stat(t, &s);
+	th_set_from_stat(t, s);
 
 	/* set the header path */
 #ifdef DEBUG_APPEND
@@ -111,15 +116,15 @@ int tar_append_file(TAR *t, char *realname, char *savename) {
 	puts("    tar_append_file(): checking inode cache for hardlink...");
 #endif
 	libtar_hashptr_reset(&hp);
-	if (libtar_hash_getkey(t->h, &hp, &(s.st_dev), (libtar_matchfunc_t)dev_match) != 0)
+	if (libtar_hash_getkey(t->h, &hp, &(s->st_dev), (libtar_matchfunc_t)dev_match) != 0)
 		td = (tar_dev_t *)libtar_hashptr_data(&hp);
 	else {
 #ifdef DEBUG_APPEND
 		printf("+++ adding hash for device (0x%lx, 0x%lx)...\n",
-		       major(s.st_dev), minor(s.st_dev));
+		       major(s->st_dev), minor(s->st_dev));
 #endif
 		td = (tar_dev_t *)calloc(1, sizeof(tar_dev_t));
-		td->td_dev = s.st_dev;
+		td->td_dev = s->st_dev;
 		td->td_h = libtar_hash_new(256, (libtar_hashfunc_t)ino_hash);
 		if (td->td_h == NULL)
 			return -1;
@@ -127,7 +132,7 @@ int tar_append_file(TAR *t, char *realname, char *savename) {
 			return -1;
 	}
 	libtar_hashptr_reset(&hp);
-	if (libtar_hash_getkey(td->td_h, &hp, &(s.st_ino), (libtar_matchfunc_t)ino_match) != 0) {
+	if (libtar_hash_getkey(td->td_h, &hp, &(s->st_ino), (libtar_matchfunc_t)ino_match) != 0) {
 		ti = (tar_ino_t *)libtar_hashptr_data(&hp);
 #ifdef DEBUG_APPEND
 		printf("    tar_append_file(): encoding hard link \"%s\" "
@@ -138,13 +143,13 @@ int tar_append_file(TAR *t, char *realname, char *savename) {
 	} else {
 #ifdef DEBUG_APPEND
 		printf("+++ adding entry: device (0x%lx,0x%lx), inode %ld "
-		       "(\"%s\")...\n", major(s.st_dev), minor(s.st_dev),
-		       s.st_ino, realname);
+		       "(\"%s\")...\n", major(s->st_dev), minor(s->st_dev),
+		       s->st_ino, realname);
 #endif
 		ti = (tar_ino_t *)calloc(1, sizeof(tar_ino_t));
 		if (ti == NULL)
 			return -1;
-		ti->ti_ino = s.st_ino;
+		ti->ti_ino = s->st_ino;
 		snprintf(ti->ti_name, sizeof(ti->ti_name), "%s", savename ? savename : realname);
 		libtar_hash_add(td->td_h, ti);
 	}
@@ -212,9 +217,10 @@ int tar_append_eof(TAR *t) {
 /* add file contents to a tarchive */
 int tar_append_regfile(TAR *t, char *realname) {
 	char block[T_BLOCKSIZE];
+	char *buf = block;
 	int filefd;
-	int i, j;
-	size_t size;
+	ssize_t i;
+	size_t size, left, len, bufsize;
 
 	filefd = open(realname, O_RDONLY);
 	if (filefd == -1) {
@@ -225,29 +231,83 @@ int tar_append_regfile(TAR *t, char *realname) {
 	}
 
 	size = th_get_size(t);
-	for (i = size; i > T_BLOCKSIZE; i -= T_BLOCKSIZE) {
-		j = read(filefd, &block, T_BLOCKSIZE);
-		if (j != T_BLOCKSIZE) {
-			if (j != -1)
+	left = size;
+
+	/* let the archive pull the data in if it can, e.g. with sendfile() */
+	if (t->type->sendfunc != NULL && size > T_BLOCKSIZE) {
+		i = (*(t->type->sendfunc))(t->fd, filefd, size);
+		if (i == (ssize_t)size)
+			left = 0;
+		else if (i != -1 || errno != ENOSYS) {
+			if (i != -1)
 				errno = EINVAL;
+			close(filefd);
 			return -1;
 		}
-		if (tar_block_write(t, &block) == -1)
-			return -1;
 	}
 
-	if (i > 0) {
-		j = read(filefd, &block, i);
-		if (j == -1)
-			return -1;
-		memset(&(block[i]), 0, T_BLOCKSIZE - i);
-		if (tar_block_write(t, &block) == -1)
+	if (left == 0) {
+		/* only the padding of the last block is left */
+		if (size % T_BLOCKSIZE) {
+			len = T_BLOCKSIZE - size % T_BLOCKSIZE;
+			memset(block, 0, len);
+			if ((*(t->type->writefunc))(t->fd, block, len) != (ssize_t)len) {
+				close(filefd);
+				return -1;
+			}
+		}
+		close(filefd);
+		return 0;
+	}
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(filefd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	bufsize = (left + T_BLOCKSIZE - 1) / T_BLOCKSIZE * T_BLOCKSIZE;
+	if (bufsize > T_APPEND_BUFSIZE)
+		bufsize = T_APPEND_BUFSIZE;
+	if (bufsize > T_BLOCKSIZE) {
+		buf = (char *)malloc(bufsize);
+		if (buf == NULL) {
+			close(filefd);
+			errno = ENOMEM;
 			return -1;
+		}
 	}
 
-	close(filefd);
+	while (left > 0) {
+		len = (left < bufsize ? left : bufsize);
+		for (i = 0; i < (ssize_t)len; ) {
+			ssize_t j = read(filefd, buf + i, len - i);
+			if (j <= 0) {
+				if (j == -1 && errno == EINTR)
+					continue;
+				/* the file got shorter than its header says */
+				if (j == 0)
+					errno = EINVAL;
+				goto fail;
+			}
+			i += j;
+		}
+		left -= len;
+		if (len % T_BLOCKSIZE) {
+			memset(buf + len, 0, T_BLOCKSIZE - len % T_BLOCKSIZE);
+			len += T_BLOCKSIZE - len % T_BLOCKSIZE;
+		}
+		if ((*(t->type->writefunc))(t->fd, buf, len) != (ssize_t)len)
+			goto fail;
+	}
 
+	if (buf != block)
+		free(buf);
+	close(filefd);
 	return 0;
+
+fail:
+	if (buf != block)
+		free(buf);
+	close(filefd);
+	return -1;
 }
 
 
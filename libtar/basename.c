@@ -32,16 +32,39 @@ static char rcsid[] = "$OpenBSD: basename.c,v 1.4 1999/05/30 17:10:30 espie Exp
 #endif /* not lint */
 
 #include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/param.h>
 
+/* Per-thread result buffer, see openbsd_dirname() */
+static pthread_key_t bname_key;
+static pthread_once_t bname_once = PTHREAD_ONCE_INIT;
+
+static void
+bname_key_init(void)
+{
+	(void)pthread_key_create(&bname_key, free);
+}
+
 char *
 openbsd_basename(path)
 	const char *path;
 {
-	static char bname[MAXPATHLEN];
+	char *bname;
 	register const char *endp, *startp;
 
+	(void)pthread_once(&bname_once, bname_key_init);
+	bname = pthread_getspecific(bname_key);
+	if (bname == NULL) {
+		bname = malloc(MAXPATHLEN);
+		if (bname == NULL || pthread_setspecific(bname_key, bname) != 0) {
+			free(bname);
+			errno = ENOMEM;
+			return(NULL);
+		}
+	}
+
 	/* Empty or NULL string gets treated as "." */
 	if (path == NULL || *path == '\0') {
 		(void)strcpy(bname, ".");
@@ -64,7 +87,7 @@ openbsd_basename(path)
 	while (startp > path && *(startp - 1) != '/')
 		startp--;
 
-	if (endp - startp + 1 > sizeof(bname)) {
+	if (endp - startp + 1 > MAXPATHLEN) {
 		errno = ENAMETOOLONG;
 		return(NULL);
 	}
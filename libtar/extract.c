@@ -221,20 +221,68 @@ tar_extract_file(TAR *t, char *realname, char *prefix)
 }
 
 
+/* read exactly len bytes of file data from the archive */
+static int
+tar_data_read(TAR *t, char *buf, size_t len)
+{
+	ssize_t k;
+
+	while (len > 0)
+	{
+		k = (*(t->type->readfunc))(t->fd, buf, len);
+		if (k <= 0)
+		{
+			if (k == -1 && errno == EINTR)
+				continue;
+			if (k != -1)
+				errno = EINVAL;
+			return -1;
+		}
+		buf += k;
+		len -= k;
+	}
+
+	return 0;
+}
+
+
+/* write all of buf to fd */
+static int
+tar_data_write(int fd, const char *buf, size_t len)
+{
+	ssize_t k;
+
+	while (len > 0)
+	{
+		k = write(fd, buf, len);
+		if (k == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += k;
+		len -= k;
+	}
+
+	return 0;
+}
+
+
 /* extract regular file */
 int
 tar_extract_regfile(TAR *t, char *realname)
 {
 	//mode_t mode;
-	size_t size;
+	size_t size, left, len, bufsize;
 	//uid_t uid;
 	//gid_t gid;
 	int fdout;
-	int i, k;
-	char buf[T_BLOCKSIZE];
+	ssize_t k;
+	char block[T_BLOCKSIZE];
+	char *buf = block;
 	char *filename;
 
-	fflush(NULL);
 #ifdef TAR_DEBUG_VERBOSE
 	printf("==> tar_extract_regfile(t=0x%lx, realname=\"%s\")\n", t,
 	       realname);
@@ -294,23 +342,66 @@ tar_extract_regfile(TAR *t, char *realname)
 	}
 #endif
 
-	/* extract the file */
-	for (i = size; i > 0; i -= T_BLOCKSIZE)
+#ifdef HAVE_FALLOCATE
+	/* reserve the blocks up front so large files end up contiguous;
+	   filesystems that can't do this just get the data written */
+	if (size > T_BLOCKSIZE)
+		fallocate(fdout, 0, 0, size);
+#endif
+
+	left = size;
+
+	/* let the archive copy the data itself if it can, e.g. with sendfile() */
+	if (t->type->recvfunc != NULL && size > T_BLOCKSIZE)
 	{
-		k = tar_block_read(t, buf);
-		if (k != T_BLOCKSIZE)
+		k = (*(t->type->recvfunc))(t->fd, fdout, size);
+		if (k == (ssize_t)size)
+			left = 0;
+		else if (k != -1 || errno != ENOSYS)
 		{
 			if (k != -1)
 				errno = EINVAL;
-			return -1;
+			goto fail;
 		}
 
-		/* write block to output file */
-		if (write(fdout, buf,
-			  ((i > T_BLOCKSIZE) ? T_BLOCKSIZE : i)) == -1)
-			return -1;
+		/* skip the padding of the last block */
+		if (left == 0 && size % T_BLOCKSIZE)
+		{
+			if (tar_data_read(t, block, T_BLOCKSIZE - size % T_BLOCKSIZE) == -1)
+				goto fail;
+		}
+	}
+
+	bufsize = (size + T_BLOCKSIZE - 1) & ~(size_t)(T_BLOCKSIZE - 1);
+	if (bufsize > T_EXTRACT_BUFSIZE)
+		bufsize = T_EXTRACT_BUFSIZE;
+	if (left > 0 && bufsize > T_BLOCKSIZE)
+	{
+		buf = (char *)malloc(bufsize);
+		if (buf == NULL)
+			goto fail;
 	}
 
+	/* extract the file, a whole number of blocks per read */
+	while (left > 0)
+	{
+		len = (left + T_BLOCKSIZE - 1) & ~(size_t)(T_BLOCKSIZE - 1);
+		if (len > bufsize)
+			len = bufsize;
+		if (tar_data_read(t, buf, len) == -1)
+			goto fail;
+
+		/* write chunk to output file */
+		if (len > left)
+			len = left;
+		if (tar_data_write(fdout, buf, len) == -1)
+			goto fail;
+		left -= len;
+	}
+
+	if (buf != block)
+		free(buf);
+
 	/* close output file */
 	if (close(fdout) == -1)
 		return -1;
@@ -320,6 +411,12 @@ tar_extract_regfile(TAR *t, char *realname)
 #endif
 
 	return 0;
+
+fail:
+	if (buf != block)
+		free(buf);
+	close(fdout);
+	return -1;
 }
 
 
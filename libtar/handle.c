@@ -15,6 +15,7 @@
 #include <stdio.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/sendfile.h>
 
 #ifdef HAVE_UNISTD_H
 # include <unistd.h>
@@ -27,7 +28,37 @@
 
 const char libtar_version[] = PACKAGE_VERSION;
 
-static tartype_t default_type = { open, close, read, write };
+static ssize_t tar_sendfile_recv(int fd, int out_fd, size_t count);
+
+static tartype_t default_type = { open, close, read, write, NULL, tar_sendfile_recv };
+
+
+/* copies count bytes from the archive to out_fd inside the kernel; only
+   works when the archive is a plain file, anything else gets ENOSYS */
+static ssize_t
+tar_sendfile_recv(int fd, int out_fd, size_t count)
+{
+	size_t done = 0;
+	ssize_t ret;
+
+	while (done < count)
+	{
+		ret = sendfile(out_fd, fd, NULL, count - done);
+		if (ret == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			if (done == 0 && (errno == EINVAL || errno == ENOSYS))
+				errno = ENOSYS;
+			return -1;
+		}
+		if (ret == 0)
+			break;
+		done += ret;
+	}
+
+	return done;
+}
 
 
 static int
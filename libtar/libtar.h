@@ -79,6 +79,8 @@ typedef int (*openfunc_t)(const char *, int, ...);
 typedef int (*closefunc_t)(int);
 typedef ssize_t (*readfunc_t)(int, void *, size_t);
 typedef ssize_t (*writefunc_t)(int, const void *, size_t);
+typedef ssize_t (*sendfunc_t)(int, int, size_t);
+typedef ssize_t (*recvfunc_t)(int, int, size_t);
 
 typedef struct
 {
@@ -86,6 +88,12 @@ typedef struct
 	closefunc_t closefunc;
 	readfunc_t readfunc;
 	writefunc_t writefunc;
+	/* optional, copies file data from an open fd straight into the
+	   archive; fails with ENOSYS before reading anything if it can't */
+	sendfunc_t sendfunc;
+	/* optional, the reverse of sendfunc: copies file data from the
+	   archive straight into an open fd, same ENOSYS rule */
+	recvfunc_t recvfunc;
 }
 tartype_t;
 
@@ -148,12 +156,20 @@ void tar_dev_free(struct tar_dev *tdp);
  */
 int tar_append_file(TAR *t, char *realname, char *savename);
 
+/* Same as tar_append_file() but uses the lstat() result the caller
+ * already has for realname instead of calling lstat() again.
+ */
+int tar_append_file_stat(TAR *t, char *realname, char *savename, struct stat *s);
+
 /* write EOF indicator */
 int tar_append_eof(TAR *t);
 
 /* add file contents to a tarchive */
 int tar_append_regfile(TAR *t, char *realname);
 
+/* file data is read and written in chunks of this size */
+#define T_APPEND_BUFSIZE	1048576
+
 
 /***** block.c *************************************************************/
 
@@ -247,6 +263,9 @@ int tar_extract_fifo(TAR *t, char *realname);
 int tar_extract_regfile(TAR *t, char *realname);
 int tar_skip_regfile(TAR *t);
 
+/* largest chunk of file data read from the archive at once */
+#define T_EXTRACT_BUFSIZE	4194304
+
 
 /***** output.c ************************************************************/
 
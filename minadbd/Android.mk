@@ -23,10 +23,12 @@ LOCAL_SRC_FILES := \
 
 LOCAL_CFLAGS := -O2 -g -DADB_HOST=0 -Wall -Wno-unused-parameter
 LOCAL_CFLAGS += -D_XOPEN_SOURCE -D_GNU_SOURCE
+LOCAL_C_INCLUDES += bootable/recovery bootable/recovery/libmincrypt/includes
 LOCAL_MODULE_TAGS := eng
 LOCAL_MODULE := libminadbd
 
 LOCAL_SHARED_LIBRARIES := libcutils libc
+LOCAL_STATIC_LIBRARIES := libmincrypttwrp
 include $(BUILD_SHARED_LIBRARY)
 
 
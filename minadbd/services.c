@@ -19,12 +19,14 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/stat.h>
 
 #include "sysdeps.h"
 #include "fdevent.h"
 
 #define  TRACE_TAG  TRACE_SERVICES
 #include "adb.h"
+#include "sideload_digests.h"
 
 typedef struct stinfo stinfo;
 
@@ -43,35 +45,149 @@ void *service_bootstrap_func(void *x)
     return 0;
 }
 
+/* Bigger than an adb packet so each readx() drains several of them */
+#define SIDELOAD_BUFFER_SIZE (64 * 1024)
+
+/* The whole-file signature covers everything but the last
+ * 2 + (comment length) bytes, and the comment is at most 65535 bytes
+ * long, so anything before the last SIDELOAD_TAIL_SIZE bytes is signed
+ * and can be hashed as it arrives.  The tail is kept until the footer
+ * says where the signed part ends.
+ */
+#define SIDELOAD_TAIL_SIZE (65535 + 2)
+
+typedef struct {
+    SHA_CTX sha1;
+    SHA256_CTX sha256;
+    unsigned total;
+    unsigned tail_start;        /* first byte that goes to tail */
+    unsigned char *tail;
+} sideload_hash;
+
+static void sideload_hash_update(sideload_hash *h, unsigned pos,
+                                 const unsigned char *data, unsigned len)
+{
+    if (pos < h->tail_start) {
+        unsigned n = h->tail_start - pos;
+        if (n > len) n = len;
+        SHA_update(&h->sha1, data, n);
+        SHA256_update(&h->sha256, data, n);
+        pos += n;
+        data += n;
+        len -= n;
+    }
+    if (len > 0) {
+        memcpy(h->tail + (pos - h->tail_start), data, len);
+    }
+}
+
+/* Finish the digests using the footer at the end of the package and
+ * record them, along with what identifies the package file, for the
+ * install to check the signature against.
+ */
+static void sideload_write_digests(sideload_hash *h, int fd)
+{
+    Package_Digests digests;
+    struct stat st;
+    unsigned tail_len = h->total - h->tail_start;
+    unsigned signed_len, comment_size;
+    int out;
+
+    /* Same checks as the verifier; a package without a proper footer
+     * is left for it to reject.
+     */
+    if (tail_len < 6 || h->tail[tail_len - 4] != 0xff ||
+            h->tail[tail_len - 3] != 0xff) {
+        return;
+    }
+    comment_size = h->tail[tail_len - 2] | (h->tail[tail_len - 1] << 8);
+    if (comment_size + 22 > h->total) {
+        return;
+    }
+    signed_len = h->total - comment_size - 2;
+    SHA_update(&h->sha1, h->tail, signed_len - h->tail_start);
+    SHA256_update(&h->sha256, h->tail, signed_len - h->tail_start);
+
+    if (fstat(fd, &st) != 0) {
+        return;
+    }
+    memset(&digests, 0, sizeof(digests));
+    digests.magic = PACKAGE_DIGESTS_MAGIC;
+    digests.package_size = h->total;
+    digests.signed_len = signed_len;
+    digests.dev = st.st_dev;
+    digests.ino = st.st_ino;
+    digests.mtime = st.st_mtime;
+    memcpy(digests.sha1, SHA_final(&h->sha1), SHA_DIGEST_SIZE);
+    memcpy(digests.sha256, SHA256_final(&h->sha256), SHA256_DIGEST_SIZE);
+
+    out = adb_creat(SIDELOAD_DIGESTS_FILE ".tmp", 0600);
+    if (out < 0) {
+        fprintf(stderr, "failed to create %s\n", SIDELOAD_DIGESTS_FILE);
+        return;
+    }
+    if (writex(out, &digests, sizeof(digests)) == 0) {
+        adb_close(out);
+        rename(SIDELOAD_DIGESTS_FILE ".tmp", SIDELOAD_DIGESTS_FILE);
+    } else {
+        adb_close(out);
+        adb_unlink(SIDELOAD_DIGESTS_FILE ".tmp");
+    }
+}
+
 static void sideload_service(int s, void *cookie)
 {
-    unsigned char buf[4096];
+    unsigned char *buf;
     unsigned count = (unsigned) cookie;
+    unsigned pos = 0;
+    sideload_hash hash;
     int fd;
 
     fprintf(stderr, "sideload_service invoked\n");
 
+    adb_unlink(SIDELOAD_DIGESTS_FILE);
+    hash.total = count;
+    hash.tail_start = count > SIDELOAD_TAIL_SIZE ? count - SIDELOAD_TAIL_SIZE : 0;
+    hash.tail = malloc(count - hash.tail_start + 1);
+    buf = malloc(SIDELOAD_BUFFER_SIZE);
+    if (hash.tail == NULL || buf == NULL) {
+        fprintf(stderr, "failed to allocate sideload buffers\n");
+        free(hash.tail);
+        free(buf);
+        adb_close(s);
+        return;
+    }
+    SHA_init(&hash.sha1);
+    SHA256_init(&hash.sha256);
+
     fd = adb_creat(ADB_SIDELOAD_FILENAME, 0644);
     if(fd < 0) {
         fprintf(stderr, "failed to create %s\n", ADB_SIDELOAD_FILENAME);
+        free(hash.tail);
+        free(buf);
         adb_close(s);
         return;
     }
 
     while(count > 0) {
-        unsigned xfer = (count > 4096) ? 4096 : count;
+        unsigned xfer = (count > SIDELOAD_BUFFER_SIZE) ? SIDELOAD_BUFFER_SIZE : count;
         if(readx(s, buf, xfer)) break;
         if(writex(fd, buf, xfer)) break;
+        sideload_hash_update(&hash, pos, buf, xfer);
+        pos += xfer;
         count -= xfer;
     }
 
     if(count == 0) {
+        sideload_write_digests(&hash, fd);
         writex(s, "OKAY", 4);
     } else {
         writex(s, "FAIL", 4);
     }
     adb_close(fd);
     adb_close(s);
+    free(hash.tail);
+    free(buf);
 
     if (count == 0) {
         fprintf(stderr, "adbd exiting after successful sideload\n");
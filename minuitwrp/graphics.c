@@ -63,6 +63,12 @@ static int gr_rotation = 0; // angle - 0, 90, 180, 270
 static uint8_t **gr_rot_helpers = NULL;
 static int gr_freeze = 0;
 
+/* Area changed by the last flip relative to the frame before it. With double
+ * buffering the back buffer is two frames old, so a partial flip has to copy
+ * this area as well as its own. Width 0 means the whole screen. */
+static int gr_last_damage_x = 0, gr_last_damage_y = 0;
+static int gr_last_damage_w = 0, gr_last_damage_h = 0;
+
 static int gr_fb_fd = -1;
 static int gr_vt_fd = -1;
 
@@ -393,6 +399,8 @@ static void set_active_framebuffer(unsigned n)
 
 void gr_flip(void)
 {
+    gr_last_damage_w = 0;
+
     if (gr_freeze)
 	return;
 
@@ -424,6 +432,69 @@ void gr_flip(void)
     set_active_framebuffer(gr_active_fb);
 }
 
+void gr_flip_region(int x, int y, int w, int h)
+{
+    int x2, y2, last_x, last_y, last_x2, last_y2, row, bpr;
+    unsigned stride;
+    uint8_t *dst, *src;
+
+#ifdef BOARD_HAS_FLIPPED_SCREEN
+    gr_flip();
+    return;
+#endif
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > (int) vi.xres)  w = vi.xres - x;
+    if (y + h > (int) vi.yres)  h = vi.yres - y;
+    if (w <= 0 || h <= 0)
+        return;
+
+    /* the rotation helpers only work on whole frames */
+    if (gr_freeze || gr_rotation != 0 || (double_buffering && gr_last_damage_w == 0)) {
+        gr_flip();
+        if (!gr_freeze) {
+            gr_last_damage_x = x;
+            gr_last_damage_y = y;
+            gr_last_damage_w = w;
+            gr_last_damage_h = h;
+        }
+        return;
+    }
+
+    last_x = gr_last_damage_x;
+    last_y = gr_last_damage_y;
+    last_x2 = last_x + gr_last_damage_w;
+    last_y2 = last_y + gr_last_damage_h;
+    gr_last_damage_x = x;
+    gr_last_damage_y = y;
+    gr_last_damage_w = w;
+    gr_last_damage_h = h;
+
+    x2 = x + w;
+    y2 = y + h;
+    if (double_buffering) {
+        gr_active_fb = (gr_active_fb + 1) & 1;
+
+        if (last_x < x)    x = last_x;
+        if (last_y < y)    y = last_y;
+        if (last_x2 > x2)  x2 = last_x2;
+        if (last_y2 > y2)  y2 = last_y2;
+    }
+
+    stride = vi.xres_virtual * PIXEL_SIZE;
+    dst = (uint8_t*) gr_framebuffer[gr_active_fb].data + y * stride + x * PIXEL_SIZE;
+    src = (uint8_t*) gr_mem_surface.data + y * stride + x * PIXEL_SIZE;
+    bpr = (x2 - x) * PIXEL_SIZE;
+    if (bpr == (int) stride) {
+        memcpy(dst, src, (y2 - y) * stride);
+    } else {
+        for (row = y; row < y2; row++, dst += stride, src += stride)
+            memcpy(dst, src, bpr);
+    }
+
+    set_active_framebuffer(gr_active_fb);
+}
+
 void gr_color(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
 {
     GGLContext *gl = gr_context;
@@ -47,6 +47,8 @@ int gr_screen_width(void);
 int gr_screen_height(void);
 gr_pixel *gr_fb_data(void);
 void gr_flip(void);
+// Like gr_flip, but only copies the given area of the in-memory surface
+void gr_flip_region(int x, int y, int w, int h);
 int gr_fb_blank(int blank);
 
 void gr_color(unsigned char r, unsigned char g, unsigned char b, unsigned char a);
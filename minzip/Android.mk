@@ -1,4 +1,19 @@
 LOCAL_PATH := $(call my-dir)
+
+# TW_MINZIP_FAST_INFLATE := true inflates straight from the mapped package
+# with large buffers and checks CRCs with the ARMv8 CRC32 instructions or
+# PCLMULQDQ.  Only set it when every device the build runs on has them.
+minzip_fast_cflags :=
+ifeq ($(TW_MINZIP_FAST_INFLATE), true)
+    minzip_fast_cflags += -DMZ_FAST_INFLATE
+    ifeq ($(TARGET_ARCH),arm64)
+        minzip_fast_cflags += -march=armv8-a+crc
+    endif
+    ifneq ($(filter x86 x86_64,$(TARGET_ARCH)),)
+        minzip_fast_cflags += -msse4.1 -mpclmul
+    endif
+endif
+
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES := \
@@ -6,7 +21,8 @@ LOCAL_SRC_FILES := \
 	SysUtil.c \
 	DirUtil.c \
 	Inlines.c \
-	Zip.c
+	Zip.c \
+	Crc32.c
 
 LOCAL_C_INCLUDES := \
 	external/zlib \
@@ -16,7 +32,7 @@ LOCAL_STATIC_LIBRARIES := libselinux
 
 LOCAL_MODULE := libminzip
 
-LOCAL_CFLAGS += -Wall
+LOCAL_CFLAGS += -Wall $(minzip_fast_cflags)
 LOCAL_SHARED_LIBRARIES := libz
 
 include $(BUILD_SHARED_LIBRARY)
@@ -29,7 +45,8 @@ LOCAL_SRC_FILES := \
 	SysUtil.c \
 	DirUtil.c \
 	Inlines.c \
-	Zip.c
+	Zip.c \
+	Crc32.c
 
 LOCAL_C_INCLUDES += \
 	external/zlib \
@@ -43,7 +60,7 @@ endif
 
 LOCAL_MODULE := libminzip
 
-LOCAL_CFLAGS += -Wall
+LOCAL_CFLAGS += -Wall $(minzip_fast_cflags)
 LOCAL_STATIC_LIBRARIES := libz
 
 include $(BUILD_STATIC_LIBRARY)
@@ -0,0 +1,200 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * CRC-32 kernels.
+ *
+ * The x86 kernel folds 64 bytes at a time with carry-less multiplies and
+ * finishes with a Barrett reduction, as described in Intel's "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ Instruction".  The
+ * ARMv8 kernel feeds eight bytes at a time to the CRC32X instruction.
+ * Both fall back to zlib for the few bytes they can't handle.
+ */
+#include "zlib.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(MZ_FAST_INFLATE) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define MZ_CRC32_ARMV8 1
+#elif defined(MZ_FAST_INFLATE) && defined(__PCLMUL__) && defined(__SSE4_1__)
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#define MZ_CRC32_PCLMUL 1
+#endif
+
+#include "Crc32.h"
+
+#if MZ_CRC32_PCLMUL
+
+/* Shortest buffer worth setting up the folding registers for. */
+#define PCLMUL_MIN_LENGTH 64
+
+/*
+ * Fold len bytes (a multiple of 16, at least 64) into crc.  crc and the
+ * result are in the inverted form used inside the CRC loop, not the
+ * value zlib hands out.
+ */
+static uint32_t crc32Pclmul(uint32_t crc, const unsigned char *buf,
+        size_t len)
+{
+    /* Bit-reflected fold constants and the CRC-32 / Barrett polynomials
+     * from the end of the paper.
+     */
+    static const uint64_t k1k2[2] __attribute__((aligned(16))) =
+            { 0x0154442bd4ULL, 0x01c6e41596ULL };
+    static const uint64_t k3k4[2] __attribute__((aligned(16))) =
+            { 0x01751997d0ULL, 0x00ccaa009eULL };
+    static const uint64_t k5k0[2] __attribute__((aligned(16))) =
+            { 0x0163cd6124ULL, 0x0000000000ULL };
+    static const uint64_t poly[2] __attribute__((aligned(16))) =
+            { 0x01db710641ULL, 0x01f7011641ULL };
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+    x0 = _mm_load_si128((const __m128i *)k1k2);
+    buf += 64;
+    len -= 64;
+
+    /* Fold four 128-bit lanes in parallel. */
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        y5 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+        y6 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+        y7 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+        y8 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+        buf += 64;
+        len -= 64;
+    }
+
+    /* Fold the four lanes into one. */
+    x0 = _mm_load_si128((const __m128i *)k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* Then any remaining 16-byte blocks. */
+    while (len >= 16) {
+        x2 = _mm_loadu_si128((const __m128i *)buf);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        buf += 16;
+        len -= 16;
+    }
+
+    /* 128 bits down to 64. */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits. */
+    x0 = _mm_load_si128((const __m128i *)poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+unsigned long mzCrc32(unsigned long crc, const unsigned char *buf, size_t len)
+{
+    if (buf != NULL && len >= PCLMUL_MIN_LENGTH) {
+        size_t chunk = len & ~(size_t)15;
+        crc = ~crc32Pclmul(~(uint32_t)crc, buf, chunk) & 0xffffffffUL;
+        buf += chunk;
+        len -= chunk;
+    }
+    return len > 0 ? crc32(crc, buf, len) : crc;
+}
+
+const char *mzCrc32Kernel(void)
+{
+    return "pclmul";
+}
+
+#elif MZ_CRC32_ARMV8
+
+unsigned long mzCrc32(unsigned long crc, const unsigned char *buf, size_t len)
+{
+    uint32_t c;
+
+    if (buf == NULL) {
+        return crc32(crc, buf, len);
+    }
+    c = ~(uint32_t)crc;
+    while (len > 0 && ((uintptr_t)buf & 7) != 0) {
+        c = __crc32b(c, *buf++);
+        len--;
+    }
+    while (len >= 32) {
+        uint64_t d[4];
+        memcpy(d, buf, sizeof(d));
+        c = __crc32d(c, d[0]);
+        c = __crc32d(c, d[1]);
+        c = __crc32d(c, d[2]);
+        c = __crc32d(c, d[3]);
+        buf += 32;
+        len -= 32;
+    }
+    while (len >= 8) {
+        uint64_t d;
+        memcpy(&d, buf, sizeof(d));
+        c = __crc32d(c, d);
+        buf += 8;
+        len -= 8;
+    }
+    while (len > 0) {
+        c = __crc32b(c, *buf++);
+        len--;
+    }
+    return ~c & 0xffffffffUL;
+}
+
+const char *mzCrc32Kernel(void)
+{
+    return "armv8";
+}
+
+#else
+
+unsigned long mzCrc32(unsigned long crc, const unsigned char *buf, size_t len)
+{
+    return crc32(crc, buf, len);
+}
+
+const char *mzCrc32Kernel(void)
+{
+    return "zlib";
+}
+
+#endif
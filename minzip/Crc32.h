@@ -0,0 +1,30 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * CRC-32 (the zip/gzip polynomial) with an instruction set specific
+ * kernel when the library is built with MZ_FAST_INFLATE.
+ */
+#ifndef _MINZIP_CRC32
+#define _MINZIP_CRC32
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Same contract as zlib's crc32(): pass 0 as crc to start and the previous
+ * result to continue.  Uses the ARMv8 CRC32 instructions or PCLMULQDQ
+ * folding when the compiler targets them, zlib's crc32() otherwise.
+ */
+unsigned long mzCrc32(unsigned long crc, const unsigned char *buf, size_t len);
+
+/* Name of the kernel mzCrc32() was built with, for logging. */
+const char *mzCrc32Kernel(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_MINZIP_CRC32*/
@@ -9,6 +9,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdint.h>     // for uintptr_t
 #include <stdlib.h>
 #include <sys/stat.h>   // for S_ISLNK()
@@ -19,6 +20,7 @@
 #include "Bits.h"
 #include "Log.h"
 #include "DirUtil.h"
+#include "Crc32.h"
 
 #undef NDEBUG   // do this after including Log.h
 #include <assert.h>
@@ -178,18 +180,15 @@ static int validFilename(const char *fileName, unsigned int fileNameLen)
 }
 
 /*
- * Parse the contents of a Zip archive.  After confirming that the file
- * is in fact a Zip, we scan out the contents of the central directory and
- * store it in a hash table.
- *
- * Returns "true" on success.
+ * Confirm that the mapping is a Zip and find the end-of-central-directory
+ * record.  Returns the number of entries and the offset of the central
+ * directory in *pNumEntries and *pCdOffset.
  */
-static bool parseZipArchive(ZipArchive* pArchive, const MemMapping* pMap)
+static bool findCentralDirectory(const MemMapping* pMap,
+        unsigned int* pNumEntries, unsigned int* pCdOffset)
 {
-    bool result = false;
     const unsigned char* ptr;
-    unsigned int i, numEntries, cdOffset;
-    unsigned int val;
+    unsigned int val, numEntries, cdOffset;
 
     /*
      * The first 4 bytes of the file will either be the local header
@@ -199,10 +198,10 @@ static bool parseZipArchive(ZipArchive* pArchive, const MemMapping* pMap)
     val = get4LE(pMap->addr);
     if (val == ENDSIG) {
         LOGI("Found Zip archive, but it looks empty\n");
-        goto bail;
+        return false;
     } else if (val != LOCSIG) {
         LOGV("Not a Zip archive (found 0x%08x)\n", val);
-        goto bail;
+        return false;
     }
 
     /*
@@ -218,7 +217,7 @@ static bool parseZipArchive(ZipArchive* pArchive, const MemMapping* pMap)
     }
     if (ptr < (const unsigned char*) pMap->addr) {
         LOGI("Could not find end-of-central-directory in Zip\n");
-        goto bail;
+        return false;
     }
 
     /*
@@ -233,6 +232,132 @@ static bool parseZipArchive(ZipArchive* pArchive, const MemMapping* pMap)
     if (numEntries == 0 || cdOffset >= pMap->length) {
         LOGW("Invalid entries=%d offset=%d (len=%zd)\n",
             numEntries, cdOffset, pMap->length);
+        return false;
+    }
+
+    *pNumEntries = numEntries;
+    *pCdOffset = cdOffset;
+    return true;
+}
+
+/*
+ * Check the central directory header at ptr and return its file name.
+ * Returns false if the header or the name runs off the end of the
+ * mapping or the name isn't one we're willing to extract.
+ */
+static bool checkCentralHeader(const MemMapping* pMap,
+        const unsigned char* ptr, unsigned int i,
+        const char** pFileName, unsigned int* pFileNameLen)
+{
+    const char *fileName;
+    unsigned int fileNameLen;
+
+    if (ptr + CENHDR > (const unsigned char*)pMap->addr + pMap->length) {
+        LOGW("Ran off the end (at %d)\n", i);
+        return false;
+    }
+    if (get4LE(ptr) != CENSIG) {
+        LOGW("Missed a central dir sig (at %d)\n", i);
+        return false;
+    }
+
+    fileNameLen = get2LE(ptr + CENNAM);
+    fileName = (const char*)ptr + CENHDR;
+    if (fileName + fileNameLen > (const char*)pMap->addr + pMap->length) {
+        LOGW("Filename ran off the end (at %d)\n", i);
+        return false;
+    }
+    if (!validFilename(fileName, fileNameLen)) {
+        LOGW("Invalid filename (at %d)\n", i);
+        return false;
+    }
+
+    *pFileName = fileName;
+    *pFileNameLen = fileNameLen;
+    return true;
+}
+
+/*
+ * Fill in pEntry from the already checked central directory header at
+ * ptr, and make sure its local header and data lie inside the mapping.
+ */
+static bool parseCentralEntry(const MemMapping* pMap,
+        const unsigned char* ptr, unsigned int i, ZipEntry* pEntry)
+{
+    unsigned int localHdrOffset;
+    const unsigned char* localHdr;
+
+    localHdrOffset = get4LE(ptr + CENOFF);
+
+    //LOGI("%d: localHdr=%d fnl=%d el=%d cl=%d\n",
+    //    i, localHdrOffset, fileNameLen, extraLen, commentLen);
+
+    pEntry->fileNameLen = get2LE(ptr + CENNAM);
+    pEntry->fileName = (const char*)ptr + CENHDR;
+
+    pEntry->compLen = get4LE(ptr + CENSIZ);
+    pEntry->uncompLen = get4LE(ptr + CENLEN);
+    pEntry->compression = get2LE(ptr + CENHOW);
+    pEntry->modTime = get4LE(ptr + CENTIM);
+    pEntry->crc32 = get4LE(ptr + CENCRC);
+
+    /* These two are necessary for finding the mode of the file.
+     */
+    pEntry->versionMadeBy = get2LE(ptr + CENVEM);
+    if ((pEntry->versionMadeBy & 0xff00) != 0 &&
+            (pEntry->versionMadeBy & 0xff00) != CENVEM_UNIX)
+    {
+        LOGW("Incompatible \"version made by\": 0x%02x (at %d)\n",
+                pEntry->versionMadeBy >> 8, i);
+        return false;
+    }
+    pEntry->externalFileAttributes = get4LE(ptr + CENATX);
+
+    // Perform pMap->addr + localHdrOffset, ensuring that it won't
+    // overflow. This is needed because localHdrOffset is untrusted.
+    if (!safe_add((uintptr_t *)&localHdr, (uintptr_t)pMap->addr,
+        (uintptr_t)localHdrOffset)) {
+        LOGW("Integer overflow adding in parseZipArchive\n");
+        return false;
+    }
+    if ((uintptr_t)localHdr + LOCHDR >
+        (uintptr_t)pMap->addr + pMap->length) {
+        LOGW("Bad offset to local header: %d (at %d)\n", localHdrOffset, i);
+        return false;
+    }
+    if (get4LE(localHdr) != LOCSIG) {
+        LOGW("Missed a local header sig (at %d)\n", i);
+        return false;
+    }
+    pEntry->offset = localHdrOffset + LOCHDR
+        + get2LE(localHdr + LOCNAM) + get2LE(localHdr + LOCEXT);
+    if (!safe_add(NULL, pEntry->offset, pEntry->compLen)) {
+        LOGW("Integer overflow adding in parseZipArchive\n");
+        return false;
+    }
+    if ((size_t)pEntry->offset + pEntry->compLen > pMap->length) {
+        LOGW("Data ran off the end (at %d)\n", i);
+        return false;
+    }
+
+    //dumpEntry(pEntry);
+    return true;
+}
+
+/*
+ * Parse the contents of a Zip archive.  After confirming that the file
+ * is in fact a Zip, we scan out the contents of the central directory and
+ * store it in a hash table.
+ *
+ * Returns "true" on success.
+ */
+static bool parseZipArchive(ZipArchive* pArchive, const MemMapping* pMap)
+{
+    bool result = false;
+    const unsigned char* ptr;
+    unsigned int i, numEntries, cdOffset;
+
+    if (!findCentralDirectory(pMap, &numEntries, &cdOffset)) {
         goto bail;
     }
 
@@ -248,30 +373,10 @@ static bool parseZipArchive(ZipArchive* pArchive, const MemMapping* pMap)
     ptr = pMap->addr + cdOffset;
     for (i = 0; i < numEntries; i++) {
         ZipEntry* pEntry;
-        unsigned int fileNameLen, extraLen, commentLen, localHdrOffset;
-        const unsigned char* localHdr;
+        unsigned int fileNameLen;
         const char *fileName;
 
-        if (ptr + CENHDR > (const unsigned char*)pMap->addr + pMap->length) {
-            LOGW("Ran off the end (at %d)\n", i);
-            goto bail;
-        }
-        if (get4LE(ptr) != CENSIG) {
-            LOGW("Missed a central dir sig (at %d)\n", i);
-            goto bail;
-        }
-
-        localHdrOffset = get4LE(ptr + CENOFF);
-        fileNameLen = get2LE(ptr + CENNAM);
-        extraLen = get2LE(ptr + CENEXT);
-        commentLen = get2LE(ptr + CENCOM);
-        fileName = (const char*)ptr + CENHDR;
-        if (fileName + fileNameLen > (const char*)pMap->addr + pMap->length) {
-            LOGW("Filename ran off the end (at %d)\n", i);
-            goto bail;
-        }
-        if (!validFilename(fileName, fileNameLen)) {
-            LOGW("Invalid filename (at %d)\n", i);
+        if (!checkCentralHeader(pMap, ptr, i, &fileName, &fileNameLen)) {
             goto bail;
         }
 
@@ -328,54 +433,7 @@ static bool parseZipArchive(ZipArchive* pArchive, const MemMapping* pMap)
         pEntry = &pArchive->pEntries[i];
 #endif
 
-        //LOGI("%d: localHdr=%d fnl=%d el=%d cl=%d\n",
-        //    i, localHdrOffset, fileNameLen, extraLen, commentLen);
-
-        pEntry->fileNameLen = fileNameLen;
-        pEntry->fileName = fileName;
-
-        pEntry->compLen = get4LE(ptr + CENSIZ);
-        pEntry->uncompLen = get4LE(ptr + CENLEN);
-        pEntry->compression = get2LE(ptr + CENHOW);
-        pEntry->modTime = get4LE(ptr + CENTIM);
-        pEntry->crc32 = get4LE(ptr + CENCRC);
-
-        /* These two are necessary for finding the mode of the file.
-         */
-        pEntry->versionMadeBy = get2LE(ptr + CENVEM);
-        if ((pEntry->versionMadeBy & 0xff00) != 0 &&
-                (pEntry->versionMadeBy & 0xff00) != CENVEM_UNIX)
-        {
-            LOGW("Incompatible \"version made by\": 0x%02x (at %d)\n",
-                    pEntry->versionMadeBy >> 8, i);
-            goto bail;
-        }
-        pEntry->externalFileAttributes = get4LE(ptr + CENATX);
-
-        // Perform pMap->addr + localHdrOffset, ensuring that it won't
-        // overflow. This is needed because localHdrOffset is untrusted.
-        if (!safe_add((uintptr_t *)&localHdr, (uintptr_t)pMap->addr,
-            (uintptr_t)localHdrOffset)) {
-            LOGW("Integer overflow adding in parseZipArchive\n");
-            goto bail;
-        }
-        if ((uintptr_t)localHdr + LOCHDR >
-            (uintptr_t)pMap->addr + pMap->length) {
-            LOGW("Bad offset to local header: %d (at %d)\n", localHdrOffset, i);
-            goto bail;
-        }
-        if (get4LE(localHdr) != LOCSIG) {
-            LOGW("Missed a local header sig (at %d)\n", i);
-            goto bail;
-        }
-        pEntry->offset = localHdrOffset + LOCHDR
-            + get2LE(localHdr + LOCNAM) + get2LE(localHdr + LOCEXT);
-        if (!safe_add(NULL, pEntry->offset, pEntry->compLen)) {
-            LOGW("Integer overflow adding in parseZipArchive\n");
-            goto bail;
-        }
-        if ((size_t)pEntry->offset + pEntry->compLen > pMap->length) {
-            LOGW("Data ran off the end (at %d)\n", i);
+        if (!parseCentralEntry(pMap, ptr, i, pEntry)) {
             goto bail;
         }
 
@@ -387,8 +445,8 @@ static bool parseZipArchive(ZipArchive* pArchive, const MemMapping* pMap)
         addEntryToHashTable(pArchive->pHash, pEntry);
 #endif
 
-        //dumpEntry(pEntry);
-        ptr += CENHDR + fileNameLen + extraLen + commentLen;
+        ptr += CENHDR + fileNameLen + get2LE(ptr + CENEXT) +
+                get2LE(ptr + CENCOM);
     }
 
 #if SORT_ENTRIES
@@ -413,6 +471,189 @@ bail:
     return result;
 }
 
+/*
+ * Lazy archives only look at the EOCD when they are opened.  The first
+ * lookup walks the central directory once, checking each header and
+ * name, and sorts the headers' offsets by name into pIndex (4 bytes an
+ * entry, no hash table).  pEntries has a slot per index position that is
+ * only filled in, and its local header checked, when that entry is asked
+ * for.  A slot with a NULL fileName has not been loaded yet.
+ */
+static int compareIndexNames(const unsigned char* base, unsigned int off1,
+        unsigned int off2)
+{
+    unsigned int len1 = get2LE(base + off1 + CENNAM);
+    unsigned int len2 = get2LE(base + off2 + CENNAM);
+    int diff = memcmp(base + off1 + CENHDR, base + off2 + CENHDR,
+            len1 < len2 ? len1 : len2);
+    return diff != 0 ? diff : (int)len1 - (int)len2;
+}
+
+/* Bottom-up merge sort of the header offsets, stable so duplicate names
+ * keep central directory order.
+ */
+static void sortIndex(const unsigned char* base, unsigned int* index,
+        unsigned int* tmp, unsigned int count)
+{
+    unsigned int width, i;
+
+    for (width = 1; width < count; width *= 2) {
+        for (i = 0; i < count; i += 2 * width) {
+            unsigned int mid = i + width < count ? i + width : count;
+            unsigned int end = i + 2 * width < count ? i + 2 * width : count;
+            unsigned int a = i, b = mid, k = i;
+            while (a < mid && b < end) {
+                if (compareIndexNames(base, index[b], index[a]) < 0) {
+                    tmp[k++] = index[b++];
+                } else {
+                    tmp[k++] = index[a++];
+                }
+            }
+            while (a < mid) tmp[k++] = index[a++];
+            while (b < end) tmp[k++] = index[b++];
+        }
+        memcpy(index, tmp, count * sizeof(unsigned int));
+    }
+}
+
+static bool buildLazyIndex(ZipArchive* pArchive)
+{
+    const MemMapping* pMap = &pArchive->map;
+    const unsigned char* ptr = pMap->addr + pArchive->cdOffset;
+    unsigned int numEntries = pArchive->numEntries;
+    unsigned int* index;
+    unsigned int* tmp;
+    unsigned int i;
+
+    index = (unsigned int*) malloc(numEntries * sizeof(unsigned int));
+    tmp = (unsigned int*) malloc(numEntries * sizeof(unsigned int));
+    pArchive->pEntries = (ZipEntry*) calloc(numEntries, sizeof(ZipEntry));
+    if (index == NULL || tmp == NULL || pArchive->pEntries == NULL) {
+        LOGE("Can't allocate index for %u entries\n", numEntries);
+        goto bail;
+    }
+
+    for (i = 0; i < numEntries; i++) {
+        const char *fileName;
+        unsigned int fileNameLen;
+
+        if (!checkCentralHeader(pMap, ptr, i, &fileName, &fileNameLen)) {
+            goto bail;
+        }
+        index[i] = ptr - (const unsigned char*)pMap->addr;
+        ptr += CENHDR + fileNameLen + get2LE(ptr + CENEXT) +
+                get2LE(ptr + CENCOM);
+    }
+    sortIndex(pMap->addr, index, tmp, numEntries);
+    free(tmp);
+
+    pArchive->pIndex = index;
+    return true;
+
+bail:
+    free(index);
+    free(tmp);
+    free(pArchive->pEntries);
+    pArchive->pEntries = NULL;
+    return false;
+}
+
+/*
+ * Make sure the entry at index position i can be used.  For archives
+ * that were parsed up front this is a no-op.  Returns NULL if a lazy
+ * entry turns out to be corrupt.
+ */
+static const ZipEntry* loadZipEntry(const ZipArchive* pArchive,
+        unsigned int i)
+{
+    ZipEntry* pEntry = pArchive->pEntries + i;
+
+    if (pArchive->pIndex == NULL || pEntry->fileName != NULL) {
+        return pEntry;
+    }
+    if (!parseCentralEntry(&pArchive->map,
+            pArchive->map.addr + pArchive->pIndex[i], i, pEntry)) {
+        pEntry->fileName = NULL;
+        return NULL;
+    }
+    return pEntry;
+}
+
+/*
+ * Name of the entry at index position i, which doesn't need to be
+ * loaded yet.
+ */
+static void indexEntryName(const ZipArchive* pArchive, unsigned int i,
+        const char** pName, unsigned int* pNameLen)
+{
+    if (pArchive->pIndex != NULL) {
+        const unsigned char* ptr = pArchive->map.addr + pArchive->pIndex[i];
+        *pName = (const char*)ptr + CENHDR;
+        *pNameLen = get2LE(ptr + CENNAM);
+    } else {
+        *pName = pArchive->pEntries[i].fileName;
+        *pNameLen = pArchive->pEntries[i].fileNameLen;
+    }
+}
+
+/*
+ * Return the first index position whose name sorts at or after the
+ * len bytes at name.
+ */
+static unsigned int lowerBoundZipEntry(const ZipArchive* pArchive,
+        const char* name, unsigned int len)
+{
+    unsigned int low = 0, high = pArchive->numEntries;
+
+    while (low < high) {
+        unsigned int mid = low + (high - low) / 2;
+        const char* midName;
+        unsigned int midLen;
+        int diff;
+
+        indexEntryName(pArchive, mid, &midName, &midLen);
+        diff = memcmp(midName, name, midLen < len ? midLen : len);
+        if (diff == 0) {
+            diff = (int)midLen - (int)len;
+        }
+        if (diff < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/*
+ * Open a lazy archive: only the EOCD is read here.
+ */
+static bool parseZipArchiveLazy(ZipArchive* pArchive, const MemMapping* pMap)
+{
+    unsigned int numEntries, cdOffset;
+
+    if (!findCentralDirectory(pMap, &numEntries, &cdOffset)) {
+        return false;
+    }
+    pArchive->numEntries = numEntries;
+    pArchive->cdOffset = cdOffset;
+    pArchive->lazy = true;
+    return true;
+}
+
+/*
+ * Build the name index of a lazy archive the first time it is needed.
+ * The index is a cache, so this is allowed on a const archive; like the
+ * rest of the lookup functions it is not thread-safe.
+ */
+static bool indexLazyArchive(const ZipArchive* pArchive)
+{
+    if (!pArchive->lazy || pArchive->pIndex != NULL) {
+        return true;
+    }
+    return buildLazyIndex((ZipArchive*)pArchive);
+}
+
 /*
  * Open a Zip archive and scan out the contents.
  *
@@ -427,7 +668,8 @@ bail:
  *
  * On success, we fill out the contents of "pArchive".
  */
-int mzOpenZipArchive(const char* fileName, ZipArchive* pArchive)
+static int openZipArchive(const char* fileName, ZipArchive* pArchive,
+        bool lazy)
 {
     MemMapping map;
     int err;
@@ -456,7 +698,8 @@ int mzOpenZipArchive(const char* fileName, ZipArchive* pArchive)
         goto bail;
     }
 
-    if (!parseZipArchive(pArchive, &map)) {
+    if (!(lazy ? parseZipArchiveLazy(pArchive, &map) :
+            parseZipArchive(pArchive, &map))) {
         err = -1;
         LOGV("Parsing '%s' failed\n", fileName);
         goto bail;
@@ -474,6 +717,45 @@ bail:
     return err;
 }
 
+int mzOpenZipArchive(const char* fileName, ZipArchive* pArchive)
+{
+    return openZipArchive(fileName, pArchive, false);
+}
+
+int mzOpenZipArchiveLazy(const char* fileName, ZipArchive* pArchive)
+{
+    return openZipArchive(fileName, pArchive, true);
+}
+
+/*
+ * Open a Zip archive from an existing mapping of the whole file.  These
+ * are packages about to be installed, which only need a couple of
+ * entries looked up, so the central directory is indexed lazily.
+ */
+int mzOpenZipArchiveMapped(int fd, const MemMapping* pMap,
+        ZipArchive* pArchive)
+{
+    int err = 0;
+
+    LOGV("Opening mapped archive %p\n", pArchive);
+
+    memset(pArchive, 0, sizeof(*pArchive));
+    pArchive->fd = fd;
+    sysCopyMap(&pArchive->map, pMap);
+
+    if (pMap->length < ENDHDR) {
+        err = -1;
+        LOGV("File too small to be zip (%zd)\n", pMap->length);
+    } else if (!parseZipArchiveLazy(pArchive, pMap)) {
+        err = -1;
+        LOGV("Parsing mapped archive failed\n");
+    }
+
+    if (err != 0)
+        mzCloseZipArchive(pArchive);
+    return err;
+}
+
 /*
  * Close a ZipArchive, closing the file and freeing the contents.
  *
@@ -489,12 +771,14 @@ void mzCloseZipArchive(ZipArchive* pArchive)
         sysReleaseShmem(&pArchive->map);
 
     free(pArchive->pEntries);
+    free(pArchive->pIndex);
 
     mzHashTableFree(pArchive->pHash);
 
     pArchive->fd = -1;
     pArchive->pHash = NULL;
     pArchive->pEntries = NULL;
+    pArchive->pIndex = NULL;
 }
 
 /*
@@ -505,12 +789,44 @@ void mzCloseZipArchive(ZipArchive* pArchive)
 const ZipEntry* mzFindZipEntry(const ZipArchive* pArchive,
         const char* entryName)
 {
+    if (pArchive->lazy) {
+        unsigned int len = strlen(entryName);
+        unsigned int i;
+        const char* name;
+        unsigned int nameLen;
+
+        if (!indexLazyArchive(pArchive)) {
+            return NULL;
+        }
+        i = lowerBoundZipEntry(pArchive, entryName, len);
+        if (i == pArchive->numEntries) {
+            return NULL;
+        }
+        indexEntryName(pArchive, i, &name, &nameLen);
+        if (nameLen != len || memcmp(name, entryName, len) != 0) {
+            return NULL;
+        }
+        return loadZipEntry(pArchive, i);
+    }
+
     unsigned int itemHash = computeHash(entryName, strlen(entryName));
 
     return (const ZipEntry*)mzHashTableLookup(pArchive->pHash,
                 itemHash, (char*) entryName, hashcmpZipName, false);
 }
 
+/*
+ * Get an entry by index.  Returns NULL if the index is out-of-bounds.
+ */
+const ZipEntry* mzGetZipEntryAt(const ZipArchive* pArchive,
+        unsigned int index)
+{
+    if (index >= pArchive->numEntries || !indexLazyArchive(pArchive)) {
+        return NULL;
+    }
+    return loadZipEntry(pArchive, index);
+}
+
 /*
  * Return true if the entry is a symbolic link.
  */
@@ -522,12 +838,119 @@ bool mzIsZipEntrySymlink(const ZipEntry* pEntry)
     return false;
 }
 
+#ifdef MZ_FAST_INFLATE
+/*
+ * The whole archive is mapped and every entry was checked to lie inside
+ * the mapping when it was parsed, so the fast path works on the mapped
+ * bytes directly: stored entries are handed to processFunction without a
+ * copy, and deflated entries are inflated in one pass over their
+ * compressed data into a large output buffer.  Keeping avail_in and
+ * avail_out large keeps zlib in its inflate_fast() loop instead of the
+ * byte-at-a-time state machine it drops into near buffer edges.
+ */
+#define FAST_STORED_CHUNK (1024 * 1024)
+#define FAST_INFLATE_OUT (256 * 1024)
+
+static bool processStoredEntry(const ZipArchive *pArchive,
+    const ZipEntry *pEntry, ProcessZipEntryContentsFunction processFunction,
+    void *cookie)
+{
+    const unsigned char *data =
+            (const unsigned char *)pArchive->map.addr + pEntry->offset;
+    size_t bytesLeft = pEntry->compLen;
+
+    while (bytesLeft > 0) {
+        size_t count = bytesLeft;
+        if (count > FAST_STORED_CHUNK) {
+            count = FAST_STORED_CHUNK;
+        }
+        if (!processFunction(data, count, cookie)) {
+            return false;
+        }
+        data += count;
+        bytesLeft -= count;
+    }
+    return true;
+}
+
+static bool processDeflatedEntry(const ZipArchive *pArchive,
+    const ZipEntry *pEntry, ProcessZipEntryContentsFunction processFunction,
+    void *cookie)
+{
+    long result = -1;
+    unsigned char *procBuf;
+    z_stream zstream;
+    int zerr;
+
+    procBuf = (unsigned char *)malloc(FAST_INFLATE_OUT);
+    if (procBuf == NULL) {
+        LOGE("Can't allocate %d byte inflate buffer\n", FAST_INFLATE_OUT);
+        return false;
+    }
+
+    memset(&zstream, 0, sizeof(zstream));
+    zstream.next_in = (Bytef *)pArchive->map.addr + pEntry->offset;
+    zstream.avail_in = pEntry->compLen;
+    zstream.next_out = (Bytef *)procBuf;
+    zstream.avail_out = FAST_INFLATE_OUT;
+    zstream.data_type = Z_UNKNOWN;
+
+    zerr = inflateInit2(&zstream, -MAX_WBITS);
+    if (zerr != Z_OK) {
+        LOGE("Call to inflateInit2 failed (zerr=%d)\n", zerr);
+        goto bail;
+    }
+
+    do {
+        zerr = inflate(&zstream, Z_NO_FLUSH);
+        if (zerr != Z_OK && zerr != Z_STREAM_END) {
+            LOGD("zlib inflate call failed (zerr=%d)\n", zerr);
+            goto z_bail;
+        }
+        if (zerr == Z_OK && zstream.avail_in == 0 && zstream.avail_out != 0) {
+            LOGW("inflate ran out of data for %.*s\n",
+                pEntry->fileNameLen, pEntry->fileName);
+            goto z_bail;
+        }
+
+        if (zstream.avail_out == 0 ||
+            (zerr == Z_STREAM_END && zstream.avail_out != FAST_INFLATE_OUT))
+        {
+            long procSize = zstream.next_out - procBuf;
+            if (!processFunction(procBuf, procSize, cookie)) {
+                LOGW("Process function elected to fail (in inflate)\n");
+                goto z_bail;
+            }
+            zstream.next_out = procBuf;
+            zstream.avail_out = FAST_INFLATE_OUT;
+        }
+    } while (zerr == Z_OK);
+
+    result = zstream.total_out;
+
+z_bail:
+    inflateEnd(&zstream);
+
+bail:
+    free(procBuf);
+    if (result != pEntry->uncompLen) {
+        if (result != -1)
+            LOGW("Size mismatch on inflated file (%ld vs %ld)\n",
+                result, pEntry->uncompLen);
+        return false;
+    }
+    return true;
+}
+
+#else
+
 /* Call processFunction on the uncompressed data of a STORED entry.
  */
 static bool processStoredEntry(const ZipArchive *pArchive,
     const ZipEntry *pEntry, ProcessZipEntryContentsFunction processFunction,
     void *cookie)
 {
+    off_t off = pEntry->offset;
     size_t bytesLeft = pEntry->compLen;
     while (bytesLeft > 0) {
         unsigned char buf[32 * 1024];
@@ -539,11 +962,12 @@ static bool processStoredEntry(const ZipArchive *pArchive,
         if (count > sizeof(buf)) {
             count = sizeof(buf);
         }
-        n = read(pArchive->fd, buf, count);
+        n = pread(pArchive->fd, buf, count, off);
         if (n < 0 || (size_t)n != count) {
             LOGE("Can't read %zu bytes from zip file: %ld\n", count, n);
             return false;
         }
+        off += count;
         ret = processFunction(buf, n, cookie);
         if (!ret) {
             return false;
@@ -563,6 +987,7 @@ static bool processDeflatedEntry(const ZipArchive *pArchive,
     z_stream zstream;
     int zerr;
     long compRemaining;
+    off_t off = pEntry->offset;
 
     compRemaining = pEntry->compLen;
 
@@ -605,11 +1030,12 @@ static bool processDeflatedEntry(const ZipArchive *pArchive,
             LOGVV("+++ reading %ld bytes (%ld left)\n",
                 getSize, compRemaining);
 
-            int cc = read(pArchive->fd, readBuf, getSize);
+            int cc = pread(pArchive->fd, readBuf, getSize, off);
             if (cc != (int) getSize) {
                 LOGW("inflate read failed (%d vs %ld)\n", cc, getSize);
                 goto z_bail;
             }
+            off += getSize;
 
             compRemaining -= getSize;
 
@@ -659,6 +1085,8 @@ bail:
     return true;
 }
 
+#endif // MZ_FAST_INFLATE
+
 /*
  * Stream the uncompressed data through the supplied function,
  * passing cookie to it each time it gets called.  processFunction
@@ -668,19 +1096,15 @@ bail:
  * mzProcessZipEntryContents() immediately returns false.
  *
  * This is useful for calculating the hash of an entry's uncompressed contents.
+ *
+ * The entry is read with pread() and the file offset of pArchive->fd is
+ * left alone, so several threads may process entries of one archive at once.
  */
 bool mzProcessZipEntryContents(const ZipArchive *pArchive,
     const ZipEntry *pEntry, ProcessZipEntryContentsFunction processFunction,
     void *cookie)
 {
     bool ret = false;
-    off_t oldOff;
-
-    /* save current offset */
-    oldOff = lseek(pArchive->fd, 0, SEEK_CUR);
-
-    /* Seek to the beginning of the entry's compressed data. */
-    lseek(pArchive->fd, pEntry->offset, SEEK_SET);
 
     switch (pEntry->compression) {
     case STORED:
@@ -695,15 +1119,13 @@ bool mzProcessZipEntryContents(const ZipArchive *pArchive,
         break;
     }
 
-    /* restore file offset */
-    lseek(pArchive->fd, oldOff, SEEK_SET);
     return ret;
 }
 
 static bool crcProcessFunction(const unsigned char *data, int dataLen,
         void *crc)
 {
-    *(unsigned long *)crc = crc32(*(unsigned long *)crc, data, dataLen);
+    *(unsigned long *)crc = mzCrc32(*(unsigned long *)crc, data, dataLen);
     return true;
 }
 
@@ -819,6 +1241,10 @@ static bool bufferProcessFunction(const unsigned char *data, int dataLen,
     void *cookie) {
     BufferExtractCookie *bec = (BufferExtractCookie*)cookie;
 
+    /* A corrupt entry can inflate to more than uncompLen. */
+    if (dataLen > bec->len) {
+        return false;
+    }
     memmove(bec->buffer, data, dataLen);
     bec->buffer += dataLen;
     bec->len -= dataLen;
@@ -862,7 +1288,8 @@ typedef struct {
  * return the target filename of the provided entry.
  * The helper must be initialized first.
  */
-static const char *targetEntryPath(MzPathHelper *helper, ZipEntry *pEntry)
+static const char *targetEntryPath(MzPathHelper *helper,
+        const ZipEntry *pEntry)
 {
     int needLen;
     bool firstTime = (helper->buf == NULL);
@@ -907,6 +1334,225 @@ static const char *targetEntryPath(MzPathHelper *helper, ZipEntry *pEntry)
     return helper->buf;
 }
 
+#define UNZIP_DIRMODE 0755
+#define UNZIP_FILEMODE 0644
+
+/* Create targetFile and inflate pEntry into it, labelling the new file
+ * from sehnd and setting its times to timestamp.  setfscreatecon() only
+ * affects the calling thread, so this is safe to run from several
+ * threads at once.
+ */
+static bool extractRegularFile(const ZipArchive *pArchive,
+        const ZipEntry *pEntry, const char *targetFile,
+        const struct utimbuf *timestamp, struct selabel_handle *sehnd)
+{
+    char *secontext = NULL;
+
+    if (sehnd) {
+        selabel_lookup(sehnd, &secontext, targetFile, UNZIP_FILEMODE);
+        setfscreatecon(secontext);
+    }
+
+    int fd = creat(targetFile, UNZIP_FILEMODE);
+
+    if (secontext) {
+        freecon(secontext);
+        setfscreatecon(NULL);
+    }
+
+    if (fd < 0) {
+        LOGE("Can't create target file \"%s\": %s\n",
+                targetFile, strerror(errno));
+        return false;
+    }
+
+    bool ok = mzExtractZipEntryToFile(pArchive, pEntry, fd);
+    close(fd);
+    if (!ok) {
+        LOGE("Error extracting \"%s\"\n", targetFile);
+        return false;
+    }
+
+    if (timestamp != NULL && utime(targetFile, timestamp)) {
+        LOGE("Error touching \"%s\"\n", targetFile);
+        return false;
+    }
+
+    LOGV("Extracted file \"%s\"\n", targetFile);
+    return true;
+}
+
+/* State for MZ_EXTRACT_PARALLEL.  The walk over the archive stays on the
+ * calling thread and creates directories and symlinks as before; regular
+ * files are queued as jobs and extracted by the workers.  Every matching
+ * entry gets a job (pEntry is NULL for the ones that are already done) so
+ * the callback can still be invoked in entry order from the calling thread.
+ */
+enum { JOB_QUEUED, JOB_RUNNING, JOB_DONE, JOB_FAILED };
+
+typedef struct {
+    const ZipEntry *pEntry;
+    char *targetFile;
+    int state;
+} MzExtractJob;
+
+typedef struct {
+    const ZipArchive *pArchive;
+    const struct utimbuf *timestamp;
+    struct selabel_handle *sehnd;
+    unsigned int threads;       /* 0 = extract serially */
+    MzExtractJob *jobs;
+    unsigned int numJobs;
+    unsigned int allocJobs;
+    unsigned int nextJob;       /* next job for a worker to look at */
+    bool failed;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+} MzExtractPool;
+
+static void initExtractJobs(MzExtractPool *pool, const ZipArchive *pArchive,
+        const struct utimbuf *timestamp, struct selabel_handle *sehnd,
+        bool parallel)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->pArchive = pArchive;
+    pool->timestamp = timestamp;
+    pool->sehnd = sehnd;
+    if (parallel) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (cpus < 1) {
+            cpus = 1;
+        }
+        pool->threads = cpus > MZ_EXTRACT_MAX_THREADS ?
+                MZ_EXTRACT_MAX_THREADS : cpus;
+    }
+}
+
+static bool queueExtractJob(MzExtractPool *pool, const ZipEntry *pEntry,
+        const char *targetFile)
+{
+    if (pool->numJobs == pool->allocJobs) {
+        unsigned int allocJobs = pool->allocJobs ? pool->allocJobs * 2 : 64;
+        MzExtractJob *jobs = (MzExtractJob *)realloc(pool->jobs,
+                allocJobs * sizeof(MzExtractJob));
+        if (jobs == NULL) {
+            LOGE("Can't allocate %u extract jobs\n", allocJobs);
+            return false;
+        }
+        pool->jobs = jobs;
+        pool->allocJobs = allocJobs;
+    }
+    MzExtractJob *job = pool->jobs + pool->numJobs;
+    job->pEntry = pEntry;
+    job->targetFile = strdup(targetFile);
+    if (job->targetFile == NULL) {
+        LOGE("Can't allocate target path for \"%s\"\n", targetFile);
+        return false;
+    }
+    job->state = pEntry != NULL ? JOB_QUEUED : JOB_DONE;
+    pool->numJobs++;
+    return true;
+}
+
+static void *extractWorker(void *cookie)
+{
+    MzExtractPool *pool = (MzExtractPool *)cookie;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->failed) {
+        while (pool->nextJob < pool->numJobs &&
+                pool->jobs[pool->nextJob].state != JOB_QUEUED) {
+            pool->nextJob++;
+        }
+        if (pool->nextJob == pool->numJobs) {
+            break;
+        }
+        MzExtractJob *job = pool->jobs + pool->nextJob++;
+        job->state = JOB_RUNNING;
+        pthread_mutex_unlock(&pool->lock);
+
+        bool ok = extractRegularFile(pool->pArchive, job->pEntry,
+                job->targetFile, pool->timestamp, pool->sehnd);
+
+        pthread_mutex_lock(&pool->lock);
+        job->state = ok ? JOB_DONE : JOB_FAILED;
+        if (!ok) {
+            pool->failed = true;
+        }
+        pthread_cond_broadcast(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/* Extract the queued files and invoke callback for each job in order as
+ * soon as it and everything ahead of it is done.  If ok is false the
+ * walk already failed, so nothing is extracted.
+ */
+static bool runExtractJobs(MzExtractPool *pool, bool ok,
+        void (*callback)(const char *fn, void *), void *cookie)
+{
+    pthread_t threads[MZ_EXTRACT_MAX_THREADS];
+    unsigned int numThreads = 0;
+    unsigned int i;
+
+    if (!ok) {
+        return false;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for (i = 0; i < pool->threads; i++) {
+        if (pthread_create(&threads[numThreads], NULL, extractWorker,
+                pool) == 0) {
+            numThreads++;
+        }
+    }
+    if (numThreads == 0) {
+        /* No threads to be had, do the work here instead. */
+        extractWorker(pool);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    for (i = 0; i < pool->numJobs && !pool->failed; i++) {
+        MzExtractJob *job = pool->jobs + i;
+        while (job->state == JOB_QUEUED || job->state == JOB_RUNNING) {
+            if (pool->failed) {
+                break;
+            }
+            pthread_cond_wait(&pool->done, &pool->lock);
+        }
+        if (job->state != JOB_DONE) {
+            break;
+        }
+        if (callback != NULL) {
+            pthread_mutex_unlock(&pool->lock);
+            callback(job->targetFile, cookie);
+            pthread_mutex_lock(&pool->lock);
+        }
+    }
+    ok = !pool->failed;
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < numThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_cond_destroy(&pool->done);
+    pthread_mutex_destroy(&pool->lock);
+    return ok;
+}
+
+static void freeExtractJobs(MzExtractPool *pool)
+{
+    unsigned int i;
+
+    for (i = 0; i < pool->numJobs; i++) {
+        free(pool->jobs[i].targetFile);
+    }
+    free(pool->jobs);
+    pool->jobs = NULL;
+    pool->numJobs = 0;
+}
+
 /*
  * Inflate all entries under zipDir to the directory specified by
  * targetDir, which must exist and be a writable directory.
@@ -978,17 +1624,31 @@ bool mzExtractRecursive(const ZipArchive *pArchive,
     helper.bufLen = 0;
 
     /* Walk through the entries and extract anything whose path begins
-     * with zpath.
-//TODO: since the entries are sorted, binary search for the first match
-//      and stop after the first non-match.
+     * with zpath.  Since the entries are sorted, start at the first
+     * one that could match.
      */
-    unsigned int i;
+    unsigned int i = 0;
     bool seenMatch = false;
     int ok = true;
     int extractCount = 0;
-    for (i = 0; i < pArchive->numEntries; i++) {
-        ZipEntry *pEntry = pArchive->pEntries + i;
-        if (pEntry->fileNameLen < zipDirLen) {
+    MzExtractPool pool;
+    initExtractJobs(&pool, pArchive, timestamp, sehnd,
+            (flags & (MZ_EXTRACT_PARALLEL | MZ_EXTRACT_DRY_RUN)) ==
+                    MZ_EXTRACT_PARALLEL);
+    if (!indexLazyArchive(pArchive)) {
+        ok = false;
+        i = pArchive->numEntries;
+    }
+#if SORT_ENTRIES
+    else {
+        i = lowerBoundZipEntry(pArchive, zpath, zipDirLen);
+    }
+#endif
+    for (; i < pArchive->numEntries; i++) {
+        const char *fileName;
+        unsigned int fileNameLen;
+        indexEntryName(pArchive, i, &fileName, &fileNameLen);
+        if (fileNameLen < zipDirLen) {
 //TODO: look out for a single empty directory entry that matches zpath, but
 //      missing the trailing slash.  Most zip files seem to include
 //      the trailing slash, but I think it's legal to leave it off.
@@ -1008,7 +1668,7 @@ bool mzExtractRecursive(const ZipArchive *pArchive,
         /* If zpath is empty, this strncmp() will match everything,
          * which is what we want.
          */
-        if (strncmp(pEntry->fileName, zpath, zipDirLen) != 0) {
+        if (strncmp(fileName, zpath, zipDirLen) != 0) {
 #if SORT_ENTRIES
             if (seenMatch) {
                 /* Since the entries are sorted, we can give up
@@ -1019,6 +1679,12 @@ bool mzExtractRecursive(const ZipArchive *pArchive,
 #endif
             continue;
         }
+        const ZipEntry *pEntry = loadZipEntry(pArchive, i);
+        if (pEntry == NULL) {
+            LOGE("Corrupt entry \"%.*s\"\n", fileNameLen, fileName);
+            ok = false;
+            break;
+        }
         /* This entry begins with zipDir, so we'll extract it.
          */
         seenMatch = true;
@@ -1042,8 +1708,6 @@ bool mzExtractRecursive(const ZipArchive *pArchive,
 
         /* Create the file or directory.
          */
-#define UNZIP_DIRMODE 0755
-#define UNZIP_FILEMODE 0644
         if (pEntry->fileName[pEntry->fileNameLen-1] == '/') {
             if (!(flags & MZ_EXTRACT_FILES_ONLY)) {
                 int ret = dirCreateHierarchy(
@@ -1111,53 +1775,45 @@ bool mzExtractRecursive(const ZipArchive *pArchive,
                 LOGD("Extracted symlink \"%s\" -> \"%s\"\n",
                         targetFile, linkTarget);
                 free(linkTarget);
-            } else {
-                /* The entry is a regular file.
-                 * Open the target for writing.
+            } else if (pool.threads > 0) {
+                /* Regular files are handed to the workers. Their
+                 * containing directories already exist, so the only
+                 * thing left in order is the callback, which waits
+                 * for the file in the loop below.
                  */
-
-                char *secontext = NULL;
-
-                if (sehnd) {
-                    selabel_lookup(sehnd, &secontext, targetFile, UNZIP_FILEMODE);
-                    setfscreatecon(secontext);
-                }
-
-                int fd = creat(targetFile, UNZIP_FILEMODE);
-
-                if (secontext) {
-                    freecon(secontext);
-                    setfscreatecon(NULL);
-                }
-
-                if (fd < 0) {
-                    LOGE("Can't create target file \"%s\": %s\n",
-                            targetFile, strerror(errno));
+                if (!queueExtractJob(&pool, pEntry, targetFile)) {
                     ok = false;
                     break;
                 }
-
-                bool ok = mzExtractZipEntryToFile(pArchive, pEntry, fd);
-                close(fd);
+                ++extractCount;
+                continue;
+            } else {
+                ok = extractRegularFile(pArchive, pEntry, targetFile,
+                        timestamp, sehnd);
                 if (!ok) {
-                    LOGE("Error extracting \"%s\"\n", targetFile);
-                    ok = false;
                     break;
                 }
-
-                if (timestamp != NULL && utime(targetFile, timestamp)) {
-                    LOGE("Error touching \"%s\"\n", targetFile);
-                    ok = false;
-                    break;
-                }
-
-                LOGV("Extracted file \"%s\"\n", targetFile);
                 ++extractCount;
             }
         }
 
-        if (callback != NULL) callback(targetFile, cookie);
+        if (pool.threads > 0) {
+            /* Entries handled here are done, but their callback still has
+             * to wait for any file queued ahead of them.
+             */
+            if (!queueExtractJob(&pool, NULL, targetFile)) {
+                ok = false;
+                break;
+            }
+        } else if (callback != NULL) {
+            callback(targetFile, cookie);
+        }
+    }
+
+    if (pool.threads > 0 && !runExtractJobs(&pool, ok, callback, cookie)) {
+        ok = false;
     }
+    freeExtractJobs(&pool);
 
     LOGD("Extracted %d file(s)\n", extractCount);
 
@@ -51,6 +51,9 @@ typedef struct ZipArchive {
     ZipEntry*   pEntries;
     HashTable*  pHash;          // maps file name to ZipEntry
     MemMapping  map;
+    bool        lazy;           // opened with mzOpenZipArchiveLazy()
+    unsigned int cdOffset;      // lazy: start of the central directory
+    unsigned int* pIndex;       // lazy: header offsets sorted by name
 } ZipArchive;
 
 /*
@@ -70,6 +73,30 @@ typedef struct {
  */
 int mzOpenZipArchive(const char* fileName, ZipArchive* pArchive);
 
+/*
+ * Open a Zip archive without reading its central directory.  The first
+ * lookup indexes the entry names (4 bytes an entry); entries themselves
+ * are only parsed, and checked, when they are looked up or extracted.
+ * Meant for big packages where only a few entries are needed, so a
+ * corrupt entry is reported when it is used rather than on open.
+ *
+ * Same return values as mzOpenZipArchive().
+ */
+int mzOpenZipArchiveLazy(const char* fileName, ZipArchive* pArchive);
+
+/*
+ * Open a Zip archive from a file the caller already mapped with
+ * sysMapFileInShmem(), so a package that was just hashed is not mapped
+ * twice.  The archive takes over "fd" and "pMap" whether or not this
+ * succeeds; mzCloseZipArchive() releases them.  The archive is opened
+ * lazily, as with mzOpenZipArchiveLazy().
+ *
+ * On success, returns 0 and populates "pArchive".  Returns nonzero
+ * value on failure.
+ */
+int mzOpenZipArchiveMapped(int fd, const MemMapping* pMap,
+        ZipArchive* pArchive);
+
 /*
  * Close archive, releasing resources associated with it.
  *
@@ -93,16 +120,11 @@ INLINE unsigned int mzZipEntryCount(const ZipArchive* pArchive) {
 }
 
 /*
- * Get an entry by index.  Returns NULL if the index is out-of-bounds.
+ * Get an entry by index.  Returns NULL if the index is out-of-bounds
+ * (or, for lazy archives, if the entry is corrupt).
  */
-INLINE const ZipEntry*
-mzGetZipEntryAt(const ZipArchive* pArchive, unsigned int index)
-{
-    if (index < pArchive->numEntries) {
-        return pArchive->pEntries + index;
-    }
-    return NULL;
-}
+const ZipEntry* mzGetZipEntryAt(const ZipArchive* pArchive,
+        unsigned int index);
 
 /*
  * Get the index number of an entry in the archive.
@@ -204,14 +226,20 @@ bool mzExtractZipEntryToBuffer(const ZipArchive *pArchive,
  *
  *     MZ_EXTRACT_FILES_ONLY - only unpack files, not directories or symlinks
  *     MZ_EXTRACT_DRY_RUN - don't do anything, but do invoke the callback
+ *     MZ_EXTRACT_PARALLEL - inflate regular files on up to
+ *         MZ_EXTRACT_MAX_THREADS worker threads (one per core).  Directories
+ *         and symlinks are still created in entry order before any file
+ *         below them is written.
  *
  * If timestamp is non-NULL, file timestamps will be set accordingly.
  *
- * If callback is non-NULL, it will be invoked with each unpacked file.
+ * If callback is non-NULL, it will be invoked with each unpacked file,
+ * in entry order and from the calling thread even with MZ_EXTRACT_PARALLEL.
  *
  * Returns true on success, false on failure.
  */
-enum { MZ_EXTRACT_FILES_ONLY = 1, MZ_EXTRACT_DRY_RUN = 2 };
+enum { MZ_EXTRACT_FILES_ONLY = 1, MZ_EXTRACT_DRY_RUN = 2, MZ_EXTRACT_PARALLEL = 4 };
+#define MZ_EXTRACT_MAX_THREADS 8
 bool mzExtractRecursive(const ZipArchive *pArchive,
         const char *zipDir, const char *targetDir,
         int flags, const struct utimbuf *timestamp,
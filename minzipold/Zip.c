@@ -474,6 +474,38 @@ bail:
     return err;
 }
 
+int mzOpenZipArchiveLazy(const char* fileName, ZipArchive* pArchive)
+{
+    return mzOpenZipArchive(fileName, pArchive);
+}
+
+/*
+ * Open a Zip archive from an existing mapping of the whole file.
+ */
+int mzOpenZipArchiveMapped(int fd, const MemMapping* pMap,
+        ZipArchive* pArchive)
+{
+    int err = 0;
+
+    LOGV("Opening mapped archive %p\n", pArchive);
+
+    memset(pArchive, 0, sizeof(*pArchive));
+    pArchive->fd = fd;
+    sysCopyMap(&pArchive->map, pMap);
+
+    if (pMap->length < ENDHDR) {
+        err = -1;
+        LOGV("File too small to be zip (%zd)\n", pMap->length);
+    } else if (!parseZipArchive(pArchive, pMap)) {
+        err = -1;
+        LOGV("Parsing mapped archive failed\n");
+    }
+
+    if (err != 0)
+        mzCloseZipArchive(pArchive);
+    return err;
+}
+
 /*
  * Close a ZipArchive, closing the file and freeing the contents.
  *
@@ -74,6 +74,24 @@ typedef struct {
  */
 int mzOpenZipArchive(const char* fileName, ZipArchive* pArchive);
 
+/*
+ * Same as mzOpenZipArchive().  minzip indexes the central directory
+ * lazily for these; this copy always parses it up front.
+ */
+int mzOpenZipArchiveLazy(const char* fileName, ZipArchive* pArchive);
+
+/*
+ * Open a Zip archive from a file the caller already mapped with
+ * sysMapFileInShmem(), so a package that was just hashed is not mapped
+ * twice.  The archive takes over "fd" and "pMap" whether or not this
+ * succeeds; mzCloseZipArchive() releases them.
+ *
+ * On success, returns 0 and populates "pArchive".  Returns nonzero
+ * value on failure.
+ */
+int mzOpenZipArchiveMapped(int fd, const MemMapping* pMap,
+        ZipArchive* pArchive);
+
 /*
  * Close archive, releasing resources associated with it.
  *
@@ -208,6 +226,8 @@ bool mzExtractZipEntryToBuffer(const ZipArchive *pArchive,
  *
  *     MZ_EXTRACT_FILES_ONLY - only unpack files, not directories or symlinks
  *     MZ_EXTRACT_DRY_RUN - don't do anything, but do invoke the callback
+ *     MZ_EXTRACT_PARALLEL - accepted for source compatibility with minzip;
+ *         this copy always extracts on the calling thread
  *
  * If timestamp is non-NULL, file timestamps will be set accordingly.
  *
@@ -215,7 +235,7 @@ bool mzExtractZipEntryToBuffer(const ZipArchive *pArchive,
  *
  * Returns true on success, false on failure.
  */
-enum { MZ_EXTRACT_FILES_ONLY = 1, MZ_EXTRACT_DRY_RUN = 2 };
+enum { MZ_EXTRACT_FILES_ONLY = 1, MZ_EXTRACT_DRY_RUN = 2, MZ_EXTRACT_PARALLEL = 4 };
 bool mzExtractRecursive(const ZipArchive *pArchive,
         const char *zipDir, const char *targetDir,
         int flags, const struct utimbuf *timestamp,
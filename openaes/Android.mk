@@ -22,5 +22,13 @@ ifneq ($(TW_EXCLUDE_ENCRYPTED_BACKUPS), true)
 		bootable/recovery/openaes/inc
 	LOCAL_SRC_FILES = src/oaes_lib.c src/isaac/rand.c
 	LOCAL_SHARED_LIBRARIES = libc
+	# let the block cipher use the AES instructions, they are only
+	# executed after checking that the cpu has them
+	ifeq ($(TARGET_ARCH),arm64)
+		LOCAL_CFLAGS += -march=armv8-a+crypto
+	endif
+	ifneq ($(filter x86 x86_64,$(TARGET_ARCH)),)
+		LOCAL_CFLAGS += -maes
+	endif
 	include $(BUILD_SHARED_LIBRARY)
 endif
@@ -87,6 +87,25 @@ typedef int ( * oaes_step_cb ) (
 
 typedef uint16_t OAES_OPTION;
 
+/*
+ * oaes_set_kernel() picks the code that encrypts and decrypts single blocks,
+ * oaes_alloc() selects the fastest one the cpu supports
+ */
+typedef enum
+{
+	// fastest supported kernel
+	OAES_KERNEL_AUTO = 0,
+	// byte at a time implementation of the standard, always used while
+	// OAES_OPTION_STEP_ON is set
+	OAES_KERNEL_REF,
+	// 32-bit lookup tables, portable
+	OAES_KERNEL_TTABLE,
+	// x86 AES-NI instructions, needs a build with -maes
+	OAES_KERNEL_AESNI,
+	// ARMv8 cryptography extensions, needs a build with +crypto
+	OAES_KERNEL_ARMV8
+} OAES_KERNEL;
+
 /*
  * // usage:
  * 
@@ -129,6 +148,11 @@ OAES_RET oaes_free( OAES_CTX ** ctx );
 OAES_RET oaes_set_option( OAES_CTX * ctx,
 		OAES_OPTION option, const void * value );
 
+// returns OAES_RET_ARG2 if kernel is not available in this build or on this cpu
+OAES_RET oaes_set_kernel( OAES_CTX * ctx, OAES_KERNEL kernel );
+
+OAES_KERNEL oaes_get_kernel( OAES_CTX * ctx );
+
 OAES_RET oaes_key_gen_128( OAES_CTX * ctx );
 
 OAES_RET oaes_key_gen_192( OAES_CTX * ctx );
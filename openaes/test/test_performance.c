@@ -27,7 +27,6 @@
  * POSSIBILITY OF SUCH DAMAGE.
  * ---------------------------------------------------------------------------
  */
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,6 +34,25 @@
 
 #include "oaes_lib.h"
 
+// openaes enc reads the input in pieces of this size, each one becomes a
+// self-contained 4096 byte record, so this is what a backup or restore does
+#define REC_LEN_ENC ( 4096 - 2 * OAES_BLOCK_SIZE )
+#define REC_LEN_DEC 4096
+#define TEST_BUF_LEN ( 1024 * 1024 )
+
+static const struct
+{
+	const char * name;
+	OAES_KERNEL kernel;
+} _kernels[] = {
+	{ "ref", OAES_KERNEL_REF },
+	{ "ttable", OAES_KERNEL_TTABLE },
+	{ "aesni", OAES_KERNEL_AESNI },
+	{ "armv8", OAES_KERNEL_ARMV8 },
+};
+
+#define KERNEL_COUNT ( sizeof( _kernels ) / sizeof( _kernels[0] ) )
+
 void usage(const char * exe_name)
 {
 	if( NULL == exe_name )
@@ -42,25 +60,43 @@ void usage(const char * exe_name)
 	
 	printf(
 			"Usage:\n"
-			"\t%s [-ecb] [-key < 128 | 192 | 256 >] [-data <data_len>]\n",
+			"\t%s [-ecb] [-key < 128 | 192 | 256 >] [-data <data_len>]\n"
+			"\t\t[-kernel < all | ref | ttable | aesni | armv8 >]\n",
 			exe_name
 	);
 }
 
+static double now()
+{
+	struct timespec _ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &_ts );
+	return _ts.tv_sec + _ts.tv_nsec / 1e9;
+}
+
+static double rate( size_t mb, double seconds )
+{
+	return seconds > 0 ? mb / seconds : 0;
+}
+
 /*
  * 
  */
 int main(int argc, char** argv) {
 
-	size_t _i, _j;
-	time_t _time_start, _time_end;
+	size_t _i, _j, _k;
+	double _time_start, _enc_time, _dec_time, _ref_enc = 0, _ref_dec = 0;
 	OAES_CTX * ctx = NULL;
 	uint8_t *_encbuf, *_decbuf;
-	size_t _encbuf_len, _decbuf_len;
-	uint8_t _buf[1024 * 1024];
+	size_t _encbuf_len, _decbuf_len, _len;
+	static uint8_t _buf[TEST_BUF_LEN];
+	uint8_t _key[32];
+	size_t _key_data_len;
 	short _is_ecb = 0;
 	int _key_len = 128;
 	size_t _data_len = 64;
+	const char * _kernel = "all";
+	int _failed = 0;
 	
 	for( _i = 1; _i < argc; _i++ )
 	{
@@ -112,6 +148,20 @@ int main(int argc, char** argv) {
 			_data_len = atoi( argv[_i] );
 		}
 		
+		if( 0 == strcmp( argv[_i], "-kernel" ) )
+		{
+			_found = 1;
+			_i++; // kernel
+			if( _i >= argc )
+			{
+				printf("Error: No value specified for '-%s'.\n",
+						"kernel");
+				usage( argv[0] );
+				return 1;
+			}
+			_kernel = argv[_i];
+		}
+		
 		if( 0 == _found )
 		{
 			printf("Error: Invalid option '%s'.\n", argv[_i]);
@@ -120,81 +170,110 @@ int main(int argc, char** argv) {
 		}			
 	}
 
-	// generate random test data
-	time( &_time_start );
-	srand( _time_start );
-	for( _i = 0; _i < 1024 * 1024; _i++ )
+	// generate random test data and a random key shared by all kernels
+	srand( time( NULL ) );
+	for( _i = 0; _i < TEST_BUF_LEN; _i++ )
 		_buf[_i] = rand();
-	
-	ctx = oaes_alloc();
-	if( NULL == ctx )
-	{
-		printf("Error: Failed to initialize OAES.\n");
-		return EXIT_FAILURE;
-	}
-	if( _is_ecb )
-		if( OAES_RET_SUCCESS != oaes_set_option( ctx, OAES_OPTION_ECB, NULL ) )
-			printf("Error: Failed to set OAES options.\n");
-	switch( _key_len )
-	{
-		case 128:
-			if( OAES_RET_SUCCESS != oaes_key_gen_128(ctx) )
-				printf("Error: Failed to generate OAES %d bit key.\n", _key_len);
-			break;
-		case 192:
-			if( OAES_RET_SUCCESS != oaes_key_gen_192(ctx) )
-				printf("Error: Failed to generate OAES %d bit key.\n", _key_len);
-			break;
-		case 256:
-			if( OAES_RET_SUCCESS != oaes_key_gen_256(ctx) )
-				printf("Error: Failed to generate OAES %d bit key.\n", _key_len);
-			break;
-		default:
-			break;
-	}
+	_key_data_len = _key_len / 8;
+	for( _i = 0; _i < _key_data_len; _i++ )
+		_key[_i] = rand();
 
-	if( OAES_RET_SUCCESS != oaes_encrypt( ctx,
-			(const uint8_t *)_buf, 1024 * 1024, NULL, &_encbuf_len ) )
-		printf("Error: Failed to retrieve required buffer size for encryption.\n");
+	_encbuf_len = ( TEST_BUF_LEN / REC_LEN_ENC + 1 ) * REC_LEN_DEC;
 	_encbuf = (uint8_t *) calloc( _encbuf_len, sizeof( char ) );
-	if( NULL == _encbuf )
-	{
-		printf( "Error: Failed to allocate memory.\n" );
-		return EXIT_FAILURE;
-	}
-
-	if( OAES_RET_SUCCESS != oaes_decrypt( ctx,
-			_encbuf, _encbuf_len, NULL, &_decbuf_len ) )
-		printf("Error: Failed to retrieve required buffer size for encryption.\n");
-	_decbuf = (uint8_t *) calloc( _decbuf_len, sizeof( char ) );
-	if( NULL == _decbuf )
+	_decbuf = (uint8_t *) calloc( TEST_BUF_LEN, sizeof( char ) );
+	if( NULL == _encbuf || NULL == _decbuf )
 	{
 		free( _encbuf );
 		printf( "Error: Failed to allocate memory.\n" );
 		return EXIT_FAILURE;
 	}
 
-	time( &_time_start );
-	
-	for( _i = 0; _i < _data_len; _i++ )
+	printf( "Test encrypt and decrypt in %d byte records:\n"
+			"\tdata: %ld MB\n\tkey: %d bits\n\tmode: %s\n",
+			REC_LEN_ENC, _data_len, _key_len, _is_ecb? "EBC" : "CBC" );
+
+	for( _k = 0; _k < KERNEL_COUNT; _k++ )
 	{
-		if( OAES_RET_SUCCESS != oaes_encrypt( ctx,
-				(const uint8_t *)_buf, 1024 * 1024, _encbuf, &_encbuf_len ) )
-			printf("Error: Encryption failed.\n");
-		if( OAES_RET_SUCCESS !=  oaes_decrypt( ctx,
-				_encbuf, _encbuf_len, _decbuf, &_decbuf_len ) )
-			printf("Error: Decryption failed.\n");
+		if( strcmp( _kernel, "all" ) && strcmp( _kernel, _kernels[_k].name ) )
+			continue;
+
+		ctx = oaes_alloc();
+		if( NULL == ctx )
+		{
+			printf("Error: Failed to initialize OAES.\n");
+			return EXIT_FAILURE;
+		}
+		if( OAES_RET_SUCCESS != oaes_set_kernel( ctx, _kernels[_k].kernel ) )
+		{
+			printf( "\t%-8s not available\n", _kernels[_k].name );
+			oaes_free( &ctx );
+			continue;
+		}
+		if( _is_ecb )
+			if( OAES_RET_SUCCESS != oaes_set_option( ctx, OAES_OPTION_ECB, NULL ) )
+				printf("Error: Failed to set OAES options.\n");
+		if( OAES_RET_SUCCESS != oaes_key_import_data( ctx, _key, _key_data_len ) )
+			printf("Error: Failed to import OAES %d bit key.\n", _key_len);
+
+		// backup
+		_time_start = now();
+		for( _i = 0; _i < _data_len; _i++ )
+		{
+			for( _j = 0, _encbuf_len = 0; _j < TEST_BUF_LEN; _j += REC_LEN_ENC )
+			{
+				size_t _out_len = REC_LEN_DEC;
+
+				_len = TEST_BUF_LEN - _j < REC_LEN_ENC ? TEST_BUF_LEN - _j : REC_LEN_ENC;
+				if( OAES_RET_SUCCESS != oaes_encrypt( ctx,
+						_buf + _j, _len, _encbuf + _encbuf_len, &_out_len ) )
+					printf("Error: Encryption failed.\n");
+				_encbuf_len += _out_len;
+			}
+		}
+		_enc_time = now() - _time_start;
+
+		// restore
+		_time_start = now();
+		for( _i = 0; _i < _data_len; _i++ )
+		{
+			for( _j = 0, _decbuf_len = 0; _j < _encbuf_len; _j += REC_LEN_DEC )
+			{
+				size_t _out_len = TEST_BUF_LEN - _decbuf_len;
+
+				_len = _encbuf_len - _j < REC_LEN_DEC ? _encbuf_len - _j : REC_LEN_DEC;
+				if( OAES_RET_SUCCESS != oaes_decrypt( ctx,
+						_encbuf + _j, _len, _decbuf + _decbuf_len, &_out_len ) )
+					printf("Error: Decryption failed.\n");
+				_decbuf_len += _out_len;
+			}
+		}
+		_dec_time = now() - _time_start;
+
+		if( _decbuf_len != TEST_BUF_LEN || memcmp( _buf, _decbuf, TEST_BUF_LEN ) )
+		{
+			printf( "Error: %s kernel did not decrypt to the original data.\n",
+					_kernels[_k].name );
+			_failed = 1;
+		}
+
+		printf( "\t%-8s encrypt: %8.2f MB/s  decrypt: %8.2f MB/s",
+				_kernels[_k].name, rate( _data_len, _enc_time ),
+				rate( _data_len, _dec_time ) );
+		if( OAES_KERNEL_REF == _kernels[_k].kernel )
+		{
+			_ref_enc = _enc_time;
+			_ref_dec = _dec_time;
+		}
+		else if( _ref_enc > 0 && _enc_time > 0 && _dec_time > 0 )
+			printf( "  (%.1fx / %.1fx)", _ref_enc / _enc_time, _ref_dec / _dec_time );
+		printf( "\n" );
+
+		if( OAES_RET_SUCCESS !=  oaes_free( &ctx ) )
+			printf("Error: Failed to uninitialize OAES.\n");
 	}
-	
-	time( &_time_end );
-	printf( "Test encrypt and decrypt:\n\ttime: %lld seconds\n\tdata: %ld MB"
-			"\n\tkey: %d bits\n\tmode: %s\n",
-			_time_end - _time_start, _data_len,
-			_key_len, _is_ecb? "EBC" : "CBC" );
+
 	free( _encbuf );
 	free( _decbuf );
-	if( OAES_RET_SUCCESS !=  oaes_free( &ctx ) )
-		printf("Error: Failed to uninitialize OAES.\n");
 
-	return (EXIT_SUCCESS);
+	return _failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -516,6 +516,8 @@ int OpenRecoveryScript::Backup_Command(string Options) {
 
 	DataManager::SetValue(TW_USE_COMPRESSION_VAR, 0);
 	DataManager::SetValue(TW_SKIP_MD5_GENERATE_VAR, 0);
+	DataManager::SetValue(TW_SPARSE_IMAGES_VAR, 0);
+	DataManager::SetValue(TW_USED_BLOCKS_IMAGES_VAR, 0);
 
 	gui_print("Setting backup options:\n");
 	line_len = Options.size();
@@ -577,6 +579,12 @@ int OpenRecoveryScript::Backup_Command(string Options) {
 		} else if (Options.substr(i, 1) == "M" || Options.substr(i, 1) == "m") {
 			DataManager::SetValue(TW_SKIP_MD5_GENERATE_VAR, 1);
 			gui_print("MD5 Generation is off\n");
+		} else if (Options.substr(i, 1) == "P" || Options.substr(i, 1) == "p") {
+			DataManager::SetValue(TW_SPARSE_IMAGES_VAR, 1);
+			gui_print("Sparse images are on\n");
+		} else if (Options.substr(i, 1) == "I" || Options.substr(i, 1) == "i") {
+			DataManager::SetValue(TW_USED_BLOCKS_IMAGES_VAR, 1);
+			gui_print("Used blocks images are on\n");
 		}
 	}
 	DataManager::SetValue("tw_backup_list", Backup_List);
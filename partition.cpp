@@ -22,6 +22,9 @@
 #include <sys/stat.h>
 #include <sys/vfs.h>
 #include <sys/mount.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <iostream>
@@ -39,6 +42,9 @@
 #include "twrp-functions.hpp"
 #include "twrpDigest.hpp"
 #include "twrpTar.hpp"
+#include "twrpDirIndex.hpp"
+#include "twrpImage.hpp"
+#include "twrpBlockMap.hpp"
 extern "C" {
 	#include "mtdutils/mtdutils.h"
 	#include "mtdutils/mounts.h"
@@ -60,6 +66,13 @@ using namespace std;
 extern struct selabel_handle *selinux_handle; 
 #endif
 
+#ifndef BLKDISCARD
+	#define BLKDISCARD _IO(0x12,119)
+#endif
+#ifndef BLKSECDISCARD
+	#define BLKSECDISCARD _IO(0x12,125)
+#endif
+
 struct flag_list {
 	const char *name;
 	unsigned flag;
@@ -150,6 +163,9 @@ TWPartition::TWPartition(void) {
 #ifdef TW_INCLUDE_CRYPTO_SAMSUNG
 	EcryptFS_Password = "";
 #endif
+	Image_Progress_Start = 0;
+	Image_Progress_Portion = 0;
+	Used_Blocks_Size = 0;
 }
 
 TWPartition::~TWPartition(void) {
@@ -1089,8 +1105,16 @@ bool TWPartition::Update_Size(bool Display_Error) {
 	if (Has_Data_Media) {
 		if (Mount(Display_Error)) {
 			unsigned long long data_media_used, actual_data;
-			Used = TWFunc::Get_Folder_Size("/data", Display_Error);
-			data_media_used = TWFunc::Get_Folder_Size("/data/media", Display_Error);
+			vector<string> Media(1, "/data/media");
+			twrpDirIndex Index;
+			// One walk sizes both /data and /data/media, the backup makes its own
+			if (Index.Build("/data", Display_Error, &Media)) {
+				Used = Index.Size_Of("/data");
+				data_media_used = Index.Size_Of("/data/media");
+			} else {
+				Used = 0;
+				data_media_used = 0;
+			}
 			actual_data = Used - data_media_used;
 			Backup_Size = actual_data;
 			int bak = (int)(Backup_Size / 1048576LLU);
@@ -1800,6 +1824,55 @@ bool TWPartition::Wipe_Encryption() {
 	return false;
 }
 
+// Tells the eMMC / UFS controller that everything the format is about to
+// overwrite is free. The erase is done by the controller in a fraction of
+// the time it takes to overwrite it and the freed blocks no longer have to
+// be carried around. A device without discard support is wiped by the
+// format alone, as before.
+bool TWPartition::Discard_Blocks() {
+#ifdef TW_NO_WIPE_DISCARD
+	return false;
+#else
+	int fd;
+	off64_t size;
+	uint64_t range[2];
+
+	fd = open(Actual_Block_Device.c_str(), O_RDWR | O_LARGEFILE);
+	if (fd < 0) {
+		LOGINFO("Unable to open '%s' to discard it: %s\n", Actual_Block_Device.c_str(), strerror(errno));
+		return false;
+	}
+	size = lseek64(fd, 0, SEEK_END);
+	if (size <= 0) {
+		close(fd);
+		return false;
+	}
+	// Keep the crypto footer outside of the file system's length
+	if (!Is_Decrypted && Length < 0 && -(off64_t) Length < size)
+		size += Length;
+	else if (!Is_Decrypted && Length > 0 && Length < size)
+		size = Length;
+	range[0] = 0;
+	range[1] = size;
+#ifdef TW_WIPE_SECURE_DISCARD
+	if (ioctl(fd, BLKSECDISCARD, &range) == 0) {
+		LOGINFO("Securely discarded %llu bytes of '%s'\n", (unsigned long long) size, Actual_Block_Device.c_str());
+		close(fd);
+		return true;
+	}
+	LOGINFO("Secure discard of '%s' failed: %s\n", Actual_Block_Device.c_str(), strerror(errno));
+#endif
+	if (ioctl(fd, BLKDISCARD, &range) != 0) {
+		LOGINFO("Unable to discard '%s': %s\n", Actual_Block_Device.c_str(), strerror(errno));
+		close(fd);
+		return false;
+	}
+	LOGINFO("Discarded %llu bytes of '%s'\n", (unsigned long long) size, Actual_Block_Device.c_str());
+	close(fd);
+	return true;
+#endif
+}
+
 bool TWPartition::Wipe_EXT23(string File_System) {
 	if (!UnMount(true))
 		return false;
@@ -1809,6 +1882,7 @@ bool TWPartition::Wipe_EXT23(string File_System) {
 
 		gui_print("Formatting %s using mke2fs...\n", Display_Name.c_str());
 		Find_Actual_Block_Device();
+		Discard_Blocks();
 		command = "mke2fs -t " + File_System + " -m 0 " + Actual_Block_Device;
 		LOGINFO("mke2fs command: %s\n", command.c_str());
 		if (TWFunc::Exec_Cmd(command) == 0) {
@@ -1834,6 +1908,7 @@ bool TWPartition::Wipe_EXT4() {
 		return false;
 #if defined(HAVE_SELINUX) && defined(USE_EXT4) 
 	gui_print("Formatting %s using make_ext4fs function.\n", Display_Name.c_str());
+	Discard_Blocks();
 	if (make_ext4fs(Actual_Block_Device.c_str(), Length, Mount_Point.c_str(), selinux_handle) != 0) {
 		LOGERR("Unable to wipe '%s' using function call.\n", Mount_Point.c_str());
 		return false;
@@ -1863,6 +1938,7 @@ bool TWPartition::Wipe_EXT4() {
 
 		gui_print("Formatting %s using make_ext4fs...\n", Display_Name.c_str());
 		Find_Actual_Block_Device();
+		Discard_Blocks();
 		Command = "make_ext4fs";
 		if (!Is_Decrypted && Length != 0) {
 			// Only use length if we're not decrypted
@@ -1903,6 +1979,7 @@ bool TWPartition::Wipe_NILFS2() {
 
 		gui_print("Formatting %s using mkfs.nilfs2...\n", Display_Name.c_str());
 		Find_Actual_Block_Device();
+		Discard_Blocks();
 		command = "mkfs.nilfs2 " + Actual_Block_Device;
 		if (TWFunc::Exec_Cmd(command) == 0) {
 			Current_File_System = "nilfs2";
@@ -1931,6 +2008,7 @@ bool TWPartition::Wipe_FAT() {
 
 		gui_print("Formatting %s using mkdosfs...\n", Display_Name.c_str());
 		Find_Actual_Block_Device();
+		Discard_Blocks();
 		command = "mkdosfs " + Actual_Block_Device;
 		if (TWFunc::Exec_Cmd(command) == 0) {
 			Current_File_System = "vfat";
@@ -1958,6 +2036,7 @@ bool TWPartition::Wipe_EXFAT() {
 
 		gui_print("Formatting %s using mkexfatfs...\n", Display_Name.c_str());
 		Find_Actual_Block_Device();
+		Discard_Blocks();
 		command = "mkexfatfs " + Actual_Block_Device;
 		if (TWFunc::Exec_Cmd(command) == 0) {
 			Recreate_AndSec_Folder();
@@ -1983,6 +2062,7 @@ bool TWPartition::Wipe_F2FS() {
 
 		gui_print("Formatting %s using mkfs.f2fs...\n", Display_Name.c_str());
 		Find_Actual_Block_Device();
+		Discard_Blocks();
 		command = "mkfs.f2fs " + Actual_Block_Device;
 		if (TWFunc::Exec_Cmd(command) == 0) {
 			Recreate_AndSec_Folder();
@@ -2008,6 +2088,7 @@ bool TWPartition::Wipe_NTFS() {
 
 		gui_print("Formatting %s using mkntfs...\n", Display_Name.c_str());
 		Find_Actual_Block_Device();
+		Discard_Blocks();
 		command = "mkntfs -f " + Actual_Block_Device;
 		if (TWFunc::Exec_Cmd(command) == 0) {
 			Current_File_System = "ntfs";
@@ -2131,7 +2212,9 @@ bool TWPartition::Wipe_Data_Without_Wiping_Media() {
  * Partition's backup stuff
  */
 int TWPartition::Backup(string backup_folder) {
-	if (Backup_Method == FILES)
+	if (Backup_Method == FILES && Can_Backup_Used_Blocks())
+		return Backup_Used_Blocks(backup_folder);
+	else if (Backup_Method == FILES)
 		return Backup_Tar(backup_folder);
 	else if (Backup_Method == DD)
 		return Backup_DD(backup_folder);
@@ -2155,10 +2238,49 @@ string TWPartition::Backup_Method_By_Name() {
 	return "ERROR!";
 }
 
+// Used blocks images hold the whole file system, partitions whose tar
+// backups leave something out or are encrypted keep using tar
+bool TWPartition::Can_Backup_Used_Blocks() {
+	if (Backup_Method != FILES || DataManager::GetIntValue(TW_USED_BLOCKS_IMAGES_VAR) == 0)
+		return false;
+	if (Current_File_System != "ext4" && Current_File_System != "f2fs")
+		return false;
+	if (Has_Data_Media || Has_Android_Secure || Has_SubPartition || Is_SubPartition || Actual_Block_Device.empty())
+		return false;
+	if ((Backup_Path == "/data" || Backup_Path == "/sd-ext" || Backup_Path == "/sdext2") && DataManager::GetIntValue(TW_SKIP_DALVIK) != 0)
+		return false;
+#ifdef TW_DEVICE_IS_HTC_LEO
+	if (Backup_Path == "/sd-ext" || Backup_Path == "/sdext2")
+		return false;
+#endif
+#ifndef TW_EXCLUDE_ENCRYPTED_BACKUPS
+	if (Can_Encrypt_Backup && DataManager::GetIntValue("tw_encrypt_backup") != 0)
+		return false;
+#endif
+	return true;
+}
+
+void TWPartition::Update_Used_Blocks_Size() {
+	twrpBlockMap block_map;
+	bool Was_Mounted;
+
+	Used_Blocks_Size = 0;
+	if (!Can_Backup_Used_Blocks())
+		return;
+	// Read the bitmaps unmounted, the same as the backup does
+	Was_Mounted = Is_Mounted();
+	if (!UnMount(false))
+		return;
+	if (block_map.read(Actual_Block_Device, Current_File_System))
+		Used_Blocks_Size = block_map.usedBlocks() * block_map.blockSize();
+	if (Was_Mounted)
+		Mount(false);
+}
+
 int TWPartition::Backup_Tar(string backup_folder) {
 	char back_name[255], split_index[5];
 	string Full_FileName, Split_FileName, Tar_Args = "", Tar_Excl = "", Command, result;
-	int use_compression, use_encryption = 0, index, backup_count, skip_dalvik;
+	int use_compression, use_encryption = 0, index, backup_count, skip_dalvik, ret;
 	struct stat st;
 	unsigned long long total_bsize = 0, file_size;
 	twrpTar tar;
@@ -2216,6 +2338,27 @@ int TWPartition::Backup_Tar(string backup_folder) {
 		gui_print("Skipping Data (Empty partition).\n", Backup_Name.c_str());
 		return -1;
 	}
+#ifndef TW_EXCLUDE_ENCRYPTED_BACKUPS
+	// A pool of threads writes the backup as Full_FileName<thread><index> archives,
+	// each thread starts a new archive whenever its current one reaches MAX_ARCHIVE_SIZE
+	tar.split_archives = 1;
+	tar.setexcl(Tar_Excl);
+#ifdef TW_DEVICE_IS_HTC_LEO
+	if (Backup_Path == "/sd-ext" && dataonext)
+		tar.setdir(Backup_Path + pathTodatafolder);
+	else
+#endif
+		tar.setdir(Backup_Path);
+	tar.setfn(Full_FileName);
+	ret = tar.createTarFork();
+	if (ret != 0)
+		return 0;
+	Full_FileName += "000";
+	if (TWFunc::Get_File_Size(Full_FileName) == 0) {
+		LOGERR("Backup file size for '%s' is 0 bytes.\n", Full_FileName.c_str());
+		return -1;
+	}
+#else
 	if (Backup_Size > MAX_ARCHIVE_SIZE) {
 		// This backup needs to be split into multiple archives
 		gui_print("Breaking backup file into multiple archives...\n");
@@ -2243,32 +2386,21 @@ int TWPartition::Backup_Tar(string backup_folder) {
 #endif
 			tar.setdir(Backup_Path);
 		tar.setfn(Full_FileName);
-#ifndef TW_EXCLUDE_ENCRYPTED_BACKUPS
-		if (tar.createTarFork() != 0)
-			return 0;
-		if (use_compression && !use_encryption) {
-#else
 		if (use_compression) {
 			if (tar.createTarGZFork() != 0)
 				return -1;
-#endif
 			string gzname = Full_FileName + ".gz";
 			rename(gzname.c_str(), Full_FileName.c_str());
-		}
-#ifdef TW_EXCLUDE_ENCRYPTED_BACKUPS
-		else {
+		} else {
 			if (tar.createTarFork() != 0)
 				return -1;
 		}
-#else
-		if (Can_Encrypt_Backup && use_encryption)
-			Full_FileName += "000";
-#endif
 		if (TWFunc::Get_File_Size(Full_FileName) == 0) {
 			LOGERR("Backup file size for '%s' is 0 bytes.\n", Full_FileName.c_str());
 			return -1;
 		}
 	}
+#endif
 #ifdef TW_DEVICE_IS_HTC_LEO
 	if (Backup_Path == "/sd-ext" && dataonext) {
 		// Create a file to recognize that this is DataOnExt and not a typical sd-ext backup
@@ -2286,39 +2418,107 @@ int TWPartition::Backup_Tar(string backup_folder) {
 }
 
 int TWPartition::Backup_DD(string backup_folder) {
-	char backup_size[32];
-	string Full_FileName, Command, DD_BS;
+	string Full_FileName;
+	twrpImage image;
+	twrpDigest md5sum;
+	bool sparse = (DataManager::GetIntValue(TW_SPARSE_IMAGES_VAR) != 0);
+	// A sparse image's header is finished last, so Make_MD5 hashes it afterwards
+	bool inline_md5 = (DataManager::GetIntValue(TW_SKIP_MD5_GENERATE_VAR) == 0 && !sparse);
+
 	TWFunc::GUI_Operation_Text(TW_BACKUP_TEXT, Display_Name, "Backing Up");
 	gui_print("Backing up %s...\n", Display_Name.c_str());
 
 	Backup_FileName = Backup_Name + "." + Current_File_System + ".win";
 	Full_FileName = backup_folder + Backup_FileName;
-	sprintf(backup_size, "%llu", Backup_Size);
-	DD_BS = backup_size;
 
-	Command = "dd if=" + Actual_Block_Device + " of='" + Full_FileName + "'" + " bs=" + DD_BS + "c count=1";
-	LOGINFO("Backup command: '%s'\n", Command.c_str());
-	TWFunc::Exec_Cmd(Command);
+	LOGINFO("Backing up '%s' to '%s' (%llu bytes)\n", Actual_Block_Device.c_str(), Full_FileName.c_str(), Backup_Size);
+	if (inline_md5) {
+		md5sum.startMD5();
+		image.setMD5(md5sum.getMD5Context());
+	}
+	image.setSparse(sparse);
+	image.setProgress(Image_Progress_Start, Image_Progress_Portion);
+	Image_Progress_Portion = 0;
+	if (image.backup(Actual_Block_Device, Full_FileName, Backup_Size) != 0)
+		return 0;
 	if (TWFunc::Get_File_Size(Full_FileName) == 0) {
 		LOGERR("Backup file size for '%s' is 0 bytes.\n", Full_FileName.c_str());
 		return -1;
 	}
+	if (inline_md5) {
+		md5sum.finishMD5();
+		md5sum.setfn(Full_FileName);
+		md5sum.write_md5digest();
+	}
 	return 1;
 }
 
 int TWPartition::Backup_Dump_Image(string backup_folder) {
-	string Full_FileName, Command;
+	string Full_FileName, Dump_FileName, Command;
+	bool sparse = (DataManager::GetIntValue(TW_SPARSE_IMAGES_VAR) != 0);
 	TWFunc::GUI_Operation_Text(TW_BACKUP_TEXT, Display_Name, "Backing Up");
 	gui_print("Backing up %s...\n", Display_Name.c_str());
 
 	Backup_FileName = Backup_Name + "." + Current_File_System + ".win";
 	Full_FileName = backup_folder + Backup_FileName;
+	// dump_image writes raw images, sparse ones are made from a copy in /tmp
+	Dump_FileName = (sparse ? "/tmp/" + Backup_FileName : Full_FileName);
 
-	Command = "dump_image " + MTD_Name + " '" + Full_FileName + "'";
+	Command = "dump_image " + MTD_Name + " '" + Dump_FileName + "'";
 	LOGINFO("Backup command: '%s'\n", Command.c_str());
 	TWFunc::Exec_Cmd(Command);
-	if (TWFunc::Get_File_Size(Full_FileName) == 0) {
+	unsigned long long dump_size = TWFunc::Get_File_Size(Dump_FileName);
+	if (dump_size == 0) {
 		// Actual size may not match backup size due to bad blocks on MTD devices so just check for 0 bytes
+		LOGERR("Backup file size for '%s' is 0 bytes.\n", Dump_FileName.c_str());
+		if (sparse)
+			unlink(Dump_FileName.c_str());
+		return -1;
+	}
+	if (sparse) {
+		twrpImage image;
+		image.setSparse(true);
+		int ret = image.backup(Dump_FileName, Full_FileName, dump_size);
+		unlink(Dump_FileName.c_str());
+		if (ret != 0)
+			return 0;
+	}
+	return 1;
+}
+
+int TWPartition::Backup_Used_Blocks(string backup_folder) {
+	string Full_FileName;
+	twrpBlockMap block_map;
+	twrpImage image;
+	unsigned long long device_size;
+
+	// The block bitmaps on disk are only up to date once the file system is unmounted
+	if (!UnMount(true))
+		return 0;
+	if (!block_map.read(Actual_Block_Device, Current_File_System)) {
+		gui_print("Unable to read the used blocks of %s, backing up its files instead.\n", Display_Name.c_str());
+		Image_Progress_Portion = 0;
+		return Backup_Tar(backup_folder);
+	}
+
+	TWFunc::GUI_Operation_Text(TW_BACKUP_TEXT, Display_Name, "Backing Up");
+	gui_print("Backing up %s (used blocks)...\n", Display_Name.c_str());
+
+	Backup_FileName = Backup_Name + "." + Current_File_System + ".win";
+	Full_FileName = backup_folder + Backup_FileName;
+	device_size = twrpImage::deviceSize(Actual_Block_Device);
+	if (device_size == 0) {
+		LOGERR("Unable to find the size of '%s'\n", Actual_Block_Device.c_str());
+		return 0;
+	}
+
+	LOGINFO("Backing up the used blocks of '%s' to '%s'\n", Actual_Block_Device.c_str(), Full_FileName.c_str());
+	image.setBlockMap(&block_map);
+	image.setProgress(Image_Progress_Start, Image_Progress_Portion);
+	Image_Progress_Portion = 0;
+	if (image.backup(Actual_Block_Device, Full_FileName, device_size) != 0)
+		return 0;
+	if (TWFunc::Get_File_Size(Full_FileName) == 0) {
 		LOGERR("Backup file size for '%s' is 0 bytes.\n", Full_FileName.c_str());
 		return -1;
 	}
@@ -2365,6 +2565,8 @@ bool TWPartition::Restore(string restore_folder) {
 	if (Is_File_System(Restore_File_System)) {
 		if (Use_unyaffs_To_Restore)
 			return Restore_Yaffs_Image(restore_folder);
+		else if (twrpImage::isSparse(restore_folder + "/" + Backup_FileName))
+			return Restore_Used_Blocks(restore_folder, Restore_File_System);
 		else
 			return Restore_Tar(restore_folder, Restore_File_System);
 	} else if (Is_Image(Restore_File_System)) {
@@ -2380,7 +2582,6 @@ bool TWPartition::Restore(string restore_folder) {
 bool TWPartition::Restore_Tar(string restore_folder, string Restore_File_System) {
 	string Full_FileName, Command, data_pth;
 	int index = 0, dataonext = 0;
-	char split_index[5];
 
 	Current_File_System = Restore_File_System;
 	if (Backup_Name == "sd-ext") {
@@ -2456,21 +2657,25 @@ bool TWPartition::Restore_Tar(string restore_folder, string Restore_File_System)
 	if (!TWFunc::Path_Exists(Full_FileName)) {
 		// Backup is multiple archives
 		LOGINFO("Backup is multiple archives.\n");
-		sprintf(split_index, "%03i", index);
-		Full_FileName += split_index;
-		while (TWFunc::Path_Exists(Full_FileName)) {
-			gui_print("Restoring archive %i...\n", index+1);
-			LOGINFO("Restoring '%s'...\n", Full_FileName.c_str());
-			if (!TWFunc::TarExtract(Full_FileName, Backup_Path))
-				return false;
-			index++;		
-			sprintf(split_index, "%03i", index);
-			Full_FileName = restore_folder + "/" + Backup_FileName + split_index;
-		}
+		vector<string> Archives;
+		index = TWFunc::Get_Split_Archives(Full_FileName, Archives);
 		if (index == 0) {
-			LOGERR("Error locating restore file: '%s'\n", Full_FileName.c_str());
+			LOGERR("Error locating restore file: '%s000'\n", Full_FileName.c_str());
 			return false;
 		}
+#ifndef TW_EXCLUDE_ENCRYPTED_BACKUPS
+		gui_print("Restoring %i archives...\n", index);
+		// extractTarFork() finds the archives of each backup thread from the base name
+		if (!TWFunc::TarExtract(Full_FileName, Backup_Path))
+			return false;
+#else
+		for (index = 0; index < (int)Archives.size(); index++) {
+			gui_print("Restoring archive %i...\n", index+1);
+			LOGINFO("Restoring '%s'...\n", Archives[index].c_str());
+			if (!TWFunc::TarExtract(Archives[index], Backup_Path))
+				return false;
+		}
+#endif
 	} else {
 		string tarDir = Backup_Path;
 		if (Backup_Path == "/sd-ext") {
@@ -2489,7 +2694,8 @@ bool TWPartition::Restore_Tar(string restore_folder, string Restore_File_System)
 }
 
 bool TWPartition::Restore_DD(string restore_folder) {
-	string Full_FileName, Command;
+	string Full_FileName;
+	twrpImage image;
 
 	TWFunc::GUI_Operation_Text(TW_RESTORE_TEXT, Display_Name, "Restoring");
 	Full_FileName = restore_folder + "/" + Backup_FileName;
@@ -2498,7 +2704,7 @@ bool TWPartition::Restore_DD(string restore_folder) {
 		LOGERR("Unable to find partition size for '%s'\n", Mount_Point.c_str());
 		return false;
 	}
-	unsigned long long backup_size = TWFunc::Get_File_Size(Full_FileName);
+	unsigned long long backup_size = twrpImage::imageSize(Full_FileName);
 	if (backup_size > Size) {
 		LOGERR("Size (%iMB) of backup '%s' is larger than target device '%s' (%iMB)\n",
 			(int)(backup_size / 1048576LLU), Full_FileName.c_str(),
@@ -2507,14 +2713,44 @@ bool TWPartition::Restore_DD(string restore_folder) {
 	}
 
 	gui_print("Restoring %s...\n", Display_Name.c_str());
-	Command = "dd bs=4096 if='" + Full_FileName + "' of=" + Actual_Block_Device;
-	LOGINFO("Restore command: '%s'\n", Command.c_str());
-	TWFunc::Exec_Cmd(Command);
+	LOGINFO("Restoring '%s' to '%s'\n", Full_FileName.c_str(), Actual_Block_Device.c_str());
+	image.setProgress(Image_Progress_Start, Image_Progress_Portion);
+	Image_Progress_Portion = 0;
+	return image.restore(Full_FileName, Actual_Block_Device) == 0;
+}
+
+// Blocks that were not in use when the image was taken are left as they are
+bool TWPartition::Restore_Used_Blocks(string restore_folder, string Restore_File_System) {
+	string Full_FileName;
+	twrpImage image;
+	unsigned long long backup_size, device_size;
+
+	TWFunc::GUI_Operation_Text(TW_RESTORE_TEXT, Display_Name, "Restoring");
+	Full_FileName = restore_folder + "/" + Backup_FileName;
+
+	if (!UnMount(true))
+		return false;
+	backup_size = twrpImage::imageSize(Full_FileName);
+	device_size = twrpImage::deviceSize(Actual_Block_Device);
+	if (backup_size > device_size) {
+		LOGERR("Size (%iMB) of backup '%s' is larger than target device '%s' (%iMB)\n",
+			(int)(backup_size / 1048576LLU), Full_FileName.c_str(),
+			Actual_Block_Device.c_str(), (int)(device_size / 1048576LLU));
+		return false;
+	}
+
+	gui_print("Restoring %s (used blocks)...\n", Display_Name.c_str());
+	LOGINFO("Restoring '%s' to '%s'\n", Full_FileName.c_str(), Actual_Block_Device.c_str());
+	image.setProgress(Image_Progress_Start, Image_Progress_Portion);
+	Image_Progress_Portion = 0;
+	if (image.restore(Full_FileName, Actual_Block_Device) != 0)
+		return false;
+	Current_File_System = Restore_File_System;
 	return true;
 }
 
 bool TWPartition::Restore_Flash_Image(string restore_folder) {
-	string Full_FileName, Command;
+	string Full_FileName, Command, Raw_FileName;
 
 	gui_print("Restoring %s...\n", Display_Name.c_str());
 	Full_FileName = restore_folder + "/" + Backup_FileName;
@@ -2523,7 +2759,7 @@ bool TWPartition::Restore_Flash_Image(string restore_folder) {
 		LOGERR("Unable to find partition size for '%s'\n", Mount_Point.c_str());
 		return false;
 	}
-	unsigned long long backup_size = TWFunc::Get_File_Size(Full_FileName);
+	unsigned long long backup_size = twrpImage::imageSize(Full_FileName);
 	if (backup_size > Size) {
 		LOGERR("Size (%iMB) of backup '%s' is larger than target device '%s' (%iMB)\n",
 			(int)(backup_size / 1048576LLU), Full_FileName.c_str(),
@@ -2534,9 +2770,21 @@ bool TWPartition::Restore_Flash_Image(string restore_folder) {
 	Command = "erase_image " + MTD_Name;
 	LOGINFO("Erase command: '%s'\n", Command.c_str());
 	TWFunc::Exec_Cmd(Command);
+	if (twrpImage::isSparse(Full_FileName)) {
+		// flash_image only takes raw images
+		twrpImage image;
+		Raw_FileName = "/tmp/" + Backup_FileName;
+		if (image.expand(Full_FileName, Raw_FileName) != 0) {
+			unlink(Raw_FileName.c_str());
+			return false;
+		}
+		Full_FileName = Raw_FileName;
+	}
 	Command = "flash_image " + MTD_Name + " '" + Full_FileName + "'";
 	LOGINFO("Restore command: '%s'\n", Command.c_str());
 	TWFunc::Exec_Cmd(Command);
+	if (!Raw_FileName.empty())
+		unlink(Raw_FileName.c_str());
 	return true;
 }
 
@@ -2629,8 +2877,8 @@ bool TWPartition::Check_MD5(string restore_folder) {
 		return true;
 
 	string Full_Filename, md5file, NandroidMD5;
-	char split_filename[512];
-	int index = 0;
+	vector<string> Archives;
+	unsigned index;
 	twrpDigest md5sum;
 
 	// Check if nandroid.md5 file exists and...
@@ -2639,28 +2887,27 @@ bool TWPartition::Check_MD5(string restore_folder) {
 		// ...split it to match TWRP's style.
 		TWFunc::Split_NandroidMD5(NandroidMD5);
 	}
-	memset(split_filename, 0, sizeof(split_filename));
 	Full_Filename = restore_folder + "/" + Backup_FileName;
 	if (!TWFunc::Path_Exists(Full_Filename)) {
 		 // This is a split archive, we presume
-		sprintf(split_filename, "%s%03i", Full_Filename.c_str(), index);
-		LOGINFO("split_filename: %s\n", split_filename);
-		md5file = split_filename;
-		md5file += ".md5";
-		if (!TWFunc::Path_Exists(md5file)) {
-			LOGERR("No md5 file found for '%s'.\n", split_filename);
+		if (TWFunc::Get_Split_Archives(Full_Filename, Archives) == 0) {
+			LOGERR("No md5 file found for '%s000'.\n", Full_Filename.c_str());
 			LOGERR("Please select 'Skip MD5 verification' to restore.\n");
 			return false;
 		}
-		md5sum.setfn(split_filename);
-		while (index < 1000 && TWFunc::Path_Exists(split_filename)) {
+		for (index = 0; index < Archives.size(); index++) {
+			LOGINFO("split_filename: %s\n", Archives[index].c_str());
+			md5file = Archives[index] + ".md5";
+			if (!TWFunc::Path_Exists(md5file)) {
+				LOGERR("No md5 file found for '%s'.\n", Archives[index].c_str());
+				LOGERR("Please select 'Skip MD5 verification' to restore.\n");
+				return false;
+			}
+			md5sum.setfn(Archives[index]);
 			if (md5sum.verify_md5digest() != 0) {
-				LOGERR("MD5 failed to match on '%s'.\n", split_filename);
+				LOGERR("MD5 failed to match on '%s'.\n", Archives[index].c_str());
 				return false;
 			}
-			index++;
-			sprintf(split_filename, "%s%03i", Full_Filename.c_str(), index);
-			md5sum.setfn(split_filename);
 		}
 		return true;
 	} else {
@@ -41,6 +41,7 @@
 #include "fixPermissions.hpp"
 #include "twrpDigest.hpp"
 #include "twrpTar.hpp"
+#include "twrpImage.hpp"
 
 #ifdef TW_INCLUDE_CRYPTO
 	#ifdef TW_INCLUDE_JB_CRYPTO
@@ -624,6 +625,11 @@ bool TWPartitionManager::Make_MD5(bool generate_md5, string Backup_Folder, strin
 	gui_print(" * Generating md5...\n");
 
 	if (TWFunc::Path_Exists(Full_File)) {
+		if (TWFunc::Path_Exists(Full_File + ".md5")) {
+			// Already computed while the archive was written
+			gui_print(" * MD5 Created.\n");
+			return true;
+		}
 		md5sum.setfn(Backup_Folder + Backup_Filename);
 		if (md5sum.computeMD5() == 0) {
 			if (md5sum.write_md5digest() == 0)
@@ -636,13 +642,17 @@ bool TWPartitionManager::Make_MD5(bool generate_md5, string Backup_Folder, strin
 			gui_print(" * MD5 compute-error!\n");
 		}
 	} else {
-		char filename[512];
-		int index = 0;
-		string strfn;
-		sprintf(filename, "%s%03i", Full_File.c_str(), index);
-		strfn = filename;
-		while (TWFunc::Path_Exists(filename) == true) {			
-			md5sum.setfn(filename);
+		vector<string> Archives;
+		unsigned index;
+
+		if (TWFunc::Get_Split_Archives(Full_File, Archives) == 0) {
+			LOGERR("Backup file: '%s000' not found!\n", Full_File.c_str());
+			return false;
+		}
+		for (index = 0; index < Archives.size(); index++) {
+			if (TWFunc::Path_Exists(Archives[index] + ".md5"))
+				continue;
+			md5sum.setfn(Archives[index]);
 			if (md5sum.computeMD5() == 0) {
 				if (md5sum.write_md5digest() != 0) {
 					gui_print(" * MD5 write-error.\n");
@@ -652,13 +662,6 @@ bool TWPartitionManager::Make_MD5(bool generate_md5, string Backup_Folder, strin
 				gui_print(" * MD5 compute-error.\n");
 				return -1;
 			}
-			index++;
-			sprintf(filename, "%s%03i", Full_File.c_str(), index);
-			strfn = filename;
-		}
-		if (index == 0) {
-			LOGERR("Backup file: '%s' not found!\n", filename);
-			return false;
 		}
 		gui_print(" * MD5 Created.\n");
 	}
@@ -679,7 +682,7 @@ int TWPartitionManager::Backup_Partition(TWPartition* Part,
 	unsigned long long file_bps;
 	unsigned long total_time, remain_time, section_time;
 	int use_compression, backup_time;
-	float pos;
+	float start_pos, pos;
 
 	if (Part == NULL)
 		return 1;
@@ -696,20 +699,29 @@ int TWPartitionManager::Backup_Partition(TWPartition* Part,
 	total_time = (*img_bytes / (unsigned long)img_bps) + (*file_bytes / (unsigned long)file_bps);
 	remain_time = (*img_bytes_remaining / (unsigned long)img_bps) + (*file_bytes_remaining / (unsigned long)file_bps);
 
-	pos = (total_time - remain_time) / (float) total_time;
-	DataManager::SetProgress(pos);
+	start_pos = (total_time - remain_time) / (float) total_time;
+	DataManager::SetProgress(start_pos);
 
 	LOGINFO("Estimated Total time: %lu  Estimated remaining time: %lu\n", total_time, remain_time);
 
 	// And get the time
-	if (Part->Backup_Method == 1)
+	if (Part->Used_Blocks_Size > 0)
+		section_time = Part->Used_Blocks_Size / img_bps;
+	else if (Part->Backup_Method == 1)
 		section_time = Part->Backup_Size / file_bps;
 	else
 		section_time = Part->Backup_Size / img_bps;
 
 	// Set the position
 	pos = section_time / (float) total_time;
-	DataManager::ShowProgress(pos, section_time);
+	if (Part->Backup_Method == TWPartition::DD || Part->Used_Blocks_Size > 0) {
+		// Raw images report how far they are, so the bar must not slide on its own
+		DataManager::ShowProgress(0, 0);
+		DataManager::SetProgress(start_pos);
+		Part->Image_Progress_Start = start_pos;
+		Part->Image_Progress_Portion = pos;
+	} else
+		DataManager::ShowProgress(pos, section_time);
 
 	time(&start);
 	
@@ -739,7 +751,10 @@ int TWPartitionManager::Backup_Partition(TWPartition* Part,
 		time(&stop);
 		backup_time = (int) difftime(stop, start);
 		LOGINFO("Partition Backup time: %d\n", backup_time);
-		if (Part->Backup_Method == 1) {
+		if (Part->Used_Blocks_Size > 0) {
+			*img_bytes_remaining -= Part->Used_Blocks_Size;
+			*img_time += backup_time;
+		} else if (Part->Backup_Method == 1) {
 			*file_bytes_remaining -= Part->Backup_Size;
 			*file_time += backup_time;
 		} else {
@@ -804,7 +819,12 @@ bool TWPartitionManager::Run_Backup(void) {
 			backup_part = Find_Partition_By_Path(backup_path);
 			if (backup_part != NULL) {
 				partition_count++;
-				if (backup_part->Backup_Method == 1)
+				// Used blocks images also hold the file system's metadata, so plan with what they copy
+				backup_part->Update_Used_Blocks_Size();
+				if (backup_part->Used_Blocks_Size > 0) {
+					img_bytes += backup_part->Used_Blocks_Size;
+					LOGINFO("%s's used blocks ~ %lluMB\n", backup_path.c_str(), backup_part->Used_Blocks_Size / 1024 / 1024);
+				} else if (backup_part->Backup_Method == 1)
 					file_bytes += backup_part->Backup_Size;
 				else
 					img_bytes += backup_part->Backup_Size;
@@ -925,7 +945,15 @@ bool TWPartitionManager::Run_Backup(void) {
 bool TWPartitionManager::Restore_Partition(TWPartition* Part, string Restore_Name, int partition_count) {
 	time_t Start, Stop;
 	time(&Start);
-	DataManager::ShowProgress(1.0 / (float)partition_count, 150);
+	if (Part->Backup_Method == TWPartition::DD || twrpImage::isSparse(Restore_Name + "/" + Part->Backup_FileName)) {
+		// Raw images report how far they are, so the bar must not slide on its own
+		float progress = 0;
+		DataManager::ShowProgress(0, 0);
+		DataManager::GetValue("ui_progress", progress);
+		Part->Image_Progress_Start = progress / 100;
+		Part->Image_Progress_Portion = 1.0 / (float)partition_count;
+	} else
+		DataManager::ShowProgress(1.0 / (float)partition_count, 150);
 	if (!Part->Restore(Restore_Name))
 		return false;
 	if (Part->Has_SubPartition) {
@@ -1013,6 +1041,10 @@ int TWPartitionManager::Run_Restore(string Restore_Name) {
 							// This is a yaffs2.img
 							file_size = TWFunc::Get_File_Size(Full_FileName);
 							min_size = TWFunc::RoundUpSize(file_size, multiple);
+						} else if (twrpImage::isSparse(Full_FileName)) {
+							// A used blocks image brings its own file system, it only has to fit on the block device
+							if (twrpImage::imageSize(Full_FileName) > twrpImage::deviceSize(restore_part->Actual_Block_Device))
+								min_size = restore_part->Size;
 						} else {
 							// This is an archive
 							twrpTar tar;
@@ -1215,21 +1247,17 @@ int TWPartitionManager::Run_Restore(string Restore_Name) {
 						min_size = 0;
 						Full_FileName = Restore_Name + "/" + restore_part->Backup_FileName;
 						if (!TWFunc::Path_Exists(Full_FileName)) {
-							int index = 0;
-							char split_index[5];
-							sprintf(split_index, "%03i", index);
-							Full_FileName += split_index;
-							while (TWFunc::Path_Exists(Full_FileName)) {
+							vector<string> Archives;
+							unsigned index;
+							TWFunc::Get_Split_Archives(Full_FileName, Archives);
+							for (index = 0; index < Archives.size(); index++) {
 								gui_print("Getting size of archive %i...\n", index+1);
 								twrpTar tar;
-								tar.setfn(Full_FileName);
+								tar.setfn(Archives[index]);
 								min_size += tar.uncompressedSize();
-								index++;		
-								sprintf(split_index, "%03i", index);
-								Full_FileName = Restore_Name + "/" + restore_part->Backup_FileName + split_index;
 							}
 							if (index == 0)
-								LOGERR("Error locating restore file: '%s'\n", Full_FileName.c_str());
+								LOGERR("Error locating restore file: '%s000'\n", Full_FileName.c_str());
 						} else {
 							twrpTar tar;
 							tar.setfn(Full_FileName);
@@ -67,6 +67,10 @@ class TWPartition {
 		bool Restore(string restore_folder);
 		// Returns a string of the backup method for human readable output
 		string Backup_Method_By_Name();
+		// True if the next backup of this file system copies its used blocks instead of its files
+		bool Can_Backup_Used_Blocks();
+		// Sets Used_Blocks_Size from the file system's block allocation, 0 when the next backup is a file backup
+		void Update_Used_Blocks_Size();
 		// Decrypts the partition, return 0 for failure and -1 for success
 		bool Decrypt(string Password);
 		// Ignores wipe commands for /data/media devices and formats the original block device
@@ -96,6 +100,8 @@ class TWPartition {
 		unsigned long long Free;
 		// Backup size -- may be different than used space especially when /data/media is present
 		unsigned long long Backup_Size;
+		// Bytes copied when the partition is backed up by its used blocks, see Update_Used_Blocks_Size()
+		unsigned long long Used_Blocks_Size;
 		// Current file system
 		string Current_File_System;
 		// Actual block device (one of primary, alternate, or decrypted)
@@ -218,6 +224,9 @@ class TWPartition {
 		// Have to store the encryption password to remount
 		string EcryptFS_Password;
 	#endif
+		// Part of the progress bar filled by the next image backup or restore, set by the partition manager
+		float Image_Progress_Start;
+		float Image_Progress_Portion;
 
 	private:
 		// Process custom fstab flags
@@ -254,22 +263,28 @@ class TWPartition {
 		bool Wipe_MTD();
 		// Uses rm -rf to wipe
 		bool Wipe_RMRF();
+		// Discards the blocks a format is about to overwrite, false if the device can't
+		bool Discard_Blocks();
 		// Uses mkfs.f2fs to wipe
 		bool Wipe_F2FS();
 		// Uses rm -rf to wipe but does not wipe /data/media
 		bool Wipe_Data_Without_Wiping_Media();
 		// Backs up using tar for file systems
 		int Backup_Tar(string backup_folder);
-		// Backs up using dd for emmc memory types
+		// Backs up emmc memory types with a raw image copy
 		int Backup_DD(string backup_folder);
 		// Backs up using dump_image for MTD memory types
 		int Backup_Dump_Image(string backup_folder);
+		// Backs up the used blocks of ext4 and f2fs as a sparse image
+		int Backup_Used_Blocks(string backup_folder);
 		// Restore using tar for file systems
 		bool Restore_Tar(string restore_folder, string Restore_File_System);
-		// Restore using dd for emmc memory types
+		// Restore emmc memory types with a raw image copy
 		bool Restore_DD(string restore_folder);
 		// Restore using flash_image for MTD memory types
 		bool Restore_Flash_Image(string restore_folder);
+		// Restore a used blocks image of a file system
+		bool Restore_Used_Blocks(string restore_folder, string Restore_File_System);
 		// Get Partition size, used, and free space using statfs
 		bool Get_Size_Via_statfs(bool Display_Error);
 		// Get Partition size, used, and free space using df command
@@ -0,0 +1,46 @@
+/*
+        Copyright 2013 bigbiff/Dees_Troy TeamWin
+        This file is part of TWRP/TeamWin Recovery Project.
+
+        TWRP is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        TWRP is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with TWRP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SIDELOAD_DIGESTS_H
+#define _SIDELOAD_DIGESTS_H
+
+#include <stdint.h>
+
+#include "mincrypt/sha.h"
+#include "mincrypt/sha256.h"
+
+/* Digests of the part of a package covered by its whole-file signature,
+ * computed by whoever received it.  The adb sideload service writes one
+ * to SIDELOAD_DIGESTS_FILE; dev, ino and mtime (from fstat() once the
+ * package was written) tie it to the file it describes.
+ */
+#define SIDELOAD_DIGESTS_FILE "/tmp/sideload.digests"
+#define PACKAGE_DIGESTS_MAGIC 0x53444731  /* "SDG1" */
+
+typedef struct Package_Digests {
+    uint32_t magic;
+    uint64_t package_size;
+    uint64_t signed_len;
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime;
+    uint8_t sha1[SHA_DIGEST_SIZE];
+    uint8_t sha256[SHA256_DIGEST_SIZE];
+} Package_Digests;
+
+#endif  // _SIDELOAD_DIGESTS_H
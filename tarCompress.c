@@ -0,0 +1,466 @@
+/*
+	Copyright 2013 bigbiff/Dees_Troy TeamWin
+	This file is part of TWRP/TeamWin Recovery Project.
+
+	TWRP is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	TWRP is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with TWRP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* In-process replacement for piping the tar stream through pigz.
+   The input is cut into TAR_GZ_BLOCK_SIZE blocks which are deflated in
+   parallel. Each block is primed with the last 32KB of the block before
+   it and ends on a sync flush, so the blocks can simply be concatenated
+   into one raw deflate stream. A writer thread puts the blocks out in
+   order and combines the per block CRCs for the gzip trailer. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "digest/md5.h"
+#include "twcommon.h"
+#include "tarCompress.h"
+
+#define TAR_GZ_MAX_STREAMS	16
+
+enum gz_job_state {
+	GZ_JOB_FREE = 0,
+	GZ_JOB_QUEUED,
+	GZ_JOB_BUSY,
+	GZ_JOB_DONE
+};
+
+struct gz_job {
+	int state;
+	int last;
+	unsigned char *in;
+	size_t in_len;
+	unsigned char *dict;
+	size_t dict_len;
+	unsigned char *out;
+	size_t out_len;
+	size_t out_size;
+	unsigned long check;
+};
+
+struct gz_stream {
+	int fd;
+	int level;
+	int error;
+	int finishing;
+	int filling;
+	unsigned worker_count;
+	unsigned job_count;
+	struct gz_job *jobs;
+	unsigned long long next_in;   // next job filled by the tar writer
+	unsigned long long next_comp; // next job taken by a deflate worker
+	unsigned long long next_out;  // next job written to fd
+	unsigned long check;
+	unsigned long long total_in;
+	unsigned char *tail;
+	size_t tail_len;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t workers[TAR_GZ_MAX_THREADS];
+	pthread_t writer;
+	struct MD5Context *md5c;
+	tar_gz_output output;
+};
+
+static struct gz_stream *gz_streams[TAR_GZ_MAX_STREAMS];
+static pthread_mutex_t gz_streams_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct gz_stream *gz_find(int fd) {
+	struct gz_stream *gz = NULL;
+	int i;
+
+	pthread_mutex_lock(&gz_streams_lock);
+	for (i = 0; i < TAR_GZ_MAX_STREAMS; i++) {
+		if (gz_streams[i] != NULL && gz_streams[i]->fd == fd) {
+			gz = gz_streams[i];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&gz_streams_lock);
+	return gz;
+}
+
+static int gz_register(struct gz_stream *gz) {
+	int i, ret = -1;
+
+	pthread_mutex_lock(&gz_streams_lock);
+	for (i = 0; i < TAR_GZ_MAX_STREAMS; i++) {
+		if (gz_streams[i] == NULL) {
+			gz_streams[i] = gz;
+			ret = 0;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&gz_streams_lock);
+	return ret;
+}
+
+static void gz_unregister(struct gz_stream *gz) {
+	int i;
+
+	pthread_mutex_lock(&gz_streams_lock);
+	for (i = 0; i < TAR_GZ_MAX_STREAMS; i++) {
+		if (gz_streams[i] == gz)
+			gz_streams[i] = NULL;
+	}
+	pthread_mutex_unlock(&gz_streams_lock);
+}
+
+static int gz_write_all(struct gz_stream *gz, const unsigned char *buf, size_t len) {
+	ssize_t ret;
+
+	while (len > 0) {
+		// Only retry when the output itself was interrupted, not on an
+		// errno left over from earlier
+		errno = 0;
+		ret = gz->output(gz->fd, buf, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+// Writes to the archive, keeping the inline digest up to date
+static int gz_emit(struct gz_stream *gz, const unsigned char *buf, size_t len) {
+	if (gz_write_all(gz, buf, len) != 0)
+		return -1;
+	if (gz->md5c != NULL)
+		MD5Update(gz->md5c, buf, len);
+	return 0;
+}
+
+static void gz_put_long(unsigned char *buf, unsigned long val) {
+	buf[0] = val & 0xff;
+	buf[1] = (val >> 8) & 0xff;
+	buf[2] = (val >> 16) & 0xff;
+	buf[3] = (val >> 24) & 0xff;
+}
+
+static int gz_deflate_job(z_stream *strm, struct gz_job *job) {
+	int ret, flush = job->last ? Z_FINISH : Z_SYNC_FLUSH;
+
+	job->check = crc32(crc32(0L, Z_NULL, 0), job->in, job->in_len);
+	if (deflateReset(strm) != Z_OK)
+		return -1;
+	if (job->dict_len > 0 && deflateSetDictionary(strm, job->dict, job->dict_len) != Z_OK)
+		return -1;
+
+	strm->next_in = job->in;
+	strm->avail_in = job->in_len;
+	job->out_len = 0;
+	do {
+		if (job->out_len == job->out_size) {
+			unsigned char *out = (unsigned char*) realloc(job->out, job->out_size * 2);
+			if (out == NULL)
+				return -1;
+			job->out = out;
+			job->out_size *= 2;
+		}
+		strm->next_out = job->out + job->out_len;
+		strm->avail_out = job->out_size - job->out_len;
+		ret = deflate(strm, flush);
+		if (ret == Z_STREAM_ERROR)
+			return -1;
+		job->out_len = job->out_size - strm->avail_out;
+	} while (strm->avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+	return 0;
+}
+
+static void* gz_worker(void *cookie) {
+	struct gz_stream *gz = (struct gz_stream*) cookie;
+	struct gz_job *job;
+	z_stream strm;
+	int ret, usable;
+
+	memset(&strm, 0, sizeof(strm));
+	usable = deflateInit2(&strm, gz->level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+
+	pthread_mutex_lock(&gz->lock);
+	if (!usable) {
+		// Keep taking jobs and hand them back as failed, the writer
+		// waits for every queued job and would hang if nobody did
+		LOGERR("Unable to initialize compression\n");
+		gz->error = 1;
+		pthread_cond_broadcast(&gz->cond);
+	}
+	for (;;) {
+		while (gz->next_comp == gz->next_in && !gz->finishing)
+			pthread_cond_wait(&gz->cond, &gz->lock);
+		if (gz->next_comp == gz->next_in)
+			break;
+		job = &gz->jobs[gz->next_comp % gz->job_count];
+		gz->next_comp++;
+		job->state = GZ_JOB_BUSY;
+		pthread_mutex_unlock(&gz->lock);
+
+		ret = usable ? gz_deflate_job(&strm, job) : -1;
+
+		pthread_mutex_lock(&gz->lock);
+		if (ret != 0)
+			gz->error = 1;
+		job->state = GZ_JOB_DONE;
+		pthread_cond_broadcast(&gz->cond);
+	}
+	pthread_mutex_unlock(&gz->lock);
+	if (!usable)
+		return (void*)-1;
+	deflateEnd(&strm);
+	return (void*)0;
+}
+
+static void* gz_writer(void *cookie) {
+	struct gz_stream *gz = (struct gz_stream*) cookie;
+	struct gz_job *job;
+	int error;
+
+	pthread_mutex_lock(&gz->lock);
+	for (;;) {
+		job = &gz->jobs[gz->next_out % gz->job_count];
+		while (job->state != GZ_JOB_DONE && !(gz->finishing && gz->next_out == gz->next_in))
+			pthread_cond_wait(&gz->cond, &gz->lock);
+		if (job->state != GZ_JOB_DONE)
+			break;
+		error = gz->error;
+		pthread_mutex_unlock(&gz->lock);
+
+		if (!error && gz_emit(gz, job->out, job->out_len) != 0) {
+			LOGERR("Error writing compressed tar file!\n");
+			error = 1;
+		}
+		gz->check = crc32_combine(gz->check, job->check, job->in_len);
+		gz->total_in += job->in_len;
+
+		pthread_mutex_lock(&gz->lock);
+		if (error)
+			gz->error = 1;
+		job->in_len = 0;
+		job->state = GZ_JOB_FREE;
+		gz->next_out++;
+		pthread_cond_broadcast(&gz->cond);
+	}
+	pthread_mutex_unlock(&gz->lock);
+	return (void*)0;
+}
+
+// Waits until the next job slot has been written out and can be refilled
+static struct gz_job *gz_get_slot(struct gz_stream *gz) {
+	struct gz_job *job = &gz->jobs[gz->next_in % gz->job_count];
+
+	if (!gz->filling) {
+		pthread_mutex_lock(&gz->lock);
+		while (job->state != GZ_JOB_FREE)
+			pthread_cond_wait(&gz->cond, &gz->lock);
+		pthread_mutex_unlock(&gz->lock);
+		gz->filling = 1;
+	}
+	return job;
+}
+
+static void gz_submit(struct gz_stream *gz, struct gz_job *job, int last) {
+	size_t keep;
+
+	// Prime this block with the end of the previous one
+	memcpy(job->dict, gz->tail, gz->tail_len);
+	job->dict_len = gz->tail_len;
+	keep = job->in_len < TAR_GZ_DICT_SIZE ? job->in_len : TAR_GZ_DICT_SIZE;
+	memcpy(gz->tail, job->in + job->in_len - keep, keep);
+	gz->tail_len = keep;
+	job->last = last;
+
+	pthread_mutex_lock(&gz->lock);
+	job->state = GZ_JOB_QUEUED;
+	gz->next_in++;
+	pthread_cond_broadcast(&gz->cond);
+	pthread_mutex_unlock(&gz->lock);
+	gz->filling = 0;
+}
+
+static void gz_free(struct gz_stream *gz) {
+	unsigned i;
+
+	if (gz->jobs != NULL) {
+		for (i = 0; i < gz->job_count; i++) {
+			free(gz->jobs[i].in);
+			free(gz->jobs[i].dict);
+			free(gz->jobs[i].out);
+		}
+		free(gz->jobs);
+	}
+	free(gz->tail);
+	pthread_cond_destroy(&gz->cond);
+	pthread_mutex_destroy(&gz->lock);
+	free(gz);
+}
+
+// Stops all threads, returns non-zero if anything went wrong along the way
+static int gz_shutdown(struct gz_stream *gz) {
+	unsigned i;
+
+	pthread_mutex_lock(&gz->lock);
+	gz->finishing = 1;
+	pthread_cond_broadcast(&gz->cond);
+	pthread_mutex_unlock(&gz->lock);
+	pthread_join(gz->writer, NULL);
+	for (i = 0; i < gz->worker_count; i++)
+		pthread_join(gz->workers[i], NULL);
+	return gz->error;
+}
+
+int tar_gz_open(int fd, int level, unsigned threads, struct MD5Context *md5c, tar_gz_output output) {
+	struct gz_stream *gz;
+	unsigned char header[10];
+	unsigned i;
+
+	if (threads == 0)
+		threads = sysconf(_SC_NPROCESSORS_CONF);
+	if (threads < 1)
+		threads = 1;
+	if (threads > TAR_GZ_MAX_THREADS)
+		threads = TAR_GZ_MAX_THREADS;
+
+	gz = (struct gz_stream*) calloc(1, sizeof(struct gz_stream));
+	if (gz == NULL)
+		return -1;
+	gz->fd = fd;
+	gz->level = level;
+	gz->md5c = md5c;
+	gz->output = output != NULL ? output : write;
+	gz->check = crc32(0L, Z_NULL, 0);
+	gz->job_count = threads * 2 + 2;
+	pthread_mutex_init(&gz->lock, NULL);
+	pthread_cond_init(&gz->cond, NULL);
+	gz->tail = (unsigned char*) malloc(TAR_GZ_DICT_SIZE);
+	gz->jobs = (struct gz_job*) calloc(gz->job_count, sizeof(struct gz_job));
+	if (gz->tail == NULL || gz->jobs == NULL) {
+		gz_free(gz);
+		return -1;
+	}
+	for (i = 0; i < gz->job_count; i++) {
+		gz->jobs[i].out_size = TAR_GZ_BLOCK_SIZE + (TAR_GZ_BLOCK_SIZE >> 3);
+		gz->jobs[i].in = (unsigned char*) malloc(TAR_GZ_BLOCK_SIZE);
+		gz->jobs[i].dict = (unsigned char*) malloc(TAR_GZ_DICT_SIZE);
+		gz->jobs[i].out = (unsigned char*) malloc(gz->jobs[i].out_size);
+		if (gz->jobs[i].in == NULL || gz->jobs[i].dict == NULL || gz->jobs[i].out == NULL) {
+			LOGERR("Unable to allocate compression buffers\n");
+			gz_free(gz);
+			return -1;
+		}
+	}
+
+	// gzip header: deflate, no name, mtime, unix
+	memset(header, 0, sizeof(header));
+	header[0] = 0x1f;
+	header[1] = 0x8b;
+	header[2] = 8;
+	gz_put_long(header + 4, (unsigned long) time(NULL));
+	header[9] = 3;
+	if (gz_emit(gz, header, sizeof(header)) != 0) {
+		LOGERR("Error writing compressed tar file!\n");
+		gz_free(gz);
+		return -1;
+	}
+
+	if (pthread_create(&gz->writer, NULL, gz_writer, (void*)gz) != 0) {
+		LOGERR("Unable to create compression writer thread\n");
+		gz_free(gz);
+		return -1;
+	}
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(&gz->workers[i], NULL, gz_worker, (void*)gz) != 0)
+			break;
+		gz->worker_count++;
+	}
+	if (gz->worker_count == 0 || gz_register(gz) != 0) {
+		LOGERR("Unable to start compression threads\n");
+		gz_shutdown(gz);
+		gz_free(gz);
+		return -1;
+	}
+	LOGINFO("Compressing with %u threads\n", gz->worker_count);
+	return 0;
+}
+
+ssize_t tar_gz_write(int fd, const void *buffer, size_t size) {
+	struct gz_stream *gz = gz_find(fd);
+	const unsigned char *ptr = (const unsigned char*) buffer;
+	struct gz_job *job;
+	size_t left = size, copy;
+
+	if (gz == NULL) {
+		errno = EBADF;
+		return -1;
+	}
+	while (left > 0) {
+		if (gz->error)
+			return -1;
+		job = gz_get_slot(gz);
+		copy = TAR_GZ_BLOCK_SIZE - job->in_len;
+		if (copy > left)
+			copy = left;
+		memcpy(job->in + job->in_len, ptr, copy);
+		job->in_len += copy;
+		ptr += copy;
+		left -= copy;
+		if (job->in_len == TAR_GZ_BLOCK_SIZE)
+			gz_submit(gz, job, 0);
+	}
+	return size;
+}
+
+int tar_gz_finish(int fd) {
+	struct gz_stream *gz = gz_find(fd);
+	unsigned char trailer[8];
+	int ret;
+
+	if (gz == NULL) {
+		errno = EBADF;
+		return -1;
+	}
+	gz_unregister(gz);
+	// The last block is always submitted, even when empty, to end the stream
+	gz_submit(gz, gz_get_slot(gz), 1);
+	ret = gz_shutdown(gz);
+	if (ret == 0) {
+		gz_put_long(trailer, gz->check);
+		gz_put_long(trailer + 4, (unsigned long)(gz->total_in & 0xffffffff));
+		if (gz_emit(gz, trailer, sizeof(trailer)) != 0) {
+			LOGERR("Error writing compressed tar file!\n");
+			ret = -1;
+		}
+	}
+	gz_free(gz);
+	return ret ? -1 : 0;
+}
+
+int tar_gz_close(int fd) {
+	int ret = tar_gz_finish(fd);
+
+	if (close(fd) != 0)
+		ret = -1;
+	return ret;
+}
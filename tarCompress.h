@@ -0,0 +1,47 @@
+/*
+        Copyright 2013 bigbiff/Dees_Troy TeamWin
+        This file is part of TWRP/TeamWin Recovery Project.
+
+        TWRP is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        TWRP is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with TWRP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TARCOMPRESS_HEADER
+#define _TARCOMPRESS_HEADER
+
+#include <sys/types.h>
+
+struct MD5Context;
+
+/* Size of the input blocks handed to the compression threads and the
+   length of the dictionary primed from the previous block (same as pigz) */
+#define TAR_GZ_BLOCK_SIZE	131072
+#define TAR_GZ_DICT_SIZE	32768
+#define TAR_GZ_MAX_THREADS	8
+
+/* Where the compressed bytes go, write() unless another stage such as
+   tar_aes_write sits between the compressor and fd */
+typedef ssize_t (*tar_gz_output)(int fd, const void *buffer, size_t size);
+
+/* Starts a gzip stream that writes to fd using up to threads deflate
+   workers (0 = one per core). If md5c is not NULL every compressed byte
+   written to fd is added to it. Returns 0 on success, -1 on failure. */
+int tar_gz_open(int fd, int level, unsigned threads, struct MD5Context *md5c, tar_gz_output output);
+/* Queues data for compression on the stream attached to fd */
+ssize_t tar_gz_write(int fd, const void *buffer, size_t size);
+/* Flushes the last block and writes the gzip trailer; does not close fd */
+int tar_gz_finish(int fd);
+/* tartype_t closefunc: finishes the stream and closes fd */
+int tar_gz_close(int fd);
+
+#endif  // _TARCOMPRESS_HEADER
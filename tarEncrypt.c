@@ -0,0 +1,421 @@
+/*
+	Copyright 2013 bigbiff/Dees_Troy TeamWin
+	This file is part of TWRP/TeamWin Recovery Project.
+
+	TWRP is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	TWRP is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with TWRP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* In-process replacement for piping the tar stream through openaes enc.
+   The output is the same stream of independent 4096 byte records that
+   openaes writes, so restores still go through openaes dec. Batches of
+   records are encrypted in parallel and a writer thread puts them out in
+   order. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "digest/md5.h"
+#include "twcommon.h"
+#include "openaes/inc/oaes_lib.h"
+#include "tarEncrypt.h"
+
+#define TAR_AES_MAX_STREAMS	16
+#define TAR_AES_JOB_IN		(TAR_AES_RECORD_IN * TAR_AES_JOB_RECORDS)
+#define TAR_AES_JOB_OUT		(TAR_AES_RECORD_OUT * TAR_AES_JOB_RECORDS)
+
+enum aes_job_state {
+	AES_JOB_FREE = 0,
+	AES_JOB_QUEUED,
+	AES_JOB_BUSY,
+	AES_JOB_DONE
+};
+
+struct aes_job {
+	int state;
+	unsigned char *in;
+	size_t in_len;
+	unsigned char *out;
+	size_t out_len;
+};
+
+struct aes_stream {
+	int fd;
+	int error;
+	int finishing;
+	int filling;
+	unsigned worker_count;
+	unsigned job_count;
+	struct aes_job *jobs;
+	unsigned long long next_in;   // next job filled by the tar writer
+	unsigned long long next_enc;  // next job taken by an encryption worker
+	unsigned long long next_out;  // next job written to fd
+	uint8_t key[32];
+	size_t key_len;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t workers[TAR_AES_MAX_THREADS];
+	pthread_t writer;
+	struct MD5Context *md5c;
+};
+
+static struct aes_stream *aes_streams[TAR_AES_MAX_STREAMS];
+static pthread_mutex_t aes_streams_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct aes_stream *aes_find(int fd) {
+	struct aes_stream *aes = NULL;
+	int i;
+
+	pthread_mutex_lock(&aes_streams_lock);
+	for (i = 0; i < TAR_AES_MAX_STREAMS; i++) {
+		if (aes_streams[i] != NULL && aes_streams[i]->fd == fd) {
+			aes = aes_streams[i];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&aes_streams_lock);
+	return aes;
+}
+
+static int aes_register(struct aes_stream *aes) {
+	int i, ret = -1;
+
+	pthread_mutex_lock(&aes_streams_lock);
+	for (i = 0; i < TAR_AES_MAX_STREAMS; i++) {
+		if (aes_streams[i] == NULL) {
+			aes_streams[i] = aes;
+			ret = 0;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&aes_streams_lock);
+	return ret;
+}
+
+static void aes_unregister(struct aes_stream *aes) {
+	int i;
+
+	pthread_mutex_lock(&aes_streams_lock);
+	for (i = 0; i < TAR_AES_MAX_STREAMS; i++) {
+		if (aes_streams[i] == aes)
+			aes_streams[i] = NULL;
+	}
+	pthread_mutex_unlock(&aes_streams_lock);
+}
+
+static int aes_write_all(int fd, const unsigned char *buf, size_t len) {
+	ssize_t ret;
+
+	while (len > 0) {
+		ret = write(fd, buf, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+// Sets up a context keyed the same way as openaes enc --key. Every worker
+// gets its own starting IV from the kernel so no two threads share a chain.
+static OAES_CTX *aes_new_ctx(struct aes_stream *aes) {
+	OAES_CTX *ctx = oaes_alloc();
+	uint8_t iv[OAES_BLOCK_SIZE];
+	int fd;
+
+	if (ctx == NULL)
+		return NULL;
+	if (oaes_key_import_data(ctx, aes->key, aes->key_len) != OAES_RET_SUCCESS) {
+		oaes_free(&ctx);
+		return NULL;
+	}
+	fd = open("/dev/urandom", O_RDONLY);
+	if (fd >= 0) {
+		if (read(fd, iv, sizeof(iv)) == (ssize_t)sizeof(iv))
+			oaes_set_option(ctx, OAES_OPTION_CBC, iv);
+		close(fd);
+	}
+	return ctx;
+}
+
+static int aes_encrypt_job(OAES_CTX *ctx, struct aes_job *job) {
+	size_t pos, len, out_len;
+
+	job->out_len = 0;
+	for (pos = 0; pos < job->in_len; pos += TAR_AES_RECORD_IN) {
+		len = job->in_len - pos;
+		if (len > TAR_AES_RECORD_IN)
+			len = TAR_AES_RECORD_IN;
+		out_len = TAR_AES_JOB_OUT - job->out_len;
+		if (oaes_encrypt(ctx, job->in + pos, len, job->out + job->out_len, &out_len) != OAES_RET_SUCCESS)
+			return -1;
+		job->out_len += out_len;
+	}
+	return 0;
+}
+
+static void* aes_worker(void *cookie) {
+	struct aes_stream *aes = (struct aes_stream*) cookie;
+	struct aes_job *job;
+	OAES_CTX *ctx = aes_new_ctx(aes);
+	int ret;
+
+	pthread_mutex_lock(&aes->lock);
+	if (ctx == NULL) {
+		// Keep taking jobs and hand them back as failed, the writer
+		// waits for every queued job and would hang if nobody did
+		LOGERR("Unable to initialize encryption\n");
+		aes->error = 1;
+		pthread_cond_broadcast(&aes->cond);
+	}
+	for (;;) {
+		while (aes->next_enc == aes->next_in && !aes->finishing)
+			pthread_cond_wait(&aes->cond, &aes->lock);
+		if (aes->next_enc == aes->next_in)
+			break;
+		job = &aes->jobs[aes->next_enc % aes->job_count];
+		aes->next_enc++;
+		job->state = AES_JOB_BUSY;
+		pthread_mutex_unlock(&aes->lock);
+
+		ret = ctx != NULL ? aes_encrypt_job(ctx, job) : -1;
+
+		pthread_mutex_lock(&aes->lock);
+		if (ret != 0)
+			aes->error = 1;
+		job->state = AES_JOB_DONE;
+		pthread_cond_broadcast(&aes->cond);
+	}
+	pthread_mutex_unlock(&aes->lock);
+	if (ctx == NULL)
+		return (void*)-1;
+	oaes_free(&ctx);
+	return (void*)0;
+}
+
+static void* aes_writer(void *cookie) {
+	struct aes_stream *aes = (struct aes_stream*) cookie;
+	struct aes_job *job;
+	int error;
+
+	pthread_mutex_lock(&aes->lock);
+	for (;;) {
+		job = &aes->jobs[aes->next_out % aes->job_count];
+		while (job->state != AES_JOB_DONE && !(aes->finishing && aes->next_out == aes->next_in))
+			pthread_cond_wait(&aes->cond, &aes->lock);
+		if (job->state != AES_JOB_DONE)
+			break;
+		error = aes->error;
+		pthread_mutex_unlock(&aes->lock);
+
+		if (!error) {
+			if (aes_write_all(aes->fd, job->out, job->out_len) != 0) {
+				LOGERR("Error writing encrypted tar file!\n");
+				error = 1;
+			} else if (aes->md5c != NULL) {
+				MD5Update(aes->md5c, job->out, job->out_len);
+			}
+		}
+
+		pthread_mutex_lock(&aes->lock);
+		if (error)
+			aes->error = 1;
+		job->in_len = 0;
+		job->state = AES_JOB_FREE;
+		aes->next_out++;
+		pthread_cond_broadcast(&aes->cond);
+	}
+	pthread_mutex_unlock(&aes->lock);
+	return (void*)0;
+}
+
+// Waits until the next job slot has been written out and can be refilled
+static struct aes_job *aes_get_slot(struct aes_stream *aes) {
+	struct aes_job *job = &aes->jobs[aes->next_in % aes->job_count];
+
+	if (!aes->filling) {
+		pthread_mutex_lock(&aes->lock);
+		while (job->state != AES_JOB_FREE)
+			pthread_cond_wait(&aes->cond, &aes->lock);
+		pthread_mutex_unlock(&aes->lock);
+		aes->filling = 1;
+	}
+	return job;
+}
+
+static void aes_submit(struct aes_stream *aes, struct aes_job *job) {
+	pthread_mutex_lock(&aes->lock);
+	job->state = AES_JOB_QUEUED;
+	aes->next_in++;
+	pthread_cond_broadcast(&aes->cond);
+	pthread_mutex_unlock(&aes->lock);
+	aes->filling = 0;
+}
+
+static void aes_free(struct aes_stream *aes) {
+	unsigned i;
+
+	if (aes->jobs != NULL) {
+		for (i = 0; i < aes->job_count; i++) {
+			free(aes->jobs[i].in);
+			free(aes->jobs[i].out);
+		}
+		free(aes->jobs);
+	}
+	memset(aes->key, 0, sizeof(aes->key));
+	pthread_cond_destroy(&aes->cond);
+	pthread_mutex_destroy(&aes->lock);
+	free(aes);
+}
+
+// Stops all threads, returns non-zero if anything went wrong along the way
+static int aes_shutdown(struct aes_stream *aes) {
+	unsigned i;
+
+	pthread_mutex_lock(&aes->lock);
+	aes->finishing = 1;
+	pthread_cond_broadcast(&aes->cond);
+	pthread_mutex_unlock(&aes->lock);
+	pthread_join(aes->writer, NULL);
+	for (i = 0; i < aes->worker_count; i++)
+		pthread_join(aes->workers[i], NULL);
+	return aes->error;
+}
+
+int tar_aes_open(int fd, const char *password, unsigned threads, struct MD5Context *md5c) {
+	struct aes_stream *aes;
+	size_t len;
+	unsigned i;
+
+	if (threads == 0)
+		threads = sysconf(_SC_NPROCESSORS_CONF);
+	if (threads < 1)
+		threads = 1;
+	if (threads > TAR_AES_MAX_THREADS)
+		threads = TAR_AES_MAX_THREADS;
+
+	aes = (struct aes_stream*) calloc(1, sizeof(struct aes_stream));
+	if (aes == NULL)
+		return -1;
+	aes->fd = fd;
+	aes->md5c = md5c;
+	// Same key padding and length rounding as openaes enc --key
+	for (i = 0; i < sizeof(aes->key); i++)
+		aes->key[i] = i + 1;
+	len = strlen(password);
+	memcpy(aes->key, password, len < sizeof(aes->key) ? len : sizeof(aes->key));
+	if (len <= 16)
+		aes->key_len = 16;
+	else if (len <= 24)
+		aes->key_len = 24;
+	else
+		aes->key_len = 32;
+	aes->job_count = threads * 2 + 2;
+	pthread_mutex_init(&aes->lock, NULL);
+	pthread_cond_init(&aes->cond, NULL);
+	aes->jobs = (struct aes_job*) calloc(aes->job_count, sizeof(struct aes_job));
+	if (aes->jobs == NULL) {
+		aes_free(aes);
+		return -1;
+	}
+	for (i = 0; i < aes->job_count; i++) {
+		aes->jobs[i].in = (unsigned char*) malloc(TAR_AES_JOB_IN);
+		aes->jobs[i].out = (unsigned char*) malloc(TAR_AES_JOB_OUT);
+		if (aes->jobs[i].in == NULL || aes->jobs[i].out == NULL) {
+			LOGERR("Unable to allocate encryption buffers\n");
+			aes_free(aes);
+			return -1;
+		}
+	}
+
+	if (pthread_create(&aes->writer, NULL, aes_writer, (void*)aes) != 0) {
+		LOGERR("Unable to create encryption writer thread\n");
+		aes_free(aes);
+		return -1;
+	}
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(&aes->workers[i], NULL, aes_worker, (void*)aes) != 0)
+			break;
+		aes->worker_count++;
+	}
+	if (aes->worker_count == 0 || aes_register(aes) != 0) {
+		LOGERR("Unable to start encryption threads\n");
+		aes_shutdown(aes);
+		aes_free(aes);
+		return -1;
+	}
+	LOGINFO("Encrypting with %u threads\n", aes->worker_count);
+	return 0;
+}
+
+ssize_t tar_aes_write(int fd, const void *buffer, size_t size) {
+	struct aes_stream *aes = aes_find(fd);
+	const unsigned char *ptr = (const unsigned char*) buffer;
+	struct aes_job *job;
+	size_t left = size, copy;
+
+	if (aes == NULL) {
+		errno = EBADF;
+		return -1;
+	}
+	while (left > 0) {
+		if (aes->error)
+			return -1;
+		job = aes_get_slot(aes);
+		copy = TAR_AES_JOB_IN - job->in_len;
+		if (copy > left)
+			copy = left;
+		memcpy(job->in + job->in_len, ptr, copy);
+		job->in_len += copy;
+		ptr += copy;
+		left -= copy;
+		if (job->in_len == TAR_AES_JOB_IN)
+			aes_submit(aes, job);
+	}
+	return size;
+}
+
+int tar_aes_finish(int fd) {
+	struct aes_stream *aes = aes_find(fd);
+	struct aes_job *job;
+	int ret;
+
+	if (aes == NULL) {
+		errno = EBADF;
+		return -1;
+	}
+	aes_unregister(aes);
+	// Only the last record may be short, like the final fread in openaes
+	job = aes_get_slot(aes);
+	if (job->in_len > 0)
+		aes_submit(aes, job);
+	ret = aes_shutdown(aes);
+	aes_free(aes);
+	return ret ? -1 : 0;
+}
+
+int tar_aes_close(int fd) {
+	int ret = tar_aes_finish(fd);
+
+	if (close(fd) != 0)
+		ret = -1;
+	return ret;
+}
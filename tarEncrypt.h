@@ -0,0 +1,48 @@
+/*
+        Copyright 2013 bigbiff/Dees_Troy TeamWin
+        This file is part of TWRP/TeamWin Recovery Project.
+
+        TWRP is free software: you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        TWRP is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with TWRP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TARENCRYPT_HEADER
+#define _TARENCRYPT_HEADER
+
+#include <sys/types.h>
+
+struct MD5Context;
+
+/* openaes enc reads 4064 bytes at a time and writes each of them out as a
+   self-contained 4096 byte record (16 byte header, 16 byte IV, ciphertext),
+   so records can be encrypted in any order and on any thread */
+#define TAR_AES_RECORD_IN	4064
+#define TAR_AES_RECORD_OUT	4096
+/* Number of records handed to an encryption thread at once */
+#define TAR_AES_JOB_RECORDS	64
+#define TAR_AES_MAX_THREADS	8
+
+/* Starts an encryption stream that writes openaes compatible records to
+   fd using up to threads workers (0 = one per core). If md5c is not NULL
+   every encrypted byte written to fd is added to it. Returns 0 on success,
+   -1 on failure. */
+int tar_aes_open(int fd, const char *password, unsigned threads, struct MD5Context *md5c);
+/* Queues data for encryption on the stream attached to fd */
+ssize_t tar_aes_write(int fd, const void *buffer, size_t size);
+/* Encrypts the last partial record and waits for everything to be written;
+   does not close fd */
+int tar_aes_finish(int fd);
+/* tartype_t closefunc: finishes the stream and closes fd */
+int tar_aes_close(int fd);
+
+#endif  // _TARENCRYPT_HEADER
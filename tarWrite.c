@@ -16,77 +16,351 @@
 	along with TWRP.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <errno.h>
 #include <fcntl.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/sendfile.h>
 #include "libtar/libtar.h"
+#include "digest/md5.h"
 #include "twcommon.h"
+#include "tarWrite.h"
 
-int flush = 0, eot_count = -1;
-unsigned char *write_buffer;
-unsigned buffer_size = 4096;
-unsigned buffer_loc = 0;
-int buffer_status = 0;
-
-void reinit_libtar_buffer(void) {
-	flush = 0;
-	eot_count = -1;
-	buffer_loc = 0;
-	buffer_status = 1;
+#ifndef TW_TAR_BUFFER_SIZE
+	#define TW_TAR_BUFFER_SIZE 1048576
+#endif
+
+/* Each archive opened through open_libtar_buffer() gets its own pair of
+   buffers and I/O thread so the backup threads can write several archives
+   at the same time. libtar fills data[cur] while the I/O thread writes
+   out the other buffer. */
+struct libtar_buffer {
+	int fd;
+	unsigned char *data[2];
+	unsigned size;
+	unsigned cur;
+	unsigned loc;
+	struct MD5Context *md5;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned char *pending;  // buffer handed to the I/O thread, NULL when idle
+	unsigned pending_len;
+	int error;
+	int stop;
+};
+
+static struct libtar_buffer libtar_buffers[LIBTAR_MAX_BUFFERS];
+static pthread_mutex_t libtar_buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned buffer_size = TW_TAR_BUFFER_SIZE;
+
+static struct libtar_buffer *find_libtar_buffer(int fd) {
+	struct libtar_buffer *buf = NULL;
+	int i;
+
+	pthread_mutex_lock(&libtar_buffers_lock);
+	for (i = 0; i < LIBTAR_MAX_BUFFERS; i++) {
+		if (libtar_buffers[i].data[0] != NULL && libtar_buffers[i].fd == fd) {
+			buf = &libtar_buffers[i];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&libtar_buffers_lock);
+	return buf;
 }
 
+static int write_all(struct libtar_buffer *buf, const unsigned char *data, size_t len) {
+	size_t written = 0;
+	ssize_t ret;
+
+	while (written < len) {
+		ret = write(buf->fd, data + written, len - written);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			LOGERR("Error writing tar file!\n");
+			return -1;
+		}
+		written += ret;
+	}
+	if (buf->md5 != NULL)
+		MD5Update(buf->md5, data, len);
+	return 0;
+}
+
+static void *libtar_buffer_thread(void *cookie) {
+	struct libtar_buffer *buf = (struct libtar_buffer*) cookie;
+	unsigned char *data;
+	unsigned len;
+	int ret;
+
+	pthread_mutex_lock(&buf->lock);
+	for (;;) {
+		while (buf->pending == NULL && !buf->stop)
+			pthread_cond_wait(&buf->cond, &buf->lock);
+		if (buf->pending == NULL)
+			break;
+		data = buf->pending;
+		len = buf->pending_len;
+		pthread_mutex_unlock(&buf->lock);
+
+		ret = (buf->error ? -1 : write_all(buf, data, len));
+
+		pthread_mutex_lock(&buf->lock);
+		if (ret != 0)
+			buf->error = 1;
+		buf->pending = NULL;
+		pthread_cond_broadcast(&buf->cond);
+	}
+	pthread_mutex_unlock(&buf->lock);
+	return NULL;
+}
+
+/* Waits for the I/O thread to finish the buffer it is writing; returns -1
+   if any earlier write failed. Called with buf->lock held. */
+static int wait_libtar_buffer(struct libtar_buffer *buf) {
+	while (buf->pending != NULL)
+		pthread_cond_wait(&buf->cond, &buf->lock);
+	return buf->error ? -1 : 0;
+}
+
+/* Hands the filled buffer to the I/O thread and switches to the other one */
+static int queue_libtar_buffer(struct libtar_buffer *buf) {
+	int ret;
+
+	if (buf->loc == 0)
+		return 0;
+	pthread_mutex_lock(&buf->lock);
+	ret = wait_libtar_buffer(buf);
+	if (ret == 0) {
+		buf->pending = buf->data[buf->cur];
+		buf->pending_len = buf->loc;
+		pthread_cond_broadcast(&buf->cond);
+	}
+	pthread_mutex_unlock(&buf->lock);
+	buf->cur ^= 1;
+	buf->loc = 0;
+	return ret;
+}
+
+/* Sets the size of each of the two buffers used by archives opened after
+   this call, limited to LIBTAR_MIN/MAX_BUFFER_SIZE */
 void init_libtar_buffer(unsigned new_buff_size) {
-	if (new_buff_size != 0)
-		buffer_size = new_buff_size;
+	if (new_buff_size == 0)
+		return;
+	if (new_buff_size < LIBTAR_MIN_BUFFER_SIZE)
+		new_buff_size = LIBTAR_MIN_BUFFER_SIZE;
+	if (new_buff_size > LIBTAR_MAX_BUFFER_SIZE)
+		new_buff_size = LIBTAR_MAX_BUFFER_SIZE;
+	buffer_size = new_buff_size;
+}
+
+int attach_libtar_buffer(int fd) {
+	struct libtar_buffer *buf;
+	int i;
+
+	pthread_mutex_lock(&libtar_buffers_lock);
+	for (i = 0; i < LIBTAR_MAX_BUFFERS; i++) {
+		if (libtar_buffers[i].data[0] == NULL)
+			break;
+	}
+	if (i == LIBTAR_MAX_BUFFERS) {
+		pthread_mutex_unlock(&libtar_buffers_lock);
+		LOGERR("Too many tar archives open for writing\n");
+		errno = EMFILE;
+		return -1;
+	}
+	buf = &libtar_buffers[i];
+	memset(buf, 0, sizeof(*buf));
+	buf->fd = fd;
+	buf->size = buffer_size;
+	buf->data[0] = (unsigned char*) malloc(buf->size);
+	buf->data[1] = (unsigned char*) malloc(buf->size);
+	if (buf->data[0] == NULL || buf->data[1] == NULL) {
+		free(buf->data[0]);
+		free(buf->data[1]);
+		buf->data[0] = NULL;
+		pthread_mutex_unlock(&libtar_buffers_lock);
+		LOGERR("Unable to allocate a tar write buffer\n");
+		errno = ENOMEM;
+		return -1;
+	}
+	pthread_mutex_init(&buf->lock, NULL);
+	pthread_cond_init(&buf->cond, NULL);
+	if (pthread_create(&buf->thread, NULL, libtar_buffer_thread, buf) != 0) {
+		pthread_mutex_destroy(&buf->lock);
+		pthread_cond_destroy(&buf->cond);
+		free(buf->data[0]);
+		free(buf->data[1]);
+		buf->data[0] = NULL;
+		pthread_mutex_unlock(&libtar_buffers_lock);
+		LOGERR("Unable to start the tar write thread\n");
+		errno = EAGAIN;
+		return -1;
+	}
+	pthread_mutex_unlock(&libtar_buffers_lock);
+	return 0;
+}
 
-	reinit_libtar_buffer();
-	write_buffer = (unsigned char*) malloc(sizeof(char *) * buffer_size);
+int open_libtar_buffer(const char *pathname, int flags, ...) {
+	va_list ap;
+	mode_t mode = 0;
+	int fd;
+
+	if (flags & O_CREAT) {
+		va_start(ap, flags);
+		mode = (mode_t) va_arg(ap, int);
+		va_end(ap);
+	}
+	fd = open(pathname, flags, mode);
+	if (fd < 0)
+		return -1;
+	if ((flags & O_ACCMODE) != O_RDONLY && attach_libtar_buffer(fd) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
 }
 
-void free_libtar_buffer(void) {
-	if (buffer_status > 0)
-		free(write_buffer);
-	buffer_status = 0;
+int close_libtar_buffer(int fd) {
+	struct libtar_buffer *buf = find_libtar_buffer(fd);
+	int ret = 0;
+
+	if (buf != NULL) {
+		ret = flush_libtar_buffer(fd);
+		pthread_mutex_lock(&buf->lock);
+		buf->stop = 1;
+		pthread_cond_broadcast(&buf->cond);
+		pthread_mutex_unlock(&buf->lock);
+		pthread_join(buf->thread, NULL);
+		pthread_mutex_destroy(&buf->lock);
+		pthread_cond_destroy(&buf->cond);
+		pthread_mutex_lock(&libtar_buffers_lock);
+		free(buf->data[0]);
+		free(buf->data[1]);
+		buf->data[0] = buf->data[1] = NULL;
+		buf->md5 = NULL;
+		pthread_mutex_unlock(&libtar_buffers_lock);
+	}
+	if (close(fd) != 0)
+		ret = -1;
+	return ret;
 }
 
 ssize_t write_libtar_buffer(int fd, const void *buffer, size_t size) {
-	void* ptr;
-
-	if (flush == 0) {
-		ptr = write_buffer + buffer_loc;
-		memcpy(ptr, buffer, size);
-		buffer_loc += size;
-		if (eot_count >= 0 && eot_count < 2)
-			eot_count++;
-			/* At the end of the tar file, libtar will add 2 blank blocks.
-			   Once we have received both EOT blocks, we will immediately
-			   write anything in the buffer to the file.
-			*/
-
-		if (buffer_loc >= buffer_size || eot_count >= 2) {
-			flush = 1;
+	struct libtar_buffer *buf = find_libtar_buffer(fd);
+	const unsigned char *data = (const unsigned char*) buffer;
+	size_t left = size, len;
+
+	if (buf == NULL) {
+		// Not opened through open_libtar_buffer(), write it straight out
+		return write(fd, buffer, size);
+	}
+	while (left > 0) {
+		len = buf->size - buf->loc;
+		if (len > left)
+			len = left;
+		memcpy(buf->data[buf->cur] + buf->loc, data, len);
+		buf->loc += len;
+		data += len;
+		left -= len;
+		if (buf->loc == buf->size && queue_libtar_buffer(buf) != 0)
+			return -1;
+	}
+	return size;
+}
+
+/* Adds len bytes of in_fd at offset to the archive's digest, reading them
+   back into the idle write buffer. They were just sent, so this is served
+   from the page cache. */
+static int digest_sent_data(struct libtar_buffer *buf, int in_fd, off64_t offset, size_t len) {
+	unsigned char *data = buf->data[buf->cur];
+	ssize_t ret;
+
+	while (len > 0) {
+		ret = pread64(in_fd, data, len, offset);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return -1;
+		MD5Update(buf->md5, data, ret);
+		offset += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+ssize_t send_libtar_buffer(int fd, int in_fd, size_t count) {
+	struct libtar_buffer *buf = find_libtar_buffer(fd);
+	struct MD5Context *md5 = (buf != NULL ? buf->md5 : NULL);
+	off64_t start = 0;
+	size_t sent = 0, chunk;
+	ssize_t ret;
+
+	if (md5 != NULL) {
+		start = lseek64(in_fd, 0, SEEK_CUR);
+		if (start < 0) {
+			errno = ENOSYS;
+			return -1;
 		}
 	}
-	if (flush == 1) {
-		flush = 0;
-		if (buffer_loc == 0) {
-			// nothing to write
-			return 0;
+	if (flush_libtar_buffer(fd) != 0)
+		return -1;
+	while (sent < count) {
+		// With a digest running, send one buffer's worth at a time and
+		// hash it right away so the file has no time to change under us
+		chunk = count - sent;
+		if (md5 != NULL && chunk > buf->size)
+			chunk = buf->size;
+		ret = sendfile(fd, in_fd, NULL, chunk);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (sent == 0 && (errno == EINVAL || errno == ENOSYS)) {
+				// Nothing was read yet, libtar can still copy it the slow way
+				errno = ENOSYS;
+			} else {
+				LOGERR("Error writing tar file!\n");
+			}
+			return -1;
 		}
-		if (write(fd, write_buffer, buffer_loc) != buffer_loc) {
-			LOGERR("Error writing tar file!\n");
-			buffer_loc = 0;
+		if (ret == 0)
+			break;
+		if (md5 != NULL && digest_sent_data(buf, in_fd, start + sent, ret) != 0) {
+			LOGERR("Error reading back file data for the digest\n");
 			return -1;
-		} else {
-			buffer_loc = 0;
-			return size;
 		}
-	} else {
-		return size;
+		sent += ret;
 	}
-	// Shouldn't ever get here
-	return -1;
+	return sent;
 }
 
-void flush_libtar_buffer(int fd) {
-	eot_count = 0;
-	buffer_status = 2;
+/* Writes out everything buffered so far and waits for it to hit the fd */
+int flush_libtar_buffer(int fd) {
+	struct libtar_buffer *buf = find_libtar_buffer(fd);
+	int ret;
+
+	if (buf == NULL)
+		return 0;
+	ret = queue_libtar_buffer(buf);
+	pthread_mutex_lock(&buf->lock);
+	if (wait_libtar_buffer(buf) != 0)
+		ret = -1;
+	pthread_mutex_unlock(&buf->lock);
+	return ret;
+}
+
+/* Everything written to the archive on fd from now on is also fed to md5c
+   so the digest is ready as soon as the archive is closed */
+void digest_libtar_buffer(int fd, struct MD5Context *md5c) {
+	struct libtar_buffer *buf = find_libtar_buffer(fd);
+
+	if (buf != NULL) {
+		pthread_mutex_lock(&buf->lock);
+		buf->md5 = md5c;
+		pthread_mutex_unlock(&buf->lock);
+	}
 }
@@ -19,10 +19,28 @@
 #ifndef _TARWRITE_HEADER
 #define _TARWRITE_HEADER
 
-void reinit_libtar_buffer();
+#include <sys/types.h>
+
+struct MD5Context;
+
+/* Number of archives that can be open for buffered writing at once */
+#define LIBTAR_MAX_BUFFERS	16
+/* Limits for the size of each of an archive's two write buffers */
+#define LIBTAR_MIN_BUFFER_SIZE	65536
+#define LIBTAR_MAX_BUFFER_SIZE	8388608
+
 void init_libtar_buffer(unsigned new_buff_size);
-void free_libtar_buffer();
-writefunc_t write_libtar_buffer(int fd, const void *buffer, size_t size);
-void flush_libtar_buffer(int fd);
+/* Buffers writes to an already open fd until close_libtar_buffer() */
+int attach_libtar_buffer(int fd);
+/* tartype_t hooks, the buffers and their I/O thread live from open to
+   close of the archive */
+int open_libtar_buffer(const char *pathname, int flags, ...);
+int close_libtar_buffer(int fd);
+ssize_t write_libtar_buffer(int fd, const void *buffer, size_t size);
+/* tartype_t sendfunc, copies file data into the archive without a trip
+   through user space; a running digest reads the data back afterwards */
+ssize_t send_libtar_buffer(int fd, int in_fd, size_t count);
+int flush_libtar_buffer(int fd);
+void digest_libtar_buffer(int fd, struct MD5Context *md5c);
 
 #endif  // _TARWRITE_HEADER
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -174,35 +175,104 @@ static int Run_Update_Binary(const char *path, ZipArchive *Zip, int* wipe_cache)
 	return INSTALL_SUCCESS;
 }
 
+// Feeds the package to the MD5 while verify_data() hashes it
+static void Update_Zip_MD5(const unsigned char* data, size_t len, void* cookie) {
+	MD5Update(((twrpDigest*) cookie)->getMD5Context(), data, len);
+}
+
+// Reads the digests the adb sideload service computed while it received
+// the package open on fd.  They are only used if they describe that very
+// file, and are removed either way so they can't be used twice.
+static bool Load_Sideload_Digests(int fd, Package_Digests* digests) {
+	struct stat st;
+	int digests_fd = open(SIDELOAD_DIGESTS_FILE, O_RDONLY);
+	if (digests_fd < 0)
+		return false;
+	bool ret = read(digests_fd, digests, sizeof(*digests)) == sizeof(*digests) &&
+		fstat(fd, &st) == 0 &&
+		digests->magic == PACKAGE_DIGESTS_MAGIC &&
+		digests->package_size == (uint64_t) st.st_size &&
+		digests->dev == (uint64_t) st.st_dev &&
+		digests->ino == (uint64_t) st.st_ino &&
+		digests->mtime == (int64_t) st.st_mtime;
+	close(digests_fd);
+	unlink(SIDELOAD_DIGESTS_FILE);
+	return ret;
+}
+
 extern "C" int TWinstall_zip(const char* path, int* wipe_cache) {
-	int ret_val, zip_verify, md5_return, key_count;
+	int ret_val, zip_verify, md5_return, key_count, zip_fd;
+	bool check_md5;
 	twrpDigest md5sum;
 	string strpath = path;
 	ZipArchive Zip;
+	MemMapping map;
+	Package_Digests digests;
+	bool have_digests;
 
 	gui_print("Installing '%s'...\nChecking for MD5 file...\n", path);
 	md5sum.setfn(strpath);
-	md5_return = md5sum.verify_md5digest();
-	if (md5_return == -2) {
-		// MD5 did not match.
-		LOGERR("Zip MD5 does not match.\nUnable to install zip.\n");
-		return INSTALL_CORRUPT;
-	} else if (md5_return == -1) {
+	check_md5 = TWFunc::Path_Exists(strpath + ".md5");
+	if (!check_md5)
 		gui_print("Skipping MD5 check: no MD5 file found.\n");
-	} else if (md5_return == 0)
-		gui_print("Zip MD5 matched.\n"); // MD5 found and matched.
 
 	DataManager::GetValue(TW_SIGNED_ZIP_VERIFY_VAR, zip_verify);
 	DataManager::SetProgress(0);
-	if (zip_verify) {
+
+	// Map the zip once: the MD5, the signature check and minzip all
+	// work from the same pages instead of reading the file three times
+	zip_fd = open(path, O_RDONLY);
+	if (zip_fd < 0) {
+		LOGERR("Unable to open '%s': %s\n", path, strerror(errno));
+		return INSTALL_CORRUPT;
+	}
+	if (sysMapFileInShmem(zip_fd, &map) != 0) {
+		LOGERR("Unable to map '%s'\n", path);
+		close(zip_fd);
+		return INSTALL_CORRUPT;
+	}
+	madvise(map.addr, map.length, MADV_SEQUENTIAL);
+	have_digests = Load_Sideload_Digests(zip_fd, &digests);
+
+	if (check_md5)
+		md5sum.startMD5();
+	ret_val = VERIFY_SUCCESS;
+	if (zip_verify && have_digests && !check_md5) {
+		// Hashed by adbd while it was received, only the signature is left
 		gui_print("Verifying zip signature...\n");
-		ret_val = verify_file(path);
-		if (ret_val != VERIFY_SUCCESS) {
-			LOGERR("Zip signature verification failed: %i\n", ret_val);
-			return -1;
-		}
+		ret_val = verify_data_digests((const unsigned char*) map.addr, map.length, &digests);
+	} else if (zip_verify) {
+		gui_print("Verifying zip signature...\n");
+		ret_val = verify_data((const unsigned char*) map.addr, map.length, check_md5 ? Update_Zip_MD5 : NULL, &md5sum);
+	} else if (check_md5) {
+		const size_t chunk = 1024 * 1024;
+		for (size_t pos = 0; pos < map.length; pos += chunk)
+			Update_Zip_MD5((const unsigned char*) map.addr + pos, map.length - pos < chunk ? map.length - pos : chunk, &md5sum);
+	}
+	if (ret_val != VERIFY_SUCCESS) {
+		LOGERR("Zip signature verification failed: %i\n", ret_val);
+		sysReleaseShmem(&map);
+		close(zip_fd);
+		return -1;
 	}
-	ret_val = mzOpenZipArchive(path, &Zip);
+	if (check_md5) {
+		md5sum.finishMD5();
+		md5_return = md5sum.check_md5digest();
+		if (md5_return == -2) {
+			// MD5 did not match.
+			LOGERR("Zip MD5 does not match.\nUnable to install zip.\n");
+			sysReleaseShmem(&map);
+			close(zip_fd);
+			return INSTALL_CORRUPT;
+		} else if (md5_return == -1) {
+			gui_print("Skipping MD5 check: no MD5 file found.\n");
+		} else if (md5_return == 0)
+			gui_print("Zip MD5 matched.\n"); // MD5 found and matched.
+	}
+	madvise(map.addr, map.length, MADV_NORMAL);
+
+	// The archive owns the descriptor and the mapping from here on
+	ret_val = mzOpenZipArchiveMapped(zip_fd, &map, &Zip);
 	if (ret_val != 0) {
 		LOGERR("Zip file is corrupt!\n", path);
 		return INSTALL_CORRUPT;
@@ -39,6 +39,7 @@
 #include <fstream>
 #include <sstream>
 #include "twrpTar.hpp"
+#include "twrpDirIndex.hpp"
 #include "twrp-functions.hpp"
 #include "partitions.hpp"
 #include "twcommon.h"
@@ -220,33 +221,7 @@ int TWFunc::Recursive_Mkdir(string Path) {
 }
 
 unsigned long long TWFunc::Get_Folder_Size(const string& Path, bool Display_Error) {
-	DIR* d = opendir(Path.c_str());
-	if (d == NULL) {
-		if (Display_Error)
-			LOGERR("Cannot open '%s'(error: %s)\n", Path.c_str(), strerror(errno));
-		else
-			LOGINFO("Cannot open '%s'(error: %s)\n", Path.c_str(), strerror(errno));
-		return 0;
-	}
-
-	struct dirent* de;
-	struct stat st;
-	unsigned long long dusize = 0;
-	unsigned long long dutemp = 0;
-	while ((de = readdir(d)) != NULL) {
-		if (de->d_type == DT_DIR) {
-			if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
-				continue;
-			dutemp = Get_Folder_Size((Path + "/" + de->d_name), Display_Error);
-			dusize += dutemp;
-			dutemp = 0;
-		} else if (de->d_type == DT_REG) {
-			stat((Path + "/" + de->d_name).c_str(), &st);
-			dusize += (unsigned long long)(st.st_size);
-		}
-	}
-	closedir(d);
-	return dusize;
+	return twrpDirIndex::Get_Size(Path, Display_Error);
 }
 
 bool TWFunc::Path_Exists(string Path) {
@@ -599,6 +574,21 @@ int TWFunc::TarEntryExists(string tarfn, string entry) {
 	return 0;
 }
 
+int TWFunc::Get_Split_Archives(string tarfn, vector<string>& Archives) {
+	char split_filename[512];
+	int index;
+
+	// Split_Archive() numbers its archives 000-999 and each backup thread
+	// numbers its own as <thread><00-99>, so the indexes need not be contiguous
+	Archives.clear();
+	for (index = 0; index < 1000; index++) {
+		snprintf(split_filename, sizeof(split_filename), "%s%03i", tarfn.c_str(), index);
+		if (Path_Exists(split_filename))
+			Archives.push_back(split_filename);
+	}
+	return Archives.size();
+}
+
 int TWFunc::cat_file(string fn, int print_line_length) {
 	if (fn.empty() || print_line_length == 0)
 		return 0;
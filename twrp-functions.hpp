@@ -137,6 +137,8 @@ class TWFunc {
 		// Used in restoring tar
 		static int TarExtract(string tarfn, string tardir);
 		static int TarEntryExists(string tarfn, string entry);
+		// Lists the archives a backup was split into (tarfn000, tarfn001, tarfn100, ...) and returns how many there are
+		static int Get_Split_Archives(string tarfn, vector<string>& Archives);
 };
 
 extern int Log_Offset;
@@ -0,0 +1,581 @@
+/*
+	Copyright 2013 bigbiff/Dees_Troy TeamWin
+	This file is part of TWRP/TeamWin Recovery Project.
+
+	TWRP is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	TWRP is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with TWRP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sys/types.h>
+#include <errno.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "twrpBlockMap.hpp"
+#include "twcommon.h"
+
+using namespace std;
+
+// On disk values are little endian, the same as every device this runs on,
+// so the structures below are read as they are.
+
+// ext4, see ext4_super_block and ext4_group_desc in the kernel
+#define EXT4_SUPER_OFFSET 1024
+#define EXT4_SUPER_MAGIC 0xEF53
+#define EXT4_FEATURE_COMPAT_SPARSE_SUPER2 0x0200
+#define EXT4_FEATURE_INCOMPAT_RECOVER 0x0004
+#define EXT4_FEATURE_INCOMPAT_META_BG 0x0010
+#define EXT4_FEATURE_INCOMPAT_64BIT 0x0080
+#define EXT4_FEATURE_RO_COMPAT_SPARSE_SUPER 0x0001
+#define EXT4_FEATURE_RO_COMPAT_GDT_CSUM 0x0010
+#define EXT4_FEATURE_RO_COMPAT_METADATA_CSUM 0x0400
+#define EXT4_BG_BLOCK_UNINIT 0x0002
+#define EXT4_MIN_DESC_SIZE 32
+#define EXT4_MIN_DESC_SIZE_64BIT 64
+#define EXT4_GOOD_OLD_INODE_SIZE 128
+
+struct ext4_super_start {
+	uint32_t s_inodes_count;
+	uint32_t s_blocks_count_lo;
+	uint32_t s_r_blocks_count_lo;
+	uint32_t s_free_blocks_count_lo;
+	uint32_t s_free_inodes_count;
+	uint32_t s_first_data_block;
+	uint32_t s_log_block_size;
+	uint32_t s_log_cluster_size;
+	uint32_t s_blocks_per_group;
+	uint32_t s_clusters_per_group;
+	uint32_t s_inodes_per_group;
+	uint32_t s_mtime;
+	uint32_t s_wtime;
+	uint16_t s_mnt_count;
+	uint16_t s_max_mnt_count;
+	uint16_t s_magic;
+} __attribute__((packed));
+
+#define EXT4_SB_REV_LEVEL 0x4C
+#define EXT4_SB_INODE_SIZE 0x58
+#define EXT4_SB_FEATURE_COMPAT 0x5C
+#define EXT4_SB_FEATURE_INCOMPAT 0x60
+#define EXT4_SB_FEATURE_RO_COMPAT 0x64
+#define EXT4_SB_RESERVED_GDT_BLOCKS 0xCE
+#define EXT4_SB_DESC_SIZE 0xFE
+#define EXT4_SB_BLOCKS_COUNT_HI 0x150
+
+#define EXT4_BG_BLOCK_BITMAP_LO 0x00
+#define EXT4_BG_INODE_BITMAP_LO 0x04
+#define EXT4_BG_INODE_TABLE_LO 0x08
+#define EXT4_BG_FLAGS 0x12
+#define EXT4_BG_BLOCK_BITMAP_HI 0x20
+#define EXT4_BG_INODE_BITMAP_HI 0x24
+#define EXT4_BG_INODE_TABLE_HI 0x28
+
+// f2fs, the leading parts of the structures in f2fs-tools/include/f2fs_fs.h
+#define F2FS_SUPER_OFFSET 1024
+#define F2FS_SUPER_MAGIC 0xF2F52010
+#define F2FS_BLKSIZE 4096
+#define F2FS_LOG_BLKSIZE 12
+#define F2FS_LOG_BLOCKS_PER_SEG 9               // the SIT valid maps have 512 bits
+#define F2FS_SB_CP_PAYLOAD 0x680                // after extension_list, zero on older versions
+#define F2FS_CP_UMOUNT_FLAG 0x00000001
+#define F2FS_CP_ORPHAN_PRESENT_FLAG 0x00000002
+#define F2FS_CP_COMPACT_SUM_FLAG 0x00000004
+#define F2FS_CP_FASTBOOT_FLAG 0x00000020
+#define F2FS_CP_CRC_RECOVERY_FLAG 0x00000040
+#define F2FS_CP_NAT_BITS_FLAG 0x00000080
+#define F2FS_CP_TRIMMED_FLAG 0x00000100
+#define F2FS_CP_NOCRC_RECOVERY_FLAG 0x00000200
+// Checkpoint flags that change nothing read here. Anything else, like
+// CP_ERROR_FLAG or CP_LARGE_NAT_BITMAP_FLAG which moves the SIT version
+// bitmap, and flags newer than this list are not trusted.
+#define F2FS_CP_KNOWN_FLAGS (F2FS_CP_UMOUNT_FLAG | F2FS_CP_ORPHAN_PRESENT_FLAG | F2FS_CP_COMPACT_SUM_FLAG | \
+	F2FS_CP_FASTBOOT_FLAG | F2FS_CP_CRC_RECOVERY_FLAG | F2FS_CP_NAT_BITS_FLAG | F2FS_CP_TRIMMED_FLAG | \
+	F2FS_CP_NOCRC_RECOVERY_FLAG)
+#define F2FS_NR_CURSEG_DATA_TYPE 3
+#define F2FS_NR_CURSEG_TYPE 6
+#define F2FS_CURSEG_COLD_DATA 2
+#define F2FS_SIT_VBLOCK_MAP_SIZE 64
+#define F2FS_SUM_ENTRIES_SIZE (7 * 512)
+#define F2FS_SUM_JOURNAL_SIZE (F2FS_BLKSIZE - 5 - F2FS_SUM_ENTRIES_SIZE)
+
+struct f2fs_super_start {
+	uint32_t magic;
+	uint16_t major_ver;
+	uint16_t minor_ver;
+	uint32_t log_sectorsize;
+	uint32_t log_sectors_per_block;
+	uint32_t log_blocksize;
+	uint32_t log_blocks_per_seg;
+	uint32_t segs_per_sec;
+	uint32_t secs_per_zone;
+	uint32_t checksum_offset;
+	uint64_t block_count;
+	uint32_t section_count;
+	uint32_t segment_count;
+	uint32_t segment_count_ckpt;
+	uint32_t segment_count_sit;
+	uint32_t segment_count_nat;
+	uint32_t segment_count_ssa;
+	uint32_t segment_count_main;
+	uint32_t segment0_blkaddr;
+	uint32_t cp_blkaddr;
+	uint32_t sit_blkaddr;
+	uint32_t nat_blkaddr;
+	uint32_t ssa_blkaddr;
+	uint32_t main_blkaddr;
+} __attribute__((packed));
+
+struct f2fs_checkpoint_start {
+	uint64_t checkpoint_ver;
+	uint64_t user_block_count;
+	uint64_t valid_block_count;
+	uint32_t rsvd_segment_count;
+	uint32_t overprov_segment_count;
+	uint32_t free_segment_count;
+	uint32_t cur_node_segno[8];
+	uint16_t cur_node_blkoff[8];
+	uint32_t cur_data_segno[8];
+	uint16_t cur_data_blkoff[8];
+	uint32_t ckpt_flags;
+	uint32_t cp_pack_total_block_count;
+	uint32_t cp_pack_start_sum;
+	uint32_t valid_node_count;
+	uint32_t valid_inode_count;
+	uint32_t next_free_nid;
+	uint32_t sit_ver_bitmap_bytesize;
+	uint32_t nat_ver_bitmap_bytesize;
+	uint32_t checksum_offset;
+	uint64_t elapsed_time;
+	unsigned char alloc_type[16];
+	unsigned char sit_nat_version_bitmap[1];
+} __attribute__((packed));
+
+struct f2fs_sit_entry {
+	uint16_t vblocks;
+	unsigned char valid_map[F2FS_SIT_VBLOCK_MAP_SIZE];
+	uint64_t mtime;
+} __attribute__((packed));
+
+struct f2fs_sit_journal_entry {
+	uint32_t segno;
+	struct f2fs_sit_entry se;
+} __attribute__((packed));
+
+#define F2FS_SIT_ENTRY_PER_BLOCK (F2FS_BLKSIZE / sizeof(struct f2fs_sit_entry))
+#define F2FS_SIT_JOURNAL_ENTRIES ((F2FS_SUM_JOURNAL_SIZE - 2) / sizeof(struct f2fs_sit_journal_entry))
+
+static int Read_At(int fd, void* buf, size_t len, unsigned long long offset) {
+	size_t done = 0;
+	ssize_t ret;
+
+	while (done < len) {
+		ret = pread64(fd, (unsigned char*) buf + done, len - done, offset + done);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return -1;
+		done += ret;
+	}
+	return 0;
+}
+
+// Block number from a group descriptor, the high half is only there in
+// 64 byte descriptors
+static unsigned long long Ext4_Desc_Block(const unsigned char* desc, uint32_t desc_size, unsigned lo, unsigned hi) {
+	uint32_t block_lo, block_hi = 0;
+
+	memcpy(&block_lo, desc + lo, sizeof(block_lo));
+	if (desc_size >= EXT4_MIN_DESC_SIZE_64BIT)
+		memcpy(&block_hi, desc + hi, sizeof(block_hi));
+	return ((unsigned long long) block_hi << 32) | block_lo;
+}
+
+// With sparse_super only groups 0, 1 and powers of 3, 5 and 7 keep a copy
+// of the superblock and group descriptors
+static bool Ext4_Group_Has_Super(unsigned long long group, bool sparse_super) {
+	unsigned long long n;
+	unsigned base;
+
+	if (!sparse_super || group <= 1)
+		return true;
+	if (!(group & 1))
+		return false;
+	for (base = 3; base <= 7; base += 2) {
+		for (n = base; n < group; n *= base);
+		if (n == group)
+			return true;
+	}
+	return false;
+}
+
+// f2fs numbers the bits of its bitmaps from the top of each byte
+static bool F2fs_Test_Bit(unsigned nr, const unsigned char* bitmap) {
+	return (bitmap[nr >> 3] & (0x80 >> (nr & 7))) != 0;
+}
+
+// Same as f2fs_cal_crc32() in f2fs-tools/lib/libf2fs.c
+static uint32_t F2fs_Crc32(uint32_t crc, const unsigned char* buf, size_t len) {
+	unsigned i;
+
+	while (len--) {
+		crc ^= *buf++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+	}
+	return crc;
+}
+
+twrpBlockMap::twrpBlockMap() {
+	block_size = 0;
+	block_count = 0;
+}
+
+bool twrpBlockMap::read(const string& Device, const string& File_System) {
+	int fd;
+	bool ret;
+
+	map.clear();
+	block_size = 0;
+	block_count = 0;
+	fd = open(Device.c_str(), O_RDONLY | O_LARGEFILE);
+	if (fd < 0) {
+		LOGINFO("Unable to open '%s' for reading: %s\n", Device.c_str(), strerror(errno));
+		return false;
+	}
+	if (File_System == "ext4")
+		ret = readExt4(fd, Device);
+	else if (File_System == "f2fs")
+		ret = readF2fs(fd, Device);
+	else
+		ret = false;
+	close(fd);
+	if (!ret) {
+		map.clear();
+		block_count = 0;
+		return false;
+	}
+	LOGINFO("'%s' uses %llu of %llu %u byte blocks\n", Device.c_str(), usedBlocks(), block_count, block_size);
+	return true;
+}
+
+unsigned long long twrpBlockMap::usedBlocks() const {
+	unsigned long long used = 0, block;
+
+	for (block = 0; block < block_count; block++) {
+		if (isUsed(block))
+			used++;
+	}
+	return used;
+}
+
+void twrpBlockMap::setUsed(unsigned long long First, unsigned long long Count) {
+	unsigned long long block;
+
+	for (block = First; block < First + Count && block < block_count; block++)
+		map[block >> 3] |= 1 << (block & 7);
+}
+
+bool twrpBlockMap::readExt4(int fd, const string& Device) {
+	unsigned char sb[1024];
+	struct ext4_super_start* super = (struct ext4_super_start*) sb;
+	uint32_t compat, incompat, ro_compat, rev_level, desc_size, inode_size = EXT4_GOOD_OLD_INODE_SIZE;
+	uint16_t reserved_gdt, size;
+	unsigned long long groups, group, start, count, bitmap, gdt_blocks, table_blocks, i;
+	bool uninit_flags, uninit_layout;
+
+	if (Read_At(fd, sb, sizeof(sb), EXT4_SUPER_OFFSET) != 0 || super->s_magic != EXT4_SUPER_MAGIC) {
+		LOGINFO("No ext4 superblock found on '%s'\n", Device.c_str());
+		return false;
+	}
+	memcpy(&compat, sb + EXT4_SB_FEATURE_COMPAT, sizeof(compat));
+	memcpy(&incompat, sb + EXT4_SB_FEATURE_INCOMPAT, sizeof(incompat));
+	memcpy(&ro_compat, sb + EXT4_SB_FEATURE_RO_COMPAT, sizeof(ro_compat));
+	memcpy(&rev_level, sb + EXT4_SB_REV_LEVEL, sizeof(rev_level));
+	memcpy(&reserved_gdt, sb + EXT4_SB_RESERVED_GDT_BLOCKS, sizeof(reserved_gdt));
+	// Blocks allocated by transactions still in the journal are only marked
+	// in the bitmaps when it is replayed at the next mount
+	if (incompat & EXT4_FEATURE_INCOMPAT_RECOVER) {
+		LOGINFO("'%s' needs journal recovery, its block bitmaps are not read\n", Device.c_str());
+		return false;
+	}
+	if (incompat & EXT4_FEATURE_INCOMPAT_META_BG) {
+		LOGINFO("'%s' uses meta_bg, its block bitmaps are not read\n", Device.c_str());
+		return false;
+	}
+	if (super->s_log_block_size > 6) {
+		LOGINFO("'%s' has an invalid block size\n", Device.c_str());
+		return false;
+	}
+	block_size = 1024 << super->s_log_block_size;
+	block_count = super->s_blocks_count_lo;
+	desc_size = EXT4_MIN_DESC_SIZE;
+	if (incompat & EXT4_FEATURE_INCOMPAT_64BIT) {
+		uint32_t blocks_hi;
+
+		memcpy(&blocks_hi, sb + EXT4_SB_BLOCKS_COUNT_HI, sizeof(blocks_hi));
+		memcpy(&size, sb + EXT4_SB_DESC_SIZE, sizeof(size));
+		block_count |= (unsigned long long) blocks_hi << 32;
+		desc_size = size;
+	}
+	if (rev_level > 0) {
+		memcpy(&size, sb + EXT4_SB_INODE_SIZE, sizeof(size));
+		inode_size = size;
+	}
+	if (super->s_blocks_per_group == 0 || super->s_blocks_per_group > block_size * 8 ||
+		super->s_first_data_block >= block_count || desc_size < EXT4_MIN_DESC_SIZE ||
+		desc_size > block_size || (desc_size & (desc_size - 1)) != 0 ||
+		inode_size < EXT4_GOOD_OLD_INODE_SIZE || inode_size > block_size) {
+		LOGINFO("'%s' has an invalid ext4 superblock\n", Device.c_str());
+		return false;
+	}
+	// Block bitmaps of groups flagged BLOCK_UNINIT were never written, the
+	// flag only counts when the descriptors are checksummed. What is used
+	// in such a group is worked out as in ext4_init_block_bitmap(), unless
+	// sparse_super2 moved the backup superblocks.
+	uninit_flags = (ro_compat & (EXT4_FEATURE_RO_COMPAT_GDT_CSUM | EXT4_FEATURE_RO_COMPAT_METADATA_CSUM)) != 0;
+	uninit_layout = !(compat & EXT4_FEATURE_COMPAT_SPARSE_SUPER2);
+
+	groups = (block_count - super->s_first_data_block + super->s_blocks_per_group - 1) / super->s_blocks_per_group;
+	gdt_blocks = (groups * desc_size + block_size - 1) / block_size;
+	table_blocks = ((unsigned long long) super->s_inodes_per_group * inode_size + block_size - 1) / block_size;
+	vector<unsigned char> descs(groups * desc_size);
+	vector<unsigned char> bits(block_size);
+	if (Read_At(fd, &descs[0], descs.size(), (super->s_first_data_block + 1ULL) * block_size) != 0) {
+		LOGINFO("Unable to read the group descriptors of '%s': %s\n", Device.c_str(), strerror(errno));
+		return false;
+	}
+	map.assign((block_count + 7) / 8, 0);
+	setUsed(0, super->s_first_data_block);
+
+	for (group = 0; group < groups; group++) {
+		const unsigned char* desc = &descs[group * desc_size];
+		uint16_t bg_flags;
+
+		start = super->s_first_data_block + group * super->s_blocks_per_group;
+		count = block_count - start;
+		if (count > super->s_blocks_per_group)
+			count = super->s_blocks_per_group;
+		memcpy(&bg_flags, desc + EXT4_BG_FLAGS, sizeof(bg_flags));
+		if (uninit_flags && (bg_flags & EXT4_BG_BLOCK_UNINIT)) {
+			if (!uninit_layout) {
+				setUsed(start, count);
+				continue;
+			}
+			if (Ext4_Group_Has_Super(group, (ro_compat & EXT4_FEATURE_RO_COMPAT_SPARSE_SUPER) != 0))
+				setUsed(start, 1 + gdt_blocks + reserved_gdt);
+			// With flex_bg a group's bitmaps and inode table can be in another group
+			bitmap = Ext4_Desc_Block(desc, desc_size, EXT4_BG_BLOCK_BITMAP_LO, EXT4_BG_BLOCK_BITMAP_HI);
+			if (bitmap >= start && bitmap < start + count)
+				setUsed(bitmap, 1);
+			bitmap = Ext4_Desc_Block(desc, desc_size, EXT4_BG_INODE_BITMAP_LO, EXT4_BG_INODE_BITMAP_HI);
+			if (bitmap >= start && bitmap < start + count)
+				setUsed(bitmap, 1);
+			bitmap = Ext4_Desc_Block(desc, desc_size, EXT4_BG_INODE_TABLE_LO, EXT4_BG_INODE_TABLE_HI);
+			if (bitmap >= start && bitmap < start + count)
+				setUsed(bitmap, table_blocks);
+			continue;
+		}
+		bitmap = Ext4_Desc_Block(desc, desc_size, EXT4_BG_BLOCK_BITMAP_LO, EXT4_BG_BLOCK_BITMAP_HI);
+		if (bitmap == 0 || bitmap >= block_count) {
+			LOGINFO("Group %llu of '%s' has an invalid block bitmap\n", group, Device.c_str());
+			return false;
+		}
+		if (Read_At(fd, &bits[0], block_size, bitmap * block_size) != 0) {
+			LOGINFO("Unable to read the block bitmap of group %llu of '%s': %s\n", group, Device.c_str(), strerror(errno));
+			return false;
+		}
+		for (i = 0; i < count; i++) {
+			if (bits[i >> 3] & (1 << (i & 7)))
+				setUsed(start + i, 1);
+		}
+	}
+	return true;
+}
+
+// Returns the checkpoint pack at Block in cp if both of its copies of the
+// checkpoint block are intact and agree, see validate_checkpoint() in fsck
+bool twrpBlockMap::readF2fsCheckpoint(int fd, unsigned long long Block, unsigned char* cp, unsigned long long* version) {
+	struct f2fs_checkpoint_start* ckpt = (struct f2fs_checkpoint_start*) cp;
+	unsigned char last[F2FS_BLKSIZE];
+	struct f2fs_checkpoint_start* last_ckpt = (struct f2fs_checkpoint_start*) last;
+	uint32_t crc;
+
+	if (Read_At(fd, cp, F2FS_BLKSIZE, Block * F2FS_BLKSIZE) != 0 ||
+		ckpt->checksum_offset < sizeof(*ckpt) || ckpt->checksum_offset > F2FS_BLKSIZE - sizeof(crc))
+		return false;
+	memcpy(&crc, cp + ckpt->checksum_offset, sizeof(crc));
+	if (F2fs_Crc32(F2FS_SUPER_MAGIC, cp, ckpt->checksum_offset) != crc)
+		return false;
+	if (ckpt->cp_pack_total_block_count == 0 || ckpt->cp_pack_total_block_count > (1U << F2FS_LOG_BLOCKS_PER_SEG))
+		return false;
+
+	if (Read_At(fd, last, F2FS_BLKSIZE, (Block + ckpt->cp_pack_total_block_count - 1) * F2FS_BLKSIZE) != 0 ||
+		last_ckpt->checksum_offset < sizeof(*last_ckpt) || last_ckpt->checksum_offset > F2FS_BLKSIZE - sizeof(crc))
+		return false;
+	memcpy(&crc, last + last_ckpt->checksum_offset, sizeof(crc));
+	if (F2fs_Crc32(F2FS_SUPER_MAGIC, last, last_ckpt->checksum_offset) != crc)
+		return false;
+	if (last_ckpt->checkpoint_ver != ckpt->checkpoint_ver)
+		return false;
+	*version = ckpt->checkpoint_ver;
+	return true;
+}
+
+// Main area blocks are used if the SIT of the current checkpoint (or its
+// journal in the cold data summary) says so. The metadata areas and the
+// segments that were open at the checkpoint are copied whole.
+bool twrpBlockMap::readF2fs(int fd, const string& Device) {
+	unsigned char sb[F2FS_BLKSIZE], cp1[F2FS_BLKSIZE], cp2[F2FS_BLKSIZE], sum[F2FS_BLKSIZE], block[F2FS_BLKSIZE];
+	struct f2fs_super_start* super = (struct f2fs_super_start*) (sb + F2FS_SUPER_OFFSET);
+	struct f2fs_checkpoint_start* ckpt;
+	unsigned char* cp;
+	unsigned long long cp1_version = 0, cp2_version = 0, cp_addr, sum_addr, sit_blocks;
+	unsigned blocks_per_seg, segno, sit_block, i, j;
+	uint32_t cp_payload;
+	bool cp1_valid, cp2_valid;
+	vector<unsigned char> sit_bitmap;
+	const struct f2fs_sit_journal_entry* journal;
+	uint16_t journal_count;
+
+	if (Read_At(fd, sb, sizeof(sb), 0) != 0 || super->magic != F2FS_SUPER_MAGIC) {
+		LOGINFO("No f2fs superblock found on '%s'\n", Device.c_str());
+		return false;
+	}
+	if (super->log_blocksize != F2FS_LOG_BLKSIZE || super->log_blocks_per_seg != F2FS_LOG_BLOCKS_PER_SEG) {
+		LOGINFO("'%s' does not use 4KB blocks and 2MB segments, its SIT is not read\n", Device.c_str());
+		return false;
+	}
+	blocks_per_seg = 1 << F2FS_LOG_BLOCKS_PER_SEG;
+	block_size = F2FS_BLKSIZE;
+	block_count = super->main_blkaddr + ((unsigned long long) super->segment_count_main << F2FS_LOG_BLOCKS_PER_SEG);
+	if (super->cp_blkaddr >= super->main_blkaddr || super->sit_blkaddr >= super->main_blkaddr) {
+		LOGINFO("'%s' has an invalid f2fs superblock\n", Device.c_str());
+		return false;
+	}
+
+	// The newer of the two checkpoint packs is the current one
+	cp1_valid = readF2fsCheckpoint(fd, super->cp_blkaddr, cp1, &cp1_version);
+	cp2_valid = readF2fsCheckpoint(fd, super->cp_blkaddr + blocks_per_seg, cp2, &cp2_version);
+	if (cp1_valid && (!cp2_valid || (long long) (cp2_version - cp1_version) <= 0)) {
+		cp = cp1;
+		cp_addr = super->cp_blkaddr;
+	} else if (cp2_valid) {
+		cp = cp2;
+		cp_addr = super->cp_blkaddr + blocks_per_seg;
+	} else {
+		LOGINFO("No valid f2fs checkpoint found on '%s'\n", Device.c_str());
+		return false;
+	}
+	ckpt = (struct f2fs_checkpoint_start*) cp;
+	// Data fsynced after the checkpoint is only found by roll-forward
+	// recovery at the next mount and may sit outside the blocks copied here
+	if (!(ckpt->ckpt_flags & F2FS_CP_UMOUNT_FLAG)) {
+		LOGINFO("'%s' was not cleanly unmounted, its SIT is not read\n", Device.c_str());
+		return false;
+	}
+	if (ckpt->ckpt_flags & ~F2FS_CP_KNOWN_FLAGS) {
+		LOGINFO("'%s' has unsupported f2fs checkpoint flags %08x\n", Device.c_str(), ckpt->ckpt_flags);
+		return false;
+	}
+	sit_blocks = (unsigned long long) (super->segment_count_sit >> 1) << F2FS_LOG_BLOCKS_PER_SEG;
+	if ((unsigned long long) ckpt->sit_ver_bitmap_bytesize * 8 < (super->segment_count_main + F2FS_SIT_ENTRY_PER_BLOCK - 1) / F2FS_SIT_ENTRY_PER_BLOCK) {
+		LOGINFO("'%s' has an invalid f2fs checkpoint\n", Device.c_str());
+		return false;
+	}
+
+	// The SIT version bitmap follows the checkpoint fields, unless the
+	// bitmaps are too big for that block and the superblock reserves payload
+	// blocks after the checkpoint block for them, see __bitmap_ptr() in f2fs
+	memcpy(&cp_payload, sb + F2FS_SUPER_OFFSET + F2FS_SB_CP_PAYLOAD, sizeof(cp_payload));
+	if (cp_payload == 0) {
+		if (offsetof(struct f2fs_checkpoint_start, sit_nat_version_bitmap) + ckpt->sit_ver_bitmap_bytesize > F2FS_BLKSIZE) {
+			LOGINFO("'%s' has an invalid f2fs checkpoint\n", Device.c_str());
+			return false;
+		}
+		sit_bitmap.assign(ckpt->sit_nat_version_bitmap, ckpt->sit_nat_version_bitmap + ckpt->sit_ver_bitmap_bytesize);
+	} else {
+		if (cp_payload + 2 > ckpt->cp_pack_total_block_count || ckpt->sit_ver_bitmap_bytesize > (unsigned long long) cp_payload * F2FS_BLKSIZE) {
+			LOGINFO("'%s' has an invalid f2fs checkpoint payload\n", Device.c_str());
+			return false;
+		}
+		sit_bitmap.resize(ckpt->sit_ver_bitmap_bytesize);
+		if (Read_At(fd, &sit_bitmap[0], sit_bitmap.size(), (cp_addr + 1) * F2FS_BLKSIZE) != 0) {
+			LOGINFO("Unable to read the checkpoint payload of '%s': %s\n", Device.c_str(), strerror(errno));
+			return false;
+		}
+	}
+
+	// Recently changed SIT entries are kept in the journal of the cold data
+	// summary until the next checkpoint that has room for them
+	if (ckpt->ckpt_flags & F2FS_CP_COMPACT_SUM_FLAG) {
+		sum_addr = cp_addr + ckpt->cp_pack_start_sum;
+		i = F2FS_SUM_JOURNAL_SIZE;
+	} else {
+		unsigned base = (ckpt->ckpt_flags & F2FS_CP_UMOUNT_FLAG) ? F2FS_NR_CURSEG_TYPE : F2FS_NR_CURSEG_DATA_TYPE;
+		sum_addr = cp_addr + ckpt->cp_pack_total_block_count - (base + 1) + F2FS_CURSEG_COLD_DATA;
+		i = F2FS_SUM_ENTRIES_SIZE;
+	}
+	if (Read_At(fd, sum, sizeof(sum), sum_addr * F2FS_BLKSIZE) != 0) {
+		LOGINFO("Unable to read the SIT journal of '%s': %s\n", Device.c_str(), strerror(errno));
+		return false;
+	}
+	memcpy(&journal_count, sum + i, sizeof(journal_count));
+	journal = (const struct f2fs_sit_journal_entry*) (sum + i + sizeof(journal_count));
+	if (journal_count > F2FS_SIT_JOURNAL_ENTRIES) {
+		LOGINFO("'%s' has an invalid SIT journal\n", Device.c_str());
+		return false;
+	}
+
+	map.assign((block_count + 7) / 8, 0);
+	setUsed(0, super->main_blkaddr);
+	for (sit_block = 0; sit_block * F2FS_SIT_ENTRY_PER_BLOCK < super->segment_count_main; sit_block++) {
+		unsigned long long addr = super->sit_blkaddr + sit_block;
+
+		if (F2fs_Test_Bit(sit_block, &sit_bitmap[0]))
+			addr += sit_blocks;
+		if (Read_At(fd, block, sizeof(block), addr * F2FS_BLKSIZE) != 0) {
+			LOGINFO("Unable to read the SIT of '%s': %s\n", Device.c_str(), strerror(errno));
+			return false;
+		}
+		for (i = 0; i < F2FS_SIT_ENTRY_PER_BLOCK; i++) {
+			const struct f2fs_sit_entry* se = (const struct f2fs_sit_entry*) block + i;
+			unsigned long long first;
+
+			segno = sit_block * F2FS_SIT_ENTRY_PER_BLOCK + i;
+			if (segno >= super->segment_count_main)
+				break;
+			for (j = 0; j < journal_count; j++) {
+				if (journal[j].segno == segno) {
+					se = &journal[j].se;
+					break;
+				}
+			}
+			first = super->main_blkaddr + ((unsigned long long) segno << F2FS_LOG_BLOCKS_PER_SEG);
+			for (j = 0; j < blocks_per_seg; j++) {
+				if (F2fs_Test_Bit(j, se->valid_map))
+					setUsed(first + j, 1);
+			}
+		}
+	}
+	for (i = 0; i < F2FS_NR_CURSEG_DATA_TYPE; i++) {
+		if (ckpt->cur_node_segno[i] < super->segment_count_main)
+			setUsed(super->main_blkaddr + ((unsigned long long) ckpt->cur_node_segno[i] << F2FS_LOG_BLOCKS_PER_SEG), blocks_per_seg);
+		if (ckpt->cur_data_segno[i] < super->segment_count_main)
+			setUsed(super->main_blkaddr + ((unsigned long long) ckpt->cur_data_segno[i] << F2FS_LOG_BLOCKS_PER_SEG), blocks_per_seg);
+	}
+	return true;
+}
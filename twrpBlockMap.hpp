@@ -0,0 +1,54 @@
+/*
+	Copyright 2013 bigbiff/Dees_Troy TeamWin
+	This file is part of TWRP/TeamWin Recovery Project.
+
+	TWRP is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	TWRP is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with TWRP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TWRPBLOCKMAP_HPP
+#define _TWRPBLOCKMAP_HPP
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Which blocks of an unmounted ext4 or f2fs file system are in use, read
+// from the ext4 block bitmaps or the f2fs segment information table. Blocks
+// past the end of the file system (crypto footers) always count as used.
+class twrpBlockMap {
+	public:
+		twrpBlockMap();
+		// Reads the allocation of the File_System on Device, false if it
+		// is not a file system that can be read or looks damaged
+		bool read(const string& Device, const string& File_System);
+		bool isUsed(unsigned long long Block) const {
+			return Block >= block_count || (map[Block >> 3] & (1 << (Block & 7))) != 0;
+		}
+		unsigned blockSize() const { return block_size; }
+		unsigned long long blockCount() const { return block_count; }
+		unsigned long long usedBlocks() const;
+
+	private:
+		bool readExt4(int fd, const string& Device);
+		bool readF2fs(int fd, const string& Device);
+		bool readF2fsCheckpoint(int fd, unsigned long long Block, unsigned char* cp, unsigned long long* version);
+		void setUsed(unsigned long long First, unsigned long long Count);
+
+		vector<unsigned char> map;               // one bit per block, set when used
+		unsigned block_size;
+		unsigned long long block_count;
+};
+
+#endif // _TWRPBLOCKMAP_HPP
@@ -51,22 +51,44 @@ void twrpDigest::setfn(string fn) {
 
 int twrpDigest::computeMD5(void) {
 	string line;
-	struct MD5Context md5c;
-	FILE *file;
-	int len;
-	unsigned char buf[1024];
-	MD5Init(&md5c);
-	file = fopen(md5fn.c_str(), "rb");
-	if (file == NULL)
+	int fd;
+	ssize_t len;
+	unsigned char *buf;
+	const size_t buf_size = 1024 * 1024;
+
+	buf = (unsigned char*) malloc(buf_size);
+	if (buf == NULL)
 		return -1;
-	while ((len = fread(buf, 1, sizeof(buf), file)) > 0) {
+	fd = open(md5fn.c_str(), O_RDONLY | O_LARGEFILE);
+	if (fd < 0) {
+		free(buf);
+		return -1;
+	}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	MD5Init(&md5c);
+	while ((len = read(fd, buf, buf_size)) > 0) {
 		MD5Update(&md5c, buf, len);
 	}
-	fclose(file);
+	close(fd);
+	free(buf);
+	if (len < 0)
+		return -1;
 	MD5Final(md5sum ,&md5c);
 	return 0;
 }
 
+void twrpDigest::startMD5(void) {
+	MD5Init(&md5c);
+}
+
+struct MD5Context* twrpDigest::getMD5Context(void) {
+	return &md5c;
+}
+
+void twrpDigest::finishMD5(void) {
+	MD5Final(md5sum, &md5c);
+}
+
 int twrpDigest::write_md5digest(void) {
 	int i;
 	string md5string, md5file;
@@ -92,23 +114,33 @@ int twrpDigest::read_md5digest(void) {
 	return 0;
 }
 
-int twrpDigest::verify_md5digest(void) {
+int twrpDigest::compare_md5digest(void) {
 	string buf;
 	char hex[3];
 	int i;
 	string md5string;
-	if (read_md5digest() != 0)
-		return -1;
 	stringstream ss(line);
 	vector<string> tokens;
 	while (ss >> buf)
 		tokens.push_back(buf);
-	computeMD5();
 	for (i = 0; i < 16; ++i) {
 		snprintf(hex, 3, "%02x", md5sum[i]);
 		md5string += hex;
 	}
-	if (tokens.at(0) != md5string)
+	if (tokens.empty() || tokens.at(0) != md5string)
 		return -2;
 	return 0;
 }
+
+int twrpDigest::verify_md5digest(void) {
+	if (read_md5digest() != 0)
+		return -1;
+	computeMD5();
+	return compare_md5digest();
+}
+
+int twrpDigest::check_md5digest(void) {
+	if (read_md5digest() != 0)
+		return -1;
+	return compare_md5digest();
+}
@@ -16,9 +16,14 @@
 	along with TWRP.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifndef _TWRPDIGEST_HPP
+#define _TWRPDIGEST_HPP
+
 extern "C" {
 	#include "digest/md5.h"
 }
+#include <string>
+
 using namespace std;
 
 class twrpDigest {
@@ -28,9 +33,19 @@ class twrpDigest {
 		int computeMD5(void);
 		int verify_md5digest(void);
 		int write_md5digest(void);
+		// Streaming digest: start, feed the context while the file is written, then finish
+		void startMD5(void);
+		struct MD5Context* getMD5Context(void);
+		void finishMD5(void);
+		// Compares a digest finished with finishMD5() against the .md5 file
+		int check_md5digest(void);
 	private:
 		int read_md5digest(void);
+		int compare_md5digest(void);
 		string md5fn;
 		string line;
 		unsigned char md5sum[MD5LENGTH];
+		struct MD5Context md5c;
 };
+
+#endif // _TWRPDIGEST_HPP
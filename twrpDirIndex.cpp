@@ -0,0 +1,392 @@
+/*
+	Copyright 2013 bigbiff/Dees_Troy TeamWin
+	This file is part of TWRP/TeamWin Recovery Project.
+
+	TWRP is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	TWRP is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with TWRP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "twrpDirIndex.hpp"
+#include "twcommon.h"
+
+using namespace std;
+
+// Threads used to add up a folder and the number of folders that can wait
+// in their queue (each one holds an open fd)
+#define TW_SIZER_MAX_THREADS 8
+#define TW_SIZER_MAX_QUEUED 256
+// How often Get_Size() reports progress
+#define TW_SIZER_PROGRESS_MS 250
+
+twrpDirIndex::twrpDirIndex() {
+}
+
+void twrpDirIndex::Clear() {
+	// swap() gives the memory back, clear() would keep it allocated
+	vector<Entry>().swap(entries);
+	root.clear();
+}
+
+static int Open_Folder(int dir_fd, const char* name, const string& Path, bool Display_Error) {
+	int fd;
+
+	if (dir_fd < 0)
+		fd = open(name, O_RDONLY | O_DIRECTORY);
+	else
+		fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+	if (fd < 0) {
+		if (Display_Error)
+			LOGERR("Cannot open '%s'(error: %s)\n", Path.c_str(), strerror(errno));
+		else
+			LOGINFO("Cannot open '%s'(error: %s)\n", Path.c_str(), strerror(errno));
+	}
+	return fd;
+}
+
+// Adds up folders for twrpDirIndex::Get_Size(). Folders found while reading
+// one folder are queued as open fds so any thread can pick them up; when the
+// queue is full the thread that found them reads them itself, which keeps
+// the number of open fds bounded.
+class twrpFolderSizer {
+	public:
+		twrpFolderSizer(bool Display_Error);
+		~twrpFolderSizer();
+		unsigned long long Run(int dir_fd, const string& Path, twrpDirIndex::Size_Progress_Func progress, void* cookie);
+
+	private:
+		struct Job {
+			int fd;
+			string Path;
+		};
+		static void* Thread_Start(void* cookie);
+		void Work();
+		void Sum(int dir_fd, const string& Path);
+
+		vector<Job> jobs;
+		pthread_mutex_t lock;
+		pthread_cond_t cond;                 // a folder was queued or pending reached 0
+		pthread_cond_t done;                 // pending reached 0
+		unsigned pending;                    // folders queued or being read
+		unsigned long long bytes;
+		unsigned long folders;
+		bool display_error;
+};
+
+twrpFolderSizer::twrpFolderSizer(bool Display_Error) {
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&cond, NULL);
+	pthread_cond_init(&done, NULL);
+	pending = 0;
+	bytes = 0;
+	folders = 0;
+	display_error = Display_Error;
+}
+
+twrpFolderSizer::~twrpFolderSizer() {
+	pthread_mutex_destroy(&lock);
+	pthread_cond_destroy(&cond);
+	pthread_cond_destroy(&done);
+}
+
+void* twrpFolderSizer::Thread_Start(void* cookie) {
+	((twrpFolderSizer*)cookie)->Work();
+	return NULL;
+}
+
+void twrpFolderSizer::Work() {
+	Job job;
+
+	pthread_mutex_lock(&lock);
+	for (;;) {
+		while (jobs.empty() && pending > 0)
+			pthread_cond_wait(&cond, &lock);
+		if (jobs.empty())
+			break;
+		job = jobs.back();
+		jobs.pop_back();
+		pthread_mutex_unlock(&lock);
+
+		Sum(job.fd, job.Path);
+
+		pthread_mutex_lock(&lock);
+		if (--pending == 0) {
+			pthread_cond_broadcast(&cond);
+			pthread_cond_signal(&done);
+		}
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+// Reads the folder open on dir_fd and closes it
+void twrpFolderSizer::Sum(int dir_fd, const string& Path) {
+	DIR* d;
+	struct dirent* de;
+	struct stat st;
+	Job job;
+	unsigned long long dusize = 0;
+	bool folder;
+
+	d = fdopendir(dir_fd);
+	if (d == NULL) {
+		LOGINFO("Cannot read '%s'(error: %s)\n", Path.c_str(), strerror(errno));
+		close(dir_fd);
+		return;
+	}
+	while ((de = readdir(d)) != NULL) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+			continue;
+		if (de->d_type == DT_DIR) {
+			folder = true;
+		} else if (de->d_type == DT_REG || de->d_type == DT_UNKNOWN) {
+			if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+				continue;
+			if (S_ISREG(st.st_mode))
+				dusize += (unsigned long long)(st.st_size);
+			folder = S_ISDIR(st.st_mode);
+		} else {
+			folder = false;
+		}
+		if (!folder)
+			continue;
+
+		job.Path = Path + "/" + de->d_name;
+		job.fd = Open_Folder(dirfd(d), de->d_name, job.Path, display_error);
+		if (job.fd < 0)
+			continue;
+		pthread_mutex_lock(&lock);
+		if (jobs.size() < TW_SIZER_MAX_QUEUED) {
+			jobs.push_back(job);
+			pending++;
+			pthread_cond_signal(&cond);
+			job.fd = -1;
+		}
+		pthread_mutex_unlock(&lock);
+		if (job.fd >= 0)
+			Sum(job.fd, job.Path);
+	}
+	closedir(d);
+
+	pthread_mutex_lock(&lock);
+	bytes += dusize;
+	folders++;
+	pthread_mutex_unlock(&lock);
+}
+
+unsigned long long twrpFolderSizer::Run(int dir_fd, const string& Path, twrpDirIndex::Size_Progress_Func progress, void* cookie) {
+	pthread_t threads[TW_SIZER_MAX_THREADS];
+	unsigned thread_count = 0, i;
+	long core_count;
+	struct timeval now;
+	struct timespec timeout;
+	Job job;
+
+	job.fd = dir_fd;
+	job.Path = Path;
+	jobs.push_back(job);
+	pending = 1;
+
+	core_count = sysconf(_SC_NPROCESSORS_CONF);
+	if (core_count > TW_SIZER_MAX_THREADS)
+		core_count = TW_SIZER_MAX_THREADS;
+	for (i = 0; i < (unsigned)core_count; i++) {
+		if (pthread_create(&threads[thread_count], NULL, Thread_Start, this) != 0)
+			break;
+		thread_count++;
+	}
+	if (thread_count == 0) {
+		// No threads to be had, do it all right here
+		Work();
+		return bytes;
+	}
+
+	pthread_mutex_lock(&lock);
+	while (pending > 0) {
+		gettimeofday(&now, NULL);
+		timeout.tv_sec = now.tv_sec;
+		timeout.tv_nsec = (now.tv_usec + TW_SIZER_PROGRESS_MS * 1000) * 1000;
+		if (timeout.tv_nsec >= 1000000000) {
+			timeout.tv_sec++;
+			timeout.tv_nsec -= 1000000000;
+		}
+		if (pthread_cond_timedwait(&done, &lock, &timeout) == ETIMEDOUT && progress != NULL && pending > 0) {
+			unsigned long long bytes_now = bytes;
+			unsigned long folders_now = folders;
+			pthread_mutex_unlock(&lock);
+			progress(bytes_now, folders_now, cookie);
+			pthread_mutex_lock(&lock);
+		}
+	}
+	pthread_mutex_unlock(&lock);
+	for (i = 0; i < thread_count; i++)
+		pthread_join(threads[i], NULL);
+	return bytes;
+}
+
+// Reads the folder open on dir_fd into the index below parent and closes it.
+// Returns the bytes in regular files below the folder.
+unsigned long long twrpDirIndex::Walk(int dir_fd, const string& Path, unsigned parent, bool Display_Error, const vector<string>* Size_Only) {
+	DIR* d;
+	struct dirent* de;
+	struct stat st;
+	Entry item;
+	string Child;
+	unsigned long long dusize = 0, child_size;
+	unsigned first, count, i;
+	int fd;
+
+	d = fdopendir(dir_fd);
+	if (d == NULL) {
+		LOGINFO("Cannot read '%s'(error: %s)\n", Path.c_str(), strerror(errno));
+		close(dir_fd);
+		return 0;
+	}
+
+	first = entries.size();
+	while ((de = readdir(d)) != NULL) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+			continue;
+		// d_type saves the stat() for everything a backup leaves out
+		if (de->d_type == DT_BLK || de->d_type == DT_CHR || de->d_type == DT_FIFO || de->d_type == DT_SOCK)
+			continue;
+		if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+			LOGINFO("Unable to stat '%s/%s': %s\n", Path.c_str(), de->d_name, strerror(errno));
+			continue;
+		}
+		if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode) && !S_ISLNK(st.st_mode))
+			continue;
+		item.name = de->d_name;
+		item.st = st;
+		item.parent = parent;
+		item.first_child = 0;
+		item.child_count = 0;
+		item.size = (S_ISREG(st.st_mode) ? (unsigned long long)(st.st_size) : 0);
+		entries.push_back(item);
+	}
+
+	// Descend only once the whole folder is in so its children stay together
+	count = entries.size() - first;
+	entries[parent].first_child = first;
+	entries[parent].child_count = count;
+	for (i = first; i < first + count; i++) {
+		if (S_ISDIR(entries[i].st.st_mode)) {
+			Child = Path + "/" + entries[i].name;
+			fd = Open_Folder(dirfd(d), entries[i].name.c_str(), Child, Display_Error);
+			if (fd >= 0) {
+				// Walk() grows entries, so don't hold on to entries[i] across it
+				if (Size_Only != NULL && find(Size_Only->begin(), Size_Only->end(), Child) != Size_Only->end()) {
+					twrpFolderSizer sizer(Display_Error);
+					child_size = sizer.Run(fd, Child, NULL, NULL);
+				} else {
+					child_size = Walk(fd, Child, i, Display_Error, Size_Only);
+				}
+				entries[i].size = child_size;
+			}
+		}
+		dusize += entries[i].size;
+	}
+	closedir(d);
+	return dusize;
+}
+
+bool twrpDirIndex::Build(const string& Path, bool Display_Error, const vector<string>* Size_Only) {
+	Entry item;
+	unsigned long long size;
+	int fd;
+
+	Clear();
+	fd = Open_Folder(-1, Path.c_str(), Path, Display_Error);
+	if (fd < 0)
+		return false;
+	if (fstat(fd, &item.st) != 0) {
+		LOGINFO("Unable to stat '%s': %s\n", Path.c_str(), strerror(errno));
+		close(fd);
+		return false;
+	}
+	root = Path;
+	item.name = Path;
+	item.parent = 0;
+	item.first_child = 0;
+	item.child_count = 0;
+	item.size = 0;
+	entries.push_back(item);
+	size = Walk(fd, Path, 0, Display_Error, Size_Only);
+	entries[0].size = size;
+	return true;
+}
+
+unsigned long long twrpDirIndex::Get_Size(const string& Path, bool Display_Error, Size_Progress_Func progress, void* cookie) {
+	twrpFolderSizer sizer(Display_Error);
+	int fd;
+
+	fd = Open_Folder(-1, Path.c_str(), Path, Display_Error);
+	if (fd < 0)
+		return 0;
+	return sizer.Run(fd, Path, progress, cookie);
+}
+
+int twrpDirIndex::Find(const string& Path) const {
+	size_t start, end;
+	unsigned current = 0, i, last;
+	string name;
+	bool found;
+
+	if (entries.empty())
+		return -1;
+	if (Path == root)
+		return 0;
+	if (Path.size() <= root.size() || Path.compare(0, root.size(), root) != 0 || Path[root.size()] != '/')
+		return -1;
+
+	start = root.size() + 1;
+	while (start < Path.size()) {
+		end = Path.find('/', start);
+		if (end == string::npos)
+			end = Path.size();
+		if (end > start) {
+			name = Path.substr(start, end - start);
+			found = false;
+			last = entries[current].first_child + entries[current].child_count;
+			for (i = entries[current].first_child; i < last; i++) {
+				if (entries[i].name == name) {
+					current = i;
+					found = true;
+					break;
+				}
+			}
+			if (!found)
+				return -1;
+		}
+		start = end + 1;
+	}
+	return (int)current;
+}
+
+unsigned long long twrpDirIndex::Size_Of(const string& Path) const {
+	int i = Find(Path);
+
+	if (i < 0)
+		return 0;
+	return entries[i].size;
+}
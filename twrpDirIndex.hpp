@@ -0,0 +1,68 @@
+/*
+	Copyright 2013 bigbiff/Dees_Troy TeamWin
+	This file is part of TWRP/TeamWin Recovery Project.
+
+	TWRP is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	TWRP is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with TWRP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TWRPDIRINDEX_HPP
+#define _TWRPDIRINDEX_HPP
+
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Snapshot of a directory tree taken with a single walk. Splitting a backup
+// between threads and building the tar lists both read from the same index
+// instead of walking the tree again each time.
+class twrpDirIndex {
+	public:
+		struct Entry {
+			string name;
+			struct stat st;                      // lstat() of the entry
+			unsigned parent;
+			unsigned first_child;                // children of a folder are stored next to each other
+			unsigned child_count;
+			unsigned long long size;             // bytes in regular files at or below this entry
+		};
+
+		// Called from the thread that called Get_Size() every so often with
+		// the bytes and folders counted so far
+		typedef void (*Size_Progress_Func)(unsigned long long bytes, unsigned long folders, void* cookie);
+
+		twrpDirIndex();
+		// Walks Path and replaces the current contents of the index. Folders
+		// listed in Size_Only are added up but their contents are not kept.
+		bool Build(const string& Path, bool Display_Error, const vector<string>* Size_Only = NULL);
+		// Adds up the regular files below Path without keeping anything,
+		// spreading the folders over one thread per core
+		static unsigned long long Get_Size(const string& Path, bool Display_Error, Size_Progress_Func progress = NULL, void* cookie = NULL);
+		// Position of Path in entries or -1 if it is not in the index
+		int Find(const string& Path) const;
+		// Size of Path from the index, 0 if it is not in the index
+		unsigned long long Size_Of(const string& Path) const;
+		const string& Root() const { return root; }
+		bool Empty() const { return entries.empty(); }
+		void Clear();
+
+		vector<Entry> entries;               // entries[0] is the root folder
+
+	private:
+		unsigned long long Walk(int dir_fd, const string& Path, unsigned parent, bool Display_Error, const vector<string>* Size_Only);
+		string root;
+};
+
+#endif // _TWRPDIRINDEX_HPP
@@ -0,0 +1,794 @@
+/*
+	Copyright 2013 bigbiff/Dees_Troy TeamWin
+	This file is part of TWRP/TeamWin Recovery Project.
+
+	TWRP is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	TWRP is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with TWRP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+extern "C" {
+	#include "digest/md5.h"
+}
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <string>
+#include "twrpImage.hpp"
+#include "twrpBlockMap.hpp"
+#include "data.hpp"
+#include "twcommon.h"
+
+using namespace std;
+
+// Size of each of the two copy buffers. Has to be a multiple of the
+// logical block size of the devices for O_DIRECT, 4096 covers all of them.
+#ifndef TW_IMAGE_BUFFER_SIZE
+	#define TW_IMAGE_BUFFER_SIZE 1048576
+#endif
+#define TW_IMAGE_ALIGN 4096
+
+// Android sparse image format, as written by make_ext4fs -s and read by
+// fastboot and simg2img. Only raw, fill and don't care chunks are used.
+#define SPARSE_HEADER_MAGIC 0xed26ff3a
+#define SPARSE_CHUNK_RAW 0xCAC1
+#define SPARSE_CHUNK_FILL 0xCAC2
+#define SPARSE_CHUNK_DONT_CARE 0xCAC3
+#define SPARSE_CHUNK_CRC32 0xCAC4
+
+struct sparse_header {
+	uint32_t magic;
+	uint16_t major_version;
+	uint16_t minor_version;
+	uint16_t file_hdr_sz;
+	uint16_t chunk_hdr_sz;
+	uint32_t blk_sz;
+	uint32_t total_blks;
+	uint32_t total_chunks;
+	uint32_t image_checksum;
+};
+
+struct sparse_chunk {
+	uint16_t chunk_type;
+	uint16_t reserved1;
+	uint32_t chunk_sz;                       // in blocks
+	uint32_t total_sz;                       // in bytes, header included
+};
+
+#ifndef BLKDISCARD
+	#define BLKDISCARD _IO(0x12,119)
+#endif
+#ifndef BLKDISCARDZEROES
+	#define BLKDISCARDZEROES _IO(0x12,124)
+#endif
+
+// Turns O_DIRECT off for fd, returns false if it was not on
+static bool Drop_Direct(int fd) {
+	int flags = fcntl(fd, F_GETFL);
+
+	if (flags < 0 || !(flags & O_DIRECT))
+		return false;
+	return fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0;
+}
+
+// O_DIRECT refuses unaligned lengths (the end of an image) with EINVAL, in
+// which case the rest of the transfer goes through the page cache
+static ssize_t Read_Full(int fd, void* buf, size_t len) {
+	size_t done = 0;
+	ssize_t ret;
+
+	while (done < len) {
+		ret = read(fd, (unsigned char*) buf + done, len - done);
+		if (ret < 0) {
+			if (errno == EINTR || (errno == EINVAL && Drop_Direct(fd)))
+				continue;
+			return -1;
+		}
+		if (ret == 0)
+			break;
+		done += ret;
+	}
+	return done;
+}
+
+// Writes at offset, or at the current position if offset is -1
+static int Write_Full(int fd, const void* buf, size_t len, off64_t offset) {
+	size_t done = 0;
+	ssize_t ret;
+
+	while (done < len) {
+		if (offset < 0)
+			ret = write(fd, (const unsigned char*) buf + done, len - done);
+		else
+			ret = pwrite64(fd, (const unsigned char*) buf + done, len - done, offset + done);
+		if (ret < 0) {
+			if (errno == EINTR || (errno == EINVAL && Drop_Direct(fd)))
+				continue;
+			return -1;
+		}
+		done += ret;
+	}
+	return 0;
+}
+
+// Largest sparse block size that divides the image
+static unsigned Sparse_Block_Size(unsigned long long Size) {
+	unsigned blk;
+
+	for (blk = 4096; blk >= 512; blk /= 2) {
+		if (Size % blk == 0)
+			return blk;
+	}
+	return 0;
+}
+
+// A block is a fill block if every 32 bit word in it is the same, which is
+// the case when the block matches itself shifted by one word
+static bool Is_Fill_Block(const unsigned char* block, unsigned blk, uint32_t* value) {
+	if (memcmp(block, block + 4, blk - 4) != 0)
+		return false;
+	memcpy(value, block, 4);
+	return true;
+}
+
+twrpImage::twrpImage() {
+	buffers[0] = buffers[1] = NULL;
+	buffer_size = TW_IMAGE_BUFFER_SIZE;
+	chunk_header = 0;
+	md5c = NULL;
+	sparse = false;
+	block_map = NULL;
+	progress_start = 0;
+	progress_portion = 0;
+	last_progress = -1;
+	writer_fd = -1;
+	pending = NULL;
+	pending_len = 0;
+	pending_offset = -1;
+	writer_error = 0;
+	writer_stop = false;
+	writer_running = false;
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&cond, NULL);
+}
+
+twrpImage::~twrpImage() {
+	if (writer_running)
+		stopWriter();
+	free(buffers[0]);
+	free(buffers[1]);
+	pthread_mutex_destroy(&lock);
+	pthread_cond_destroy(&cond);
+}
+
+void twrpImage::setProgress(float Start, float Portion) {
+	progress_start = Start;
+	progress_portion = Portion;
+}
+
+void twrpImage::setMD5(struct MD5Context* md5) {
+	md5c = md5;
+}
+
+void twrpImage::setSparse(bool Sparse) {
+	sparse = Sparse;
+}
+
+void twrpImage::setBlockMap(const twrpBlockMap* Map) {
+	block_map = Map;
+	if (Map)
+		sparse = true;
+}
+
+int twrpImage::backup(const string& Device, const string& File, unsigned long long Size) {
+	int in_fd, out_fd, ret;
+
+	in_fd = open(Device.c_str(), O_RDONLY | O_LARGEFILE | O_DIRECT);
+	if (in_fd < 0)
+		in_fd = open(Device.c_str(), O_RDONLY | O_LARGEFILE);
+	if (in_fd < 0) {
+		LOGERR("Unable to open '%s' for reading: %s\n", Device.c_str(), strerror(errno));
+		return -1;
+	}
+	out_fd = open(File.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_LARGEFILE, 0666);
+	if (out_fd < 0) {
+		LOGERR("Unable to open '%s' for writing: %s\n", File.c_str(), strerror(errno));
+		close(in_fd);
+		return -1;
+	}
+	posix_fadvise(in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	if (sparse)
+		ret = copyToSparse(in_fd, out_fd, Size, Device, File);
+	else
+		ret = copy(in_fd, out_fd, Size, Device, File);
+	close(in_fd);
+	if (close(out_fd) != 0 && ret == 0) {
+		LOGERR("Unable to close '%s': %s\n", File.c_str(), strerror(errno));
+		ret = -1;
+	}
+	return ret;
+}
+
+int twrpImage::restore(const string& File, const string& Device) {
+	int out_fd, ret;
+
+	out_fd = open(Device.c_str(), O_WRONLY | O_LARGEFILE | O_DIRECT);
+	if (out_fd < 0)
+		out_fd = open(Device.c_str(), O_WRONLY | O_LARGEFILE);
+	if (out_fd < 0) {
+		LOGERR("Unable to open '%s' for writing: %s\n", Device.c_str(), strerror(errno));
+		return -1;
+	}
+	ret = restoreTo(File, out_fd, false, Device);
+	if (ret == 0 && fsync(out_fd) != 0) {
+		LOGERR("Unable to sync '%s': %s\n", Device.c_str(), strerror(errno));
+		ret = -1;
+	}
+	close(out_fd);
+	return ret;
+}
+
+int twrpImage::expand(const string& File, const string& Out_File) {
+	int out_fd, ret;
+
+	out_fd = open(Out_File.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_LARGEFILE, 0644);
+	if (out_fd < 0) {
+		LOGERR("Unable to open '%s' for writing: %s\n", Out_File.c_str(), strerror(errno));
+		return -1;
+	}
+	ret = restoreTo(File, out_fd, true, Out_File);
+	if (close(out_fd) != 0 && ret == 0) {
+		LOGERR("Unable to close '%s': %s\n", Out_File.c_str(), strerror(errno));
+		ret = -1;
+	}
+	return ret;
+}
+
+int twrpImage::restoreTo(const string& File, int out_fd, bool Out_Is_File, const string& Out_Name) {
+	int in_fd, ret;
+	uint32_t magic = 0;
+	struct stat st;
+
+	in_fd = open(File.c_str(), O_RDONLY | O_LARGEFILE);
+	if (in_fd < 0 || fstat(in_fd, &st) != 0) {
+		LOGERR("Unable to open '%s' for reading: %s\n", File.c_str(), strerror(errno));
+		if (in_fd >= 0)
+			close(in_fd);
+		return -1;
+	}
+	posix_fadvise(in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	if (Read_Full(in_fd, &magic, sizeof(magic)) == sizeof(magic) && magic == SPARSE_HEADER_MAGIC) {
+		lseek64(in_fd, 0, SEEK_SET);
+		ret = copyFromSparse(in_fd, out_fd, Out_Is_File, File, Out_Name);
+	} else {
+		lseek64(in_fd, 0, SEEK_SET);
+		ret = copy(in_fd, out_fd, st.st_size, File, Out_Name);
+	}
+	// The image will not be read again, don't let it push out other data
+	posix_fadvise(in_fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(in_fd);
+	return ret;
+}
+
+bool twrpImage::isSparse(const string& File) {
+	int fd;
+	uint32_t magic = 0;
+
+	fd = open(File.c_str(), O_RDONLY | O_LARGEFILE);
+	if (fd < 0)
+		return false;
+	if (Read_Full(fd, &magic, sizeof(magic)) != sizeof(magic))
+		magic = 0;
+	close(fd);
+	return magic == SPARSE_HEADER_MAGIC;
+}
+
+unsigned long long twrpImage::imageSize(const string& File) {
+	int fd;
+	struct sparse_header header;
+	struct stat st;
+	unsigned long long size = 0;
+
+	fd = open(File.c_str(), O_RDONLY | O_LARGEFILE);
+	if (fd < 0)
+		return 0;
+	if (Read_Full(fd, &header, sizeof(header)) == sizeof(header) && header.magic == SPARSE_HEADER_MAGIC)
+		size = (unsigned long long) header.total_blks * header.blk_sz;
+	else if (fstat(fd, &st) == 0)
+		size = st.st_size;
+	close(fd);
+	return size;
+}
+
+unsigned long long twrpImage::deviceSize(const string& Device) {
+	int fd;
+	off64_t size;
+
+	fd = open(Device.c_str(), O_RDONLY | O_LARGEFILE);
+	if (fd < 0)
+		return 0;
+	size = lseek64(fd, 0, SEEK_END);
+	close(fd);
+	return (size < 0 ? 0 : size);
+}
+
+bool twrpImage::allocBuffers(void) {
+	unsigned i;
+
+	for (i = 0; i < 2; i++) {
+		if (buffers[i] == NULL && posix_memalign((void**) &buffers[i], TW_IMAGE_ALIGN, buffer_size) != 0) {
+			buffers[i] = NULL;
+			LOGERR("Unable to allocate %lu byte image buffer\n", (unsigned long) buffer_size);
+			return false;
+		}
+	}
+	return true;
+}
+
+int twrpImage::copy(int in_fd, int out_fd, unsigned long long Size, const string& In_Name, const string& Out_Name) {
+	unsigned long long done = 0;
+	unsigned cur = 0;
+	ssize_t len;
+	size_t want;
+	int ret = 0;
+
+	if (!allocBuffers() || !startWriter(out_fd))
+		return -1;
+
+	last_progress = -1;
+	reportProgress(0, Size);
+	while (done < Size) {
+		want = buffer_size;
+		if (Size - done < want)
+			want = (size_t) (Size - done);
+		len = Read_Full(in_fd, buffers[cur], want);
+		if (len < 0) {
+			LOGERR("Unable to read '%s': %s\n", In_Name.c_str(), strerror(errno));
+			ret = -1;
+			break;
+		}
+		if (len == 0) {
+			LOGINFO("'%s' ended after %llu of %llu bytes\n", In_Name.c_str(), done, Size);
+			break;
+		}
+		if (queueWrite(buffers[cur], len) != 0)
+			break;
+		cur ^= 1;
+		done += len;
+		reportProgress(done, Size);
+	}
+
+	if (stopWriter() != 0) {
+		LOGERR("Unable to write '%s': %s\n", Out_Name.c_str(), strerror(writer_error));
+		ret = -1;
+	}
+	return ret;
+}
+
+int twrpImage::copyToSparse(int in_fd, int out_fd, unsigned long long Size, const string& In_Name, const string& Out_Name) {
+	struct sparse_header header;
+	const twrpBlockMap* map = block_map;
+	unsigned long long done = 0, fill_blocks = 0, block, run;
+	unsigned blk, total_blks = 0, total_chunks = 0, cur = 0, off, raw_start;
+	int last_queued = -1, ret = 0;
+	uint32_t value = 0, fill_value = 0;
+	ssize_t len, read_len;
+	size_t want;
+
+	if (map && (Size % map->blockSize() || buffer_size % map->blockSize())) {
+		LOGINFO("'%s' does not end on a file system block, copying all of it\n", In_Name.c_str());
+		map = NULL;
+	}
+	blk = (map ? map->blockSize() : Sparse_Block_Size(Size));
+	if (blk == 0 || Size / blk > 0xFFFFFFFFULL) {
+		LOGINFO("'%s' can't be stored as a sparse image, copying it as is\n", In_Name.c_str());
+		return copy(in_fd, out_fd, Size, In_Name, Out_Name);
+	}
+	if (!allocBuffers())
+		return -1;
+
+	// The header is written again with the chunk count once it is known
+	memset(&header, 0, sizeof(header));
+	header.magic = SPARSE_HEADER_MAGIC;
+	header.major_version = 1;
+	header.file_hdr_sz = sizeof(struct sparse_header);
+	header.chunk_hdr_sz = sizeof(struct sparse_chunk);
+	header.blk_sz = blk;
+	if (Write_Full(out_fd, &header, sizeof(header), -1) != 0) {
+		LOGERR("Unable to write '%s': %s\n", Out_Name.c_str(), strerror(errno));
+		return -1;
+	}
+	if (!startWriter(out_fd))
+		return -1;
+
+	last_progress = -1;
+	reportProgress(0, Size);
+	while (done < Size && ret == 0) {
+		want = buffer_size;
+		if (Size - done < want)
+			want = (size_t) (Size - done);
+		if (map) {
+			// Runs of unused blocks are seeked over, reads stop before the next one
+			block = done / blk;
+			run = 0;
+			if (!map->isUsed(block)) {
+				while (done + run * blk < Size && !map->isUsed(block + run))
+					run++;
+				if (fill_blocks) {
+					if (queueChunk(SPARSE_CHUNK_FILL, fill_blocks, sizeof(uint32_t), fill_value) != 0)
+						ret = -1;
+					total_chunks++;
+					fill_blocks = 0;
+				}
+				if (queueChunk(SPARSE_CHUNK_DONT_CARE, run, 0, 0) != 0)
+					ret = -1;
+				total_chunks++;
+				total_blks += run;
+				done += run * blk;
+				if (done < Size && lseek64(in_fd, done, SEEK_SET) < 0) {
+					LOGERR("Unable to seek in '%s': %s\n", In_Name.c_str(), strerror(errno));
+					ret = -1;
+				}
+				reportProgress(done, Size);
+				continue;
+			}
+			while (run < want / blk && map->isUsed(block + run))
+				run++;
+			want = run * blk;
+		}
+		// Fill runs can leave the other buffer's last raw run still being written
+		if (last_queued == (int) cur && waitWriter() != 0)
+			break;
+		read_len = Read_Full(in_fd, buffers[cur], want);
+		if (read_len < 0) {
+			LOGERR("Unable to read '%s': %s\n", In_Name.c_str(), strerror(errno));
+			ret = -1;
+			break;
+		}
+		if (read_len == 0) {
+			LOGINFO("'%s' ended after %llu of %llu bytes\n", In_Name.c_str(), done, Size);
+			break;
+		}
+		len = read_len;
+		if (len % blk) {
+			memset(buffers[cur] + len, 0, blk - len % blk);
+			len += blk - len % blk;
+		}
+
+		// Raw runs end with the buffer, fill runs carry on into the next one
+		raw_start = len;
+		for (off = 0; off <= (unsigned) len && ret == 0; off += blk) {
+			bool fill = (off < (unsigned) len && Is_Fill_Block(buffers[cur] + off, blk, &value));
+
+			if (raw_start < off && (fill || off == (unsigned) len)) {
+				if (queueChunk(SPARSE_CHUNK_RAW, (off - raw_start) / blk, off - raw_start, 0) != 0 ||
+					queueWrite(buffers[cur] + raw_start, off - raw_start) != 0)
+					ret = -1;
+				last_queued = cur;
+				total_chunks++;
+				raw_start = len;
+			}
+			if (off == (unsigned) len)
+				break;
+			if (fill_blocks && (!fill || value != fill_value)) {
+				if (queueChunk(SPARSE_CHUNK_FILL, fill_blocks, sizeof(uint32_t), fill_value) != 0)
+					ret = -1;
+				total_chunks++;
+				fill_blocks = 0;
+			}
+			if (fill) {
+				fill_value = value;
+				fill_blocks++;
+			} else if (raw_start == (unsigned) len) {
+				raw_start = off;
+			}
+		}
+		total_blks += len / blk;
+		done += read_len;
+		cur ^= 1;
+		reportProgress(done, Size);
+	}
+	if (fill_blocks && ret == 0) {
+		queueChunk(SPARSE_CHUNK_FILL, fill_blocks, sizeof(uint32_t), fill_value);
+		total_chunks++;
+	}
+
+	if (stopWriter() != 0) {
+		LOGERR("Unable to write '%s': %s\n", Out_Name.c_str(), strerror(writer_error));
+		return -1;
+	}
+	if (ret != 0)
+		return ret;
+	header.total_blks = total_blks;
+	header.total_chunks = total_chunks;
+	if (Write_Full(out_fd, &header, sizeof(header), 0) != 0) {
+		LOGERR("Unable to write '%s': %s\n", Out_Name.c_str(), strerror(errno));
+		return -1;
+	}
+	LOGINFO("Sparse image '%s': %u blocks of %u bytes in %u chunks\n", Out_Name.c_str(), total_blks, blk, total_chunks);
+	return 0;
+}
+
+// Queues the header of a chunk, along with the value of a fill chunk. The
+// two header slots are used in turn, once queueWrite() returns only the
+// last one queued can still be in use by the writer.
+int twrpImage::queueChunk(unsigned type, unsigned blocks, unsigned data_size, uint32_t fill_value) {
+	struct sparse_chunk* chunk = (struct sparse_chunk*) chunk_headers[chunk_header];
+
+	chunk_header ^= 1;
+	chunk->chunk_type = type;
+	chunk->reserved1 = 0;
+	chunk->chunk_sz = blocks;
+	chunk->total_sz = sizeof(struct sparse_chunk) + data_size;
+	if (type == SPARSE_CHUNK_FILL) {
+		memcpy(chunk + 1, &fill_value, sizeof(fill_value));
+		return queueWrite((unsigned char*) chunk, sizeof(struct sparse_chunk) + sizeof(fill_value));
+	}
+	return queueWrite((unsigned char*) chunk, sizeof(struct sparse_chunk));
+}
+
+// Zeroed runs are discarded when the device reads discarded blocks back as
+// zeroes, left as holes when writing to a new file and written otherwise
+int twrpImage::copyFromSparse(int in_fd, int out_fd, bool Out_Is_File, const string& In_Name, const string& Out_Name) {
+	struct sparse_header header;
+	struct sparse_chunk chunk;
+	unsigned long long total, bytes;
+	unsigned int discard_zeroes = 0;
+	unsigned i, cur = 0;
+	int last_queued = -1, ret = 0;
+	uint32_t value;
+	off64_t offset = 0;
+	size_t len;
+
+	if (Read_Full(in_fd, &header, sizeof(header)) != sizeof(header) || header.magic != SPARSE_HEADER_MAGIC ||
+		header.major_version != 1 || header.file_hdr_sz < sizeof(header) ||
+		header.chunk_hdr_sz < sizeof(chunk) || header.blk_sz == 0 || header.blk_sz % 4) {
+		LOGERR("'%s' is not a valid sparse image\n", In_Name.c_str());
+		return -1;
+	}
+	lseek64(in_fd, header.file_hdr_sz, SEEK_SET);
+	total = (unsigned long long) header.total_blks * header.blk_sz;
+	if (!Out_Is_File && ioctl(out_fd, BLKDISCARDZEROES, &discard_zeroes) != 0)
+		discard_zeroes = 0;
+
+	if (!allocBuffers() || !startWriter(out_fd))
+		return -1;
+
+	last_progress = -1;
+	reportProgress(0, total);
+	for (i = 0; i < header.total_chunks && ret == 0; i++) {
+		if (Read_Full(in_fd, &chunk, sizeof(chunk)) != sizeof(chunk)) {
+			LOGERR("'%s' ended in the middle of chunk %u\n", In_Name.c_str(), i);
+			ret = -1;
+			break;
+		}
+		if (header.chunk_hdr_sz > sizeof(chunk))
+			lseek64(in_fd, header.chunk_hdr_sz - sizeof(chunk), SEEK_CUR);
+		bytes = (unsigned long long) chunk.chunk_sz * header.blk_sz;
+		if ((unsigned long long) offset + bytes > total) {
+			LOGERR("Chunk %u of '%s' goes past the end of the image\n", i, In_Name.c_str());
+			ret = -1;
+			break;
+		}
+
+		switch (chunk.chunk_type) {
+			case SPARSE_CHUNK_RAW:
+				if (chunk.total_sz != header.chunk_hdr_sz + bytes) {
+					LOGERR("Chunk %u of '%s' has a bad size\n", i, In_Name.c_str());
+					ret = -1;
+					break;
+				}
+				while (bytes > 0) {
+					len = buffer_size;
+					if (bytes < len)
+						len = (size_t) bytes;
+					if (last_queued == (int) cur && waitWriter() != 0) {
+						ret = -1;
+						break;
+					}
+					if (Read_Full(in_fd, buffers[cur], len) != (ssize_t) len) {
+						LOGERR("'%s' ended in the middle of chunk %u\n", In_Name.c_str(), i);
+						ret = -1;
+						break;
+					}
+					if (queueWrite(buffers[cur], len, offset) != 0) {
+						ret = -1;
+						break;
+					}
+					last_queued = cur;
+					cur ^= 1;
+					offset += len;
+					bytes -= len;
+					reportProgress(offset, total);
+				}
+				break;
+			case SPARSE_CHUNK_FILL:
+				if (Read_Full(in_fd, &value, sizeof(value)) != sizeof(value)) {
+					LOGERR("'%s' ended in the middle of chunk %u\n", In_Name.c_str(), i);
+					ret = -1;
+					break;
+				}
+				if (value == 0 && Out_Is_File) {
+					offset += bytes;
+					break;
+				}
+				if (value == 0 && discard_zeroes && offset % 512 == 0 && bytes % 512 == 0) {
+					uint64_t range[2] = { (uint64_t) offset, bytes };
+					if (ioctl(out_fd, BLKDISCARD, &range) == 0) {
+						offset += bytes;
+						break;
+					}
+				}
+				// The writer only reads the pattern, so one buffer can be queued over and over
+				if (waitWriter() != 0) {
+					ret = -1;
+					break;
+				}
+				len = buffer_size;
+				if (bytes < len)
+					len = (size_t) bytes;
+				for (size_t pos = 0; pos < len; pos += sizeof(value))
+					memcpy(buffers[0] + pos, &value, sizeof(value));
+				while (bytes > 0) {
+					if (bytes < len)
+						len = (size_t) bytes;
+					if (queueWrite(buffers[0], len, offset) != 0) {
+						ret = -1;
+						break;
+					}
+					offset += len;
+					bytes -= len;
+					reportProgress(offset, total);
+				}
+				last_queued = 0;
+				break;
+			case SPARSE_CHUNK_DONT_CARE:
+				offset += bytes;
+				break;
+			case SPARSE_CHUNK_CRC32:
+				lseek64(in_fd, sizeof(uint32_t), SEEK_CUR);
+				break;
+			default:
+				LOGERR("Chunk %u of '%s' has unknown type 0x%x\n", i, In_Name.c_str(), chunk.chunk_type);
+				ret = -1;
+				break;
+		}
+	}
+
+	if (stopWriter() != 0) {
+		LOGERR("Unable to write '%s': %s\n", Out_Name.c_str(), strerror(writer_error));
+		ret = -1;
+	}
+	// Zeroed runs at the end of a new file still have to count towards its size
+	if (ret == 0 && Out_Is_File && ftruncate64(out_fd, total) != 0) {
+		LOGERR("Unable to set the size of '%s': %s\n", Out_Name.c_str(), strerror(errno));
+		ret = -1;
+	}
+	return ret;
+}
+
+bool twrpImage::startWriter(int out_fd) {
+	writer_fd = out_fd;
+	pending = NULL;
+	pending_len = 0;
+	pending_offset = -1;
+	writer_error = 0;
+	writer_stop = false;
+	if (pthread_create(&writer, NULL, writerThread, this) != 0) {
+		LOGERR("Unable to start image writer thread\n");
+		return false;
+	}
+	writer_running = true;
+	return true;
+}
+
+// Hands data to the writer thread once it is done with the previous buffer
+int twrpImage::queueWrite(unsigned char* data, size_t len, off64_t offset) {
+	int error;
+
+	pthread_mutex_lock(&lock);
+	while (pending != NULL && writer_error == 0)
+		pthread_cond_wait(&cond, &lock);
+	error = writer_error;
+	if (error == 0) {
+		pending = data;
+		pending_len = len;
+		pending_offset = offset;
+		pthread_cond_broadcast(&cond);
+	}
+	pthread_mutex_unlock(&lock);
+	return error;
+}
+
+// Waits until nothing is being written, returns the writer's errno
+int twrpImage::waitWriter(void) {
+	int error;
+
+	pthread_mutex_lock(&lock);
+	while (pending != NULL && writer_error == 0)
+		pthread_cond_wait(&cond, &lock);
+	error = writer_error;
+	pthread_mutex_unlock(&lock);
+	return error;
+}
+
+// Waits for the last buffer to be written, returns the writer's errno
+int twrpImage::stopWriter(void) {
+	if (!writer_running)
+		return 0;
+	pthread_mutex_lock(&lock);
+	writer_stop = true;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&lock);
+	pthread_join(writer, NULL);
+	writer_running = false;
+	return writer_error;
+}
+
+void* twrpImage::writerThread(void* cookie) {
+	twrpImage* image = (twrpImage*) cookie;
+	unsigned char* data;
+	size_t len;
+	off64_t offset;
+
+	pthread_mutex_lock(&image->lock);
+	for (;;) {
+		while (image->pending == NULL && !image->writer_stop)
+			pthread_cond_wait(&image->cond, &image->lock);
+		if (image->pending == NULL)
+			break;
+		data = image->pending;
+		len = image->pending_len;
+		offset = image->pending_offset;
+		pthread_mutex_unlock(&image->lock);
+
+		int error = 0;
+		if (Write_Full(image->writer_fd, data, len, offset) != 0)
+			error = errno;
+		else if (image->md5c && !image->sparse)
+			MD5Update(image->md5c, data, len);
+
+		pthread_mutex_lock(&image->lock);
+		image->pending = NULL;
+		image->writer_error = error;
+		pthread_cond_broadcast(&image->cond);
+		if (error)
+			break;
+	}
+	pthread_mutex_unlock(&image->lock);
+	return NULL;
+}
+
+// The progress bar only moves in whole percent, skip updates that would not move it
+void twrpImage::reportProgress(unsigned long long done, unsigned long long total) {
+	float pos;
+	int percent;
+
+	if (progress_portion <= 0 || total == 0)
+		return;
+	pos = progress_start + progress_portion * ((float) done / (float) total);
+	percent = (int) (pos * 100);
+	if (percent == last_progress)
+		return;
+	last_progress = percent;
+	DataManager::SetProgress(pos);
+}
@@ -0,0 +1,104 @@
+/*
+	Copyright 2013 bigbiff/Dees_Troy TeamWin
+	This file is part of TWRP/TeamWin Recovery Project.
+
+	TWRP is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	TWRP is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with TWRP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TWRPIMAGE_HPP
+#define _TWRPIMAGE_HPP
+
+#include <sys/types.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string>
+
+using namespace std;
+
+struct MD5Context;
+class twrpBlockMap;
+
+// Copies raw partition images between a block device and a backup file
+// through two fixed size buffers. The calling thread fills one buffer while
+// a writer thread writes out (and hashes) the other, so memory use does not
+// depend on the size of the partition.
+class twrpImage {
+	public:
+		twrpImage();
+		~twrpImage();
+		// Progress bar fraction the copy starts at and the part of the bar
+		// it fills, a Portion of 0 leaves the progress bar alone
+		void setProgress(float Start, float Portion);
+		// Data written by the copy is added to md5, NULL to not hash. Not
+		// used for sparse backups, their header is only known at the end.
+		void setMD5(struct MD5Context* md5);
+		// Stores runs of blocks filled with one 32 bit value (zeroed or
+		// erased flash) as fill chunks of an Android sparse image
+		void setSparse(bool Sparse);
+		// Only reads the blocks Map marks as used and stores the others as
+		// don't care chunks, which makes the backup sparse. Map has to stay
+		// around until the backup is done.
+		void setBlockMap(const twrpBlockMap* Map);
+		// Copies the first Size bytes of Device into File
+		int backup(const string& Device, const string& File, unsigned long long Size);
+		// Writes all of File, raw or sparse, to the start of Device
+		int restore(const string& File, const string& Device);
+		// Writes the raw contents of a raw or sparse File to a new Out_File
+		int expand(const string& File, const string& Out_File);
+		// True if File is a sparse image
+		static bool isSparse(const string& File);
+		// Size of the partition contents stored in File, 0 on error
+		static unsigned long long imageSize(const string& File);
+		// Size of a block device or file, 0 on error
+		static unsigned long long deviceSize(const string& Device);
+
+	private:
+		int copy(int in_fd, int out_fd, unsigned long long Size, const string& In_Name, const string& Out_Name);
+		int copyToSparse(int in_fd, int out_fd, unsigned long long Size, const string& In_Name, const string& Out_Name);
+		int queueChunk(unsigned type, unsigned blocks, unsigned data_size, uint32_t fill_value);
+		int copyFromSparse(int in_fd, int out_fd, bool Out_Is_File, const string& In_Name, const string& Out_Name);
+		int restoreTo(const string& File, int out_fd, bool Out_Is_File, const string& Out_Name);
+		bool allocBuffers(void);
+		bool startWriter(int out_fd);
+		int queueWrite(unsigned char* data, size_t len, off64_t offset = -1);
+		int waitWriter(void);
+		int stopWriter(void);
+		static void* writerThread(void* cookie);
+		void reportProgress(unsigned long long done, unsigned long long total);
+
+		unsigned char* buffers[2];
+		size_t buffer_size;
+		unsigned char chunk_headers[2][16];      // sparse chunk headers, used in turn so one can be in flight
+		unsigned chunk_header;
+		struct MD5Context* md5c;
+		bool sparse;
+		const twrpBlockMap* block_map;
+		float progress_start;
+		float progress_portion;
+		int last_progress;
+
+		// Shared with the writer thread
+		pthread_t writer;
+		pthread_mutex_t lock;
+		pthread_cond_t cond;
+		int writer_fd;
+		unsigned char* pending;                  // buffer handed to the writer, NULL when idle
+		size_t pending_len;
+		off64_t pending_offset;                  // -1 to write after the previous buffer
+		int writer_error;
+		bool writer_stop;
+		bool writer_running;
+};
+
+#endif // _TWRPIMAGE_HPP
@@ -20,6 +20,10 @@ extern "C" {
 	#include "libtar/libtar.h"
 	#include "twrpTar.h"
 	#include "tarWrite.h"
+	#include "tarCompress.h"
+#ifndef TW_EXCLUDE_ENCRYPTED_BACKUPS
+	#include "tarEncrypt.h"
+#endif
 	#include "libcrecovery/common.h"
 }
 #include <sys/types.h>
@@ -33,8 +37,10 @@ extern "C" {
 #include <string>
 #include <sstream>
 #include <vector>
+#include <algorithm>
 #include <dirent.h>
 #include <sys/mman.h>
+#include <zlib.h>
 #include "twrpTar.hpp"
 #include "twcommon.h"
 #include "data.hpp"
@@ -51,6 +57,10 @@ twrpTar::twrpTar(void) {
 	has_data_media = 0;
 	pigz_pid = 0;
 	oaes_pid = 0;
+	inline_md5 = 0;
+	stream_threads = 0;
+	ItemQueue = NULL;
+	Index = NULL;
 }
 
 twrpTar::~twrpTar(void) {
@@ -69,6 +79,83 @@ void twrpTar::setexcl(string exclude) {
 	tarexclude = exclude;
 }
 
+#ifndef TW_EXCLUDE_ENCRYPTED_BACKUPS
+twrpTarQueue::twrpTarQueue(std::vector<std::vector<TarListStruct> > *TarLists, unsigned first_thread_id) {
+	unsigned i;
+	std::vector<TarListStruct> *list;
+
+	first_id = first_thread_id;
+	count = TarLists->size() - first_id;
+	shares = new TarShare[count];
+	for (i = 0; i < count; i++) {
+		list = &TarLists->at(first_id + i);
+		shares[i].items = (list->empty() ? NULL : &list->at(0));
+		shares[i].begin = 0;
+		shares[i].end = list->size();
+		pthread_mutex_init(&shares[i].lock, NULL);
+	}
+}
+
+twrpTarQueue::~twrpTarQueue() {
+	unsigned i;
+
+	for (i = 0; i < count; i++)
+		pthread_mutex_destroy(&shares[i].lock);
+	delete [] shares;
+}
+
+TarListStruct* twrpTarQueue::next(unsigned thread_id) {
+	TarShare *own = &shares[thread_id - first_id], *victim;
+	TarListStruct *items;
+	unsigned i, left, most, take, begin;
+
+	pthread_mutex_lock(&own->lock);
+	if (own->begin < own->end) {
+		items = own->items + own->begin++;
+		pthread_mutex_unlock(&own->lock);
+		return items;
+	}
+	pthread_mutex_unlock(&own->lock);
+
+	for (;;) {
+		victim = NULL;
+		most = 0;
+		for (i = 0; i < count; i++) {
+			pthread_mutex_lock(&shares[i].lock);
+			left = shares[i].end - shares[i].begin;
+			pthread_mutex_unlock(&shares[i].lock);
+			if (left > most) {
+				most = left;
+				victim = &shares[i];
+			}
+		}
+		if (victim == NULL)
+			return NULL;
+
+		pthread_mutex_lock(&victim->lock);
+		left = victim->end - victim->begin;
+		if (left == 0) {
+			// Someone else got there first, look again
+			pthread_mutex_unlock(&victim->lock);
+			continue;
+		}
+		take = (left + 1) / 2;
+		victim->end -= take;
+		begin = victim->end;
+		items = victim->items;
+		pthread_mutex_unlock(&victim->lock);
+
+		// The stolen entries stay where they are, the share just points at them
+		pthread_mutex_lock(&own->lock);
+		own->items = items;
+		own->begin = begin + 1;
+		own->end = begin + take;
+		pthread_mutex_unlock(&own->lock);
+		return items + begin;
+	}
+}
+#endif
+
 int twrpTar::createTarFork() {
 	int status = 0;
 	pid_t pid, rc_pid;
@@ -81,131 +168,131 @@ int twrpTar::createTarFork() {
 	if (pid == 0) {
 		// Child process
 #ifndef TW_EXCLUDE_ENCRYPTED_BACKUPS
-		if (use_encryption || userdata_encryption) {
+		if (use_encryption || userdata_encryption || split_archives) {
 	#ifdef TAR_DEBUG_VERBOSE
-			LOGINFO("Using encryption\n");
+			if (use_encryption || userdata_encryption)
+				LOGINFO("Using encryption\n");
 	#endif
-			DIR* d;
-			struct dirent* de;
-			unsigned long long regular_size = 0, encrypt_size = 0, target_size = 0, core_count = 1;
-			unsigned enc_thread_id = 1, regular_thread_id = 0, i, start_thread_id = 1;
+			unsigned long long regular_size = 0, archive_size = 0, target_size = 0;
+			unsigned thread_count = 1, stream_share, start_thread_id = 0, archive_thread_id, regular_thread_id = 0, i, last;
 			int item_len, ret, thread_error = 0;
-			std::vector<TarListStruct> RegularList;
-			std::vector<TarListStruct> EncryptList;
+			long core_count;
+			std::vector<std::vector<TarListStruct> > RegularLists(1);
+			std::vector<std::vector<TarListStruct> > ArchiveLists;
 			string FileName;
 			struct TarListStruct TarItem;
-			twrpTar reg, enc[9];
-			struct stat st;
-			pthread_t enc_thread[9];
+			twrpTar reg, workers[9];
+			twrpDirIndex Local_Index;
+			vector<string> Media;
+			pthread_t worker_thread[9];
 			pthread_attr_t tattr;
 			void *thread_return;
 
 			core_count = sysconf(_SC_NPROCESSORS_CONF);
-			if (core_count > 8)
-				core_count = 8;
+			if (core_count > 1)
+				thread_count = (core_count > 8 ? 8 : (unsigned)core_count);
+			// The archives are written at the same time, so each one only
+			// compresses and encrypts with its share of the cores
+			stream_share = (core_count > (long)thread_count ? (unsigned)(core_count / thread_count) : 1);
 	#ifdef TAR_DEBUG_VERBOSE
-			LOGINFO("   Core Count      : %llu\n", core_count);
+			LOGINFO("   Thread Count    : %u\n", thread_count);
+			LOGINFO("   Stream Threads  : %u\n", stream_share);
 	#endif
+			if (!tarexclude.empty())
+				Excluded = TWFunc::split_string(tarexclude, ' ', true);
+			// Thread 0 holds the unencrypted app and dalvik archives when only part of data is encrypted
+			if (userdata_encryption)
+				start_thread_id = 1;
+			archive_thread_id = start_thread_id;
+			ArchiveLists.resize(start_thread_id + thread_count);
 			Archive_Current_Size = 0;
 
-			d = opendir(tardir.c_str());
-			if (d == NULL) {
+			// Everything below comes from one walk of tardir, made here so the
+			// index only lives as long as this backup
+			if (has_data_media == 1)
+				Media.push_back("/data/media");
+			if (!Local_Index.Build(tardir, false, &Media)) {
 	#ifdef TAR_DEBUG_VERBOSE
 				LOGERR("error opening '%s'\n", tardir.c_str());
 	#endif
 				_exit(-1);
 			}
-			// Figure out the size of all data to be encrypted and create a list of unencrypted files
-			while ((de = readdir(d)) != NULL) {
-				FileName = tardir + "/";
-				FileName += de->d_name;
+			Index = &Local_Index;
+			last = Index->entries[0].first_child + Index->entries[0].child_count;
+
+			// Figure out the size of all data to be archived by the threads and create a list of unencrypted files
+			for (i = Index->entries[0].first_child; i < last; i++) {
+				const twrpDirIndex::Entry& Item = Index->entries[i];
+				FileName = tardir + "/" + Item.name;
 				if (has_data_media == 1 && FileName.size() >= 11 && strncmp(FileName.c_str(), "/data/media", 11) == 0)
 					continue; // Skip /data/media
-				if (de->d_type == DT_BLK || de->d_type == DT_CHR)
+				if (skip((char*)Item.name.c_str(), NULL))
 					continue;
-				if (de->d_type == DT_DIR && strcmp(de->d_name, ".") != 0 && strcmp(de->d_name, "..") != 0 && strcmp(de->d_name, "lost+found") != 0) {
-					item_len = strlen(de->d_name);
-					if (userdata_encryption && ((item_len >= 3 && strncmp(de->d_name, "app", 3) == 0) || (item_len >= 6 && strncmp(de->d_name, "dalvik", 6) == 0))) {
-						if (Generate_TarList(FileName, &RegularList, &target_size, &regular_thread_id) < 0) {
+				if (S_ISDIR(Item.st.st_mode) && Item.name != "lost+found") {
+					item_len = Item.name.size();
+					if (userdata_encryption && ((item_len >= 3 && strncmp(Item.name.c_str(), "app", 3) == 0) || (item_len >= 6 && strncmp(Item.name.c_str(), "dalvik", 6) == 0))) {
+						TarItem.fn = FileName;
+						TarItem.st = Item.st;
+						RegularLists[0].push_back(TarItem);
+						if (Generate_TarList(i, FileName, &RegularLists, &target_size, &regular_thread_id) < 0) {
 							LOGERR("Error in Generate_TarList with regular list!\n");
-							closedir(d);
 							_exit(-1);
 						}
-						regular_size += TWFunc::Get_Folder_Size(FileName, false);
+						regular_size += Item.size;
 					} else {
-						encrypt_size += TWFunc::Get_Folder_Size(FileName, false);
+						archive_size += Item.size;
 					}
-				} else if (de->d_type == DT_REG) {
-					stat(FileName.c_str(), &st);
-					encrypt_size += (unsigned long long)(st.st_size);
+				} else if (S_ISREG(Item.st.st_mode)) {
+					archive_size += Item.size;
 				}
 			}
-			closedir(d);
 
-			target_size = encrypt_size / core_count;
+			target_size = archive_size / thread_count;
 			target_size++;
 	#ifdef TAR_DEBUG_VERBOSE
 			LOGINFO("   Unencrypted size: %llu\n", regular_size);
-			LOGINFO("   Encrypted size  : %llu\n", encrypt_size);
+			LOGINFO("   Archive size    : %llu\n", archive_size);
 			LOGINFO("   Target size     : %llu\n", target_size);
 	#endif
-			if (!userdata_encryption) {
-				enc_thread_id = 0;
-				start_thread_id = 0;
-				core_count--;
-			}
 			Archive_Current_Size = 0;
 
-			d = opendir(tardir.c_str());
-			if (d == NULL) {
-	#ifdef TAR_DEBUG_VERBOSE
-				LOGERR("error opening '%s'\n", tardir.c_str());
-	#endif
-				_exit(-1);
-			}
-			// Divide up the encrypted file list for threading
-			while ((de = readdir(d)) != NULL) {
-				FileName = tardir + "/";
-				FileName += de->d_name;
+			// The root folder goes first so its permissions are restored like with a single archive
+			TarItem.fn = tardir + "/";
+			TarItem.st = Index->entries[0].st;
+			ArchiveLists[archive_thread_id].push_back(TarItem);
+			// Give every thread a starting share of roughly the same number of bytes
+			for (i = Index->entries[0].first_child; i < last; i++) {
+				const twrpDirIndex::Entry& Item = Index->entries[i];
+				FileName = tardir + "/" + Item.name;
 				if (has_data_media == 1 && FileName.size() >= 11 && strncmp(FileName.c_str(), "/data/media", 11) == 0)
 					continue; // Skip /data/media
-				if (de->d_type == DT_BLK || de->d_type == DT_CHR)
+				if (skip((char*)Item.name.c_str(), NULL))
 					continue;
-				if (de->d_type == DT_DIR && strcmp(de->d_name, ".") != 0 && strcmp(de->d_name, "..") != 0 && strcmp(de->d_name, "lost+found") != 0) {
-					item_len = strlen(de->d_name);
-					if (userdata_encryption && ((item_len >= 3 && strncmp(de->d_name, "app", 3) == 0) || (item_len >= 6 && strncmp(de->d_name, "dalvik", 6) == 0))) {
-						// Do nothing, we added these to RegularList earlier
+				TarItem.fn = FileName;
+				TarItem.st = Item.st;
+				if (S_ISDIR(TarItem.st.st_mode) && Item.name != "lost+found") {
+					item_len = Item.name.size();
+					if (userdata_encryption && ((item_len >= 3 && strncmp(Item.name.c_str(), "app", 3) == 0) || (item_len >= 6 && strncmp(Item.name.c_str(), "dalvik", 6) == 0))) {
+						// Do nothing, we added these to RegularLists earlier
 					} else {
-						FileName = tardir + "/";
-						FileName += de->d_name;
-						if (Generate_TarList(FileName, &EncryptList, &target_size, &enc_thread_id) < 0) {
-							LOGERR("Error in Generate_TarList with encrypted list!\n");
-							closedir(d);
+						ArchiveLists[archive_thread_id].push_back(TarItem);
+						if (Generate_TarList(i, FileName, &ArchiveLists, &target_size, &archive_thread_id) < 0) {
+							LOGERR("Error in Generate_TarList with archive list!\n");
 							_exit(-1);
 						}
 					}
-				} else if (de->d_type == DT_REG || de->d_type == DT_LNK) {
-					stat(FileName.c_str(), &st);
-					if (de->d_type == DT_REG)
-						Archive_Current_Size += (unsigned long long)(st.st_size);
-					TarItem.fn = FileName;
-					TarItem.thread_id = enc_thread_id;
-					EncryptList.push_back(TarItem);
+				} else if (S_ISREG(TarItem.st.st_mode) || S_ISLNK(TarItem.st.st_mode)) {
+					if (S_ISREG(TarItem.st.st_mode))
+						Archive_Current_Size += (unsigned long long)(TarItem.st.st_size);
+					ArchiveLists[archive_thread_id].push_back(TarItem);
 				}
 			}
-			closedir(d);
-			if (enc_thread_id != core_count) {
-				LOGERR("Error dividing up threads for encryption, %i threads for %i cores!\n", enc_thread_id, core_count);
-				if (enc_thread_id > core_count)
-					_exit(-1);
-				else
-					LOGERR("Continuining anyway.");
-			}
 
 			if (userdata_encryption) {
 				// Create a backup of unencrypted data
+				twrpTarQueue RegularQueue(&RegularLists, 0);
 				reg.setfn(tarfn);
-				reg.ItemList = &RegularList;
+				reg.ItemQueue = &RegularQueue;
 				reg.thread_id = 0;
 				reg.use_encryption = 0;
 				reg.use_compression = use_compression;
@@ -216,6 +303,9 @@ int twrpTar::createTarFork() {
 				}
 			}
 
+			// Threads that run out of work steal from the others, so an uneven split only costs a little locking
+			twrpTarQueue ArchiveQueue(&ArchiveLists, start_thread_id);
+
 			if (pthread_attr_init(&tattr)) {
 				LOGERR("Unable to pthread_attr_init\n");
 				_exit(-1);
@@ -233,40 +323,40 @@ int twrpTar::createTarFork() {
 				_exit(-1);
 			}*/
 
-			// Create threads for the divided up encryption lists
-			for (i = start_thread_id; i <= core_count; i++) {
-				enc[i].setdir(tardir);
-				enc[i].setfn(tarfn);
-				enc[i].ItemList = &EncryptList;
-				enc[i].thread_id = i;
-				enc[i].use_encryption = use_encryption;
-				enc[i].use_compression = use_compression;
+			// Create the archive threads
+			for (i = start_thread_id; i < start_thread_id + thread_count; i++) {
+				workers[i].setdir(tardir);
+				workers[i].setfn(tarfn);
+				workers[i].ItemQueue = &ArchiveQueue;
+				workers[i].thread_id = i;
+				workers[i].use_encryption = use_encryption;
+				workers[i].use_compression = use_compression;
+				workers[i].stream_threads = stream_share;
 	#ifdef TAR_DEBUG_VERBOSE
-				LOGINFO("Start encryption thread %i\n", i);
+				LOGINFO("Start archive thread %i\n", i);
 	#endif
-				ret = pthread_create(&enc_thread[i], &tattr, createList, (void*)&enc[i]);
+				ret = pthread_create(&worker_thread[i], &tattr, createList, (void*)&workers[i]);
 				if (ret) {
-					LOGINFO("Unable to create %i thread for encryption! %i\nContinuing in same thread (backup will be slower).", i, ret);
-					if (createList((void*)&enc[i]) != 0) {
-						LOGERR("Error creating encrypted backup %i.\n", i);
+					LOGINFO("Unable to create %i thread for archiving! %i\nContinuing in same thread (backup will be slower).", i, ret);
+					if (createList((void*)&workers[i]) != 0) {
+						LOGERR("Error creating backup %i.\n", i);
 						_exit(-1);
 					} else {
-						enc[i].thread_id = i + 1;
+						workers[i].thread_id = i + 1;
 					}
 				}
-				usleep(100000); // Need a short delay before starting the next thread or the threads will never finish for some reason.
 			}
 			if (pthread_attr_destroy(&tattr)) {
 				LOGERR("Failed to pthread_attr_destroy\n");
 			}
-			for (i = start_thread_id; i <= core_count; i++) {
-				if (enc[i].thread_id == i) {
-					if (pthread_join(enc_thread[i], &thread_return)) {
+			for (i = start_thread_id; i < start_thread_id + thread_count; i++) {
+				if (workers[i].thread_id == i) {
+					if (pthread_join(worker_thread[i], &thread_return)) {
 						LOGERR("Error joining thread %i\n", i);
 						_exit(-1);
 					} else {
 						LOGINFO("Joined thread %i.\n", i);
-						ret = (int)thread_return;
+						ret = (int)(intptr_t)thread_return;
 						if (ret != 0) {
 							thread_error = 1;
 							LOGERR("Thread %i returned an error %i.\n", i, ret);
@@ -282,7 +372,7 @@ int twrpTar::createTarFork() {
 				_exit(-1);
 			}
 	#ifdef TAR_DEBUG_VERBOSE
-			LOGINFO("Finished encrypted backup.\n");
+			LOGINFO("Finished threaded backup.\n");
 	#endif
 			_exit(0);
 		} else {
@@ -301,6 +391,10 @@ int twrpTar::createTarFork() {
 	return 0;
 }
 
+static bool Segment_Larger(const TarListStruct& a, const TarListStruct& b) {
+	return a.st.st_size > b.st.st_size;
+}
+
 int twrpTar::extractTarFork() {
 	int status = 0;
 	pid_t pid, rc_pid;
@@ -322,35 +416,47 @@ int twrpTar::extractTarFork() {
 #ifdef TAR_DEBUG_VERBOSE
 				LOGINFO("Multiple archives\n");
 #endif
-				string temp;
-				char actual_filename[255];
-				twrpTar tars[9];
-				pthread_t tar_thread[9];
+				vector<string> Archives;
+				std::vector<std::vector<TarListStruct> > SegmentLists;
+				std::vector<TarListStruct> Segments;
+				TarListStruct Segment;
+				twrpTar workers[8];
+				pthread_t worker_thread[8];
 				pthread_attr_t tattr;
-				unsigned thread_count = 0, i, start_thread_id = 1, ret, thread_error = 0;
+				long core_count;
+				unsigned thread_count, i, thread_error = 0;
+				int ret;
 				void *thread_return;
 
 				basefn = tarfn;
-				temp = basefn + "%i%02i";
-				tarfn += "000";
-				if (!TWFunc::Path_Exists(tarfn)) {
-					LOGERR("Unable to locate '%s' or '%s'\n", basefn.c_str(), tarfn.c_str());
+				// Every segment is a complete archive no matter which backup
+				// thread wrote it, so they can be restored in any order
+				if (TWFunc::Get_Split_Archives(basefn, Archives) == 0) {
+					LOGERR("Unable to locate '%s' or '%s000'\n", basefn.c_str(), basefn.c_str());
 					_exit(-1);
 				}
-				if (TWFunc::Get_File_Type(tarfn) != 2) {
-#ifdef TAR_DEBUG_VERBOSE
-					LOGINFO("First tar file '%s' not encrypted\n", tarfn.c_str());
-#endif
-					tars[0].basefn = basefn;
-					tars[0].thread_id = 0;
-					if (extractMulti((void*)&tars[0]) != 0) {
-						LOGERR("Error extracting split archive.\n");
+				for (i = 0; i < Archives.size(); i++) {
+					Segment.fn = Archives[i];
+					if (stat(Segment.fn.c_str(), &Segment.st) != 0) {
+						LOGERR("Unable to stat '%s'\n", Segment.fn.c_str());
 						_exit(-1);
 					}
-				} else {
-					start_thread_id = 0;
+					Segments.push_back(Segment);
 				}
-				// Start threading encrypted restores
+				// Deal the biggest segments out first so the threads finish close together
+				std::sort(Segments.begin(), Segments.end(), Segment_Larger);
+
+				core_count = sysconf(_SC_NPROCESSORS_CONF);
+				if (core_count > 8)
+					core_count = 8;
+				thread_count = (core_count > 1 ? (unsigned)core_count : 1);
+				if (thread_count > Segments.size())
+					thread_count = Segments.size();
+				SegmentLists.resize(thread_count);
+				for (i = 0; i < Segments.size(); i++)
+					SegmentLists[i % thread_count].push_back(Segments[i]);
+				twrpTarQueue SegmentQueue(&SegmentLists, 0);
+
 				if (pthread_attr_init(&tattr)) {
 					LOGERR("Unable to pthread_attr_init\n");
 					_exit(-1);
@@ -363,55 +469,46 @@ int twrpTar::extractTarFork() {
 					LOGERR("Error setting pthread_attr_setscope\n");
 					_exit(-1);
 				}
-				/*if (pthread_attr_setstacksize(&tattr, 524288)) {
-					LOGERR("Error setting pthread_attr_setstacksize\n");
-					_exit(-1);
-				}*/
-				for (i = start_thread_id; i < 9; i++) {
-					sprintf(actual_filename, temp.c_str(), i, 0);
-					if (TWFunc::Path_Exists(actual_filename)) {
-						thread_count++;
-						tars[i].basefn = basefn;
-						tars[i].thread_id = i;
-						LOGINFO("Creating extract thread ID %i\n", i);
-						ret = pthread_create(&tar_thread[i], &tattr, extractMulti, (void*)&tars[i]);
-						if (ret) {
-							LOGINFO("Unable to create %i thread for extraction! %i\nContinuing in same thread (restore will be slower).", i, ret);
-							if (extractMulti((void*)&tars[i]) != 0) {
-								LOGERR("Error extracting backup in thread %i.\n", i);
-								_exit(-1);
-							} else {
-								tars[i].thread_id = i + 1;
-							}
-						}
-						usleep(100000); // Need a short delay before starting the next thread or the threads will never finish for some reason.
-					} else {
-						break;
+				LOGINFO("Restoring %lu archives with %u threads\n", (unsigned long)Segments.size(), thread_count);
+				for (i = 0; i < thread_count; i++) {
+					workers[i].basefn = basefn;
+					workers[i].setdir(tardir);
+					workers[i].thread_id = i;
+					workers[i].ItemQueue = &SegmentQueue;
+					// Thread 0 is this thread so it is never idle
+					if (i == 0)
+						continue;
+					ret = pthread_create(&worker_thread[i], &tattr, extractMulti, (void*)&workers[i]);
+					if (ret) {
+						LOGINFO("Unable to create %i thread for extraction! %i\nContinuing with fewer threads (restore will be slower).\n", i, ret);
+						workers[i].ItemQueue = NULL;
 					}
 				}
-				for (i = start_thread_id; i < thread_count + start_thread_id; i++) {
-					if (tars[i].thread_id == i) {
-						if (pthread_join(tar_thread[i], &thread_return)) {
-							LOGERR("Error joining thread %i\n", i);
-							_exit(-1);
-						} else {
-							LOGINFO("Joined thread %i.\n", i);
-							ret = (int)thread_return;
-							if (ret != 0) {
-								thread_error = 1;
-								LOGERR("Thread %i returned an error %i.\n", i, ret);
-								_exit(-1);
-							}
-						}
+				if (extractMulti((void*)&workers[0]) != 0) {
+					LOGERR("Error extracting backup in thread 0.\n");
+					thread_error = 1;
+				}
+				for (i = 1; i < thread_count; i++) {
+					if (workers[i].ItemQueue == NULL)
+						continue;
+					if (pthread_join(worker_thread[i], &thread_return)) {
+						LOGERR("Error joining thread %i\n", i);
+						thread_error = 1;
 					} else {
-						LOGINFO("Skipping joining thread %i because of pthread failure.\n", i);
+						LOGINFO("Joined thread %i.\n", i);
+						ret = (int)(intptr_t)thread_return;
+						if (ret != 0) {
+							thread_error = 1;
+							LOGERR("Thread %i returned an error %i.\n", i, ret);
+						}
 					}
 				}
+				pthread_attr_destroy(&tattr);
 				if (thread_error) {
 					LOGERR("Error returned by one or more threads.\n");
 					_exit(-1);
 				}
-				LOGINFO("Finished encrypted backup.\n");
+				LOGINFO("Finished threaded restore.\n");
 				_exit(0);
 			}
 		}
@@ -461,62 +558,52 @@ int twrpTar::splitArchiveFork() {
 	return 0;
 }
 
-int twrpTar::Generate_TarList(string Path, std::vector<TarListStruct> *TarList, unsigned long long *Target_Size, unsigned *thread_id) {
-	DIR* d;
-	struct dirent* de;
-	struct stat st;
+int twrpTar::Generate_TarList(unsigned Folder, string Path, std::vector<std::vector<TarListStruct> > *TarLists, unsigned long long *Target_Size, unsigned *thread_id) {
 	string FileName;
 	struct TarListStruct TarItem;
+	unsigned i, last;
 
 	if (has_data_media == 1 && Path.size() >= 11 && strncmp(Path.c_str(), "/data/media", 11) == 0)
 		return 0; // Skip /data/media
 
-	d = opendir(Path.c_str());
-	if (d == NULL) {
-#ifdef TAR_DEBUG_VERBOSE
-		LOGERR("error opening '%s' -- error: %s\n", Path.c_str(), strerror(errno));
-#endif
-		closedir(d);
-		return -1;
-	}
-	while ((de = readdir(d)) != NULL) {
+	last = Index->entries[Folder].first_child + Index->entries[Folder].child_count;
+	for (i = Index->entries[Folder].first_child; i < last; i++) {
+		const twrpDirIndex::Entry& Item = Index->entries[i];
 		// Skip excluded stuff
 		char* type = NULL;
 #ifdef TAR_DEBUG_VERBOSE
-		if (de->d_type == DT_DIR)
+		if (S_ISDIR(Item.st.st_mode))
 			type = (char*)"(dir) ";
-		else if (de->d_type == DT_REG)
+		else if (S_ISREG(Item.st.st_mode))
 			type = (char*)"(reg) ";
-		else if (de->d_type == DT_LNK)
+		else if (S_ISLNK(Item.st.st_mode))
 			type = (char*)"(link) ";
 #endif
-		if (skip(de->d_name, type))
+		if (skip((char*)Item.name.c_str(), type))
 			continue;
 
 		FileName = Path + "/";
-		FileName += de->d_name;
+		FileName += Item.name;
 		if (has_data_media == 1 && FileName.size() >= 11 && strncmp(FileName.c_str(), "/data/media", 11) == 0)
 			continue; // Skip /data/media
-		if (de->d_type == DT_BLK || de->d_type == DT_CHR)
-			continue;
+		// The index already holds the lstat() of every item, libtar gets it from here
 		TarItem.fn = FileName;
-		TarItem.thread_id = *thread_id;
-		if (de->d_type == DT_DIR && strcmp(de->d_name, ".") != 0 && strcmp(de->d_name, "..") != 0 && strcmp(de->d_name, "lost+found") != 0) {
-			TarList->push_back(TarItem);
-			if (Generate_TarList(FileName, TarList, Target_Size, thread_id) < 0)
+		TarItem.st = Item.st;
+		if (S_ISDIR(TarItem.st.st_mode) && Item.name != "lost+found") {
+			TarLists->at(*thread_id).push_back(TarItem);
+			if (Generate_TarList(i, FileName, TarLists, Target_Size, thread_id) < 0)
 				return -1;
-		} else if (de->d_type == DT_REG || de->d_type == DT_LNK) {
-			stat(FileName.c_str(), &st);
-			TarList->push_back(TarItem);
-			if (de->d_type == DT_REG)
-				Archive_Current_Size += st.st_size;
+		} else if (S_ISREG(TarItem.st.st_mode) || S_ISLNK(TarItem.st.st_mode)) {
+			TarLists->at(*thread_id).push_back(TarItem);
+			if (S_ISREG(TarItem.st.st_mode))
+				Archive_Current_Size += TarItem.st.st_size;
 			if (Archive_Current_Size != 0 && *Target_Size != 0 && Archive_Current_Size > *Target_Size) {
-				*thread_id = *thread_id + 1;
+				if (*thread_id + 1 < TarLists->size())
+					*thread_id = *thread_id + 1;
 				Archive_Current_Size = 0;
 			}
 		}
 	}
-	closedir(d);
 	return 0;
 }
 
@@ -785,10 +872,9 @@ int twrpTar::tarDirs(bool include_root) {
 	return 0;
 }
 
-int twrpTar::tarList(bool include_root, std::vector<TarListStruct> *TarList, unsigned thread_id) {
-	struct stat st;
-	char buf[PATH_MAX];
-	int list_size = TarList->size(), i = 0, archive_count = 0;
+int twrpTar::tarList(bool include_root, twrpTarQueue *Queue, unsigned thread_id) {
+	TarListStruct *item;
+	int archive_count = 0;
 	string temp;
 	char actual_filename[PATH_MAX];
 
@@ -804,45 +890,40 @@ int twrpTar::tarList(bool include_root, std::vector<TarListStruct> *TarList, uns
 	}
 	Archive_Current_Size = 0;
 
-	while (i < list_size) {
-		if (TarList->at(i).thread_id == thread_id) {
-			strcpy(buf, TarList->at(i).fn.c_str());
-			stat(buf, &st);
-			if (st.st_mode & S_IFREG) { // item is a regular file
-				if (Archive_Current_Size + (unsigned long long)(st.st_size) > MAX_ARCHIVE_SIZE) {
-					if (closeTar() != 0) {
+	while ((item = Queue->next(thread_id)) != NULL) {
+		if (S_ISREG(item->st.st_mode)) {
+			if (Archive_Current_Size + (unsigned long long)(item->st.st_size) > MAX_ARCHIVE_SIZE) {
+				if (closeTar() != 0) {
 #ifdef TAR_DEBUG_VERBOSE
-						LOGERR("Error closing '%s' on thread %i\n", tarfn.c_str(), thread_id);
+					LOGERR("Error closing '%s' on thread %i\n", tarfn.c_str(), thread_id);
 #endif
-						return -3;
-					}
-					archive_count++;
-					if (archive_count > 99) {
+					return -3;
+				}
+				archive_count++;
+				if (archive_count > 99) {
 #ifdef TAR_DEBUG_VERBOSE
-						LOGERR("Too many archives for thread %i\n", thread_id);
+					LOGERR("Too many archives for thread %i\n", thread_id);
 #endif
-						return -4;
-					}
-					sprintf(actual_filename, temp.c_str(), thread_id, archive_count);
-					tarfn = actual_filename;
-					if (createTar() != 0) {
+					return -4;
+				}
+				sprintf(actual_filename, temp.c_str(), thread_id, archive_count);
+				tarfn = actual_filename;
+				if (createTar() != 0) {
 #ifdef TAR_DEBUG_VERBOSE
-						LOGERR("Error creating tar '%s' for thread %i\n", tarfn.c_str(), thread_id);
+					LOGERR("Error creating tar '%s' for thread %i\n", tarfn.c_str(), thread_id);
 #endif
-						return -2;
-					}
-					Archive_Current_Size = 0;
+					return -2;
 				}
-				Archive_Current_Size += (unsigned long long)(st.st_size);
+				Archive_Current_Size = 0;
 			}
-			if (addFile(buf, include_root) != 0) {
+			Archive_Current_Size += (unsigned long long)(item->st.st_size);
+		}
+		if (addFile(item->fn, include_root, &item->st) != 0) {
 #ifdef TAR_DEBUG_VERBOSE
-				LOGERR("Error adding file '%s' to '%s'\n", buf, tarfn.c_str());
+			LOGERR("Error adding file '%s' to '%s'\n", item->fn.c_str(), tarfn.c_str());
 #endif
-				return -1;
-			}
+			return -1;
 		}
-		i++;
 	}
 	if (closeTar() != 0) {
 #ifdef TAR_DEBUG_VERBOSE
@@ -855,21 +936,20 @@ int twrpTar::tarList(bool include_root, std::vector<TarListStruct> *TarList, uns
 
 int twrpTar::create() {
 
-	init_libtar_buffer(0);
 	if (createTar() == -1)
 		return -1;
 	if (tarDirs(false) == -1)
 		return -1;
 	if (closeTar() == -1)
 		return -1;
-	free_libtar_buffer();
 	return 0;
 }
 
 void* twrpTar::createList(void *cookie) {
 
 	twrpTar* threadTar = (twrpTar*) cookie;
-	if (threadTar->tarList(true, threadTar->ItemList, threadTar->thread_id) == -1) {
+	// Store paths relative to the partition like create() does so restores can use the same folder
+	if (threadTar->tarList(false, threadTar->ItemQueue, threadTar->thread_id) != 0) {
 #ifdef TAR_DEBUG_VERBOSE
 		LOGINFO("ERROR tarList for thread ID %i\n", threadTar->thread_id);
 #endif
@@ -884,22 +964,17 @@ void* twrpTar::createList(void *cookie) {
 void* twrpTar::extractMulti(void *cookie) {
 
 	twrpTar* threadTar = (twrpTar*) cookie;
-	int archive_count = 0;
-	string temp = threadTar->basefn + "%i%02i";
-	char actual_filename[255];
-	sprintf(actual_filename, temp.c_str(), threadTar->thread_id, archive_count);
-	while (TWFunc::Path_Exists(actual_filename)) {
-		threadTar->tarfn = actual_filename;
+	TarListStruct *item;
+
+	// Keep taking segments until every one of them has been claimed
+	while ((item = threadTar->ItemQueue->next(threadTar->thread_id)) != NULL) {
+		threadTar->tarfn = item->fn;
 		if (threadTar->extract() != 0) {
 #ifdef TAR_DEBUG_VERBOSE
-			LOGINFO("Error extracting '%s' in thread ID %i\n", actual_filename, threadTar->thread_id);
+			LOGINFO("Error extracting '%s' in thread ID %i\n", item->fn.c_str(), threadTar->thread_id);
 #endif
 			return (void*)-2;
 		}
-		archive_count++;
-		if (archive_count > 99)
-			break;
-		sprintf(actual_filename, temp.c_str(), threadTar->thread_id, archive_count);
 	}
 #ifdef TAR_DEBUG_VERBOSE
 	LOGINFO("Thread ID %i finished successfully.\n", threadTar->thread_id);
@@ -927,162 +1002,101 @@ int twrpTar::addFilesToExistingTar(vector <string> files, string fn) {
 	return 0;
 }
 
+#ifndef TW_EXCLUDE_ENCRYPTED_BACKUPS
+// tartype_t closefunc for gzip feeding the encryption stage: the gzip
+// trailer has to go through the encryption stage before it is finished
+static int close_gz_aes(int fd) {
+	int ret = tar_gz_finish(fd);
+
+	if (tar_aes_close(fd) != 0)
+		ret = -1;
+	return ret;
+}
+#endif
+
 int twrpTar::createTar() {
 	char* charTarFile = (char*) tarfn.c_str();
 	char* charRootDir = (char*) tardir.c_str();
-	static tartype_t type = { open, close, read, write_tar };
+	static tartype_t type = { open_libtar_buffer, close_libtar_buffer, read, write_tar, send_libtar_buffer };
+	static tartype_t gz_type = { open, tar_gz_close, read, tar_gz_write };
+#ifndef TW_EXCLUDE_ENCRYPTED_BACKUPS
+	static tartype_t aes_type = { open, tar_aes_close, read, tar_aes_write };
+	static tartype_t gz_aes_type = { open, close_gz_aes, read, tar_gz_write };
+#endif
 	string Password;
 
+	// Every archive type is written by this process now, so the digest is always inline
+	inline_md5 = 0;
+	if (DataManager::GetIntValue(TW_SKIP_MD5_GENERATE_VAR) == 0) {
+		inline_md5 = 1;
+		md5sum.startMD5();
+	}
+
 	if (use_encryption && use_compression) {
 #ifdef TW_EXCLUDE_ENCRYPTED_BACKUPS
 		LOGINFO("Using encryption NOT supported...\n");
 		return -1;
 #else
-		// Compressed and encrypted
+		// Compressed and encrypted, the compressor feeds the encryption stage directly
 		Archive_Current_Type = 3;
 		LOGINFO("Using encryption and compression...\n");
 		DataManager::GetValue("tw_backup_password", Password);
-		int i, pipes[4];
-
-		if (pipe(pipes) < 0 || pipe(pipes + 2) < 0) {
+		pigz_pid = 0;
+		oaes_pid = 0;
+		fd = open(tarfn.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_LARGEFILE, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+		if (fd < 0) {
 	#ifdef TAR_DEBUG_VERBOSE
-			LOGERR("Error creating pipes\n");
+			LOGERR("Failed to open '%s'\n", tarfn.c_str());
 	#endif
 			return -1;
 		}
-
-		pigz_pid = fork();
-		
-		if (pigz_pid < 0) {
+		if (tar_aes_open(fd, Password.c_str(), stream_threads, inline_md5 ? md5sum.getMD5Context() : NULL) != 0) {
+			close(fd);
 	#ifdef TAR_DEBUG_VERBOSE
-			LOGERR("pigz fork() failed\n");
+			LOGERR("tar_aes_open failed\n");
 	#endif
-			for (i = 0; i < 4; i++)
-				close(pipes[i]); // close all
 			return -1;
-		} else if (pigz_pid == 0) {
-			// pigz Child
-			close(pipes[1]);
-			close(pipes[2]);
-			close(STDIN_FILENO);
-			dup2(pipes[0], STDIN_FILENO);
-			close(STDOUT_FILENO);
-			dup2(pipes[3], STDOUT_FILENO);
-			if (execlp("pigz", "pigz", "-", NULL) < 0) {
-	#ifdef TAR_DEBUG_VERBOSE
-				LOGERR("execlp pigz ERROR!\n");
-	#endif
-				close(pipes[0]);
-				close(pipes[3]);
-				_exit(-1);
-			}
-		} else {
-			// Parent
-			oaes_pid = fork();
-		
-			if (oaes_pid < 0) {
-	#ifdef TAR_DEBUG_VERBOSE
-				LOGERR("openaes fork() failed\n");
-	#endif
-				for (i = 0; i < 4; i++)
-					close(pipes[i]); // close all
-				return -1;
-			} else if (oaes_pid == 0) {
-				// openaes Child
-				int output_fd = open(tarfn.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_LARGEFILE, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
-				if (output_fd < 0) {
-	#ifdef TAR_DEBUG_VERBOSE
-					LOGERR("Failed to open '%s'\n", tarfn.c_str());
-	#endif
-					for (i = 0; i < 4; i++)
-						close(pipes[i]); // close all
-					return -1;
-				}
-				close(pipes[0]);
-				close(pipes[1]);
-				close(pipes[3]);
-				close(STDIN_FILENO);
-				dup2(pipes[2], STDIN_FILENO);
-				close(STDOUT_FILENO);
-				dup2(output_fd, STDOUT_FILENO);
-				if (execlp("openaes", "openaes", "enc", "--key", Password.c_str(), NULL) < 0) {
+		}
+		if (tar_gz_open(fd, Z_DEFAULT_COMPRESSION, stream_threads, NULL, tar_aes_write) != 0) {
+			tar_aes_close(fd);
 	#ifdef TAR_DEBUG_VERBOSE
-					LOGERR("execlp openaes ERROR!\n");
+			LOGERR("tar_gz_open failed\n");
 	#endif
-					close(pipes[2]);
-					close(output_fd);
-					exit(-1);
-				}
-			} else {
-				// Parent
-				close(pipes[0]);
-				close(pipes[2]);
-				close(pipes[3]);
-				fd = pipes[1];
-				if(tar_fdopen(&t, fd, charRootDir, NULL, O_WRONLY | O_CREAT | O_EXCL | O_LARGEFILE, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH, TAR_GNU | TAR_STORE_SELINUX) != 0) {
-					close(fd);
+			return -1;
+		}
+		if(tar_fdopen(&t, fd, charRootDir, &gz_aes_type, O_WRONLY | O_CREAT | O_EXCL | O_LARGEFILE, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH, TAR_GNU | TAR_STORE_SELINUX) != 0) {
+			close_gz_aes(fd);
 	#ifdef TAR_DEBUG_VERBOSE
-					LOGERR("tar_fdopen failed\n");
+			LOGERR("tar_fdopen failed\n");
 	#endif
-					return -1;
-				}
-				return 0;
-			}
+			return -1;
 		}
 #endif
 	} else if (!use_encryption && use_compression) {
 		// Compressed
 		Archive_Current_Type = 1;
 		LOGINFO("Creating gzipped archive...\n");
-		int pigzfd[2];
-
-		if (pipe(pigzfd) < 0) {
+		pigz_pid = 0;
+		fd = open(tarfn.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_LARGEFILE, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+		if (fd < 0) {
 #ifdef TAR_DEBUG_VERBOSE
-			LOGERR("Error creating pipe\n");
+			LOGERR("Failed to open '%s'\n", tarfn.c_str());
 #endif
 			return -1;
 		}
-		pigz_pid = fork();
-		
-		if (pigz_pid < 0) {
+		if (tar_gz_open(fd, Z_DEFAULT_COMPRESSION, stream_threads, inline_md5 ? md5sum.getMD5Context() : NULL, NULL) != 0) {
+			close(fd);
 #ifdef TAR_DEBUG_VERBOSE
-			LOGERR("fork() failed\n");
+			LOGERR("tar_gz_open failed\n");
 #endif
-			close(pigzfd[0]);
-			close(pigzfd[1]);
 			return -1;
-		} else if (pigz_pid == 0) {
-			// Child
-			close(pigzfd[1]);   // close unused output pipe
-			int output_fd = open(tarfn.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_LARGEFILE, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
-			if (output_fd < 0) {
-#ifdef TAR_DEBUG_VERBOSE
-				LOGERR("Failed to open '%s'\n", tarfn.c_str());
-#endif
-				close(pigzfd[0]);
-				_exit(-1);
-			}
-			dup2(pigzfd[0], STDIN_FILENO); // remap stdin
-			dup2(output_fd, STDOUT_FILENO); // remap stdout to output file
-			if (execlp("pigz", "pigz", "-", NULL) < 0) {
-#ifdef TAR_DEBUG_VERBOSE
-				LOGERR("execlp pigz ERROR!\n");
-#endif
-				close(output_fd);
-				close(pigzfd[0]);
-				_exit(-1);
-			}
-		} else {
-			// Parent
-			close(pigzfd[0]); // close parent input
-			fd = pigzfd[1];   // copy parent output
-			if(tar_fdopen(&t, fd, charRootDir, NULL, O_WRONLY | O_CREAT | O_EXCL | O_LARGEFILE, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH, TAR_GNU | TAR_STORE_SELINUX) != 0) {
-				close(fd);
+		}
+		if(tar_fdopen(&t, fd, charRootDir, &gz_type, O_WRONLY | O_CREAT | O_EXCL | O_LARGEFILE, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH, TAR_GNU | TAR_STORE_SELINUX) != 0) {
+			tar_gz_close(fd);
 #ifdef TAR_DEBUG_VERBOSE
-				LOGERR("tar_fdopen failed\n");
+			LOGERR("tar_fdopen failed\n");
 #endif
-				return -1;
-			}
+			return -1;
 		}
 	} else if (use_encryption && !use_compression) {
 #ifdef TW_EXCLUDE_ENCRYPTED_BACKUPS
@@ -1093,61 +1107,41 @@ int twrpTar::createTar() {
 		Archive_Current_Type = 2;
 		LOGINFO("Using encryption...\n");
 		DataManager::GetValue("tw_backup_password", Password);
-		int oaesfd[2];
-		pipe(oaesfd);
-		oaes_pid = fork();
-		
-		if (oaes_pid < 0) {
+		pigz_pid = 0;
+		oaes_pid = 0;
+		fd = open(tarfn.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_LARGEFILE, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+		if (fd < 0) {
 	#ifdef TAR_DEBUG_VERBOSE
-			LOGERR("fork() failed\n");
+			LOGERR("Failed to open '%s'\n", tarfn.c_str());
 	#endif
-			close(oaesfd[0]);
-			close(oaesfd[1]);
 			return -1;
-		} else if (oaes_pid == 0) {
-			// Child
-			close(oaesfd[1]);   // close unused
-			int output_fd = open(tarfn.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_LARGEFILE, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
-			if (output_fd < 0) {
-	#ifdef TAR_DEBUG_VERBOSE
-				LOGERR("Failed to open '%s'\n", tarfn.c_str());
-	#endif
-				_exit(-1);
-			}
-			dup2(oaesfd[0], STDIN_FILENO); // remap stdin
-			dup2(output_fd, STDOUT_FILENO); // remap stdout to output file
-			if (execlp("openaes", "openaes", "enc", "--key", Password.c_str(), NULL) < 0) {
+		}
+		if (tar_aes_open(fd, Password.c_str(), stream_threads, inline_md5 ? md5sum.getMD5Context() : NULL) != 0) {
+			close(fd);
 	#ifdef TAR_DEBUG_VERBOSE
-				LOGERR("execlp openaes ERROR!\n");
+			LOGERR("tar_aes_open failed\n");
 	#endif
-				close(output_fd);
-				close(oaesfd[0]);
-				_exit(-1);
-			}
-		} else {
-			// Parent
-			close(oaesfd[0]); // close parent input
-			fd = oaesfd[1];   // copy parent output
-			if(tar_fdopen(&t, fd, charRootDir, NULL, O_WRONLY | O_CREAT | O_EXCL | O_LARGEFILE, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH, TAR_GNU | TAR_STORE_SELINUX) != 0) {
-				close(fd);
+			return -1;
+		}
+		if(tar_fdopen(&t, fd, charRootDir, &aes_type, O_WRONLY | O_CREAT | O_EXCL | O_LARGEFILE, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH, TAR_GNU | TAR_STORE_SELINUX) != 0) {
+			tar_aes_close(fd);
 	#ifdef TAR_DEBUG_VERBOSE
-				LOGERR("tar_fdopen failed\n");
+			LOGERR("tar_fdopen failed\n");
 	#endif
-				return -1;
-			}
-			return 0;
+			return -1;
 		}
 #endif
 	} else {
 		LOGINFO("Creating uncompressed archive...\n");
 		// Not compressed or encrypted
-		init_libtar_buffer(0);
 		if (tar_open(&t, charTarFile, &type, O_WRONLY | O_CREAT | O_LARGEFILE, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH, TAR_GNU | TAR_STORE_SELINUX) == -1) {
 #ifdef TAR_DEBUG_VERBOSE
 			LOGERR("tar_open error opening '%s'\n", tarfn.c_str());
 #endif
 			return -1;
 		}
+		if (inline_md5)
+			digest_libtar_buffer(t->fd, md5sum.getMD5Context());
 	}
 	return 0;
 }
@@ -1382,21 +1376,27 @@ string twrpTar::Strip_Root_Dir(string Path) {
 }
 
 int twrpTar::addFile(string fn, bool include_root) {
+	return addFile(fn, include_root, NULL);
+}
+
+int twrpTar::addFile(string fn, bool include_root, struct stat *st) {
 	char* charTarFile = (char*) fn.c_str();
-	if (include_root) {
-		if (tar_append_file(t, charTarFile, NULL) == -1)
-			return -1;
-	} else {
-		string temp = Strip_Root_Dir(fn);
-		char* charTarPath = (char*) temp.c_str();
-		if (tar_append_file(t, charTarFile, charTarPath) == -1)
-			return -1;
+	string temp;
+	char* charTarPath = NULL;
+
+	if (!include_root) {
+		temp = Strip_Root_Dir(fn);
+		charTarPath = (char*) temp.c_str();
 	}
+	if (st != NULL) {
+		if (tar_append_file_stat(t, charTarFile, charTarPath, st) == -1)
+			return -1;
+	} else if (tar_append_file(t, charTarFile, charTarPath) == -1)
+		return -1;
 	return 0;
 }
 
 int twrpTar::closeTar() {
-	flush_libtar_buffer(t->fd);
 	if (tar_append_eof(t) != 0) {
 #ifdef TAR_DEBUG_VERBOSE
 		LOGERR("tar_append_eof(): %s\n", strerror(errno));
@@ -1411,14 +1411,20 @@ int twrpTar::closeTar() {
 		return -1;
 	}
 	if (Archive_Current_Type > 0) {
-		close(fd);
+		// tar_close() already closed fd, closing it again could hit a descriptor another thread just opened
 		int status;
 		if (pigz_pid > 0 && TWFunc::Wait_For_Child(pigz_pid, &status, "pigz") != 0)
 			return -1;
 		if (oaes_pid > 0 && TWFunc::Wait_For_Child(oaes_pid, &status, "openaes") != 0)
 			return -1;
 	}
-	free_libtar_buffer();
+	if (inline_md5) {
+		inline_md5 = 0;
+		md5sum.finishMD5();
+		md5sum.setfn(tarfn);
+		if (md5sum.write_md5digest() != 0)
+			return -1;
+	}
 	return 0;
 }
 
@@ -27,19 +27,46 @@ extern "C" {
 #include <fstream>
 #include <string>
 #include <vector>
+#include <pthread.h>
+#include "twrpDigest.hpp"
+#include "twrpDirIndex.hpp"
 
 using namespace std;
 
 #ifndef TW_EXCLUDE_ENCRYPTED_BACKUPS
+// One entry per file or folder, st is the lstat() taken while building the list
 struct TarListStruct {
 	std::string fn;
-	unsigned thread_id;
+	struct stat st;
 };
 
 struct thread_data_struct {
 	std::vector<TarListStruct> *TarList;
 	unsigned thread_id;
 };
+
+// Hands out list entries to the archive threads. Each thread works through
+// its own list, once that runs out it steals the back half of the largest
+// share that is left.
+class twrpTarQueue {
+	public:
+		// TarLists is indexed by thread id, threads first_thread_id and up take part
+		twrpTarQueue(std::vector<std::vector<TarListStruct> > *TarLists, unsigned first_thread_id);
+		~twrpTarQueue();
+		// Returns NULL when there is nothing left for any thread
+		TarListStruct* next(unsigned thread_id);
+
+	private:
+		struct TarShare {
+			TarListStruct *items;
+			unsigned begin;
+			unsigned end;
+			pthread_mutex_t lock;
+		};
+		TarShare *shares;
+		unsigned first_id;
+		unsigned count;
+};
 #endif
 class twrpTar {
 	public:
@@ -64,6 +91,7 @@ class twrpTar {
 		int use_encryption;
 		int userdata_encryption;
 		int use_compression;
+		// Lets createTarFork() write the backup as per-thread archives (tarfn%i%02i)
 		int split_archives;
 #endif
 
@@ -90,6 +118,11 @@ class twrpTar {
 		TAR *t;
 		FILE* p;
 		int fd;
+		// MD5 of the archive computed while it is written
+		twrpDigest md5sum;
+		int inline_md5;
+		// Threads for each compression and encryption stage, 0 = one per core
+		unsigned stream_threads;
 #ifndef TW_EXCLUDE_ENCRYPTED_BACKUPS
 		pid_t pigz_pid;
 		pid_t oaes_pid;
@@ -105,11 +138,13 @@ class twrpTar {
 		vector<string> Excluded;
 
 #ifndef TW_EXCLUDE_ENCRYPTED_BACKUPS
-		int Generate_TarList(string Path, std::vector<TarListStruct> *TarList, unsigned long long *Target_Size, unsigned *thread_id);
+		int Generate_TarList(unsigned Folder, string Path, std::vector<std::vector<TarListStruct> > *TarLists, unsigned long long *Target_Size, unsigned *thread_id);
+		twrpDirIndex *Index;
+		int addFile(string fn, bool include_root, struct stat *st);
 		static void* createList(void *cookie);
 		static void* extractMulti(void *cookie);
-		int tarList(bool include_root, std::vector<TarListStruct> *TarList, unsigned thread_id);
-		std::vector<TarListStruct> *ItemList;
+		int tarList(bool include_root, twrpTarQueue *Queue, unsigned thread_id);
+		twrpTarQueue *ItemQueue;
 		unsigned thread_id;
 #else
 		int extractTGZ();
@@ -359,7 +359,6 @@ int twrpTar::Generate_Multiple_Archives(string Path) {
 				LOGINFO("Closing tar '%s', ", tarfn.c_str());
 #endif
 				closeTar();
-				reinit_libtar_buffer();
 				if (TWFunc::Get_File_Size(tarfn) == 0) {
 					LOGERR("Backup file size for '%s' is 0 bytes.\n", tarfn.c_str());
 					return -1;
@@ -407,7 +406,6 @@ int twrpTar::Split_Archive()
 	Archive_Current_Size = 0;
 	sprintf(actual_filename, temp.c_str(), Archive_File_Count);
 	tarfn = actual_filename;
-	init_libtar_buffer(0);
 	createTar();
 	DataManager::GetValue(TW_HAS_DATA_MEDIA, has_data_media);
 	gui_print("Creating archive 1...\n");
@@ -415,11 +413,9 @@ int twrpTar::Split_Archive()
 #ifdef TAR_DEBUG_VERBOSE
 		LOGERR("Error generating multiple archives\n");
 #endif
-		free_libtar_buffer();
 		return -1;
 	}
 	closeTar();
-	free_libtar_buffer();
 	LOGINFO("Done, created %i archives.\n", (Archive_File_Count++));
 	return (Archive_File_Count);
 }
@@ -536,34 +532,29 @@ int twrpTar::tarDirs(bool include_root) {
 }
 
 int twrpTar::createTGZ() {
-	init_libtar_buffer(0);
 	if (createTar() == -1)
 		return -1;
 	if (tarDirs(false) == -1)
 		return -1;
 	if (closeTar() == -1)
 		return -1;
-	free_libtar_buffer();
 	return 0;
 }
 
 int twrpTar::create() {
-	init_libtar_buffer(0);
 	if (createTar() == -1)
 		return -1;
 	if (tarDirs(false) == -1)
 		return -1;
 	if (closeTar() == -1)
 		return -1;
-	free_libtar_buffer();
 	return 0;
 }
 
 int twrpTar::addFilesToExistingTar(vector <string> files, string fn) {
 	char* charTarFile = (char*) fn.c_str();
-	static tartype_t type = { open, close, read, write_tar };
+	static tartype_t type = { open_libtar_buffer, close_libtar_buffer, read, write_tar };
 
-	init_libtar_buffer(0);
 	if (tar_open(&t, charTarFile, &type, O_RDONLY | O_LARGEFILE, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH, TAR_GNU | TAR_STORE_SELINUX) == -1)
 		return -1;
 	removeEOT(charTarFile);
@@ -574,12 +565,10 @@ int twrpTar::addFilesToExistingTar(vector <string> files, string fn) {
 		if (tar_append_file(t, file, file) == -1)
 			return -1;
 	}
-	flush_libtar_buffer(t->fd);
 	if (tar_append_eof(t) == -1)
 		return -1;
 	if (tar_close(t) == -1)
 		return -1;
-	free_libtar_buffer();
 	return 0;
 }
 
@@ -587,7 +576,7 @@ int twrpTar::createTar() {
 	char* charTarFile = (char*) tarfn.c_str();
 	char* charRootDir = (char*) tardir.c_str();
 	int use_compression = 0;
-	static tartype_t type = { open, close, read, write_tar };
+	static tartype_t type = { open_libtar_buffer, close_libtar_buffer, read, write_tar };
 
 	DataManager::GetValue(TW_USE_COMPRESSION_VAR, use_compression);
 	if (use_compression) {
@@ -600,6 +589,11 @@ int twrpTar::createTar() {
 			pclose(p);
 			return -1;
 		}
+		if (attach_libtar_buffer(fd) != 0) {
+			tar_close(t);
+			pclose(p);
+			return -1;
+		}
 	}
 	else {
 		LOGINFO("Creating uncompressed archive...\n");
@@ -674,7 +668,6 @@ int twrpTar::closeTar() {
 	DataManager::GetValue(TW_USE_COMPRESSION_VAR, use_compression);
 	Archive_Current_Type = TWFunc::Get_File_Type(tarfn);
 
-	flush_libtar_buffer(t->fd);
 	if (tar_append_eof(t) != 0) {
 #ifdef TAR_DEBUG_VERBOSE
 		LOGERR("tar_append_eof(): %s\n", strerror(errno));
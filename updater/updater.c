@@ -75,7 +75,7 @@ int main(int argc, char** argv) {
     char* package_data = argv[3];
     ZipArchive za;
     int err;
-    err = mzOpenZipArchive(package_data, &za);
+    err = mzOpenZipArchiveLazy(package_data, &za);
     if (err != 0) {
         printf("failed to open package %s: %s\n",
                 package_data, strerror(err));
@@ -122,6 +122,8 @@
 #define TW_USE_COMPRESSION_VAR      	"tw_use_compression"
 #define TW_SKIP_MD5_CHECK_VAR       	"tw_skip_md5_check"
 #define TW_SKIP_MD5_GENERATE_VAR    	"tw_skip_md5_generate"
+#define TW_SPARSE_IMAGES_VAR        	"tw_sparse_images"
+#define TW_USED_BLOCKS_IMAGES_VAR   	"tw_used_blocks_images"
 #define TW_SIGNED_ZIP_VERIFY_VAR    	"tw_signed_zip_verify"
 
 #define TW_FILENAME                 	"tw_filename"
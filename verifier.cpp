@@ -25,34 +25,21 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 //extern RecoveryUI* ui;
 
 #define PUBLIC_KEYS_FILE "/res/keys"
 
-// Look for an RSA signature embedded in the .ZIP file comment given
-// the path to the zip.  Verify it matches one of the given public
-// keys.
-//
-// Return VERIFY_SUCCESS, VERIFY_FAILURE (if any error is encountered
-// or no key matches the signature).
-int verify_file(const char* path) {
-    //ui->SetProgress(0.0);
-
-    int numKeys;
-    Certificate* pKeys = load_keys(PUBLIC_KEYS_FILE, &numKeys);
-    if (pKeys == NULL) {
-        LOGE("Failed to load keys\n");
-        return INSTALL_CORRUPT;
-    }
-    LOGI("%d key(s) loaded from %s\n", numKeys, PUBLIC_KEYS_FILE);
-
-    FILE* f = fopen(path, "rb");
-    if (f == NULL) {
-        LOGE("failed to open %s (%s)\n", path, strerror(errno));
-        return VERIFY_FAILURE;
-    }
-
+// Check the signature footer and EOCD at the end of the package mapped
+// at addr.  On success returns VERIFY_SUCCESS with the number of leading
+// bytes covered by the signature in *signed_len and the RSA block in
+// *signature; only the tail of the package is read.
+static int find_signature(const unsigned char* addr, size_t length,
+                          size_t* signed_len, const unsigned char** signature) {
     // An archive with a whole-file signature will end in six bytes:
     //
     //   (2-byte signature start) $ff $ff (2-byte comment size)
@@ -64,22 +51,15 @@ int verify_file(const char* path) {
 
 #define FOOTER_SIZE 6
 
-    if (fseek(f, -FOOTER_SIZE, SEEK_END) != 0) {
-        LOGE("failed to seek in %s (%s)\n", path, strerror(errno));
-        fclose(f);
+    if (length < FOOTER_SIZE) {
+        LOGE("not big enough to contain footer\n");
         return VERIFY_FAILURE;
     }
 
-    unsigned char footer[FOOTER_SIZE];
-    if (fread(footer, 1, FOOTER_SIZE, f) != FOOTER_SIZE) {
-        LOGE("failed to read footer from %s (%s)\n", path, strerror(errno));
-        fclose(f);
-        return VERIFY_FAILURE;
-    }
+    const unsigned char* footer = addr + length - FOOTER_SIZE;
 
     if (footer[2] != 0xff || footer[3] != 0xff) {
         LOGE("footer is wrong\n");
-        fclose(f);
         return VERIFY_FAILURE;
     }
 
@@ -91,7 +71,6 @@ int verify_file(const char* path) {
     if (signature_start - FOOTER_SIZE < RSANUMBYTES) {
         // "signature" block isn't big enough to contain an RSA block.
         LOGE("signature is too short\n");
-        fclose(f);
         return VERIFY_FAILURE;
     }
 
@@ -101,9 +80,8 @@ int verify_file(const char* path) {
     // comment length.
     size_t eocd_size = comment_size + EOCD_HEADER_SIZE;
 
-    if (fseek(f, -eocd_size, SEEK_END) != 0) {
-        LOGE("failed to seek in %s (%s)\n", path, strerror(errno));
-        fclose(f);
+    if (length < eocd_size) {
+        LOGE("not big enough to contain EOCD\n");
         return VERIFY_FAILURE;
     }
 
@@ -111,26 +89,15 @@ int verify_file(const char* path) {
     // This is everything except the signature data and length, which
     // includes all of the EOCD except for the comment length field (2
     // bytes) and the comment data.
-    size_t signed_len = ftell(f) + EOCD_HEADER_SIZE - 2;
+    *signed_len = length - eocd_size + EOCD_HEADER_SIZE - 2;
 
-    unsigned char* eocd = (unsigned char*)malloc(eocd_size);
-    if (eocd == NULL) {
-        LOGE("malloc for EOCD record failed\n");
-        fclose(f);
-        return VERIFY_FAILURE;
-    }
-    if (fread(eocd, 1, eocd_size, f) != eocd_size) {
-        LOGE("failed to read eocd from %s (%s)\n", path, strerror(errno));
-        fclose(f);
-        return VERIFY_FAILURE;
-    }
+    const unsigned char* eocd = addr + length - eocd_size;
 
     // If this is really is the EOCD record, it will begin with the
     // magic number $50 $4b $05 $06.
     if (eocd[0] != 0x50 || eocd[1] != 0x4b ||
         eocd[2] != 0x05 || eocd[3] != 0x06) {
         LOGE("signature length doesn't match EOCD marker\n");
-        fclose(f);
         return VERIFY_FAILURE;
     }
 
@@ -143,15 +110,74 @@ int verify_file(const char* path) {
             // which could be exploitable.  Fail verification if
             // this sequence occurs anywhere after the real one.
             LOGE("EOCD marker occurs after start of EOCD\n");
-            fclose(f);
             return VERIFY_FAILURE;
         }
     }
 
-#define BUFFER_SIZE 4096
+    // The 6 bytes is the "(signature_start) $ff $ff (comment_size)" that
+    // the signing tool appends after the signature itself.
+    *signature = eocd + eocd_size - 6 - RSANUMBYTES;
+    return VERIFY_SUCCESS;
+}
+
+// Check the digests of the signed part of the package against the
+// signature with each of the keys.
+static int check_signature(const Certificate* pKeys, int numKeys,
+                           const unsigned char* signature,
+                           const uint8_t* sha1, const uint8_t* sha256) {
+    int i;
+    for (i = 0; i < numKeys; ++i) {
+        const uint8_t* hash;
+        switch (pKeys[i].hash_len) {
+            case SHA_DIGEST_SIZE: hash = sha1; break;
+            case SHA256_DIGEST_SIZE: hash = sha256; break;
+            default: continue;
+        }
+
+        if (RSA_verify(pKeys[i].public_key, signature,
+                       RSANUMBYTES, hash, pKeys[i].hash_len)) {
+            LOGI("whole-file signature verified against key %d\n", i);
+            return VERIFY_SUCCESS;
+        } else {
+            LOGI("failed to verify against key %d\n", i);
+        }
+    }
+    LOGE("failed to verify whole-file signature\n");
+    return VERIFY_FAILURE;
+}
+
+// Look for an RSA signature embedded in the .ZIP file comment of the
+// package mapped at addr.  Verify it matches one of the given public
+// keys.  If extra is not NULL it is handed every byte of the package, in
+// order, while the signed part is hashed, so callers can compute other
+// digests in the same pass over the data.
+//
+// Return VERIFY_SUCCESS, VERIFY_FAILURE (if any error is encountered
+// or no key matches the signature).
+int verify_data(const unsigned char* addr, size_t length,
+                verify_data_func extra, void* cookie) {
+    //ui->SetProgress(0.0);
+
+    int numKeys;
+    Certificate* pKeys = load_keys(PUBLIC_KEYS_FILE, &numKeys);
+    if (pKeys == NULL) {
+        LOGE("Failed to load keys\n");
+        return INSTALL_CORRUPT;
+    }
+    LOGI("%d key(s) loaded from %s\n", numKeys, PUBLIC_KEYS_FILE);
+
+    size_t signed_len;
+    const unsigned char* signature;
+    if (find_signature(addr, length, &signed_len, &signature) != VERIFY_SUCCESS)
+        return VERIFY_FAILURE;
+
+// Hash the mapping in pieces so every digest works on data that is
+// still in the cache
+#define BUFFER_SIZE (1024 * 1024)
 
     bool need_sha1 = false;
     bool need_sha256 = false;
+    int i;
     for (i = 0; i < numKeys; ++i) {
         switch (pKeys[i].hash_len) {
             case SHA_DIGEST_SIZE: need_sha1 = true; break;
@@ -163,62 +189,89 @@ int verify_file(const char* path) {
     SHA256_CTX sha256_ctx;
     SHA_init(&sha1_ctx);
     SHA256_init(&sha256_ctx);
-    unsigned char* buffer = (unsigned char*)malloc(BUFFER_SIZE);
-    if (buffer == NULL) {
-        LOGE("failed to alloc memory for sha1 buffer\n");
-        fclose(f);
-        return VERIFY_FAILURE;
-    }
 
     double frac = -1.0;
     size_t so_far = 0;
-    fseek(f, 0, SEEK_SET);
-    while (so_far < signed_len) {
+    while (so_far < length) {
         size_t size = BUFFER_SIZE;
-        if (signed_len - so_far < size) size = signed_len - so_far;
-        if (fread(buffer, 1, size, f) != size) {
-            LOGE("failed to read data from %s (%s)\n", path, strerror(errno));
-            fclose(f);
-            return VERIFY_FAILURE;
+        if (length - so_far < size) size = length - so_far;
+        if (extra != NULL) extra(addr + so_far, size, cookie);
+        if (so_far < signed_len) {
+            size_t signed_size = size;
+            if (signed_len - so_far < signed_size) signed_size = signed_len - so_far;
+            if (need_sha1) SHA_update(&sha1_ctx, addr + so_far, signed_size);
+            if (need_sha256) SHA256_update(&sha256_ctx, addr + so_far, signed_size);
         }
-        if (need_sha1) SHA_update(&sha1_ctx, buffer, size);
-        if (need_sha256) SHA256_update(&sha256_ctx, buffer, size);
         so_far += size;
-        double f = so_far / (double)signed_len;
+        double f = so_far / (double)length;
         if (f > frac + 0.02 || size == so_far) {
             //ui->SetProgress(f);
             frac = f;
         }
     }
-    fclose(f);
-    free(buffer);
 
     const uint8_t* sha1 = SHA_final(&sha1_ctx);
     const uint8_t* sha256 = SHA256_final(&sha256_ctx);
 
-    for (i = 0; i < numKeys; ++i) {
-        const uint8_t* hash;
-        switch (pKeys[i].hash_len) {
-            case SHA_DIGEST_SIZE: hash = sha1; break;
-            case SHA256_DIGEST_SIZE: hash = sha256; break;
-            default: continue;
-        }
+    return check_signature(pKeys, numKeys, signature, sha1, sha256);
+}
 
-        // The 6 bytes is the "(signature_start) $ff $ff (comment_size)" that
-        // the signing tool appends after the signature itself.
-        if (RSA_verify(pKeys[i].public_key, eocd + eocd_size - 6 - RSANUMBYTES,
-                       RSANUMBYTES, hash, pKeys[i].hash_len)) {
-            LOGI("whole-file signature verified against key %d\n", i);
-            free(eocd);
-            return VERIFY_SUCCESS;
-        } else {
-            LOGI("failed to verify against key %d\n", i);
-        }
-		LOGI("i: %i, eocd_size: %i, RSANUMBYTES: %i\n", i, eocd_size, RSANUMBYTES);
+// Same as verify_data() when the signed part of the package was already
+// hashed as it arrived.  Only the footer, the EOCD and the signature at
+// the end of the mapping are read.
+int verify_data_digests(const unsigned char* addr, size_t length,
+                        const Package_Digests* digests) {
+    int numKeys;
+    Certificate* pKeys = load_keys(PUBLIC_KEYS_FILE, &numKeys);
+    if (pKeys == NULL) {
+        LOGE("Failed to load keys\n");
+        return INSTALL_CORRUPT;
     }
-    free(eocd);
-    LOGE("failed to verify whole-file signature\n");
-    return VERIFY_FAILURE;
+    LOGI("%d key(s) loaded from %s\n", numKeys, PUBLIC_KEYS_FILE);
+
+    size_t signed_len;
+    const unsigned char* signature;
+    if (find_signature(addr, length, &signed_len, &signature) != VERIFY_SUCCESS)
+        return VERIFY_FAILURE;
+
+    if (digests->magic != PACKAGE_DIGESTS_MAGIC ||
+        digests->package_size != length || digests->signed_len != signed_len) {
+        LOGE("precomputed digests don't match the package\n");
+        return VERIFY_FAILURE;
+    }
+    return check_signature(pKeys, numKeys, signature,
+                           digests->sha1, digests->sha256);
+}
+
+// Maps the package at path and checks its whole-file signature with
+// verify_data().
+int verify_file(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        LOGE("failed to open %s (%s)\n", path, strerror(errno));
+        return VERIFY_FAILURE;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        LOGE("failed to stat %s (%s)\n", path, strerror(errno));
+        close(fd);
+        return VERIFY_FAILURE;
+    }
+
+    void* addr = NULL;
+    if (st.st_size > 0)
+        addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == NULL || addr == MAP_FAILED) {
+        LOGE("failed to map %s (%s)\n", path, strerror(errno));
+        return VERIFY_FAILURE;
+    }
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+    int ret = verify_data((const unsigned char*)addr, st.st_size, NULL, NULL);
+    munmap(addr, st.st_size);
+    return ret;
 }
 
 // Reads a file containing one or more public keys as produced by
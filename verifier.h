@@ -18,6 +18,7 @@
 #define _RECOVERY_VERIFIER_H
 
 #include "mincrypt/rsa.h"
+#include "sideload_digests.h"
 
 #define ASSUMED_UPDATE_BINARY_NAME  "META-INF/com/google/android/update-binary"
 
@@ -35,6 +36,22 @@ typedef struct Certificate {
  */
 int verify_file(const char* path);
 
+/* Receives the whole package, in order, while verify_data() hashes it */
+typedef void (*verify_data_func)(const unsigned char* data, size_t len, void* cookie);
+
+/* Same as verify_file() for a package that is already mapped at addr.
+ * extra, if not NULL, sees every byte so other digests can be computed
+ * in the same pass.
+ */
+int verify_data(const unsigned char* addr, size_t length,
+                verify_data_func extra, void* cookie);
+
+/* Same as verify_data() with the hashing already done: only the footer
+ * and signature at the end of the mapping are read.
+ */
+int verify_data_digests(const unsigned char* addr, size_t length,
+                        const Package_Digests* digests);
+
 Certificate* load_keys(const char* filename, int* numKeys);
 
 #define VERIFY_SUCCESS        0